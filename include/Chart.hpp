@@ -0,0 +1,109 @@
+#ifndef HCPCHART_HPP
+#define HCPCHART_HPP
+
+#include "Widget.hpp"
+#include "Button.hpp"
+#include "Viewport.hpp"
+#include "GLInclude.hpp"
+
+#include "hcp/Telemetry.hpp"
+#include "hcp/TelemetryArchive.hpp"
+
+#include <string>
+#include <vector>
+
+// Telemetry channels over time, each series scaled to its own range. Every
+// column of the plot is a channel's min/max envelope from its summaries
+// (HCPTelemetryChannel::summarize), or from the archive where the channel
+// has no samples, such as before the panel started. Columns sit at fixed
+// times for a zoom level and live in a ring of GL_LINES vertices on the GPU,
+// so a frame only fetches and uploads the columns that came into view or
+// were still filling.
+//
+// Scrolling zooms around the cursor and dragging pans. Either one stops
+// following the newest samples until the live button is pressed. Hovering
+// shows a crosshair with every series' value under it, and clicking a
+// series in the legend puts its axis and threshold band on the plot.
+class HCPChart : public HCPWidget
+{
+public:
+    HCPChart();
+    ~HCPChart();
+
+    // Returns the series' index
+    size_t addSeries(const char* name, const char* unit, uint32_t color);
+    void clearSeries();
+
+    // Null until the channel has samples. Handing over a different one drops
+    // the series' columns.
+    void setChannel(size_t series, const HCPTelemetryChannel* channel);
+    // Auto fits to what is in view unless set
+    void setRange(size_t series, float low, float high);
+    void setThresholds(size_t series, float low, float high);
+
+    // Null for none. The offset turns channel timestamps into archive ones,
+    // which the chart then runs on.
+    void setArchive(const HCPTelemetryArchive* archive, int64_t offset);
+    void setArchiveChannel(size_t series, uint8_t channel);
+
+    void setSpan(double seconds);
+    void setLive();
+protected:
+    void doDraw() override;
+private:
+    struct Series
+    {
+        std::string name;
+        std::string unit;
+        uint32_t color;
+        const HCPTelemetryChannel* channel;
+        int archiveChannel; // -1 for none
+
+        bool fixedRange;
+        float low, high; // what the plot spans
+        bool hasThresholds;
+        float thresholdLow, thresholdHigh;
+    };
+
+    std::vector<Series> m_series;
+    size_t m_focus; // series whose axis and band are drawn
+
+    const HCPTelemetryArchive* m_archive;
+    int64_t m_offset;
+    int64_t m_archiveEnd; // when columns were last fetched
+
+    // View, timestamps in microseconds on the archive's clock (the channels'
+    // plus m_offset)
+    int64_t m_span;
+    int64_t m_end; // right edge when not live
+    bool m_live;
+    HCPButton m_liveButton;
+    HCPViewport m_plot;
+
+    // Column k covers [k * m_columnTime, (k + 1) * m_columnTime). Slot k % m_ringColumns
+    // of every series holds it for k in [m_ringFirst, m_ringEnd).
+    int64_t m_columnTime;
+    size_t m_ringColumns;
+    int64_t m_ringFirst, m_ringEnd;
+    int64_t m_unsettled; // columns from here on were still filling when fetched
+    std::vector<HCPTelemetryChannel::Summary> m_columns; // CPU copy, series by series
+
+    // Persistent GPU ring, laid out like m_columns with four vertices a column
+    GLuint m_glVAO;
+    GLuint m_glVBO;
+    size_t m_glColumns; // what the buffer has room for
+    std::vector<uint8_t> m_vertices; // scratch for uploads
+    std::vector<HCPTelemetryChannel::Summary> m_fetched;
+    std::vector<HCPTelemetryChannel::Summary> m_archived;
+
+    void handleInput(int64_t newest);
+    void fetchColumns(int64_t first, int64_t end);
+    void uploadColumns(size_t series, int64_t first, int64_t end);
+    void drawSeries(size_t series, int64_t first, int64_t end, double leftColumn);
+    void drawLegend(float headerHeight, int64_t cursorColumn);
+    void fitRanges(int64_t first, int64_t end);
+    const HCPTelemetryChannel::Summary& getColumn(size_t series, int64_t column) const;
+    void dropColumns();
+};
+
+#endif // HCPCHART_HPP
@@ -2,6 +2,7 @@
 #define HCPFONT_RENDERER_HPP
 
 #include "MeshBuilder.hpp"
+#include "StyledText.hpp"
 
 #include <stdint.h>
 #include <glm/glm.hpp>
@@ -57,6 +58,7 @@ public:
 
     float getStringWidth(const char* text) const;
     float getStringWidth(const char* text, size_t strLen) const;
+    float getStringWidth(const HCPStyledText& text) const;
     float getStringHeight() const;
 
     void setTextSize(float size);
@@ -69,6 +71,10 @@ public:
     void genString(HCPMeshBuilder& meshBuilder, const char* str, float x, float y, uint32_t color);
     void genString(HCPMeshBuilder& meshBuilder, const char* str, float x, float y, const glm::vec4& color);
     void genString(HCPMeshBuilder& meshBuilder, const char* str, size_t strLen, float x, float y, const glm::vec4& color);
+    void genString(HCPMeshBuilder& meshBuilder, const HCPStyledText& text, float x, float y, const glm::vec4& color);
+
+    // Decodes the string and its format codes once, for text drawn over and over
+    void parse(HCPStyledText& text, const char* str, size_t strLen) const;
 
     int charsToFit(const char* str, float width) const;
     int charsToFit(const char* str, size_t strLen, float width) const;
@@ -91,9 +97,13 @@ private:
     HCPAlignment m_anchor;
     int m_texUnit;
 
+    HCPStyledText m_parsed; // scratch for strings drawn straight away
+
     int getUnicodeFromUTF8(const uint8_t* str, int* bytesRead) const;
+    int getAdvance(int unicode) const;
     void genChar(HCPMeshBuilder& meshBuilder, int unicode, float x, float y, float italics, bool bold, glm::vec4& color);
-    glm::vec2 anchor(const char* str, size_t strLen, float x, float y);
+    void genLine(HCPMeshBuilder& meshBuilder, float y, float left, float right, float width, glm::vec4& color);
+    glm::vec2 anchor(float stringWidth, float x, float y);
     void initToRender();
 };
 
@@ -145,6 +145,9 @@ public:
     HCPMeshBuilder& vertex(void* notUsed, ...);
     HCPMeshBuilder& index(size_t numIndicies, ...);
     HCPMeshBuilder& indexv(size_t numIndicies, const uint32_t* indicies);
+    // Vertices already laid out in this builder's format, copied in bulk. Their
+    // positions still go through the modelview like vertex() does.
+    HCPMeshBuilder& vertexv(size_t numVerticies, const void* verticies);
 
     const HCPVertexFormat& getVertexFormat() const;
     const uint8_t* getVertexBuffer(size_t* getNumBytes) const;
@@ -0,0 +1,51 @@
+#ifndef HCP_STYLED_TEXT_HPP
+#define HCP_STYLED_TEXT_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A string with its UTF-8 decoded and § format codes turned into style runs,
+// built once by HCPFontRenderer::parse() so drawing it only walks glyphs.
+// Advances and width are in font units, they scale with the text size.
+struct HCPStyledText
+{
+    enum Style : uint8_t
+    {
+        BOLD = 1,
+        STRIKETHROUGH = 2,
+        UNDERLINE = 4,
+        ITALIC = 8
+    };
+
+    // Applies from the glyph at start up to the next run
+    struct Run
+    {
+        uint32_t start;
+        uint8_t color; // colour code, 15 is white
+        uint8_t style;
+    };
+
+    std::vector<uint32_t> codepoints;
+    std::vector<int16_t> advances;
+    std::vector<Run> runs;
+    int width = 0;
+
+    void clear()
+    {
+        codepoints.clear();
+        advances.clear();
+        runs.clear();
+        width = 0;
+    }
+};
+
+// For strings formatted every frame that mostly come out the same, such as
+// status lines. hcpui::cacheText() only parses them again when they change.
+struct HCPCachedText
+{
+    std::string source;
+    HCPStyledText text;
+};
+
+#endif // HCP_STYLED_TEXT_HPP
@@ -27,6 +27,7 @@ private:
     static double s_lastTimeCursorMoved;
 
     char m_title[256];
+    HCPStyledText m_styledTitle;
     bool m_focused;
     float m_textSize;
 
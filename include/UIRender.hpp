@@ -5,10 +5,13 @@
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
+#include <vector>
 
 #include "FontRenderer.hpp"
 #include "Inputs.hpp"
 
+struct HCPVertexFormat;
+
 enum HCPDirection
 {
     LEFT,
@@ -17,6 +20,18 @@ enum HCPDirection
     BOTTOM
 };
 
+// Glyph quads of a string laid out once by hcpui::buildText(), so drawing it
+// again is a copy instead of decoding the string. Positions are relative to
+// its top left corner.
+struct HCPTextMesh
+{
+    std::vector<uint8_t> vertices; // in the UI batch's vertex format
+    std::vector<uint32_t> indices;
+    size_t numVertices = 0;
+    float width = 0.0f;
+    float height = 0.0f;
+};
+
 class hcpui
 {
 public:
@@ -35,6 +50,8 @@ public:
     static void genString(HCPAlignment alignment, const char* str, size_t strLen, float x, float y, float scale, uint32_t color);
     static void genString(const char* str, size_t strLen, float x, float y, float scale, uint32_t color);
     static void genDisc(float x, float y, float radius, uint32_t color, int resloution = -1, int texID = 0);
+    static void genString(HCPAlignment alignment, const HCPStyledText& text, float x, float y, float scale, uint32_t color);
+    static void genText(HCPAlignment alignment, const HCPTextMesh& mesh, float x, float y);
 
     static void genQuad(float left, float top, float right, float bottom, const glm::vec4& color, int texID = 0);
     static void genGradientQuad(HCPDirection direction, float left, float top, float right, float bottom, const glm::vec4& color1, const glm::vec4& color2, int texID = 0);
@@ -44,12 +61,22 @@ public:
     static void genString(const char* str, float x, float y, float scale, const glm::vec4& color);
     static void genString(HCPAlignment alignment, const char* str, size_t strLen, float x, float y, float scale,  const glm::vec4& color);
     static void genString(const char* str, size_t strLen, float x, float y, float scale, const glm::vec4& color);
+    static void genString(HCPAlignment alignment, const HCPStyledText& text, float x, float y, float scale, const glm::vec4& color);
     static void genDisc(float x, float y, float radius, const glm::vec4& color, int resloution = -1, int texID = 0);
 
     static void renderBatch();
+    // Of the UI batch, for buffers drawn with the same shader
+    static const HCPVertexFormat& getVertexFormat();
+
+    static void buildText(HCPTextMesh& mesh, const char* str, size_t strLen, float scale, uint32_t color);
+    static void buildText(HCPTextMesh& mesh, const HCPStyledText& text, float scale, uint32_t color);
 
     static float getStringwidth(const char* str, float scale);
     static float getStringwidth(const char* str, size_t length, float scale);
+    static float getStringwidth(const HCPStyledText& text, float scale);
+
+    // The cache's styled text for str, parsed only if str differs from last time
+    static const HCPStyledText& cacheText(HCPCachedText& cache, const char* str);
 
     static int getWindowWidth();
     static int getWindowHeight();
@@ -46,6 +46,7 @@ private:
     };
 
     std::string m_title;
+    HCPCachedText m_titleText;
     bool m_shouldClose;
     CloseButton m_closeButton;
 
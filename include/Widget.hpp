@@ -1,6 +1,8 @@
 #ifndef HCPWIDGET_HPP
 #define HCPWIDGET_HPP
 
+#include "StyledText.hpp"
+
 #include <glm/glm.hpp>
 #include <string>
 #include <stack>
@@ -39,6 +41,7 @@ public:
     Type getType() const;
     int getZLevel() const;
     const char* getText() const;
+    const HCPStyledText& getStyledText() const;
 
     float localCursorX() const;
     float localCursorY() const;
@@ -73,6 +76,7 @@ private:
     bool m_pressed;
     bool m_justReleased;
     std::string m_text;
+    HCPStyledText m_styledText; // parsed once per setText()
 
     void updateHoverState();
 };
@@ -10,7 +10,7 @@
 class HCPApplication
 {
 public:
-    HCPApplication(const char* title);
+    HCPApplication(const char* title, int argc = 0, char** argv = nullptr);
 
     void setup();
     void loop();
@@ -20,6 +20,10 @@ public:
 
     void setCurrentScreen(HCPScreen* screen);
 
+    // Command line options are given as "--name" or "--name=value"
+    bool hasOption(const char* name) const;
+    const char* getOption(const char* name, const char* defaultValue = nullptr) const;
+
     static HCPApplication* getInstance();
 private:
     static HCPApplication* s_instance;
@@ -27,6 +31,9 @@ private:
     const char* m_title;
     bool m_shouldClose;
 
+    int m_argc;
+    char** m_argv;
+
     GLFWwindow* m_window;
     HCPInputContext* m_inputContext;
 
@@ -0,0 +1,166 @@
+#ifndef HCP_CAPTURE_HPP
+#define HCP_CAPTURE_HPP
+
+#include "hcp/MappedFile.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+
+// Capture files record every chunk a port read or wrote, with the
+// steady_clock time in nanoseconds it happened at.
+//
+// The file is a 4 KiB header followed by 64 KiB blocks. Records never cross
+// a block, and every block starts with the time of its first record, so the
+// block headers double as a sparse time index that seeking binary searches.
+// Blocks are only ever appended. A block's header is updated after each of
+// its records is written, so a capture cut short by a crash reads back up to
+// the last whole record.
+class HCPCapture
+{
+public:
+    enum Direction : uint8_t
+    {
+        RX = 0, // from the device
+        TX = 1  // to the device
+    };
+
+    struct Record
+    {
+        int64_t timestamp; // steady_clock nanoseconds
+        Direction direction;
+        const uint8_t* data;
+        uint32_t len;
+    };
+
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 4096;
+    static const size_t BLOCK_SIZE = 1 << 16;
+    static const size_t BLOCK_HEADER_SIZE = 32;
+    static const size_t RECORD_HEADER_SIZE = 12; // timestamp i64, len u32 with the direction in the top bit
+    static const size_t MAX_RECORD_DATA = BLOCK_SIZE - BLOCK_HEADER_SIZE - RECORD_HEADER_SIZE;
+
+    static int64_t now();
+};
+
+// Appends records to a capture file. Not thread safe, a port only writes to
+// it from whichever side does its I/O.
+class HCPCaptureWriter
+{
+public:
+    HCPCaptureWriter();
+    HCPCaptureWriter(const HCPCaptureWriter&) = delete;
+    HCPCaptureWriter& operator=(const HCPCaptureWriter&) = delete;
+    ~HCPCaptureWriter();
+
+    // Starts a new capture, replacing any file at the path
+    bool open(const char* path);
+    void close();
+    bool isOpen() const;
+
+    // Chunks longer than a block are split over several records
+    void record(HCPCapture::Direction direction, const uint8_t* data, size_t len, int64_t timestamp);
+
+    uint64_t getBytesWritten() const;
+private:
+    static HCPLogger s_logger;
+
+    static const size_t GROW_BLOCKS = 64; // the file grows 4 MiB at a time
+
+    HCPMappedFile m_file;
+    size_t m_block;     // offset of the block being filled
+    size_t m_blockUsed; // bytes after its header
+    uint32_t m_blockRecords;
+    int64_t m_lastTimestamp;
+    uint64_t m_bytesWritten;
+
+    bool startBlock(int64_t timestamp);
+};
+
+// Reads a capture file in time order
+class HCPCaptureReader
+{
+public:
+    HCPCaptureReader();
+    HCPCaptureReader(const HCPCaptureReader&) = delete;
+    HCPCaptureReader& operator=(const HCPCaptureReader&) = delete;
+
+    bool open(const char* path);
+    void close();
+    bool isOpen() const;
+
+    // Times of the first and last record, 0 for an empty capture
+    int64_t getStartTime() const;
+    int64_t getEndTime() const;
+    // System clock nanoseconds since the epoch when the capture started
+    int64_t getWallClockStart() const;
+    size_t getBlockCount() const;
+
+    // Moves to the first record at or after the timestamp. Binary searches
+    // the block headers, then scans within one block.
+    void seek(int64_t timestamp);
+    void rewind();
+
+    // The data points into the mapping and stays valid until close()
+    bool next(HCPCapture::Record& record);
+private:
+    static HCPLogger s_logger;
+
+    HCPMappedFile m_file;
+    size_t m_blockCount;
+    size_t m_block;  // index of the block being read
+    size_t m_offset; // into the block, past its header
+
+    int64_t getBlockStart(size_t block) const;
+    size_t getBlockUsed(size_t block) const;
+    bool peekRecord(HCPCapture::Record& record, size_t* recordLen) const;
+};
+
+// Plays the received side of a capture back in time, at any speed. The I/O
+// side calls read() and getTimeout(), the control calls can come from any
+// thread.
+class HCPCaptureReplay
+{
+public:
+    HCPCaptureReplay();
+
+    bool open(const char* path);
+
+    // 1 is real time, 0 is as fast as the reader keeps up
+    void setSpeed(double speed);
+    double getSpeed() const;
+
+    void seek(int64_t timestamp);
+    // Capture time of the next byte to be played back
+    int64_t getPosition() const;
+    int64_t getStartTime() const;
+    int64_t getEndTime() const;
+    bool isFinished() const;
+
+    // Copies the received bytes that are due by now into dst
+    size_t read(uint8_t* dst, size_t len);
+    // Milliseconds until more data is due, at most timeoutMs
+    int getTimeout(int timeoutMs) const;
+private:
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex m_lock;
+    HCPCaptureReader m_reader;
+
+    HCPCapture::Record m_pending; // next RX record, partly played
+    size_t m_pendingOffset;
+    bool m_hasPending;
+    bool m_finished;
+
+    double m_speed;
+    // Capture time m_anchorTime plays back at m_anchorClock
+    int64_t m_anchorTime;
+    Clock::time_point m_anchorClock;
+
+    bool loadPending();
+    void anchor(int64_t timestamp);
+    Clock::time_point dueAt(int64_t timestamp) const;
+};
+
+#endif // HCP_CAPTURE_HPP
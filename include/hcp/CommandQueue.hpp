@@ -0,0 +1,109 @@
+#ifndef HCP_COMMAND_QUEUE_HPP
+#define HCP_COMMAND_QUEUE_HPP
+
+#include "hcp/Protocol.hpp"
+#include "hcp/Histogram.hpp"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+// Acked command and console frames with up to a window of them in flight at
+// once, so a sequence of commands costs about one round trip rather than one
+// per command. A frame that isn't acked within the timeout is sent again with
+// the same seq, which the rack uses to ack a duplicate without running it
+// twice. Completions are reported in submission order. A resent frame can
+// still overtake the ones after it on the wire, so sequences that must run
+// strictly in order on the rack need a window of 1.
+//
+// Not thread safe, everything runs on the thread that drains the transport.
+class HCPCommandQueue
+{
+public:
+    enum Result
+    {
+        RESULT_OK,
+        RESULT_FAILED,   // the rack acked with a non-zero status
+        RESULT_TIMEOUT,  // no ack after every retry
+        RESULT_CANCELLED
+    };
+    struct Completion
+    {
+        uint16_t seq;
+        Result result;
+        uint8_t status;    // from the ack
+        uint32_t attempts; // times the frame was sent
+    };
+    using Callback = std::function<void(const Completion& completion)>;
+
+    HCPCommandQueue(size_t window = 8, std::chrono::milliseconds timeout = std::chrono::milliseconds(500), uint32_t maxRetries = 3);
+    HCPCommandQueue(const HCPCommandQueue&) = delete;
+    HCPCommandQueue& operator=(const HCPCommandQueue&) = delete;
+
+    void setWindow(size_t window);
+    void setTimeout(std::chrono::milliseconds timeout);
+    void setMaxRetries(uint32_t maxRetries);
+    // Output lane the frames go out on, interactive by default
+    void setPriority(HCPTransport::Priority priority);
+    size_t getWindow() const;
+
+    // Encodes the message right away, so console text only has to live for
+    // the call. Its seq identifies the command. Returns false if it doesn't
+    // encode.
+    bool submit(const HCPMessage& message, Callback callback = nullptr);
+
+    // Sends what the window has room for, resends what timed out and reports
+    // what completed. Call it every time the transport is drained.
+    void service(HCPTransport& transport);
+
+    // Returns false if the ack isn't for a command in flight
+    bool handleAck(const HCPMessage& ack, std::chrono::steady_clock::time_point receivedAt);
+
+    // Completes everything still queued or in flight as cancelled
+    void cancel();
+
+    size_t getQueued() const;
+    size_t getInFlight() const;
+    bool isIdle() const;
+
+    // Send to ack, first attempts only since a resent frame's ack can't be
+    // told apart from the original's
+    const HCPHistogram& getAckLatency() const;
+private:
+    enum EntryState
+    {
+        ENTRY_QUEUED,
+        ENTRY_SENT,
+        ENTRY_DONE
+    };
+    struct Entry
+    {
+        uint16_t seq;
+        EntryState state;
+        uint32_t attempts;
+        std::chrono::steady_clock::time_point sent; // last attempt
+        Result result;
+        uint8_t status;
+        Callback callback;
+        size_t frameLen;
+        uint8_t frame[HCPProtocol::MAX_FRAME_SIZE];
+    };
+
+    size_t m_window;
+    std::chrono::steady_clock::duration m_timeout;
+    uint32_t m_maxRetries;
+    HCPTransport::Priority m_priority;
+
+    std::deque<Entry> m_entries; // in submission order, completed ones leave from the front
+    size_t m_inFlight;
+
+    HCPHistogram m_ackLatency;
+
+    bool send(HCPTransport& transport, Entry& entry, std::chrono::steady_clock::time_point now);
+    void complete(Entry& entry, Result result, uint8_t status);
+    void reportCompleted();
+};
+
+#endif // HCP_COMMAND_QUEUE_HPP
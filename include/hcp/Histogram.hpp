@@ -0,0 +1,48 @@
+#ifndef HCP_HISTOGRAM_HPP
+#define HCP_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear histogram in the style of HdrHistogram. Every power of two range
+// is split into 64 linear sub-buckets, which keeps about 1.5% precision for
+// values up to 2^32. record() is lock-free and can run on any thread while
+// another one reads percentiles.
+class HCPHistogram
+{
+public:
+    HCPHistogram();
+    HCPHistogram(const HCPHistogram&) = delete;
+    HCPHistogram& operator=(const HCPHistogram&) = delete;
+
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    double getMean() const;
+
+    // Highest value that the given percentage (0-100) of samples are at or below
+    uint64_t getPercentile(double percentile) const;
+
+    // Prints count, mean and the usual percentiles, dividing values by
+    // unitDivisor first
+    void print(FILE* file, const char* title, double unitDivisor = 1000.0, const char* unit = "ms") const;
+private:
+    static const int SUB_BUCKET_BITS = 6;
+    static const size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const uint64_t MAX_VALUE = 0xFFFFFFFF;
+    static const size_t BUCKET_COUNT = SUB_BUCKET_COUNT * (32 - SUB_BUCKET_BITS + 1);
+
+    std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+
+    static size_t indexOf(uint64_t value);
+    static uint64_t lowestValueAt(size_t index);
+};
+
+#endif // HCP_HISTOGRAM_HPP
@@ -0,0 +1,47 @@
+#ifndef HCP_HOTPLUG_WATCH_HPP
+#define HCP_HOTPLUG_WATCH_HPP
+
+#include "Logger.hpp"
+
+#include <stdint.h>
+
+#define IMPL_FUNC // Marker for functions that are implemented in the platform-specific source file
+
+// Notices a device node or socket file (re)appearing at a path, so a lost
+// device is reopened as soon as it is back rather than at the next retry.
+// The deepest existing directory on the path is watched, since the node and
+// directories like /dev/serial/by-id vanish along with the device. udev
+// creates nodes before fixing their permissions, so a change to the node
+// counts too. Only paths starting with / can be watched, on Linux.
+class HCPHotplugWatch
+{
+public:
+    HCPHotplugWatch();
+    HCPHotplugWatch(const HCPHotplugWatch&) = delete;
+    HCPHotplugWatch& operator=(const HCPHotplugWatch&) = delete;
+    ~HCPHotplugWatch();
+
+    // Returns false if the path can't be watched
+    bool watch(const char* path);
+    void unwatch();
+    bool isWatching() const;
+
+    // Readable when there are events for check(), -1 while not watching
+    intptr_t getPollHandle() const;
+    // Drains the pending events without blocking. True if one was for the
+    // path, which may well be back by now.
+    bool IMPL_FUNC check();
+private:
+    static HCPLogger s_logger;
+
+    char m_path[256];
+
+    void* m_impl; // platform specific implementation struct
+    void IMPL_FUNC impl_init();
+    bool IMPL_FUNC impl_watch();
+    void IMPL_FUNC impl_unwatch();
+    intptr_t IMPL_FUNC impl_getPollHandle() const;
+    void IMPL_FUNC impl_destroy();
+};
+
+#endif // HCP_HOTPLUG_WATCH_HPP
@@ -0,0 +1,92 @@
+#ifndef HCP_LINE_INDEX_HPP
+#define HCP_LINE_INDEX_HPP
+
+#include "hcp/LineStore.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Searches text lines on a worker thread. It is fed the same appends as an
+// HCPLineStore, so line numbers match, and keeps its own copy of the lines
+// along with a trigram index over blocks of them. A query only looks at
+// the blocks that hold every trigram of the text it must contain. Matching
+// ignores case and § format codes. Lines that arrive while a query is set
+// are matched as they are indexed, the open last line once it is complete.
+class HCPLineIndex
+{
+public:
+    HCPLineIndex(size_t maxLines = HCPLineStore::DEFAULT_MAX_LINES, size_t maxBytes = HCPLineStore::DEFAULT_MAX_BYTES);
+    HCPLineIndex(const HCPLineIndex&) = delete;
+    HCPLineIndex& operator=(const HCPLineIndex&) = delete;
+    ~HCPLineIndex();
+
+    // Only copies the text, the worker splits and indexes it
+    void append(const char* text, size_t len);
+    void clear();
+
+    // A substring, or an ECMAScript regex when regex is set. An empty query
+    // matches nothing. Returns false if the regex doesn't compile.
+    bool setQuery(const char* query, bool regex);
+
+    // Set until the worker has gone through the history for the query
+    bool isSearching() const;
+
+    // Matching line numbers, oldest first
+    size_t getMatchCount() const;
+    size_t getMatches(size_t first, size_t count, uint64_t* lines) const;
+    bool isMatch(uint64_t line) const;
+    // Newest match older than line
+    bool findMatchBefore(uint64_t line, uint64_t* match) const;
+private:
+    static const uint64_t BLOCK_LINES = 64;
+    static const uint32_t TRIM_BLOCKS = 1024; // dropped blocks before the lists are trimmed
+
+    struct Query
+    {
+        uint32_t version = 0;
+        bool active = false;
+        bool regex = false;
+        std::string text; // lower case, substring queries only
+        std::regex pattern;
+        std::vector<uint32_t> trigrams; // every match contains all of them
+    };
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    bool m_running;
+
+    // Handed over to the worker
+    std::string m_pending;
+    bool m_clearPending;
+    Query m_nextQuery;
+    bool m_queryChanged;
+
+    // Published by the worker
+    std::deque<uint64_t> m_matches;
+    bool m_searching;
+
+    // Worker only
+    HCPLineStore m_lines;
+    uint64_t m_indexedEnd;
+    uint32_t m_trimmedBlock; // the lists hold nothing older
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings; // trigram to the blocks holding it
+    Query m_query;
+    std::string m_plain;
+
+    void run();
+    void indexLines(std::vector<uint64_t>* found);
+    void search(std::vector<uint64_t>* found);
+    bool matchLine(uint64_t line);
+    void trimPostings();
+    const std::string& plainText(uint64_t line);
+};
+
+#endif // HCP_LINE_INDEX_HPP
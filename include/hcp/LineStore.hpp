@@ -0,0 +1,71 @@
+#ifndef HCP_LINE_STORE_HPP
+#define HCP_LINE_STORE_HPP
+
+#include <deque>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+// Scrollback of text lines. Text is copied into fixed size chunks and every
+// line gets a fixed size index entry, so appending costs only the bytes
+// appended and memory grows by the same amount per line. Lines are numbered
+// from the first one ever appended. Once there are more lines or bytes than
+// the limits, the oldest ones are dropped a chunk at a time.
+class HCPLineStore
+{
+public:
+    struct Line
+    {
+        const char* text; // not terminated
+        uint32_t len;
+    };
+
+    static const size_t DEFAULT_MAX_LINES = 1 << 20;
+    static const size_t DEFAULT_MAX_BYTES = 64 << 20;
+    static const size_t MAX_LINE_LENGTH = 4096; // longer lines are cut short
+
+    HCPLineStore(size_t maxLines = DEFAULT_MAX_LINES, size_t maxBytes = DEFAULT_MAX_BYTES);
+    HCPLineStore(const HCPLineStore&) = delete;
+    HCPLineStore& operator=(const HCPLineStore&) = delete;
+
+    // Splits on \n, \r and \0 and skips empty lines. Text after the last line
+    // break stays open and the next append carries on with it.
+    void append(const char* text, size_t len);
+    void clear();
+
+    uint64_t getFirstLine() const;
+    uint64_t getEndLine() const; // one past the newest line, open or not
+    size_t getLineCount() const;
+    bool isLastLineOpen() const;
+
+    // Valid until the line is dropped or, for the open line, appended to
+    Line getLine(uint64_t line) const;
+private:
+    static const size_t CHUNK_SIZE = 1 << 16;
+    static const size_t INDEX_BLOCK_SIZE = 1 << 12;
+
+    struct Chunk
+    {
+        std::unique_ptr<char[]> text;
+        size_t used;
+        uint64_t firstLine;
+    };
+
+    size_t m_maxLines;
+    size_t m_maxChunks;
+
+    std::deque<Chunk> m_chunks;
+    std::deque<std::unique_ptr<Line[]>> m_index;
+    uint64_t m_indexStart; // line number of the first index entry
+
+    uint64_t m_firstLine;
+    uint64_t m_endLine;
+    bool m_lineOpen;
+
+    Line& lineAt(uint64_t line);
+    void extendLine(const char* text, size_t len);
+    void addChunk();
+    void dropOldLines();
+};
+
+#endif // HCP_LINE_STORE_HPP
@@ -0,0 +1,76 @@
+#ifndef HCP_LINK_MONITOR_HPP
+#define HCP_LINK_MONITOR_HPP
+
+#include "hcp/Transport.hpp"
+#include "hcp/Protocol.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+
+// Rates over the last second of a transport's counters, together with the
+// frame errors its decoder found. Sampled every tenth of a second from the
+// thread that drains the transport, so reading it costs nothing.
+class HCPLinkMonitor
+{
+public:
+    struct Rates
+    {
+        double bytesReceived; // per second
+        double bytesSent;
+        double framesReceived;
+        double framesSent;
+        double errors; // frame and line errors
+    };
+
+    HCPLinkMonitor();
+
+    // Bytes a second the line carries each way, 0 when there is no such limit
+    void setLineRate(double bytesPerSecond);
+
+    // Call as often as convenient
+    void update(const HCPTransport& transport, const HCPFrameDecoder& decoder);
+
+    const HCPTransport::Stats& getStats() const;
+    const Rates& getRates() const;
+    uint32_t getCRCErrors() const;
+    uint32_t getFramingErrors() const;
+    uint64_t getErrors() const; // every kind, in total
+
+    // Busier direction as a share of the line rate, 0 when it isn't known
+    double getLoad() const;
+    // The line is close to full or errors turned up within the last second
+    bool isSaturated() const;
+    bool isNoisy() const;
+
+    // One CSV line per call, for soak test logs
+    static void printHeader(FILE* file);
+    void print(FILE* file, double time, const char* name) const;
+private:
+    static const int SAMPLE_COUNT = 11; // a second apart end to end
+    static constexpr std::chrono::milliseconds SAMPLE_INTERVAL = std::chrono::milliseconds(100);
+    static constexpr double SATURATED_LOAD = 0.8;
+
+    struct Sample
+    {
+        std::chrono::steady_clock::time_point time;
+        uint64_t bytesReceived;
+        uint64_t bytesSent;
+        uint64_t framesReceived;
+        uint64_t framesSent;
+        uint64_t errors;
+    };
+
+    double m_lineRate;
+
+    Sample m_samples[SAMPLE_COUNT];
+    int m_sampleCount;
+    int m_newest;
+
+    HCPTransport::Stats m_stats;
+    uint32_t m_crcErrors;
+    uint32_t m_framingErrors;
+    Rates m_rates;
+};
+
+#endif // HCP_LINK_MONITOR_HPP
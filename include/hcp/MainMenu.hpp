@@ -3,21 +3,38 @@
 
 #include "hcp/Screen.hpp"
 #include "hcp/Resources.hpp"
-#include "hcp/Serial.hpp"
+#include "hcp/Transport.hpp"
+#include "hcp/TransportReactor.hpp"
+#include "hcp/Protocol.hpp"
+#include "hcp/Histogram.hpp"
+#include "hcp/SetpointStreamer.hpp"
+#include "hcp/CommandQueue.hpp"
+#include "hcp/LinkMonitor.hpp"
+#include "hcp/Telemetry.hpp"
+#include "hcp/TelemetryArchive.hpp"
+#include "hcp/LineIndex.hpp"
+#include "hcp/LineStore.hpp"
 
 #include "UIWindow.hpp"
+#include "UIRender.hpp"
 #include "Viewport.hpp"
 #include "Button.hpp"
 #include "TextField.hpp"
 #include "Animation.hpp"
+#include "Chart.hpp"
 
-#include <array>
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string>
 
 class HCPMainMenu : public HCPScreen
 {
 public:
     HCPMainMenu();
-    HCPMainMenu(const char* comPort);
+    // One rack per port, the first one is attached to the view
+    HCPMainMenu(const std::vector<std::string>& addresses);
 
     void setup() override;
     void draw() override;
@@ -32,6 +49,8 @@ private:
         const char* axesLabels[4]; // x, -x, y, -y
     protected:
         void doDraw() override;
+    private:
+        HCPCachedText m_axesText[4];
     };
 
     class Console : public HCPWidget
@@ -40,6 +59,7 @@ private:
         Console();
 
         void addLog(const char* log);
+        void addLog(const char* log, size_t len);
         void clearLog();
         const char* getCommand();
 
@@ -47,40 +67,127 @@ private:
     protected:
         void doDraw() override;
     private:
-        int m_scroll;
-        size_t m_logLen;
-        size_t m_logIndex;
-        std::vector<std::pair<const char*, size_t>> m_lines;
-        std::array<char, 2049> m_log;
+        // Glyph quads of the lines drawn last frame, by line number. A line
+        // is only laid out again when it grew.
+        struct CachedLine
+        {
+            HCPTextMesh mesh;
+            uint32_t len;
+            uint64_t frame;
+        };
+
+        int m_scroll; // lines up from the newest, or matches when filtering
+        HCPLineStore m_lines;
+        std::unordered_map<uint64_t, CachedLine> m_lineCache;
+        std::vector<uint64_t> m_visibleLines;
+        uint64_t m_frame;
         HCPButton m_sendButton;
         HCPTextField m_commandField;
         HCPViewport m_viewport;
 
+        // Searched in the background, only matches are shown when filtering
+        HCPLineIndex m_index;
+        std::string m_query;
+        bool m_queryValid;
+        bool m_filter;
+        HCPTextField m_searchField;
+        HCPButton m_filterButton;
+        HCPCachedText m_statusText;
+
+        void updateSearch();
         void handleInput();
     };
 
     char m_splashText[256];
+
+    // Text formatted every frame, only parsed again when it changes
+    HCPCachedText m_splashStyled;
+    HCPCachedText m_controllerCountText;
+    HCPCachedText m_titleText;
+    HCPCachedText m_portStatusText;
+    HCPCachedText m_controllerStatusText;
+    HCPCachedText m_robotText[4]; // x, y, swivel, claw
+    HCPCachedText m_linkStatsText[5];
     HCPImagePtr m_nasaMindsLogo;
 
     HCPViewport m_viewport;
 
     HCPButton m_manualControlButton;
     bool m_manualControlEnabled;
+    HCPButton m_stopButton;
+
+    // Every rack is drained each frame so none of them backs up, the view
+    // only shows the attached one
+    struct Rack
+    {
+        std::unique_ptr<HCPTransport> transport;
+        HCPFrameDecoder decoder;
+        uint16_t txSeq;
+
+        // Each on its own output lane, so a stop never waits behind a recipe
+        HCPCommandQueue stops;    // control
+        HCPCommandQueue commands; // interactive, typed into the console
+        HCPCommandQueue recipes;  // bulk
+        std::chrono::steady_clock::time_point nextPing;
+
+        // Round trip times in microseconds, the ack latency is in commands
+        HCPHistogram pingLatency;
+        HCPLinkMonitor monitor;
+
+        HCPSetpointStreamer setpoints;
+        uint32_t reconnects;  // the transport's count when last serviced
+        bool awaitingState;   // reconnected, setpoints wait for where the rack is
+
+        HCPTelemetryArchive archive; // open with --telemetry-archive
+        HCPTelemetryStore telemetry;
+
+        Rack(const char* address, size_t telemetrySamples);
+    };
+
+    // Services the transports when there is more than one, declared first so it
+    // outlives them
+    HCPTransportReactor m_reactor;
+    std::vector<std::unique_ptr<Rack>> m_racks;
+    size_t m_rack; // attached to the view
+    HCPButton m_rackButton;
+
+    // --stats-log, a line per rack every second
+    FILE* m_statsLog;
+    std::chrono::steady_clock::time_point m_statsLogStart;
+    std::chrono::steady_clock::time_point m_nextStatsLog;
 
-    HCPSerial* m_serial;
     Console m_console;
 
     JoyStickVisual m_xyJoystick;
     JoyStickVisual m_clawJoystick;
 
+    // The attached rack's sensors, in place of the robot views while shown
+    HCPChart m_chart;
+    HCPButton m_chartButton;
+    bool m_showChart;
+
     // Float robot values
     float m_robX, m_robY, m_robSwivel, m_robClaw;
+    bool m_robReported; // the rack has sent its actual position
+
+    // Joystick setpoints streamed to the attached rack: x, y, swivel, claw
+    float m_targets[HCPSetpointStreamer::JOINT_COUNT];
+    HCPSetpointStreamer::ResumePolicy m_setpointResume;
 
     void drawHeader();
     void drawJoysticks();
     void drawRobotView();
     void drawRobotArmView();
+    void drawChart();
+    void drawLinkStats(float width, float height);
     void handleInput();
+    void attachRack(size_t index);
+    void serviceRack(Rack& rack);
+    void logStats();
+    void handleMessage(Rack& rack, const HCPMessage& message, size_t offset);
+    bool sendCommand(Rack& rack, HCPCommandQueue& queue, const HCPMessage& message, HCPCommandQueue::Callback done = nullptr);
+    void runRecipe(Rack& rack, const char* path);
+    void emergencyStop();
 };
 
 #endif // HCP_MAIN_MENU_HPP
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef HCP_MAPPED_FILE_HPP
+#define HCP_MAPPED_FILE_HPP
+
+#include "Logger.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMPL_FUNC // Marker for functions that are implemented in the platform-specific source file
+
+// A whole file mapped into memory. Writable files grow with resize(), which
+// may move the mapping, so keep offsets rather than pointers across it.
+class HCPMappedFile
+{
+public:
+    enum Mode
+    {
+        MODE_READ,
+        MODE_READ_WRITE // created if missing
+    };
+
+    HCPMappedFile();
+    HCPMappedFile(const HCPMappedFile&) = delete;
+    HCPMappedFile& operator=(const HCPMappedFile&) = delete;
+    ~HCPMappedFile();
+
+    bool open(const char* path, Mode mode);
+    void close();
+    bool isOpen() const;
+
+    // Changes the file size and remaps it. New space reads as zero.
+    bool resize(size_t size);
+    // Asks the OS to start writing dirty pages back without waiting for it
+    void flush();
+
+    uint8_t* data();
+    const uint8_t* data() const;
+    size_t size() const;
+    const char* getPath() const;
+private:
+    static HCPLogger s_logger;
+
+    char m_path[256];
+    Mode m_mode;
+    bool m_open;
+    uint8_t* m_data;
+    size_t m_size;
+
+    void* m_impl; // platform specific implementation struct
+    void IMPL_FUNC impl_init();
+    bool IMPL_FUNC impl_open();
+    void IMPL_FUNC impl_close();
+    bool IMPL_FUNC impl_resize(size_t size);
+    void IMPL_FUNC impl_flush();
+    void IMPL_FUNC impl_destroy();
+};
+
+#endif // HCP_MAPPED_FILE_HPP
@@ -0,0 +1,90 @@
+#ifndef HCP_PORT_REGISTRY_HPP
+#define HCP_PORT_REGISTRY_HPP
+
+#include "Logger.hpp"
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+
+#define IMPL_FUNC // Marker for functions that are implemented in the platform-specific source file
+
+// Serial ports present on the machine, kept current from a background thread
+// so nothing on the UI thread ever waits for a scan. On Linux the first scan
+// reads /sys/class/tty, after that only the ports whose /dev nodes change are
+// looked at again. Windows rescans every second. Lookups only take the lock
+// and a map search.
+class HCPPortRegistry
+{
+public:
+    struct Port
+    {
+        std::string path;         // what to open, /dev/ttyUSB0 or COM3
+        std::string driver;       // ftdi_sio, cdc_acm, serial8250...
+        std::string byId;         // stable /dev/serial/by-id link, if udev made one
+        uint16_t vendorId;        // USB ports only, 0 otherwise
+        uint16_t productId;
+        std::string serialNumber;
+        std::string manufacturer;
+        std::string product;
+
+        Port();
+
+        // Product and serial number when known, for lists
+        std::string describe() const;
+    };
+
+    static HCPPortRegistry* getInstance();
+
+    HCPPortRegistry(const HCPPortRegistry&) = delete;
+    HCPPortRegistry& operator=(const HCPPortRegistry&) = delete;
+    ~HCPPortRegistry();
+
+    // Starts the scan in the background, does nothing if it is running
+    void start();
+    void stop();
+
+    // Set once the first scan is done, the registry is empty before that
+    bool isReady() const;
+    // Bumped on every change, cheap enough to check every frame
+    uint32_t getVersion() const;
+
+    // Sorted by path
+    std::vector<Port> getPorts() const;
+    // Takes the device path or its by-id link
+    bool findPort(const char* path, Port* port) const;
+private:
+    static HCPLogger s_logger;
+
+    mutable std::mutex m_lock;
+    std::map<std::string, Port> m_ports; // by path
+    std::unordered_map<std::string, std::string> m_byId; // by-id link to path
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_ready;
+    std::atomic<uint32_t> m_version;
+
+    HCPPortRegistry();
+
+    // From the platform's thread
+    void update(const Port& port);
+    void remove(const std::string& path);
+    // Drops every port not in paths, for full rescans
+    void retain(const std::vector<std::string>& paths);
+    void setReady();
+
+    void* m_impl; // platform specific implementation struct
+    void IMPL_FUNC impl_init();
+    // Scans and then follows changes until stop()
+    void IMPL_FUNC impl_run();
+    void IMPL_FUNC impl_wake();
+    void IMPL_FUNC impl_destroy();
+};
+
+#endif // HCP_PORT_REGISTRY_HPP
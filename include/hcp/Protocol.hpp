@@ -0,0 +1,169 @@
+#ifndef HCP_PROTOCOL_HPP
+#define HCP_PROTOCOL_HPP
+
+#include "hcp/Transport.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary link protocol between the panel and the rack controller.
+//
+// Every frame is [type u8][seq u16][payload][crc16 u16], COBS encoded and
+// terminated by a single 0x00. All integers and floats are little endian and
+// the CRC is CRC-16/CCITT-FALSE over everything before it.
+
+struct HCPMessage
+{
+    enum Type : uint8_t
+    {
+        NONE = 0,
+        SENSOR_SAMPLES = 1, // device -> panel
+        ROBOT_STATE = 2,    // device -> panel
+        ACK = 3,            // both ways
+        COMMAND = 4,        // panel -> device
+        CONSOLE = 5,        // both ways, one line of console text
+        PING = 6,           // panel -> device
+        PONG = 7            // device -> panel, echoes the ping's seq and timestamp
+    };
+
+    enum Opcode : uint8_t
+    {
+        CMD_STOP = 1,
+        CMD_SET_TARGET = 2,    // args: x, y, swivel, claw as f32
+        // Streamed setpoints are never acked, a newer one is always on its way
+        CMD_STREAM_TARGET = 3, // args: x, y, swivel, claw as f32
+        CMD_STREAM_DELTA = 4   // args: joint mask u8, then an i16 change in thousandths per joint in the mask
+    };
+
+    // Sensor channels the panel knows, racks may send others
+    enum Channel : uint8_t
+    {
+        CHANNEL_PH = 0,
+        CHANNEL_EC = 1,                // mS/cm
+        CHANNEL_WATER_TEMPERATURE = 2, // degrees C
+        CHANNEL_WATER_LEVEL = 3,       // percent
+        CHANNEL_LIGHT = 4,             // lux
+        CHANNEL_PUMP_CURRENT = 5       // A
+    };
+
+    static const size_t MAX_PAYLOAD = 240;
+    static const size_t MAX_SAMPLES = 47; // fills MAX_PAYLOAD
+
+    struct SensorSample
+    {
+        uint8_t channel;
+        float value;
+    };
+
+    struct Sensors
+    {
+        uint32_t timestamp; // device milliseconds
+        uint8_t count;
+        SensorSample samples[MAX_SAMPLES];
+    };
+
+    struct Robot
+    {
+        float x, y, swivel, claw;
+    };
+
+    struct Ping
+    {
+        uint64_t timestamp; // sender's clock in microseconds, echoed untouched
+    };
+
+    struct Ack
+    {
+        uint16_t seq;
+        uint8_t status; // 0 is success
+    };
+
+    struct Command
+    {
+        uint8_t opcode;
+        uint8_t len;
+        uint8_t args[MAX_PAYLOAD - 2];
+    };
+
+    // The text is not null terminated. For decoded messages it points into the
+    // decoder and stays valid until the next call to HCPFrameDecoder::feed().
+    struct Console
+    {
+        uint8_t len;
+        const char* text;
+    };
+
+    Type type;
+    uint16_t seq;
+
+    union
+    {
+        Sensors sensors;
+        Robot robot;
+        Ping ping;
+        Ack ack;
+        Command command;
+        Console console;
+    };
+
+    HCPMessage(Type type = NONE, uint16_t seq = 0);
+};
+
+class HCPProtocol
+{
+public:
+    // Worst case size of an encoded frame including the delimiter
+    static const size_t MAX_FRAME_SIZE = 1 + 2 + HCPMessage::MAX_PAYLOAD + 2 + 2 + 1;
+
+    static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+
+    // COBS without the trailing delimiter. Decode returns 0 on malformed input.
+    static size_t cobsEncode(const uint8_t* src, size_t len, uint8_t* dst);
+    static size_t cobsDecode(const uint8_t* src, size_t len, uint8_t* dst);
+
+    // Serializes a message into a complete frame, returns 0 if it doesn't fit
+    static size_t encode(const HCPMessage& message, uint8_t* dst, size_t dstLen);
+
+    // Encodes straight into the transport's output ring. All or nothing,
+    // returns false when the ring doesn't have room for the whole frame.
+    static bool send(HCPTransport& transport, const HCPMessage& message, HCPTransport::Priority priority = HCPTransport::PRIORITY_INTERACTIVE);
+
+    static HCPMessage consoleMessage(const char* text, size_t len, uint16_t seq = 0);
+
+    // Little endian floats, for command arguments packed by hand
+    static void putF32(uint8_t* dst, float value);
+    static float getF32(const uint8_t* src);
+private:
+    static size_t serialize(const HCPMessage& message, uint8_t* dst);
+};
+
+// Incremental frame decoder. Never allocates; a corrupt or oversized frame is
+// dropped and decoding picks up again at the next delimiter.
+class HCPFrameDecoder
+{
+public:
+    HCPFrameDecoder();
+
+    // Consumes bytes up to and including the end of the next frame. Returns the
+    // number of bytes used; message->type is NONE unless a valid frame ended.
+    size_t feed(const uint8_t* data, size_t len, HCPMessage* message);
+
+    void reset();
+
+    uint32_t getFrameCount() const;
+    uint32_t getCRCErrors() const;
+    uint32_t getFramingErrors() const;
+private:
+    uint8_t m_frame[HCPProtocol::MAX_FRAME_SIZE];
+    uint8_t m_decoded[HCPProtocol::MAX_FRAME_SIZE];
+    size_t m_frameLen;
+    bool m_discarding;
+
+    uint32_t m_frameCount;
+    uint32_t m_crcErrors;
+    uint32_t m_framingErrors;
+
+    bool parse(const uint8_t* data, size_t len, HCPMessage* message);
+};
+
+#endif // HCP_PROTOCOL_HPP
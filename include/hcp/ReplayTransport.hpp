@@ -0,0 +1,38 @@
+#ifndef HCP_REPLAY_TRANSPORT_HPP
+#define HCP_REPLAY_TRANSPORT_HPP
+
+#include "hcp/Transport.hpp"
+#include "hcp/Capture.hpp"
+
+// Plays back what was received in a capture, addressed as replay:<path>, as
+// if the rack were connected. Whatever is written is discarded. There is
+// nothing to wait on, so in reactor mode it still gets a thread of its own.
+class HCPReplayTransport : public HCPTransport
+{
+public:
+    static constexpr const char* PREFIX = "replay:";
+
+    HCPReplayTransport(const char* address);
+    ~HCPReplayTransport();
+
+    // Speed and seeking, usable before begin()
+    HCPCaptureReplay* getReplay() override;
+protected:
+    bool impl_open() override;
+    void impl_close() override;
+    bool impl_service(int timeoutMs) override;
+    bool impl_handleEvents(uint32_t events) override;
+    bool impl_attach(intptr_t pollHandle) override;
+    bool impl_flush() override;
+    void impl_wake() override;
+    bool impl_isPollable() const override;
+private:
+    static HCPLogger s_logger;
+
+    // Short sleeps stand in for a wakeup when there is output or on close
+    static const int MAX_WAIT_MS = 5;
+
+    HCPCaptureReplay m_replay;
+};
+
+#endif // HCP_REPLAY_TRANSPORT_HPP
@@ -0,0 +1,55 @@
+#ifndef HCP_RING_BUFFER_HPP
+#define HCP_RING_BUFFER_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed capacity byte ring. Safe for exactly one producer thread and one
+// consumer thread without locks. The capacity is rounded up to a power of two.
+class HCPRingBuffer
+{
+public:
+    // A contiguous piece of the ring. Data that wraps around the end of the
+    // storage comes back as two spans.
+    struct Span
+    {
+        uint8_t* data;
+        size_t len;
+    };
+
+    HCPRingBuffer(size_t capacity = 0);
+    HCPRingBuffer(const HCPRingBuffer&) = delete;
+    HCPRingBuffer& operator=(const HCPRingBuffer&) = delete;
+    ~HCPRingBuffer();
+
+    // Not thread safe, only call while nothing else is using the ring
+    void resize(size_t capacity);
+
+    size_t capacity() const;
+    size_t size() const;
+    size_t space() const;
+    bool empty() const;
+
+    // Producer side
+    size_t write(const uint8_t* data, size_t len);
+    size_t writeSpan(uint8_t** dst); // contiguous free region starting at the head
+    size_t reserve(Span spans[2], size_t len); // up to len free bytes, returns the amount reserved
+    void commitWrite(size_t len);
+
+    // Consumer side
+    size_t read(uint8_t* data, size_t len);
+    size_t readSpan(const uint8_t** src); // contiguous used region starting at the tail
+    size_t peek(Span spans[2]); // everything readable without copying, returns the total
+    void consume(size_t len);
+    void clear();
+private:
+    uint8_t* m_data;
+    size_t m_mask;
+
+    // Kept on separate cache lines so the two threads don't false share
+    alignas(64) std::atomic<size_t> m_head; // written by the producer
+    alignas(64) std::atomic<size_t> m_tail; // written by the consumer
+};
+
+#endif // HCP_RING_BUFFER_HPP
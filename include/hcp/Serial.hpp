@@ -1,14 +1,13 @@
 #ifndef HCP_SERIAL_UTIL_HPP
 #define HCP_SERIAL_UTIL_HPP
 
-#include "Logger.hpp"
+#include "hcp/Transport.hpp"
 
 #include <vector>
 #include <string>
+#include <stdint.h>
 
-#define IMPL_FUNC // Marker for functions that are implemented in the platform-specific source file
-
-class HCPSerial
+class HCPSerial : public HCPTransport
 {
 public:
     struct Timeout
@@ -40,56 +39,62 @@ public:
         STOPBITS_ONE_POINT_FIVE = 3,
         STOPBITS_TWO = 2
     };
+    // Lets the device hold back what we send and us hold back what it sends.
+    // Either way output waits in the rings, so HCPProtocol::send() starts
+    // failing once they are full, and a full input ring pauses the device
+    // instead of overrunning. XON/XOFF takes 0x11 and 0x13 out of the data,
+    // which binary frames contain, so it only suits text devices.
+    enum FlowControl
+    {
+        FLOWCONTROL_NONE,
+        FLOWCONTROL_HARDWARE, // RTS/CTS
+        FLOWCONTROL_SOFTWARE  // XON/XOFF
+    };
 
     HCPSerial(const char* port = nullptr,
     uint32_t baudRate = 9600,
     Parity parity = Parity::PARITY_NONE,
-    StopBits stopBits = StopBits::STOPBITS_ONE, 
-    Timeout timeout = Timeout());
-
-    HCPSerial(const HCPSerial&) = delete;
-    HCPSerial& operator=(const HCPSerial&) = delete;
+    StopBits stopBits = StopBits::STOPBITS_ONE,
+    Timeout timeout = Timeout(),
+    FlowControl flowControl = FlowControl::FLOWCONTROL_NONE);
 
     ~HCPSerial();
 
-    void IMPL_FUNC begin();
-    void IMPL_FUNC close();
-
-    bool isOpen() const;
-
-    int available() const;
-    void write(const uint8_t* data, size_t len);
-    int read(uint8_t* data, size_t len);
-
-    void IMPL_FUNC poll();
-    // Returns true if the output buffer was flushed
-    bool IMPL_FUNC flushOuput();
-
     const char* getPort() const;
     uint32_t getBaudRate() const;
     Parity getParity() const;
     StopBits getStopBits() const;
     Timeout getTimeout() const;
+    FlowControl getFlowControl() const;
 
     void setBaudRate(uint32_t baudRate);
     void setParity(Parity parity);
     void setStopBits(StopBits stopBits);
     void setTimeout(Timeout timeout);
-
-    static std::vector<std::string> IMPL_FUNC getSerialPorts();
+    void setFlowControl(FlowControl flowControl);
+
+    // Paths of the ports in HCPPortRegistry, which is started if it isn't
+    // already. Empty until its first scan is done.
+    static std::vector<std::string> getSerialPorts();
+protected:
+    bool IMPL_FUNC impl_open() override;
+    void IMPL_FUNC impl_close() override;
+    bool IMPL_FUNC impl_handleEvents(uint32_t events) override;
+    bool IMPL_FUNC impl_flush() override;
+    const char* impl_getHotplugPath() const override;
 private:
     static HCPLogger s_logger;
 
-    char m_port[128];
+    // The driver is kept to about 2 ms of output, but at least a whole frame
+    // at low baud rates. Output in the driver can't be overtaken.
+    static const size_t MIN_OUTPUT_QUEUE = 256;
+    size_t getOutputQueueLimit() const;
+
     uint32_t m_baudRate;
     Parity m_parity;
     StopBits m_stopBits;
     Timeout m_timeout;
-
-    std::vector<uint8_t> m_readBuffer;
-    std::vector<uint8_t> m_writeBuffer;
-
-    bool m_open;
+    FlowControl m_flowControl;
 
     void* m_impl; // platform specific implementation struct
     void IMPL_FUNC impl_init();
@@ -97,7 +102,8 @@ private:
     void IMPL_FUNC impl_setParity(Parity parity);
     void IMPL_FUNC impl_setStopBits(StopBits stopBits);
     void IMPL_FUNC impl_setTimeout(Timeout timeout);
+    void IMPL_FUNC impl_setFlowControl(FlowControl flowControl);
     void IMPL_FUNC impl_destory();
 };
 
-#endif // HCP_SERIAL_UTIL_HPP
\ No newline at end of file
+#endif // HCP_SERIAL_UTIL_HPP
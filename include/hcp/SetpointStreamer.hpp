@@ -0,0 +1,67 @@
+#ifndef HCP_SETPOINT_STREAMER_HPP
+#define HCP_SETPOINT_STREAMER_HPP
+
+#include "hcp/Transport.hpp"
+
+#include <atomic>
+#include <stdint.h>
+
+// Streams the joint setpoints (x, y, swivel, claw) to the rack at a fixed
+// rate from the transport's I/O side. The UI only overwrites the latest
+// targets, so a slow link skips intermediate values instead of queueing
+// them. Unchanged targets send nothing, small changes go out as deltas and an
+// absolute frame follows every burst of deltas so the rack settles on the
+// exact values. After the transport reconnects the rack may have restarted,
+// so the next frame is always absolute.
+class HCPSetpointStreamer
+{
+public:
+    static const int JOINT_COUNT = 4;
+
+    // What happens to targets set while the link was down
+    enum ResumePolicy
+    {
+        RESUME_DISCARD, // dropped, nothing is sent until the next setTargets()
+        RESUME_REPLAY   // the latest targets go out as soon as the link is back
+    };
+
+    HCPSetpointStreamer();
+    HCPSetpointStreamer(const HCPSetpointStreamer&) = delete;
+    HCPSetpointStreamer& operator=(const HCPSetpointStreamer&) = delete;
+
+    // Installs the streamer as the transport's output task, so before begin()
+    void attach(HCPTransport& transport, double rateHz);
+    // Discard by default, so the rack doesn't move on its own when it comes back
+    void setResumePolicy(ResumePolicy policy);
+
+    // From a single thread. Latest call wins.
+    void setTargets(const float targets[JOINT_COUNT]);
+
+    uint32_t getFramesSent() const;
+    uint32_t getBytesSent() const;
+private:
+    static const int KEYFRAME_INTERVAL = 25; // deltas in a row before an absolute frame
+
+    // Seqlock, the version is odd while setTargets() is writing
+    std::atomic<uint32_t> m_version;
+    std::atomic<float> m_targets[JOINT_COUNT];
+
+    const HCPTransport* m_transport;
+    std::atomic<ResumePolicy> m_resumePolicy;
+
+    // I/O side
+    uint32_t m_reconnects; // the transport's count when the task last ran
+    uint32_t m_sentVersion;
+    int32_t m_sent[JOINT_COUNT]; // thousandths, what the rack was last told
+    bool m_synced;               // the rack has had an absolute frame
+    bool m_settled;              // the last frame was absolute
+    int m_deltasInRow;
+    uint16_t m_seq;
+
+    std::atomic<uint32_t> m_framesSent;
+    std::atomic<uint32_t> m_bytesSent;
+
+    size_t produce(uint8_t* dst, size_t len);
+};
+
+#endif // HCP_SETPOINT_STREAMER_HPP
@@ -0,0 +1,47 @@
+#ifndef HCP_SOCKET_TRANSPORT_HPP
+#define HCP_SOCKET_TRANSPORT_HPP
+
+#include "hcp/Transport.hpp"
+
+#include <stddef.h>
+
+// A stream socket to a serial bridge (ser2net and the like) or a local
+// gateway daemon, addressed as tcp://host:port or unix:/path. Nagle is off
+// since frames are small and latency matters more than packet count. The
+// connect doesn't block, one that fails counts as a failure of the transport
+// and the reactor retries it like an unplugged port. Host names are resolved
+// when opening, which does block.
+class HCPSocketTransport : public HCPTransport
+{
+public:
+    static constexpr const char* TCP_PREFIX = "tcp://";
+    static constexpr const char* UNIX_PREFIX = "unix:";
+
+    static bool isSocketAddress(const char* address);
+
+    HCPSocketTransport(const char* address);
+    ~HCPSocketTransport();
+protected:
+    bool IMPL_FUNC impl_open() override;
+    void IMPL_FUNC impl_close() override;
+    bool IMPL_FUNC impl_handleEvents(uint32_t events) override;
+    bool IMPL_FUNC impl_flush() override;
+    // The socket file of a Unix socket, a gateway restarting creates it anew
+    const char* impl_getHotplugPath() const override;
+private:
+    static HCPLogger s_logger;
+
+    // Unsent bytes left in the socket, kept low so more urgent frames in the
+    // rings don't wait behind a kernel buffer of bulk output
+    static const size_t OUTPUT_QUEUE_LIMIT = 256;
+
+    bool isTcp() const;
+    // Splits tcp://host:port, with IPv6 hosts in brackets
+    bool splitHostPort(char* host, size_t hostLen, char* port, size_t portLen) const;
+
+    void* m_impl; // platform specific implementation struct
+    void IMPL_FUNC impl_init();
+    void IMPL_FUNC impl_destroy();
+};
+
+#endif // HCP_SOCKET_TRANSPORT_HPP
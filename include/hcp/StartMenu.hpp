@@ -7,6 +7,7 @@
 
 #include "Viewport.hpp"
 #include "Button.hpp"
+#include "TextField.hpp"
 
 class HCPStartMenu : public HCPScreen
 {
@@ -22,14 +23,21 @@ private:
     HCPViewport m_viewport;
     HCPButton m_selectSerialPortButton;
     HCPButton m_okButton;
+    HCPTextField m_addressField; // a socket address instead of a serial port
 
-    std::vector<char*> m_serialPorts;
+    std::vector<std::string> m_serialPorts; // paths
+    std::vector<char*> m_serialPortNames;   // what the selection window lists
+    uint32_t m_serialPortsVersion;          // of the port registry
     std::weak_ptr<HCPSelectionWindow> m_serialPortSelectionWindow;
 
     char m_splashText[256];
+    HCPCachedText m_splashStyled;
+    HCPCachedText m_promptText;
 
     int m_selectedSerialPort;
 
+    void updateSerialPorts();
+    void freeSerialPortNames();
     void handleInput();
 };
 
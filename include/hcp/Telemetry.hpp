@@ -0,0 +1,175 @@
+#ifndef HCP_TELEMETRY_HPP
+#define HCP_TELEMETRY_HPP
+
+#include "hcp/Protocol.hpp"
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+class HCPTelemetryArchive;
+
+// Recent samples of one sensor channel in columns. Each block holds the
+// timestamps of BLOCK_SAMPLES samples followed by their values, starting on
+// a cache line. The blocks form a ring that is allocated as it first fills,
+// so memory never grows past the capacity. Safe for one appending thread
+// and any number of reading threads without locks. A read the writer laps
+// while copying drops the samples that were overwritten.
+//
+// Appends also keep a pyramid of min/max/mean summaries. A level 0 bucket
+// covers LEVEL0_SAMPLES samples and each level above folds FANOUT buckets of
+// the one below, kept in rings of LEVEL_BUCKETS. The coarser a level, the
+// further back it reaches, the top one about a month at 100 Hz.
+class HCPTelemetryChannel
+{
+public:
+    static const size_t BLOCK_SAMPLES = 1024;
+    static const size_t LEVEL0_SAMPLES = 16;
+    static const size_t FANOUT = 4;
+    static const size_t LEVELS = 7;
+    static const size_t LEVEL_BUCKETS = 4096;
+
+    struct Summary
+    {
+        int64_t start; // first and last sample's timestamps
+        int64_t end;
+        float min;
+        float max;
+        float mean;
+        uint32_t count; // samples, 0 for an empty column. A bucket wider than a
+                        // column counts in each one it overlaps.
+    };
+
+    // Folds a summary into another, means weighted by their sample counts.
+    // An empty summary changes nothing.
+    static void merge(Summary& into, const Summary& from);
+
+    // Rounded up to a power of two number of blocks
+    HCPTelemetryChannel(size_t capacity);
+    HCPTelemetryChannel(const HCPTelemetryChannel&) = delete;
+    HCPTelemetryChannel& operator=(const HCPTelemetryChannel&) = delete;
+
+    // Writer side. Timestamps are microseconds, one older than the newest
+    // sample is moved up to it.
+    void append(int64_t timestamp, float value);
+
+    // Samples are numbered from the first one appended
+    uint64_t getStart() const; // oldest still held
+    uint64_t getEnd() const; // one past the newest
+    size_t getCapacity() const;
+    size_t getMemoryUsage() const;
+
+    bool getLatest(int64_t* timestamp, float* value) const;
+
+    // First sample at or after the timestamp, getEnd() if there is none
+    uint64_t lowerBound(int64_t timestamp) const;
+
+    // Copies up to count samples from *first on, oldest first. Samples dropped
+    // before or during the copy are skipped and *first is set to the first
+    // one copied. Either array may be null to skip that column.
+    size_t read(uint64_t* first, size_t count, int64_t* timestamps, float* values) const;
+
+    // Splits [from, to) into equal columns and summarises the samples in
+    // each. Uses the coarsest level whose buckets fit in a column, so it
+    // touches a few buckets per column however long the range is. Times that
+    // level no longer holds come from coarser ones and the newest, not yet in
+    // a full bucket, from finer ones and the raw samples.
+    void summarize(int64_t from, int64_t to, Summary* columns, size_t numColumns) const;
+private:
+    struct alignas(64) Block
+    {
+        int64_t timestamps[BLOCK_SAMPLES];
+        float values[BLOCK_SAMPLES];
+    };
+
+    struct Level
+    {
+        std::unique_ptr<Summary[]> buckets; // allocated with the first one
+        alignas(64) std::atomic<uint64_t> end;
+
+        // Writer only, the bucket being filled
+        Summary partial;
+        double sum;
+        size_t parts;
+    };
+
+    // Where summarize() gets a stretch of time from, RAW_SOURCE or a level
+    static const int RAW_SOURCE = -1;
+
+    struct Columns
+    {
+        int64_t from;
+        double width;
+        Summary* columns;
+        size_t count;
+    };
+
+    std::unique_ptr<std::unique_ptr<Block>[]> m_blocks;
+    size_t m_blockMask;
+    int64_t m_newest; // writer only
+
+    alignas(64) std::atomic<uint64_t> m_end;
+
+    Level m_levels[LEVELS];
+
+    uint64_t getValidStart(uint64_t end) const;
+    int64_t timestampAt(uint64_t sample) const;
+
+    void addToLevel(size_t level, const Summary& summary, double sum);
+    void pushBucket(size_t level);
+    bool getCoverage(int source, int64_t* oldest, int64_t* newest) const;
+    size_t readBuckets(size_t level, uint64_t* first, Summary* buckets, size_t count) const;
+    int64_t addSource(int source, int64_t from, int64_t to, Columns& columns) const;
+    static size_t getColumn(const Columns& columns, int64_t timestamp);
+};
+
+// Sensor history of one rack, a channel per sensor id created on its first
+// sample. Reading threads see a channel once its pointer is published.
+//
+// Samples from the rack are also written to an archive when one is set,
+// stamped with the system clock. The device clock is tied to it on the
+// first sample and again whenever the two drift more than MAX_CLOCK_DRIFT
+// apart, but never moved back, so archived timestamps keep increasing.
+class HCPTelemetryStore
+{
+public:
+    static const size_t MAX_CHANNELS = 256;
+    static const size_t DEFAULT_CAPACITY = 1 << 16; // samples per channel, about 11 minutes at 100 Hz
+    static const int64_t MAX_CLOCK_DRIFT = 2000000;
+
+    HCPTelemetryStore(size_t capacity = DEFAULT_CAPACITY);
+    HCPTelemetryStore(const HCPTelemetryStore&) = delete;
+    HCPTelemetryStore& operator=(const HCPTelemetryStore&) = delete;
+    ~HCPTelemetryStore();
+
+    // Writer side. Device milliseconds are unwrapped into a clock that never
+    // goes backwards, also when the device restarts.
+    void append(const HCPMessage::Sensors& sensors);
+    void append(uint8_t channel, int64_t timestamp, float value);
+    void setArchive(HCPTelemetryArchive* archive);
+
+    // Null until the channel has a sample
+    const HCPTelemetryChannel* getChannel(uint8_t channel) const;
+    size_t getMemoryUsage() const;
+    // Added to a channel timestamp gives system clock microseconds, 0 before
+    // the first sample from the rack
+    int64_t getWallClockOffset() const;
+
+    static const char* getChannelName(uint8_t channel);
+    static const char* getChannelUnit(uint8_t channel);
+private:
+    size_t m_capacity;
+    std::atomic<HCPTelemetryChannel*> m_channels[MAX_CHANNELS];
+
+    // Writer only
+    bool m_deviceTimeKnown;
+    uint32_t m_lastDeviceTime;
+    int64_t m_deviceTime; // milliseconds
+    bool m_wallClockKnown;
+    HCPTelemetryArchive* m_archive;
+
+    std::atomic<int64_t> m_wallClockOffset;
+};
+
+#endif // HCP_TELEMETRY_HPP
@@ -0,0 +1,154 @@
+#ifndef HCP_TELEMETRY_ARCHIVE_HPP
+#define HCP_TELEMETRY_ARCHIVE_HPP
+
+#include "hcp/MappedFile.hpp"
+#include "hcp/Telemetry.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Telemetry history on disk, a directory of immutable chunk files. A chunk
+// is a 16 byte header, then blocks of up to BLOCK_SAMPLES samples of one
+// channel each, then an index of the blocks with their time range and
+// min/max/mean, then a 32 byte trailer pointing at the index. A block starts
+// with the min/max/mean of every SEGMENT_SAMPLES of it, followed by the
+// samples with timestamps stored as deltas of deltas and values XORed with
+// the one before (Gorilla), so a steady sensor costs a few bits a sample.
+//
+// Chunks are named after the time they cover, so opening an archive only
+// lists the directory. Reads map the chunks a range overlaps, look the
+// channel's blocks up in their index and decode only those.
+//
+// Samples collect in memory until a chunk is written, every CHUNK_TIME, at
+// CHUNK_BYTES or on close. A crash loses what was not written yet and reads
+// only see written chunks. Not thread safe, the frame thread appends and
+// reads.
+class HCPTelemetryArchive
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t BLOCK_SAMPLES = 1024;
+    static const size_t SEGMENT_SAMPLES = 64;
+    static const int64_t CHUNK_TIME = 1800LL * 1000000; // half an hour
+    static const size_t CHUNK_BYTES = 4 << 20;
+    static const size_t MAX_MAPPED = 8192; // the least recently read chunk is unmapped past this
+
+    HCPTelemetryArchive();
+    HCPTelemetryArchive(const HCPTelemetryArchive&) = delete;
+    HCPTelemetryArchive& operator=(const HCPTelemetryArchive&) = delete;
+    ~HCPTelemetryArchive();
+
+    // Created if missing
+    bool open(const char* directory);
+    // Writes what is pending first
+    void close();
+    bool isOpen() const;
+
+    // Chunks ending this long before the newest one are deleted as new ones
+    // are written, 0 keeps everything
+    void setRetention(int64_t micros);
+
+    // Writer side. Timestamps are system clock microseconds, one older than
+    // the channel's newest sample is moved up to it.
+    void append(uint8_t channel, int64_t timestamp, float value);
+    // Writes the pending samples out as a chunk
+    void flush();
+
+    // Time covered by the written chunks, 0 when there are none
+    int64_t getStartTime() const;
+    int64_t getEndTime() const;
+    size_t getChunkCount() const;
+    uint64_t getDiskUsage() const;
+
+    // Appends the channel's samples in [from, to) to the arrays and returns
+    // how many there were. Each chunk's are in order, chunks by their start.
+    size_t read(uint8_t channel, int64_t from, int64_t to, std::vector<int64_t>& timestamps, std::vector<float>& values) const;
+
+    // Like HCPTelemetryChannel::summarize(). Blocks and then segments no
+    // wider than a column are summarised already, only the samples of longer
+    // segments are decoded.
+    void summarize(uint8_t channel, int64_t from, int64_t to, HCPTelemetryChannel::Summary* columns, size_t numColumns) const;
+private:
+    static HCPLogger s_logger;
+
+    // As stored in a chunk's index, sorted by channel, then time
+    struct BlockEntry
+    {
+        int64_t start; // first and last sample's timestamps
+        int64_t end;
+        uint64_t offset; // into the chunk
+        uint32_t size;
+        uint32_t count;
+        uint32_t unit; // every timestamp delta in the block is a multiple of it
+        uint8_t channel;
+        uint8_t reserved[3];
+        float min;
+        float max;
+        float mean;
+        uint32_t reserved2;
+    };
+
+    // At the start of a block's data, one per SEGMENT_SAMPLES
+    struct Segment
+    {
+        uint32_t start; // microseconds after the block's start
+        uint32_t end;
+        float min;
+        float max;
+        float mean;
+    };
+
+    struct Chunk
+    {
+        std::string path;
+        int64_t start;
+        int64_t end;
+        uint64_t size;
+
+        // While mapped
+        std::unique_ptr<HCPMappedFile> file;
+        const BlockEntry* index;
+        size_t blockCount;
+        uint64_t lastRead;
+        bool broken; // failed to map or check, skipped from then on
+    };
+
+    // A channel's samples not in a block yet
+    struct Pending
+    {
+        std::vector<int64_t> timestamps;
+        std::vector<float> values;
+        int64_t newest;
+    };
+
+    std::string m_directory;
+    bool m_open;
+    int64_t m_retention;
+
+    mutable std::vector<Chunk> m_chunks; // by start time
+    mutable size_t m_mapped;
+    mutable uint64_t m_reads;
+
+    // Writer only
+    std::vector<Pending> m_pending; // by channel
+    std::vector<uint8_t> m_chunkData; // header and blocks of the chunk being built
+    std::vector<BlockEntry> m_chunkIndex;
+    int64_t m_chunkOpened; // first sample since the last chunk was written
+
+    // Decoded blocks
+    mutable std::vector<int64_t> m_timestamps;
+    mutable std::vector<float> m_values;
+
+    void encodeBlock(uint8_t channel);
+    void applyRetention();
+    bool mapChunk(Chunk& chunk) const;
+    void unmapChunk(Chunk& chunk) const;
+    template<typename Visit>
+    void forEachBlock(uint8_t channel, int64_t from, int64_t to, Visit visit) const;
+    size_t decodeBlock(const Chunk& chunk, const BlockEntry& entry) const;
+};
+
+#endif // HCP_TELEMETRY_ARCHIVE_HPP
@@ -0,0 +1,316 @@
+#ifndef HCP_TRANSPORT_HPP
+#define HCP_TRANSPORT_HPP
+
+#include "Logger.hpp"
+#include "hcp/RingBuffer.hpp"
+#include "hcp/HotplugWatch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+#define IMPL_FUNC // Marker for functions that are implemented in the platform-specific source file
+
+class HCPTransportReactor;
+class HCPCaptureWriter;
+class HCPCaptureReplay;
+
+// A byte stream to a rack controller, whether that is a serial port, a
+// socket to a bridge or a capture being played back. The rings, the I/O
+// modes, the output task and capture are shared. A transport only moves bytes
+// between its device and the rings through the impl_ hooks.
+//
+// A device that fails, or can't be opened by begin(), is reopened from the
+// I/O side until close(): first after RETRY_DELAY_MIN, then twice as long
+// each time up to RETRY_DELAY_MAX, or right away when its path reappears.
+// What is queued for output stays queued and goes out once it is back, except
+// the rest of a frame that was cut off, which is dropped.
+class HCPTransport
+{
+public:
+    enum State
+    {
+        STATE_CLOSED,
+        STATE_OPEN,
+        STATE_RECONNECTING // failed, the reactor is trying to reopen it
+    };
+    // Output classes, most urgent first. Each has its own ring. At every frame
+    // boundary the next frame comes from the most urgent class with one
+    // queued, so a control frame waits for at most the rest of the frame on
+    // the wire and what the device has queued, which the device code keeps to
+    // about a frame. The output task ranks between control and interactive.
+    //
+    // Lanes carry whole COBS frames, each ended by its 0x00 delimiter. A lane
+    // that runs dry partway through a frame gets a delimiter of its own so the
+    // others aren't held up, and the device drops what came before it.
+    enum Priority
+    {
+        PRIORITY_CONTROL,     // emergency stop and the like
+        PRIORITY_INTERACTIVE, // console, commands and pings
+        PRIORITY_BULK,        // scripts, firmware and other long transfers
+        PRIORITY_COUNT
+    };
+    struct LaneStats
+    {
+        size_t queued;      // bytes in the ring right now
+        size_t maxQueued;   // most bytes the ring has held
+        uint64_t bytesSent;
+    };
+    // Errors the device reports on the line itself, serial ports only
+    struct LineErrors
+    {
+        uint32_t overruns; // bytes the UART or the driver had no room for
+        uint32_t parity;
+        uint32_t framing;  // bad stop bits, often a baud rate mismatch
+        uint32_t breaks;
+    };
+    // Running totals since the transport was created
+    struct Stats
+    {
+        uint64_t bytesReceived;
+        uint64_t bytesSent;
+        uint64_t framesReceived; // frame delimiters, whether or not the frame was any good
+        uint64_t framesSent;
+        uint32_t inputStalls;    // times the input ring filled up and reading paused
+        size_t inputMaxQueued;   // most bytes the input ring has held
+        uint32_t failures;
+        uint32_t reconnects;
+        LineErrors lineErrors;
+        LaneStats lanes[PRIORITY_COUNT];
+    };
+
+    // Picks the transport from the address: tcp://host:port, unix:/path,
+    // replay:/path or otherwise a serial port
+    static HCPTransport* create(const char* address);
+
+    HCPTransport(const HCPTransport&) = delete;
+    HCPTransport& operator=(const HCPTransport&) = delete;
+
+    // Subclasses close() in their own destructor, the device is gone by now
+    virtual ~HCPTransport();
+
+    void begin();
+    void close();
+
+    bool isOpen() const;
+    State getState() const;
+    Stats getStats() const;
+    const char* getAddress() const;
+
+    // Threaded mode moves all I/O onto a background thread. read() and
+    // write() then only copy to and from the rings. Must be set before begin().
+    void setThreaded(bool threaded);
+    bool isThreaded() const;
+
+    // Like threaded mode, but the transport shares the reactor's thread with
+    // others and is reopened by it after a failure. Must be set before begin().
+    void setReactor(HCPTransportReactor* reactor);
+    HCPTransportReactor* getReactor() const;
+
+    // Records everything read and written to a capture file, nullptr stops
+    // recording. Must be set before begin().
+    bool setCapture(const char* path);
+    bool isCapturing() const;
+
+    // Playback controls when the transport replays a capture, null otherwise
+    virtual HCPCaptureReplay* getReplay();
+
+    int available() const;
+    // Queues all of data or, if the lane hasn't the room, none of it.
+    // Returns the bytes queued.
+    size_t write(const uint8_t* data, size_t len, Priority priority = PRIORITY_INTERACTIVE);
+    int read(uint8_t* data, size_t len);
+
+    // Zero-copy input. peek() hands out everything received so far as up to
+    // two spans that stay valid until consume() releases them.
+    size_t peek(HCPRingBuffer::Span spans[2]);
+    void consume(size_t len);
+
+    // Zero-copy output. Reserve up to len bytes, fill the spans in order and
+    // commit what was used to the same class. Nothing is sent before
+    // commitWrite().
+    size_t reserveWrite(HCPRingBuffer::Span spans[2], size_t len, Priority priority = PRIORITY_INTERACTIVE);
+    void commitWrite(size_t len, Priority priority = PRIORITY_INTERACTIVE);
+
+    // When the byte at the given offset into peek() was received. Lets
+    // callers time a frame by when it arrived rather than when they got
+    // around to decoding it.
+    std::chrono::steady_clock::time_point getReceiveTime(size_t offset);
+
+    // Periodic output produced on the I/O side, for traffic that should go
+    // out at a fixed rate whatever the UI is doing. Every period the task may
+    // fill dst with one complete frame and return its length. The frame is
+    // written at the next frame boundary, ahead of anything queued below
+    // PRIORITY_CONTROL, and the task is skipped until it is out. In polled
+    // mode the task runs from poll(). Must be set before begin().
+    using OutputTask = std::function<size_t(uint8_t* dst, size_t len)>;
+    void setOutputTask(std::chrono::microseconds period, OutputTask task);
+
+    // Services the transport from the calling thread, reopening it when due.
+    // Does nothing in threaded or reactor mode.
+    void poll();
+    // Returns true if the output buffer was flushed
+    bool flushOuput();
+protected:
+    static HCPLogger s_logger;
+
+    HCPTransport(const char* address);
+
+    char m_address[128];
+
+    // Single producer/single consumer. In threaded mode the I/O thread
+    // produces into m_readBuffer and consumes m_writeBuffers.
+    HCPRingBuffer m_readBuffer;
+    HCPRingBuffer m_writeBuffers[PRIORITY_COUNT];
+
+    std::atomic<bool> m_open;
+    HCPTransportReactor* m_reactor;
+    std::atomic<bool> m_ioWakePending;
+
+    std::atomic<uint64_t> m_bytesReceived;
+    std::atomic<uint32_t> m_inputStalls;
+
+    // Raised by the device code from the I/O side
+    std::atomic<uint32_t> m_lineOverruns;
+    std::atomic<uint32_t> m_lineParityErrors;
+    std::atomic<uint32_t> m_lineFramingErrors;
+    std::atomic<uint32_t> m_lineBreaks;
+
+    bool m_inputStalled; // I/O side, the input ring is full and the device is left unread
+    // I/O side, set by the device code while output waits for the device's
+    // own queue to drain below its limit. Serviced every millisecond then,
+    // like a stalled input.
+    bool m_outputThrottled;
+
+    // Used by the device code to pick what to write next, in place of
+    // peeking and consuming m_writeBuffers directly
+    bool hasOutput() const;
+    size_t peekOutput(HCPRingBuffer::Span spans[2]);
+    void consumeOutput(size_t len);
+    void commitReceived(size_t len);
+    // Shortens spans from peekOutput() to at most maxLen bytes in total
+    static size_t limitSpans(HCPRingBuffer::Span spans[2], size_t maxLen);
+
+    // Device hooks, all called from the I/O side
+    virtual bool impl_open() = 0;
+    virtual void impl_close() = 0;
+    // Moves bytes between the device and the rings, waiting up to timeoutMs
+    // for it to become ready. Returns false if the device has failed.
+    virtual bool IMPL_FUNC impl_service(int timeoutMs);
+    // The part of impl_service() after the wait, given the readiness flags
+    // the wait reported. The reactor calls this for devices it polls itself.
+    virtual bool impl_handleEvents(uint32_t events) = 0;
+    // Registers the watched handle with a reactor's poll handle
+    virtual bool IMPL_FUNC impl_attach(intptr_t pollHandle);
+    virtual bool impl_flush() = 0;
+    virtual void IMPL_FUNC impl_wake();
+    // Transports with nothing a reactor could wait on get an I/O thread of
+    // their own in reactor mode
+    virtual bool impl_isPollable() const;
+    // Where the device shows up again after it is lost, see HCPHotplugWatch.
+    // Null if there is nothing to watch.
+    virtual const char* impl_getHotplugPath() const;
+
+    // For impl_open() and impl_close() of devices with a pollable handle,
+    // a file descriptor on Linux. Watches it for input, and for output while
+    // impl_watchOutput() is on.
+    bool IMPL_FUNC impl_watch(intptr_t handle);
+    void IMPL_FUNC impl_unwatch();
+    bool IMPL_FUNC impl_watchInput(bool watch);
+    bool IMPL_FUNC impl_watchOutput(bool watch);
+    // Watches for input again once a stalled consumer has made room
+    bool resumeInput();
+private:
+    static constexpr std::chrono::milliseconds RETRY_DELAY_MIN = std::chrono::milliseconds(250);
+    static constexpr std::chrono::milliseconds RETRY_DELAY_MAX = std::chrono::seconds(8);
+
+    friend class HCPTransportReactor;
+
+    // Arrival times of recent reads, produced alongside m_readBuffer. A stamp
+    // covers every byte received before its end. When the stamps are full the
+    // next one covers the skipped reads too, so times only ever err late.
+    struct ReceiveStamp
+    {
+        uint64_t end;
+        std::chrono::steady_clock::rep time;
+    };
+
+    static const size_t READ_BUFFER_SIZE = 1 << 18; // ~850 ms at 3 Mbaud
+    static const size_t WRITE_BUFFER_SIZES[PRIORITY_COUNT];
+
+    static const size_t RECEIVE_STAMP_COUNT = 64;
+    ReceiveStamp m_receiveStamps[RECEIVE_STAMP_COUNT];
+    std::atomic<size_t> m_stampHead;
+    std::atomic<size_t> m_stampTail;
+    std::atomic<std::chrono::steady_clock::rep> m_lastReceive;
+    uint64_t m_received; // producer side
+    uint64_t m_consumed; // consumer side
+
+    std::atomic<bool> m_reconnecting;
+
+    // I/O side while reconnecting
+    HCPHotplugWatch m_hotplug;
+    std::chrono::steady_clock::time_point m_retryAt;
+    std::chrono::steady_clock::duration m_retryDelay;
+
+    bool m_threaded;
+    std::thread m_ioThread;
+    std::atomic<bool> m_ioRunning;
+
+    std::atomic<uint64_t> m_bytesSent;
+    std::atomic<uint64_t> m_framesReceived;
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<size_t> m_inputMaxQueued; // producer side
+    std::atomic<uint64_t> m_laneBytesSent[PRIORITY_COUNT];
+    std::atomic<size_t> m_laneMaxQueued[PRIORITY_COUNT]; // producer side
+    std::atomic<uint32_t> m_failures;
+    std::atomic<uint32_t> m_reconnects;
+
+    // Only used from the I/O side while the transport is open
+    std::unique_ptr<HCPCaptureWriter> m_capture;
+
+    // I/O side only
+    static const size_t OUTPUT_TASK_BUFFER_SIZE = 256;
+    OutputTask m_outputTask;
+    std::chrono::steady_clock::duration m_outputTaskPeriod;
+    std::chrono::steady_clock::time_point m_nextOutputTask;
+    uint8_t m_taskOutput[OUTPUT_TASK_BUFFER_SIZE];
+    size_t m_taskOutputLen;
+    size_t m_taskOutputSent;
+    static const int OUTPUT_TASK = PRIORITY_COUNT;
+    static const int OUTPUT_DELIMITER = PRIORITY_COUNT + 1; // ends a frame its source left open
+    static uint8_t s_delimiter;
+    int m_outputSource;      // the lane, OUTPUT_TASK or OUTPUT_DELIMITER the last bytes written came from
+    bool m_outputAtBoundary; // the last byte written ended a frame
+
+    void ioLoop();
+    void wakeIO();
+    // The device failed, closes it and starts reconnecting
+    void fail();
+    void startReconnecting();
+    // Reopens the device if the retry is due or it has reappeared. The
+    // caller finishes with reconnected() once it is ready for I/O.
+    bool retry();
+    void retryLater();
+    void reconnected();
+    int getRetryTimeout(int timeoutMs) const;
+    void dropPartialFrame();
+    bool runOutputTask();
+    int getOutputTaskTimeout(int timeoutMs) const;
+    void releaseStamps(size_t len);
+    bool hasQueuedOutput() const;
+    void noteQueued(Priority priority);
+
+    void* m_ioImpl; // platform specific implementation struct for the watched handle
+    void IMPL_FUNC impl_initIO();
+    void IMPL_FUNC impl_destroyIO();
+    // Registers the hotplug watch with a reactor's poll handle
+    bool IMPL_FUNC impl_watchHotplug(intptr_t pollHandle);
+    // Waits while reconnecting, for the hotplug watch, a wake or the timeout
+    void IMPL_FUNC impl_waitRetry(int timeoutMs);
+};
+
+#endif // HCP_TRANSPORT_HPP
@@ -0,0 +1,83 @@
+#ifndef HCP_TRANSPORT_REACTOR_HPP
+#define HCP_TRANSPORT_REACTOR_HPP
+
+#include "hcp/Transport.hpp"
+#include "hcp/Histogram.hpp"
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Services any number of transports from a single background thread, one
+// per rack controller would not scale. Transports join with
+// HCPTransport::setReactor() before begin() and leave on close(). One that
+// fails, or could not be opened in the first place, is retried with backoff
+// until it is closed, see HCPTransport.
+class HCPTransportReactor
+{
+public:
+    HCPTransportReactor();
+    HCPTransportReactor(const HCPTransportReactor&) = delete;
+    HCPTransportReactor& operator=(const HCPTransportReactor&) = delete;
+
+    // Transports should be closed first, any left are closed and detached
+    ~HCPTransportReactor();
+
+    size_t getTransportCount() const;
+
+    // Time from the wait returning to a ready transport having been serviced, in
+    // microseconds. One sample per ready transport.
+    const HCPHistogram& getDispatchLatency() const;
+    // CPU time the reactor thread has used so far
+    std::chrono::microseconds getCpuTime() const;
+private:
+    friend class HCPTransport;
+
+    static HCPLogger s_logger;
+
+    static const int MAX_READY = 64;
+
+    struct Ready
+    {
+        HCPTransport* transport;
+        uint32_t events;
+    };
+
+    // Held while transports are serviced, so one is never touched after remove()
+    mutable std::mutex m_lock;
+    std::vector<HCPTransport*> m_transports;
+    std::atomic<uint32_t> m_version; // bumped whenever a transport leaves
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_wakePending;
+    bool m_pollAll; // the platform can't wait on handles, service everything every round
+
+    HCPHistogram m_dispatchLatency;
+    std::atomic<int64_t> m_cpuTime;
+
+    // From HCPTransport
+    void add(HCPTransport* transport);
+    void remove(HCPTransport* transport);
+    void wake();
+
+    void loop();
+    bool attach(HCPTransport* transport);
+    void service(HCPTransport* transport, uint32_t events);
+    void reconnect(HCPTransport* transport);
+
+    void* m_impl; // platform specific implementation struct
+    void IMPL_FUNC impl_init();
+    void IMPL_FUNC impl_destroy();
+    intptr_t IMPL_FUNC impl_getPollHandle() const;
+    // Waits up to timeoutMs and fills ready with the transports that can be
+    // serviced. Sets woken if wake() was called.
+    int IMPL_FUNC impl_wait(int timeoutMs, Ready* ready, int maxReady, bool* woken);
+    void IMPL_FUNC impl_wake();
+    int64_t IMPL_FUNC impl_threadCpuTime() const; // microseconds
+};
+
+#endif // HCP_TRANSPORT_REACTOR_HPP
@@ -0,0 +1,575 @@
+#include "Chart.hpp"
+
+#include "UIRender.hpp"
+#include "Shaders.hpp"
+#include "MeshBuilder.hpp"
+#include "Viewport.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#define getVec4Color(intcolor) glm::vec4(((intcolor >> 16) & 0xFF) / 255.0f, ((intcolor >> 8) & 0xFF) / 255.0f, (intcolor & 0xFF) / 255.0f, ((intcolor >> 24) & 0xFF) / 255.0f)
+
+static const float edgeSize = 5.0f;
+static const float textSize = 14.0f;
+static const float axisWidth = 64.0f;
+static const int64_t minSpan = 1000000;              // a second
+static const int64_t maxSpan = 91LL * 86400 * 1000000; // a season of the archive
+
+// The UI batch's vertex format, so the ring draws with the UI shader
+struct ChartVertex
+{
+    float x, y, z;
+    float u, v;
+    float r, g, b, a;
+    uint32_t texID;
+};
+
+// Four per column: its min to max, then a line from the previous column's
+// mean to its own so the trace stays joined where the envelope is thin
+static const size_t columnVertices = 4;
+
+// Fewer decimals the bigger it gets, a lux reading needs none
+static void i_formatValue(char* dst, size_t dstLen, float value)
+{
+    float magnitude = std::fabs(value);
+    snprintf(dst, dstLen, magnitude < 10.0f ? "%.2f" : magnitude < 100.0f ? "%.1f" : "%.0f", value);
+}
+
+// Seconds, minutes, hours or days, whichever reads best
+static void i_formatTime(char* dst, size_t dstLen, double micros)
+{
+    double seconds = micros / 1e6;
+    double magnitude = std::fabs(seconds);
+
+    if(magnitude < 120.0) snprintf(dst, dstLen, "%.1f s", seconds);
+    else if(magnitude < 7200.0) snprintf(dst, dstLen, "%.1f min", seconds / 60.0);
+    else if(magnitude < 172800.0) snprintf(dst, dstLen, "%.1f h", seconds / 3600.0);
+    else snprintf(dst, dstLen, "%.1f d", seconds / 86400.0);
+}
+
+static int64_t i_floorDiv(int64_t value, int64_t divisor)
+{
+    int64_t quotient = value / divisor;
+    return quotient * divisor <= value ? quotient : quotient - 1;
+}
+
+HCPChart::HCPChart() :
+    m_focus(0),
+    m_archive(nullptr),
+    m_offset(0),
+    m_archiveEnd(0),
+    m_span(60 * 1000000LL),
+    m_end(0),
+    m_live(true),
+    m_columnTime(0),
+    m_ringColumns(0),
+    m_ringFirst(0),
+    m_ringEnd(0),
+    m_unsettled(0),
+    m_glVAO(0),
+    m_glVBO(0),
+    m_glColumns(0)
+{
+    m_liveButton.setText("§2Live");
+}
+
+HCPChart::~HCPChart()
+{
+    if(m_glVBO)
+    {
+        glDeleteVertexArrays(1, &m_glVAO);
+        glDeleteBuffers(1, &m_glVBO);
+    }
+}
+
+size_t HCPChart::addSeries(const char* name, const char* unit, uint32_t color)
+{
+    Series series;
+    series.name = name;
+    series.unit = unit;
+    series.color = color;
+    series.channel = nullptr;
+    series.archiveChannel = -1;
+    series.fixedRange = false;
+    series.low = 0.0f;
+    series.high = 1.0f;
+    series.hasThresholds = false;
+    series.thresholdLow = series.thresholdHigh = 0.0f;
+
+    m_series.push_back(series);
+    dropColumns();
+    return m_series.size() - 1;
+}
+
+void HCPChart::clearSeries()
+{
+    m_series.clear();
+    m_focus = 0;
+    dropColumns();
+}
+
+void HCPChart::setChannel(size_t series, const HCPTelemetryChannel* channel)
+{
+    if(m_series[series].channel == channel) return;
+
+    m_series[series].channel = channel;
+    dropColumns();
+}
+
+void HCPChart::setRange(size_t series, float low, float high)
+{
+    m_series[series].fixedRange = true;
+    m_series[series].low = low;
+    m_series[series].high = high;
+}
+
+void HCPChart::setThresholds(size_t series, float low, float high)
+{
+    m_series[series].hasThresholds = true;
+    m_series[series].thresholdLow = low;
+    m_series[series].thresholdHigh = high;
+}
+
+void HCPChart::setArchive(const HCPTelemetryArchive* archive, int64_t offset)
+{
+    if(m_archive == archive && m_offset == offset) return;
+
+    m_archive = archive;
+    m_offset = offset;
+    dropColumns();
+}
+
+void HCPChart::setArchiveChannel(size_t series, uint8_t channel)
+{
+    m_series[series].archiveChannel = channel;
+    dropColumns();
+}
+
+void HCPChart::setSpan(double seconds)
+{
+    m_span = std::max(minSpan, std::min((int64_t) (seconds * 1e6), maxSpan));
+}
+
+void HCPChart::setLive()
+{
+    m_live = true;
+    m_liveButton.setText("§2Live");
+}
+
+void HCPChart::doDraw()
+{
+    HCPViewport body;
+    body.width = width;
+    body.height = height;
+    body.x = x;
+    body.y = y;
+
+    body.start(false);
+    {
+        hcpui::genQuad(0, 0, body.width, body.height, 0x22000000);
+
+        float headerHeight = textSize + edgeSize * 2;
+        hcpui::genQuad(0, 0, body.width, headerHeight, 0x11000000);
+        hcpui::genString(HCPAlignment::TOP_LEFT, getStyledText(), edgeSize, edgeSize, textSize, 0xFFFFFFFF);
+
+        m_liveButton.height = textSize + edgeSize;
+        m_liveButton.width = m_liveButton.height * 4;
+        m_liveButton.x = body.width - m_liveButton.width - edgeSize;
+        m_liveButton.y = (headerHeight - m_liveButton.height) / 2;
+        m_liveButton.draw();
+        if(m_liveButton.isPressed()) setLive();
+
+        HCPViewport& plot = m_plot;
+        plot.x = axisWidth;
+        plot.y = headerHeight + edgeSize;
+        plot.width = std::max(1.0f, body.width - axisWidth - edgeSize);
+        plot.height = std::max(1.0f, body.height - plot.y - textSize - edgeSize * 2);
+
+        int64_t newest = INT64_MIN;
+        for(const Series& series : m_series)
+        {
+            int64_t timestamp;
+            float value;
+            if(series.channel && series.channel->getLatest(&timestamp, &value)) newest = std::max(newest, timestamp + m_offset);
+        }
+
+        // Not connected yet, the history can still be looked at
+        if(newest == INT64_MIN && m_archive && m_archive->getChunkCount()) newest = m_archive->getEndTime();
+
+        if(newest == INT64_MIN)
+        {
+            hcpui::genString(HCPAlignment::CENTER, "No samples yet", plot.x + plot.width / 2, plot.y + plot.height / 2, textSize, 0xFFAAAAAA);
+            drawLegend(headerHeight, -1);
+            body.end();
+            return;
+        }
+
+        plot.start(true);
+        handleInput(newest);
+
+        // A column per pixel. The columns stay put while the view pans, only
+        // a zoom or resize lays them out again.
+        size_t columns = std::max((size_t) 1, (size_t) (plot.width * hcpui::getUIScale()));
+        int64_t columnTime = std::max((int64_t) 1, m_span / (int64_t) columns);
+        size_t ringColumns = 1;
+        while(ringColumns < (size_t) (m_span / columnTime) + 2) ringColumns <<= 1;
+
+        if(columnTime != m_columnTime || ringColumns != m_ringColumns || m_columns.size() != m_series.size() * ringColumns)
+        {
+            m_columnTime = columnTime;
+            m_ringColumns = ringColumns;
+            m_columns.assign(m_series.size() * ringColumns, HCPTelemetryChannel::Summary());
+            dropColumns();
+        }
+
+        int64_t right = m_live ? newest + 1 : m_end;
+        int64_t left = right - m_span;
+        int64_t first = std::max((int64_t) 0, i_floorDiv(left, m_columnTime));
+        int64_t end = std::max(first, i_floorDiv(right - 1, m_columnTime) + 1);
+
+        // The channels of a store share the device clock, so no sample will
+        // land before the newest one of any series
+        int64_t unsettled = i_floorDiv(newest, m_columnTime);
+
+        // A chunk written since may fill in what the channel has lapped
+        int64_t archiveEnd = m_archive ? m_archive->getEndTime() : 0;
+        if(archiveEnd != m_archiveEnd) m_unsettled = std::min(m_unsettled, i_floorDiv(m_archiveEnd, m_columnTime));
+        m_archiveEnd = archiveEnd;
+        if(m_ringEnd <= first || end <= m_ringFirst)
+        {
+            m_ringFirst = first;
+            m_ringEnd = end;
+            fetchColumns(first, end);
+        }
+        else
+        {
+            if(first < m_ringFirst)
+            {
+                fetchColumns(first, m_ringFirst);
+                m_ringFirst = first;
+                m_ringEnd = std::min(m_ringEnd, first + (int64_t) m_ringColumns);
+            }
+            if(m_ringEnd < end)
+            {
+                fetchColumns(m_ringEnd, end);
+                m_ringEnd = end;
+                m_ringFirst = std::max(m_ringFirst, end - (int64_t) m_ringColumns);
+            }
+
+            if(m_unsettled < m_ringEnd) fetchColumns(std::max(m_unsettled, m_ringFirst), m_ringEnd);
+        }
+        m_unsettled = unsettled;
+
+        fitRanges(first, end);
+
+        // Grid and the focused series' axis and threshold band
+        for(int i = 0; i <= 4; i++)
+            hcpui::genHorizontalLine(plot.height * i / 4.0f, 0, plot.width, 0x11FFFFFF);
+
+        if(m_focus < m_series.size())
+        {
+            const Series& series = m_series[m_focus];
+            float scale = plot.height / (series.high - series.low);
+
+            if(series.hasThresholds)
+            {
+                float top = plot.height - (series.thresholdHigh - series.low) * scale;
+                float bottom = plot.height - (series.thresholdLow - series.low) * scale;
+                uint32_t rgb = series.color & 0x00FFFFFF;
+                hcpui::genQuad(0, top, plot.width, bottom, 0x18000000 | rgb);
+                hcpui::genHorizontalLine(top, 0, plot.width, 0x66000000 | rgb);
+                hcpui::genHorizontalLine(bottom + 1, 0, plot.width, 0x66000000 | rgb);
+            }
+        }
+
+        hcpui::renderBatch();
+
+        double leftColumn = (double) left / m_columnTime;
+        for(size_t i = 0; i < m_series.size(); i++)
+            if(m_series[i].channel || (m_archive && 0 <= m_series[i].archiveChannel)) drawSeries(i, first, end, leftColumn);
+
+        hcps::setColor(1.0f, 1.0f, 1.0f, 1.0f);
+        hcpui::setupUIRendering();
+
+        int64_t cursorColumn = -1;
+        float cursorX = plot.localCursorX();
+        if(plot.isHovered())
+        {
+            cursorColumn = (int64_t) std::floor(leftColumn + cursorX / plot.width * ((double) m_span / m_columnTime));
+            hcpui::genVerticalLine(cursorX, 0, plot.height, 0x66FFFFFF);
+        }
+        plot.end();
+
+        if(m_focus < m_series.size())
+        {
+            const Series& series = m_series[m_focus];
+            for(int i = 0; i <= 4; i++)
+            {
+                char label[32];
+                i_formatValue(label, sizeof(label), series.low + (series.high - series.low) * i / 4.0f);
+                hcpui::genString(HCPAlignment::CENTER_RIGHT, label, plot.x - edgeSize, plot.y + plot.height * (1.0f - i / 4.0f), textSize, series.color);
+            }
+        }
+
+        char time[32];
+        float timeY = plot.y + plot.height + edgeSize;
+        i_formatTime(time, sizeof(time), (double) (left - newest));
+        hcpui::genString(HCPAlignment::TOP_LEFT, time, plot.x, timeY, textSize, 0xFFAAAAAA);
+        if(m_live) hcpui::genString(HCPAlignment::TOP_RIGHT, "now", plot.x + plot.width, timeY, textSize, 0xFFAAAAAA);
+        else
+        {
+            i_formatTime(time, sizeof(time), (double) (right - newest));
+            hcpui::genString(HCPAlignment::TOP_RIGHT, time, plot.x + plot.width, timeY, textSize, 0xFFAAAAAA);
+        }
+
+        // Under the crosshair, over the edge labels
+        if(0 <= cursorColumn)
+        {
+            i_formatTime(time, sizeof(time), (double) (cursorColumn * m_columnTime - newest));
+            float timeWidth = hcpui::getStringwidth(time, textSize) + edgeSize * 2;
+            float timeX = std::max(plot.x, std::min(plot.x + cursorX - timeWidth / 2, plot.x + plot.width - timeWidth));
+            hcpui::genQuad(timeX, timeY - edgeSize, timeX + timeWidth, timeY + textSize + edgeSize, 0xFF222222);
+            hcpui::genString(time, timeX + edgeSize, timeY, textSize, 0xFFFFFFFF);
+        }
+
+        drawLegend(headerHeight, cursorColumn);
+    }
+    body.end();
+}
+
+// Scrolling zooms around the cursor, dragging pans. Panning up to the newest
+// sample goes live again.
+void HCPChart::handleInput(int64_t newest)
+{
+    const HCPViewport& plot = m_plot;
+    HCPInputContext* input = hcpi::get();
+    int64_t right = m_live ? newest + 1 : m_end;
+
+    if(plot.isHovered() && input->justScrolled())
+    {
+        int64_t span = (int64_t) (m_span * std::pow(0.8, input->scrollDeltaY()));
+        span = std::max(minSpan, std::min(span, maxSpan));
+
+        // The time under the cursor stays there, live views keep their right edge
+        if(!m_live)
+        {
+            double cursor = std::max(0.0f, std::min(plot.localCursorX() / plot.width, 1.0f));
+            int64_t anchor = right - m_span + (int64_t) (cursor * m_span);
+            m_end = anchor + (int64_t) ((1.0 - cursor) * span);
+        }
+        m_span = span;
+    }
+
+    float dragged = input->cursorDeltaX() / hcpui::getUIScale();
+    if(plot.isHeld() && dragged != 0.0f)
+    {
+        if(m_live)
+        {
+            m_live = false;
+            m_liveButton.setText("§7Paused");
+        }
+        m_end = right - (int64_t) (dragged / plot.width * m_span);
+    }
+
+    if(!m_live && newest < m_end) setLive();
+}
+
+// Summarises columns [first, end) of every series into the ring
+void HCPChart::fetchColumns(int64_t first, int64_t end)
+{
+    if(end <= first) return;
+
+    size_t count = (size_t) (end - first);
+    m_fetched.resize(count + 1);
+
+    // Only the written chunks, the rest is still in the channels
+    int64_t archived = m_archive && m_archive->getChunkCount() ? i_floorDiv(m_archive->getEndTime(), m_columnTime) + 1 : INT64_MIN;
+
+    for(size_t i = 0; i < m_series.size(); i++)
+    {
+        // With the column before, for the line into the first one
+        const Series& series = m_series[i];
+        if(series.channel) series.channel->summarize((first - 1) * m_columnTime - m_offset, end * m_columnTime - m_offset, m_fetched.data(), count + 1);
+        else std::fill(m_fetched.begin(), m_fetched.end(), HCPTelemetryChannel::Summary());
+
+        // The archive fills in the columns the channel has nothing for
+        if(0 <= series.archiveChannel && first - 1 < archived)
+        {
+            size_t archivedCount = (size_t) (std::min(end, archived) - (first - 1));
+            m_archived.resize(archivedCount);
+            m_archive->summarize((uint8_t) series.archiveChannel, (first - 1) * m_columnTime, (first - 1 + (int64_t) archivedCount) * m_columnTime,
+                m_archived.data(), archivedCount);
+
+            for(size_t column = 0; column < archivedCount; column++)
+                if(!m_fetched[column].count) m_fetched[column] = m_archived[column];
+        }
+
+        HCPTelemetryChannel::Summary* columns = m_columns.data() + i * m_ringColumns;
+        for(size_t column = 0; column < count; column++)
+            columns[(first + column) % m_ringColumns] = m_fetched[column + 1];
+
+        uploadColumns(i, first, end);
+    }
+}
+
+// Writes the vertices of columns [first, end) of a series, fetched into
+// m_fetched, to their slots in the GPU ring
+void HCPChart::uploadColumns(size_t series, int64_t first, int64_t end)
+{
+    const size_t vertexBytes = columnVertices * sizeof(ChartVertex);
+
+    if(!m_glVBO)
+    {
+        glGenVertexArrays(1, &m_glVAO);
+        glGenBuffers(1, &m_glVBO);
+
+        glBindVertexArray(m_glVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+        hcpui::getVertexFormat().apply();
+        glBindVertexArray(0);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+
+    // Everything in it is stale once the ring is laid out differently
+    if(m_glColumns != m_columns.size())
+    {
+        glBufferData(GL_ARRAY_BUFFER, m_columns.size() * vertexBytes, nullptr, GL_DYNAMIC_DRAW);
+        m_glColumns = m_columns.size();
+    }
+
+    size_t count = (size_t) (end - first);
+    m_vertices.resize(count * vertexBytes);
+    ChartVertex* vertices = (ChartVertex*) m_vertices.data();
+
+    for(size_t i = 0; i < count; i++)
+    {
+        const HCPTelemetryChannel::Summary& previous = m_fetched[i];
+        const HCPTelemetryChannel::Summary& column = m_fetched[i + 1];
+        float slot = (float) ((first + i) % m_ringColumns) + 0.5f;
+        float envelope = column.count ? 1.0f : 0.0f;
+        float joined = column.count && previous.count ? 1.0f : 0.0f;
+
+        ChartVertex* vertex = vertices + i * columnVertices;
+        vertex[0] = { slot,        column.min,    0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, envelope, 0 };
+        vertex[1] = { slot,        column.max,    0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, envelope, 0 };
+        vertex[2] = { slot - 1.0f, previous.mean, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, joined,   0 };
+        vertex[3] = { slot,        column.mean,   0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, joined,   0 };
+    }
+
+    // At most two runs of slots, split where the ring wraps
+    for(size_t done = 0; done < count;)
+    {
+        size_t slot = (size_t) ((first + done) % m_ringColumns);
+        size_t run = std::min(count - done, m_ringColumns - slot);
+
+        glBufferSubData(GL_ARRAY_BUFFER, (series * m_ringColumns + slot) * vertexBytes, run * vertexBytes, m_vertices.data() + done * vertexBytes);
+        done += run;
+    }
+}
+
+void HCPChart::drawSeries(size_t series, int64_t first, int64_t end, double leftColumn)
+{
+    const Series& target = m_series[series];
+    float plotWidth = m_plot.width;
+    float plotHeight = m_plot.height;
+    float columnWidth = (float) (plotWidth / ((double) m_span / m_columnTime));
+    float scale = plotHeight / (target.high - target.low);
+
+    hcps::setColor(getVec4Color(target.color));
+
+    glBindVertexArray(m_glVAO);
+
+    // Slot x of the ring lap starting at column base is drawn at base + x
+    for(int64_t column = first; column < end;)
+    {
+        int64_t base = column - column % (int64_t) m_ringColumns;
+        size_t slot = (size_t) (column - base);
+        size_t run = (size_t) std::min(end - column, (int64_t) m_ringColumns - (int64_t) slot);
+
+        glm::mat4 modelView = hcpui::getModelViewMatrix();
+        modelView = glm::translate(modelView, glm::vec3((float) ((base - leftColumn) * columnWidth), plotHeight + target.low * scale, 0.0f));
+        modelView = glm::scale(modelView, glm::vec3(columnWidth, -scale, 1.0f));
+        hcps::setModelViewMatrix(modelView);
+        hcps::UI();
+
+        glDrawArrays(GL_LINES, (GLint) ((series * m_ringColumns + slot) * columnVertices), (GLsizei) (run * columnVertices));
+        column += run;
+    }
+
+    glBindVertexArray(0);
+}
+
+// Each series' name and value, under the crosshair or else the newest.
+// Clicking one focuses it.
+void HCPChart::drawLegend(float headerHeight, int64_t cursorColumn)
+{
+    float entryX = edgeSize + hcpui::getStringwidth(getStyledText(), textSize) + textSize;
+
+    for(size_t i = 0; i < m_series.size(); i++)
+    {
+        const Series& series = m_series[i];
+        char value[32] = "-";
+        int64_t timestamp;
+        float latest;
+
+        if(0 <= cursorColumn && m_ringFirst <= cursorColumn && cursorColumn < m_ringEnd && getColumn(i, cursorColumn).count)
+            i_formatValue(value, sizeof(value), getColumn(i, cursorColumn).mean);
+        else if(cursorColumn < 0 && series.channel && series.channel->getLatest(&timestamp, &latest))
+            i_formatValue(value, sizeof(value), latest);
+
+        char entry[96];
+        snprintf(entry, sizeof(entry), "%s %s %s", series.name.c_str(), value, series.unit.c_str());
+
+        float entryWidth = hcpui::getStringwidth(entry, textSize);
+        hcpui::genString(entry, entryX, edgeSize, textSize, series.color);
+        if(i == m_focus) hcpui::genHorizontalLine(headerHeight - 2, entryX, entryX + entryWidth, series.color, 2.0f);
+
+        bool clicked = isPressed() && entryX <= localCursorX() && localCursorX() < entryX + entryWidth && localCursorY() < headerHeight;
+        if(clicked) m_focus = i;
+
+        entryX += entryWidth + textSize;
+    }
+}
+
+// Series without a fixed range span the columns in view
+void HCPChart::fitRanges(int64_t first, int64_t end)
+{
+    first = std::max(first, m_ringFirst);
+    end = std::min(end, m_ringEnd);
+
+    for(size_t i = 0; i < m_series.size(); i++)
+    {
+        Series& series = m_series[i];
+        if(series.fixedRange) continue;
+
+        float low = INFINITY, high = -INFINITY;
+        for(int64_t column = first; column < end; column++)
+        {
+            const HCPTelemetryChannel::Summary& summary = getColumn(i, column);
+            if(!summary.count) continue;
+
+            low = std::min(low, summary.min);
+            high = std::max(high, summary.max);
+        }
+        if(high < low) continue;
+
+        float padding = std::max((high - low) * 0.05f, std::max(std::fabs(high) * 0.01f, 1e-3f));
+        series.low = low - padding;
+        series.high = high + padding;
+    }
+}
+
+const HCPTelemetryChannel::Summary& HCPChart::getColumn(size_t series, int64_t column) const
+{
+    return m_columns[series * m_ringColumns + column % m_ringColumns];
+}
+
+void HCPChart::dropColumns()
+{
+    m_ringFirst = m_ringEnd = 0;
+    m_unsettled = 0;
+}
@@ -98,9 +98,7 @@ float HCPFontRenderer::getStringWidth(const char* str, size_t strLen) const
         }
         else
         {
-            Glyph glyph = m_font.glyphs[unicode];
-
-            cursor += glyph.xAdvance - m_font.leftPadding - m_font.rightPadding;
+            cursor += getAdvance(unicode);
         }
 
         i += bytesRead;
@@ -109,6 +107,11 @@ float HCPFontRenderer::getStringWidth(const char* str, size_t strLen) const
     return cursor * m_scale;
 }
 
+float HCPFontRenderer::getStringWidth(const HCPStyledText& text) const
+{
+    return text.width * m_scale;
+}
+
 float HCPFontRenderer::getStringHeight() const
 {
     return m_textSize;
@@ -153,85 +156,101 @@ void HCPFontRenderer::genString(HCPMeshBuilder& meshBuilder, const char* text, f
 
 void HCPFontRenderer::genString(HCPMeshBuilder& meshBuilder, const char* str, size_t strLen, float x, float y, const glm::vec4& color)
 {
-    glm::vec2 anch = anchor(str, strLen, x, y);
+    parse(m_parsed, str, strLen);
+    genString(meshBuilder, m_parsed, x, y, color);
+}
+
+void HCPFontRenderer::genString(HCPMeshBuilder& meshBuilder, const HCPStyledText& text, float x, float y, const glm::vec4& color)
+{
+    glm::vec2 anch = anchor(getStringWidth(text), x, y);
     x = anch.x;
     y = anch.y;
 
     float xCursor = x;
+    size_t run = 0;
 
-    bool bold = false;
-    bool strikethrough = false;
-    bool underline = false;
-    bool italic = false;
-    glm::vec4 charColor(1.0f);
+    for(size_t i = 0; i < text.codepoints.size(); i++)
+    {
+        while(run + 1 < text.runs.size() && text.runs[run + 1].start <= i) run++;
 
-    for(int i = 0; i < strLen;)
+        const HCPStyledText::Run& style = text.runs[run];
+        float advance = text.advances[i] * m_scale;
+        float italics = style.style & HCPStyledText::ITALIC ? m_textSize * 0.07f : 0;
+        glm::vec4 mixedColor = color * m_COLOR_CODES[style.color];
+
+        genChar(meshBuilder, (int) text.codepoints[i], xCursor, y, italics, style.style & HCPStyledText::BOLD, mixedColor);
+        if(style.style & HCPStyledText::STRIKETHROUGH)
+        {
+            genLine(meshBuilder, y + m_textSize / 2, xCursor, xCursor + advance, m_textSize * 0.09f, mixedColor);
+        }
+        if(style.style & HCPStyledText::UNDERLINE)
+        {
+            genLine(meshBuilder, y + m_textSize * 1.05f, xCursor, xCursor + advance, m_textSize * 0.09f, mixedColor);
+        }
+
+        xCursor += advance;
+    }
+}
+
+void HCPFontRenderer::parse(HCPStyledText& text, const char* str, size_t strLen) const
+{
+    text.clear();
+    text.runs.push_back({ 0, 15, 0 });
+
+    for(size_t i = 0; i < strLen;)
     {
         int bytesRead = 0;
         int unicode = getUnicodeFromUTF8((const uint8_t*) &str[i], &bytesRead);
 
         if(unicode == 167 && i + bytesRead < strLen)
         {
-            char key[] = { (char) tolower((int) str[i + bytesRead]), (char) 0 };
-            int formatKey = (int) (strstr(m_FORMATTING_KEYS, key) - m_FORMATTING_KEYS);
+            const char* key = strchr(m_FORMATTING_KEYS, tolower((uint8_t) str[i + bytesRead]));
+            int formatKey = key ? (int) (key - m_FORMATTING_KEYS) : -1;
+
+            HCPStyledText::Run run = text.runs.back();
+            run.start = (uint32_t) text.codepoints.size();
 
             if(formatKey < 16)
             {
-                if(formatKey < 0) formatKey = 15;
-
-                strikethrough = false;
-                underline = false;
-                italic = false;
-                bold = false;
-                charColor = m_COLOR_CODES[formatKey];
+                run.color = (uint8_t) (formatKey < 0 ? 15 : formatKey);
+                run.style = 0;
             }
             else
             {
                 switch(formatKey)
                 {
                 case 17:
-                    bold = true;
+                    run.style |= HCPStyledText::BOLD;
                     break;
                 case 18:
-                    strikethrough = true;
+                    run.style |= HCPStyledText::STRIKETHROUGH;
                     break;
                 case 19:
-                    underline = true;
+                    run.style |= HCPStyledText::UNDERLINE;
                     break;
                 case 20:
-                    italic = true;
+                    run.style |= HCPStyledText::ITALIC;
                     break;
                 case 21:
-                    bold = false;
-                    strikethrough = false;
-                    underline = false;
-                    italic = false;
-                    charColor = glm::vec4(1.0f);
+                    run.color = 15;
+                    run.style = 0;
                     break;
                 }
             }
 
+            // Codes in a row leave one run
+            if(text.runs.back().start == run.start) text.runs.back() = run;
+            else text.runs.push_back(run);
+
             i++;
         }
         else
         {
-            Glyph glyph = m_font.glyphs[unicode];
-
-            float advance = (glyph.xAdvance - m_font.leftPadding - m_font.rightPadding) * m_scale;
-            float italics = italic ? m_textSize * 0.07f : 0;
-            glm::vec4 mixedColor = color * charColor;
-
-            genChar(meshBuilder, unicode, xCursor, y, italics, bold, mixedColor);
-            if(strikethrough)
-            {
-                hcpui::genHorizontalLine(y + m_textSize / 2, xCursor, xCursor + advance, mixedColor, m_textSize * 0.09f);
-            }
-            if(underline)
-            {
-                hcpui::genHorizontalLine(y + m_textSize * 1.05f, xCursor, xCursor + advance, mixedColor, m_textSize * 0.09f);
-            }
+            int advance = getAdvance(unicode);
 
-            xCursor += advance;
+            text.codepoints.push_back((uint32_t) unicode);
+            text.advances.push_back((int16_t) advance);
+            text.width += advance;
         }
 
         i += bytesRead;
@@ -259,9 +278,7 @@ int HCPFontRenderer::charsToFit(const char* str, size_t strLen, float width) con
         }
         else
         {
-            Glyph glyph = m_font.glyphs[unicode];
-
-            float advance = (glyph.xAdvance - m_font.leftPadding - m_font.rightPadding) * m_scale;
+            float advance = getAdvance(unicode) * m_scale;
 
             if(xCursor + advance > width)
             {
@@ -332,9 +349,18 @@ int HCPFontRenderer::getUnicodeFromUTF8(const uint8_t* str, int* bytesRead) cons
     return unicode;
 }
 
+// Glyphs past the atlas aren't drawn and take no space
+int HCPFontRenderer::getAdvance(int unicode) const
+{
+    if(unicode < 0 || m_font.numGlyphs <= unicode) return 0;
+
+    const Glyph& glyph = m_font.glyphs[unicode];
+    return glyph.xAdvance - m_font.leftPadding - m_font.rightPadding;
+}
+
 void HCPFontRenderer::genChar(HCPMeshBuilder& meshBuilder, int unicode, float x, float y, float italics, bool bold, glm::vec4& color)
 {
-    if(256 <= unicode) // Cannot handle unicodes more than 256 at the moment
+    if(unicode < 0 || m_font.numGlyphs <= unicode) // Only the glyphs in the atlas
     {
         return;
     }
@@ -358,10 +384,19 @@ void HCPFontRenderer::genChar(HCPMeshBuilder& meshBuilder, int unicode, float x,
     meshBuilder.vertex(NULL, left  + italics, top   , 0.0f, glyph.uvLeft,  glyph.uvTop   , vec4Color(color), texUnit);
 }
 
-glm::vec2 HCPFontRenderer::anchor(const char* str, size_t strLen, float x, float y)
+// Same quad as hcpui::genHorizontalLine(), but into the builder the string goes to
+void HCPFontRenderer::genLine(HCPMeshBuilder& meshBuilder, float y, float left, float right, float width, glm::vec4& color)
+{
+    meshBuilder.index(6, 0, 1, 2, 0, 2, 3);
+    meshBuilder.vertex(NULL, left,  y,         0.0f, 0.0f, 0.0f, vec4Color(color), 0);
+    meshBuilder.vertex(NULL, right, y,         0.0f, 1.0f, 0.0f, vec4Color(color), 0);
+    meshBuilder.vertex(NULL, right, y - width, 0.0f, 1.0f, 1.0f, vec4Color(color), 0);
+    meshBuilder.vertex(NULL, left,  y - width, 0.0f, 0.0f, 1.0f, vec4Color(color), 0);
+}
+
+glm::vec2 HCPFontRenderer::anchor(float stringWidth, float x, float y)
 {
     glm::vec2 newPos;
-    float stringWidth = getStringWidth(str, strLen);
     float stringHeight = m_textSize;
 
     switch(m_anchor)
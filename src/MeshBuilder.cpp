@@ -327,6 +327,36 @@ HCPMeshBuilder& HCPMeshBuilder::indexv(size_t numIndicies, const uint32_t* indic
     return *this;
 }
 
+HCPMeshBuilder& HCPMeshBuilder::vertexv(size_t numVerticies, const void* verticies)
+{
+    const HCPVertexFormat& vtxFmt = getVertexFormat();
+    size_t vertexSize = vtxFmt.vertexNumBytes();
+
+    size_t posOffset = 0;
+    for(int i = 0; i < vtxFmt.size && vtxFmt.attributes[i].getUsage() != HCPVF_ATTRB_USAGE_POS; i++)
+    {
+        posOffset += vtxFmt.attributes[i].numBytes();
+    }
+
+    size_t start = m_vertexDataBuffer.size();
+    pushVertexData(numVerticies * vertexSize, verticies);
+
+    const glm::mat4& modelView = m_modelViewStack.top();
+    for(size_t i = 0; i < numVerticies; i++)
+    {
+        uint8_t* posInVertex = m_vertexDataBuffer.data() + start + i * vertexSize + posOffset;
+
+        glm::vec4 pos(0.0f, 0.0f, 0.0f, 1.0f);
+        memcpy(&pos, posInVertex, sizeof(glm::vec3));
+        pos = modelView * pos;
+        memcpy(posInVertex, &pos, sizeof(glm::vec3));
+    }
+
+    m_numVerticies += numVerticies;
+
+    return *this;
+}
+
 const HCPVertexFormat& HCPMeshBuilder::getVertexFormat() const
 {
     return m_vertexFormat;
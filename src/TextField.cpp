@@ -42,7 +42,7 @@ void HCPTextField::doDraw()
 
     if(m_focused && isHovered() && m_inputContext && m_inputContext->justScrolled())
     {
-        double maxScroll = hcpui::getStringwidth(getText(), m_textSize) + width * 0.6f;
+        double maxScroll = hcpui::getStringwidth(getStyledText(), m_textSize) + width * 0.6f;
         m_textScroll.grab(glm::min(0.0, glm::max(m_textScroll.grabbingTo() + m_inputContext->scrollDeltaY() * 40.0, maxScroll)));
     }
 
@@ -63,7 +63,7 @@ void HCPTextField::doDraw()
         float titleOffset = m_titlePosition.getValuef();
         float titleOpacity = m_titleOpacity.getValuef();
 
-        hcpui::genString(HCPAlignment::CENTER_LEFT, m_title, titleOffset, height / 2, m_textSize, glm::vec4(0.66, 0.66, 0.66, titleOpacity));
+        hcpui::genString(HCPAlignment::CENTER_LEFT, m_styledTitle, titleOffset, height / 2, m_textSize, glm::vec4(0.66, 0.66, 0.66, titleOpacity));
 
         hcpui::pushStack();
         {
@@ -88,7 +88,7 @@ void HCPTextField::doDraw()
             }
 
             int textColor = !isEnabled() ? -6250336 : isHovered() ? -70 : -2039584;
-            hcpui::genString(HCPAlignment::CENTER_LEFT, getText(), edgeSize, height / 2, m_textSize, textColor);
+            hcpui::genString(HCPAlignment::CENTER_LEFT, getStyledText(), edgeSize, height / 2, m_textSize, textColor);
         }
         hcpui::popStack();
     }
@@ -113,6 +113,7 @@ const char* HCPTextField::getTitle() const
 void HCPTextField::setTitle(const char* title)
 {
     strncpy_s(m_title, sizeof(m_title), title, sizeof(m_title) - 1);
+    hcpui::getFontRenderer()->parse(m_styledTitle, m_title, strlen(m_title));
 }
 
 void HCPTextField::setCursors(int cursorPos, int secondCursorPos)
@@ -138,7 +139,7 @@ void HCPTextField::setCursorAtEnd(bool autoScroll)
 
     if(autoScroll)
     {
-        double stringWidth = hcpui::getStringwidth(getText(), m_textSize);
+        double stringWidth = hcpui::getStringwidth(getStyledText(), m_textSize);
         double scroll = -(stringWidth - glm::min(stringWidth, width * 0.66));
         m_textScroll.grab(scroll);
     }
@@ -234,7 +235,7 @@ void HCPTextField::handleMouseInputs()
 
     float scroll = m_textScroll.getValuef();
     float cursorX = localCursorX() - edgeSize - scroll;
-    float stringWidth = hcpui::getStringwidth(getText(), m_textSize);
+    float stringWidth = hcpui::getStringwidth(getStyledText(), m_textSize);
 
     if(stringWidth < cursorX)
     {
@@ -326,7 +327,7 @@ void HCPTextField::positionTitle()
 
     if(textLen)
     {
-        m_titlePosition.grab(hcpui::getStringwidth(getText(), m_textSize) + edgeSize);
+        m_titlePosition.grab(hcpui::getStringwidth(getStyledText(), m_textSize) + edgeSize);
         m_titleOpacity.grab(0.0);
     }
     else
@@ -11,6 +11,8 @@
 
 // Batch Rendering
 static HCPMeshBuilder* i_batchMeshBuilder = nullptr;
+static HCPMeshBuilder* i_textMeshBuilder = nullptr; // scratch for buildText()
+static HCPStyledText i_parsedText;
 
 // Window bookkeeping
 static GLFWwindow* i_window = nullptr;
@@ -123,6 +125,13 @@ void hcpui::genString(const char* str, size_t strLen, float x, float y, float sc
     genString(HCPAlignment::TOP_LEFT, str, strLen, x, y, scale, colorVec);
 }
 
+void hcpui::genString(HCPAlignment alignment, const HCPStyledText& text, float x, float y, float scale, uint32_t color)
+{
+    glm::vec4 colorVec = getVec4Color(color);
+
+    genString(alignment, text, x, y, scale, colorVec);
+}
+
 void hcpui::genDisc(float x, float y, float radius, uint32_t color, int resolution, int texID)
 {
     glm::vec4 colorVec = getVec4Color(color);
@@ -201,6 +210,54 @@ void hcpui::genString(const char* str, size_t strLen, float x, float y, float sc
     i_fontRenderer.genString(*i_batchMeshBuilder, str, strLen, x, y, color);
 }
 
+void hcpui::genString(HCPAlignment alignment, const HCPStyledText& text, float x, float y, float scale, const glm::vec4& color)
+{
+    i_fontRenderer.setAnchor(alignment);
+    i_fontRenderer.setTextSize(scale);
+    i_fontRenderer.genString(*i_batchMeshBuilder, text, x, y, color);
+}
+
+void hcpui::genText(HCPAlignment alignment, const HCPTextMesh& mesh, float x, float y)
+{
+    switch(alignment)
+    {
+    case HCPAlignment::CENTER_LEFT:
+    case HCPAlignment::CENTER:
+    case HCPAlignment::CENTER_RIGHT:
+        y -= mesh.height / 2.0f;
+        break;
+    case HCPAlignment::BOTTOM_LEFT:
+    case HCPAlignment::BOTTOM_CENTER:
+    case HCPAlignment::BOTTOM_RIGHT:
+        y -= mesh.height;
+        break;
+    default:
+        break;
+    }
+
+    switch(alignment)
+    {
+    case HCPAlignment::TOP_CENTER:
+    case HCPAlignment::CENTER:
+    case HCPAlignment::BOTTOM_CENTER:
+        x -= mesh.width / 2.0f;
+        break;
+    case HCPAlignment::TOP_RIGHT:
+    case HCPAlignment::CENTER_RIGHT:
+    case HCPAlignment::BOTTOM_RIGHT:
+        x -= mesh.width;
+        break;
+    default:
+        break;
+    }
+
+    pushStack();
+    translate(x, y);
+    i_batchMeshBuilder->indexv(mesh.indices.size(), mesh.indices.data());
+    i_batchMeshBuilder->vertexv(mesh.numVertices, mesh.vertices.data());
+    popStack();
+}
+
 void hcpui::genDisc(float x, float y, float radius, const glm::vec4& color, int resolution, int texID)
 {
     if(resolution < 0) resolution = int(radius * 0.7f);
@@ -250,6 +307,35 @@ void hcpui::renderBatch()
     i_batchMeshBuilder->reset();
 }
 
+const HCPVertexFormat& hcpui::getVertexFormat()
+{
+    return i_batchMeshBuilder->getVertexFormat();
+}
+
+void hcpui::buildText(HCPTextMesh& mesh, const char* str, size_t strLen, float scale, uint32_t color)
+{
+    i_fontRenderer.parse(i_parsedText, str, strLen);
+    buildText(mesh, i_parsedText, scale, color);
+}
+
+void hcpui::buildText(HCPTextMesh& mesh, const HCPStyledText& text, float scale, uint32_t color)
+{
+    i_textMeshBuilder->reset();
+    i_fontRenderer.setAnchor(HCPAlignment::TOP_LEFT);
+    i_fontRenderer.setTextSize(scale);
+    i_fontRenderer.genString(*i_textMeshBuilder, text, 0.0f, 0.0f, getVec4Color(color));
+
+    size_t vertexBytes, indexBytes;
+    const uint8_t* vertices = i_textMeshBuilder->getVertexBuffer(&vertexBytes);
+    const uint32_t* indices = i_textMeshBuilder->getIndexBuffer(&indexBytes);
+
+    mesh.vertices.assign(vertices, vertices + vertexBytes);
+    mesh.indices.assign(indices, indices + indexBytes / sizeof(uint32_t));
+    mesh.numVertices = vertexBytes / i_textMeshBuilder->getVertexFormat().vertexNumBytes();
+    mesh.width = i_fontRenderer.getStringWidth(text);
+    mesh.height = scale;
+}
+
 float hcpui::getStringwidth(const char* str, float scale)
 {
     i_fontRenderer.setTextSize(scale);
@@ -262,6 +348,23 @@ float hcpui::getStringwidth(const char* str, size_t length, float scale)
     return i_fontRenderer.getStringWidth(str, length);
 }
 
+float hcpui::getStringwidth(const HCPStyledText& text, float scale)
+{
+    i_fontRenderer.setTextSize(scale);
+    return i_fontRenderer.getStringWidth(text);
+}
+
+const HCPStyledText& hcpui::cacheText(HCPCachedText& cache, const char* str)
+{
+    if(cache.source != str)
+    {
+        cache.source = str;
+        i_fontRenderer.parse(cache.text, cache.source.data(), cache.source.size());
+    }
+
+    return cache.text;
+}
+
 int hcpui::getWindowWidth()
 {
     return i_windowWidth;
@@ -416,6 +519,7 @@ static void i_init()
                    | HCPVF_ATTRB_NORMALIZED_FALSE;
 
     i_batchMeshBuilder = new HCPMeshBuilder(vtxFmt);
+    i_textMeshBuilder = new HCPMeshBuilder(vtxFmt);
 
     glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &i_fontAtlasTexUnit);
     i_fontRenderer.setAtlasTexUnit(i_fontAtlasTexUnit);
@@ -101,7 +101,7 @@ void HCPUIWindow::draw()
         {
             hcpui::genGradientQuad(HCPDirection::RIGHT, 0, 0, width, titleBarHeight, -1728053248, 1275068416, 0);
 
-            hcpui::genString(HCPAlignment::CENTER_LEFT, m_title.c_str(), edgeSize, titleBarHeight / 2.0f, 22.0f, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::CENTER_LEFT, hcpui::cacheText(m_titleText, m_title.c_str()), edgeSize, titleBarHeight / 2.0f, 22.0f, 0xFFFFFFFF);
 
             m_closeButton.width = m_closeButton.height = titleBarHeight - edgeSize * 2.0f;
             m_closeButton.x = width - m_closeButton.width - edgeSize;
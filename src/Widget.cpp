@@ -94,7 +94,11 @@ void HCPWidget::setZLevel(int zLevel)
 
 void HCPWidget::setText(const char* text)
 {
+    // Some widgets are handed the same text every frame
+    if(m_text == text) return;
+
     m_text = text;
+    hcpui::getFontRenderer()->parse(m_styledText, m_text.data(), m_text.size());
 }
 
 HCPWidget::Type HCPWidget::getType() const
@@ -112,6 +116,11 @@ const char* HCPWidget::getText() const
     return m_text.c_str();
 }
 
+const HCPStyledText& HCPWidget::getStyledText() const
+{
+    return m_styledText;
+}
+
 float HCPWidget::localCursorX() const
 {
     return m_localCursor.x;
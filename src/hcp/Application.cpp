@@ -9,13 +9,17 @@
 #include "hcp/MainMenu.hpp"
 #include "hcp/RobotRenderer.hpp"
 
+#include <cstring>
+
 HCPLogger mainLogger("Main");
 
 HCPApplication* HCPApplication::s_instance = nullptr;
 
-HCPApplication::HCPApplication(const char* title) :
+HCPApplication::HCPApplication(const char* title, int argc, char** argv) :
     m_title(title),
     m_shouldClose(false),
+    m_argc(argc),
+    m_argv(argv),
     m_currentScreen(nullptr)
 {
     if(s_instance)
@@ -68,6 +72,9 @@ void HCPApplication::loop()
 
 void HCPApplication::terminate()
 {
+    // Lets the screen shut down its serial port and report before exit
+    setCurrentScreen(nullptr);
+
     mainLogger.infof("Terminating GLFW window");
     glfwTerminate();
 
@@ -95,6 +102,27 @@ void HCPApplication::setCurrentScreen(HCPScreen* screen)
     m_currentScreen = screen;
 }
 
+bool HCPApplication::hasOption(const char* name) const
+{
+    return getOption(name) != nullptr;
+}
+
+const char* HCPApplication::getOption(const char* name, const char* defaultValue) const
+{
+    size_t nameLen = strlen(name);
+
+    for(int i = 1; i < m_argc; i++)
+    {
+        const char* arg = m_argv[i];
+        if(strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, nameLen) != 0) continue;
+
+        if(arg[2 + nameLen] == '\0') return arg + 2 + nameLen;
+        if(arg[2 + nameLen] == '=') return arg + 3 + nameLen;
+    }
+
+    return defaultValue;
+}
+
 HCPApplication* HCPApplication::getInstance()
 {
     return s_instance;
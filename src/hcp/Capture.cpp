@@ -0,0 +1,447 @@
+#include "hcp/Capture.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// File header
+static const char i_magic[8] = { 'H', 'C', 'P', 'C', 'A', 'P', 0, 0 };
+static const size_t VERSION_OFFSET = 8;
+static const size_t BLOCK_SIZE_OFFSET = 12;
+static const size_t WALL_CLOCK_OFFSET = 16;
+
+// Block header
+static const size_t FIRST_TIME_OFFSET = 0;
+static const size_t LAST_TIME_OFFSET = 8;
+static const size_t USED_OFFSET = 16;
+static const size_t RECORDS_OFFSET = 20;
+
+static const uint32_t TX_BIT = 0x80000000;
+
+template<typename T>
+static T i_load(const uint8_t* src)
+{
+    T value;
+    memcpy(&value, src, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static void i_store(uint8_t* dst, T value)
+{
+    memcpy(dst, &value, sizeof(T));
+}
+
+int64_t HCPCapture::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+HCPLogger HCPCaptureWriter::s_logger("CaptureWriter");
+
+HCPCaptureWriter::HCPCaptureWriter() :
+    m_block(0),
+    m_blockUsed(0),
+    m_blockRecords(0),
+    m_lastTimestamp(0),
+    m_bytesWritten(0)
+{
+}
+
+HCPCaptureWriter::~HCPCaptureWriter()
+{
+    close();
+}
+
+bool HCPCaptureWriter::open(const char* path)
+{
+    close();
+
+    if(!m_file.open(path, HCPMappedFile::MODE_READ_WRITE)) return false;
+
+    // Drop whatever was there before, then make room for the first blocks
+    if(!m_file.resize(0) || !m_file.resize(HCPCapture::HEADER_SIZE + GROW_BLOCKS * HCPCapture::BLOCK_SIZE))
+    {
+        m_file.close();
+        return false;
+    }
+
+    uint8_t* header = m_file.data();
+    memcpy(header, i_magic, sizeof(i_magic));
+    i_store<uint32_t>(header + VERSION_OFFSET, HCPCapture::VERSION);
+    i_store<uint32_t>(header + BLOCK_SIZE_OFFSET, (uint32_t) HCPCapture::BLOCK_SIZE);
+    i_store<int64_t>(header + WALL_CLOCK_OFFSET,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+    m_block = 0;
+    m_blockUsed = 0;
+    m_blockRecords = 0;
+    m_lastTimestamp = 0;
+    m_bytesWritten = 0;
+
+    s_logger.infof("Capturing to %s", path);
+    return true;
+}
+
+void HCPCaptureWriter::close()
+{
+    if(!m_file.isOpen()) return;
+
+    // Give back the space grown ahead of time
+    m_file.resize(m_block ? m_block + HCPCapture::BLOCK_SIZE : HCPCapture::HEADER_SIZE);
+    m_file.flush();
+    m_file.close();
+}
+
+bool HCPCaptureWriter::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void HCPCaptureWriter::record(HCPCapture::Direction direction, const uint8_t* data, size_t len, int64_t timestamp)
+{
+    if(!m_file.isOpen()) return;
+
+    // The index needs time to only go forward
+    timestamp = std::max(timestamp, m_lastTimestamp);
+    m_lastTimestamp = timestamp;
+
+    const size_t blockSpace = HCPCapture::BLOCK_SIZE - HCPCapture::BLOCK_HEADER_SIZE;
+
+    while(len)
+    {
+        // Fill the current block before starting the next one
+        if(!m_block || blockSpace < m_blockUsed + HCPCapture::RECORD_HEADER_SIZE + 1)
+        {
+            if(!startBlock(timestamp)) return;
+        }
+
+        size_t chunk = std::min(len, blockSpace - m_blockUsed - HCPCapture::RECORD_HEADER_SIZE);
+
+        uint8_t* block = m_file.data() + m_block;
+        uint8_t* dst = block + HCPCapture::BLOCK_HEADER_SIZE + m_blockUsed;
+        i_store<int64_t>(dst, timestamp);
+        i_store<uint32_t>(dst + 8, (uint32_t) chunk | (direction == HCPCapture::TX ? TX_BIT : 0));
+        memcpy(dst + HCPCapture::RECORD_HEADER_SIZE, data, chunk);
+
+        // The header last, so a reader never sees a record that isn't there
+        m_blockUsed += HCPCapture::RECORD_HEADER_SIZE + chunk;
+        m_blockRecords++;
+        i_store<int64_t>(block + LAST_TIME_OFFSET, timestamp);
+        i_store<uint32_t>(block + RECORDS_OFFSET, m_blockRecords);
+        i_store<uint32_t>(block + USED_OFFSET, (uint32_t) m_blockUsed);
+
+        m_bytesWritten += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+uint64_t HCPCaptureWriter::getBytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+bool HCPCaptureWriter::startBlock(int64_t timestamp)
+{
+    size_t block = m_block ? m_block + HCPCapture::BLOCK_SIZE : HCPCapture::HEADER_SIZE;
+
+    if(m_file.size() < block + HCPCapture::BLOCK_SIZE && !m_file.resize(m_file.size() + GROW_BLOCKS * HCPCapture::BLOCK_SIZE))
+    {
+        s_logger.errorf("Capture stopped, could not grow %s", m_file.getPath());
+        close();
+        return false;
+    }
+
+    m_block = block;
+    m_blockUsed = 0;
+    m_blockRecords = 0;
+
+    uint8_t* header = m_file.data() + m_block;
+    memset(header, 0, HCPCapture::BLOCK_HEADER_SIZE);
+    i_store<int64_t>(header + FIRST_TIME_OFFSET, timestamp);
+    i_store<int64_t>(header + LAST_TIME_OFFSET, timestamp);
+
+    return true;
+}
+
+HCPLogger HCPCaptureReader::s_logger("CaptureReader");
+
+HCPCaptureReader::HCPCaptureReader() :
+    m_blockCount(0),
+    m_block(0),
+    m_offset(0)
+{
+}
+
+bool HCPCaptureReader::open(const char* path)
+{
+    close();
+
+    if(!m_file.open(path, HCPMappedFile::MODE_READ)) return false;
+
+    const uint8_t* header = m_file.data();
+    if(m_file.size() < HCPCapture::HEADER_SIZE || memcmp(header, i_magic, sizeof(i_magic)) != 0
+    || i_load<uint32_t>(header + VERSION_OFFSET) != HCPCapture::VERSION
+    || i_load<uint32_t>(header + BLOCK_SIZE_OFFSET) != HCPCapture::BLOCK_SIZE)
+    {
+        s_logger.errorf("Not a capture file: %s", path);
+        m_file.close();
+        return false;
+    }
+
+    // A capture that was never closed still has empty blocks grown ahead
+    m_blockCount = (m_file.size() - HCPCapture::HEADER_SIZE) / HCPCapture::BLOCK_SIZE;
+    while(m_blockCount && !getBlockUsed(m_blockCount - 1)) m_blockCount--;
+
+    rewind();
+    return true;
+}
+
+void HCPCaptureReader::close()
+{
+    m_file.close();
+    m_blockCount = 0;
+    rewind();
+}
+
+bool HCPCaptureReader::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+int64_t HCPCaptureReader::getStartTime() const
+{
+    return m_blockCount ? getBlockStart(0) : 0;
+}
+
+int64_t HCPCaptureReader::getEndTime() const
+{
+    if(!m_blockCount) return 0;
+
+    const uint8_t* block = m_file.data() + HCPCapture::HEADER_SIZE + (m_blockCount - 1) * HCPCapture::BLOCK_SIZE;
+    return i_load<int64_t>(block + LAST_TIME_OFFSET);
+}
+
+int64_t HCPCaptureReader::getWallClockStart() const
+{
+    return m_file.isOpen() ? i_load<int64_t>(m_file.data() + WALL_CLOCK_OFFSET) : 0;
+}
+
+size_t HCPCaptureReader::getBlockCount() const
+{
+    return m_blockCount;
+}
+
+void HCPCaptureReader::seek(int64_t timestamp)
+{
+    // Last block that starts at or before the timestamp
+    size_t low = 0, high = m_blockCount;
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if(getBlockStart(middle) <= timestamp) low = middle + 1;
+        else high = middle;
+    }
+
+    m_block = low ? low - 1 : 0;
+    m_offset = 0;
+
+    // Every later block starts after the timestamp, so this stays in one block
+    HCPCapture::Record record;
+    size_t recordLen;
+    while(m_block < m_blockCount && peekRecord(record, &recordLen) && record.timestamp < timestamp)
+        m_offset += recordLen;
+}
+
+void HCPCaptureReader::rewind()
+{
+    m_block = 0;
+    m_offset = 0;
+}
+
+bool HCPCaptureReader::next(HCPCapture::Record& record)
+{
+    while(m_block < m_blockCount)
+    {
+        size_t recordLen;
+        if(peekRecord(record, &recordLen))
+        {
+            m_offset += recordLen;
+            return true;
+        }
+
+        m_block++;
+        m_offset = 0;
+    }
+
+    return false;
+}
+
+int64_t HCPCaptureReader::getBlockStart(size_t block) const
+{
+    return i_load<int64_t>(m_file.data() + HCPCapture::HEADER_SIZE + block * HCPCapture::BLOCK_SIZE + FIRST_TIME_OFFSET);
+}
+
+size_t HCPCaptureReader::getBlockUsed(size_t block) const
+{
+    size_t used = i_load<uint32_t>(m_file.data() + HCPCapture::HEADER_SIZE + block * HCPCapture::BLOCK_SIZE + USED_OFFSET);
+    return std::min(used, HCPCapture::BLOCK_SIZE - HCPCapture::BLOCK_HEADER_SIZE);
+}
+
+// False at the end of the block, or where it stops making sense
+bool HCPCaptureReader::peekRecord(HCPCapture::Record& record, size_t* recordLen) const
+{
+    size_t used = getBlockUsed(m_block);
+    if(used < m_offset + HCPCapture::RECORD_HEADER_SIZE) return false;
+
+    const uint8_t* src = m_file.data() + HCPCapture::HEADER_SIZE + m_block * HCPCapture::BLOCK_SIZE + HCPCapture::BLOCK_HEADER_SIZE + m_offset;
+    uint32_t lenAndDirection = i_load<uint32_t>(src + 8);
+    uint32_t len = lenAndDirection & ~TX_BIT;
+    if(used < m_offset + HCPCapture::RECORD_HEADER_SIZE + len) return false;
+
+    record.timestamp = i_load<int64_t>(src);
+    record.direction = lenAndDirection & TX_BIT ? HCPCapture::TX : HCPCapture::RX;
+    record.data = src + HCPCapture::RECORD_HEADER_SIZE;
+    record.len = len;
+
+    *recordLen = HCPCapture::RECORD_HEADER_SIZE + len;
+    return true;
+}
+
+HCPCaptureReplay::HCPCaptureReplay() :
+    m_pending(),
+    m_pendingOffset(0),
+    m_hasPending(false),
+    m_finished(true),
+    m_speed(1.0),
+    m_anchorTime(0)
+{
+}
+
+bool HCPCaptureReplay::open(const char* path)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(!m_reader.open(path)) return false;
+
+    m_finished = !loadPending();
+    anchor(m_reader.getStartTime());
+    return true;
+}
+
+void HCPCaptureReplay::setSpeed(double speed)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    // Carry on from where playback is now rather than jumping
+    int64_t position = m_hasPending ? std::max(m_pending.timestamp, m_anchorTime) : m_anchorTime;
+    if(0.0 < m_speed && m_hasPending && Clock::now() < dueAt(m_pending.timestamp))
+        position = m_anchorTime + (int64_t) (std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_anchorClock).count() * m_speed);
+
+    m_speed = std::max(0.0, speed);
+    anchor(position);
+}
+
+double HCPCaptureReplay::getSpeed() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_speed;
+}
+
+void HCPCaptureReplay::seek(int64_t timestamp)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_reader.seek(timestamp);
+    m_finished = !loadPending();
+    anchor(timestamp);
+}
+
+int64_t HCPCaptureReplay::getPosition() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_hasPending ? m_pending.timestamp : m_reader.getEndTime();
+}
+
+int64_t HCPCaptureReplay::getStartTime() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_reader.getStartTime();
+}
+
+int64_t HCPCaptureReplay::getEndTime() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_reader.getEndTime();
+}
+
+bool HCPCaptureReplay::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_finished;
+}
+
+size_t HCPCaptureReplay::read(uint8_t* dst, size_t len)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    Clock::time_point now = Clock::now();
+    size_t copied = 0;
+
+    while(copied < len && m_hasPending)
+    {
+        if(0.0 < m_speed && now < dueAt(m_pending.timestamp)) break;
+
+        size_t chunk = std::min(len - copied, (size_t) m_pending.len - m_pendingOffset);
+        memcpy(dst + copied, m_pending.data + m_pendingOffset, chunk);
+        copied += chunk;
+        m_pendingOffset += chunk;
+
+        if(m_pendingOffset == m_pending.len) m_finished = !loadPending();
+    }
+
+    return copied;
+}
+
+int HCPCaptureReplay::getTimeout(int timeoutMs) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(!m_hasPending) return timeoutMs;
+    if(m_speed <= 0.0) return 0;
+
+    // Rounded up, waking a little late beats spinning until the data is due
+    auto untilDue = std::chrono::duration_cast<std::chrono::microseconds>(dueAt(m_pending.timestamp) - Clock::now());
+    int64_t dueMs = (untilDue.count() + 999) / 1000;
+    return (int) std::max<int64_t>(0, std::min<int64_t>(timeoutMs, dueMs));
+}
+
+// Only the received side is played back, what the panel sent is in the
+// capture for post-mortems
+bool HCPCaptureReplay::loadPending()
+{
+    m_pendingOffset = 0;
+
+    while(m_reader.next(m_pending))
+    {
+        if(m_pending.direction == HCPCapture::RX && m_pending.len)
+        {
+            m_hasPending = true;
+            return true;
+        }
+    }
+
+    m_hasPending = false;
+    return false;
+}
+
+void HCPCaptureReplay::anchor(int64_t timestamp)
+{
+    m_anchorTime = timestamp;
+    m_anchorClock = Clock::now();
+}
+
+HCPCaptureReplay::Clock::time_point HCPCaptureReplay::dueAt(int64_t timestamp) const
+{
+    return m_anchorClock + std::chrono::nanoseconds((int64_t) ((timestamp - m_anchorTime) / m_speed));
+}
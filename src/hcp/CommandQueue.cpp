@@ -0,0 +1,181 @@
+#include "hcp/CommandQueue.hpp"
+
+#include <cstring>
+#include <utility>
+
+HCPCommandQueue::HCPCommandQueue(size_t window, std::chrono::milliseconds timeout, uint32_t maxRetries) :
+    m_window(window ? window : 1),
+    m_timeout(timeout),
+    m_maxRetries(maxRetries),
+    m_priority(HCPTransport::PRIORITY_INTERACTIVE),
+    m_inFlight(0)
+{
+}
+
+void HCPCommandQueue::setWindow(size_t window)
+{
+    m_window = window ? window : 1;
+}
+
+void HCPCommandQueue::setTimeout(std::chrono::milliseconds timeout)
+{
+    m_timeout = timeout;
+}
+
+void HCPCommandQueue::setMaxRetries(uint32_t maxRetries)
+{
+    m_maxRetries = maxRetries;
+}
+
+void HCPCommandQueue::setPriority(HCPTransport::Priority priority)
+{
+    m_priority = priority;
+}
+
+size_t HCPCommandQueue::getWindow() const
+{
+    return m_window;
+}
+
+bool HCPCommandQueue::submit(const HCPMessage& message, Callback callback)
+{
+    m_entries.emplace_back();
+    Entry& entry = m_entries.back();
+
+    entry.frameLen = HCPProtocol::encode(message, entry.frame, sizeof(entry.frame));
+    if(!entry.frameLen)
+    {
+        m_entries.pop_back();
+        return false;
+    }
+
+    entry.seq = message.seq;
+    entry.state = ENTRY_QUEUED;
+    entry.attempts = 0;
+    entry.result = RESULT_OK;
+    entry.status = 0;
+    entry.callback = std::move(callback);
+
+    return true;
+}
+
+void HCPCommandQueue::service(HCPTransport& transport)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    bool blocked = false; // the output ring is full, nothing more goes out this time
+
+    // Resends first, they hold up completion of everything behind them
+    for(Entry& entry : m_entries)
+    {
+        if(entry.state != ENTRY_SENT || now - entry.sent < m_timeout) continue;
+
+        if(m_maxRetries < entry.attempts) complete(entry, RESULT_TIMEOUT, 0);
+        else if(!send(transport, entry, now))
+        {
+            blocked = true;
+            break;
+        }
+    }
+
+    for(Entry& entry : m_entries)
+    {
+        if(blocked || m_window <= m_inFlight) break;
+        if(entry.state == ENTRY_QUEUED) blocked = !send(transport, entry, now);
+    }
+
+    reportCompleted();
+}
+
+bool HCPCommandQueue::handleAck(const HCPMessage& ack, std::chrono::steady_clock::time_point receivedAt)
+{
+    size_t inFlight = 0;
+
+    for(Entry& entry : m_entries)
+    {
+        if(m_inFlight <= inFlight) break;
+        if(entry.state != ENTRY_SENT) continue;
+        inFlight++;
+
+        if(entry.seq != ack.ack.seq) continue;
+
+        if(entry.attempts == 1 && entry.sent <= receivedAt)
+            m_ackLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(receivedAt - entry.sent).count());
+
+        complete(entry, ack.ack.status ? RESULT_FAILED : RESULT_OK, ack.ack.status);
+        return true;
+    }
+
+    return false;
+}
+
+void HCPCommandQueue::cancel()
+{
+    for(Entry& entry : m_entries)
+        if(entry.state != ENTRY_DONE) complete(entry, RESULT_CANCELLED, 0);
+
+    reportCompleted();
+}
+
+size_t HCPCommandQueue::getQueued() const
+{
+    size_t queued = 0;
+    for(const Entry& entry : m_entries) queued += entry.state == ENTRY_QUEUED;
+    return queued;
+}
+
+size_t HCPCommandQueue::getInFlight() const
+{
+    return m_inFlight;
+}
+
+bool HCPCommandQueue::isIdle() const
+{
+    return m_entries.empty();
+}
+
+const HCPHistogram& HCPCommandQueue::getAckLatency() const
+{
+    return m_ackLatency;
+}
+
+bool HCPCommandQueue::send(HCPTransport& transport, Entry& entry, std::chrono::steady_clock::time_point now)
+{
+    // All or nothing, like HCPProtocol::send()
+    HCPRingBuffer::Span spans[2];
+    if(transport.reserveWrite(spans, entry.frameLen, m_priority) < entry.frameLen) return false;
+
+    size_t first = entry.frameLen < spans[0].len ? entry.frameLen : spans[0].len;
+    memcpy(spans[0].data, entry.frame, first);
+    if(first < entry.frameLen) memcpy(spans[1].data, entry.frame + first, entry.frameLen - first);
+    transport.commitWrite(entry.frameLen, m_priority);
+
+    if(entry.state == ENTRY_QUEUED) m_inFlight++;
+    entry.state = ENTRY_SENT;
+    entry.attempts++;
+    entry.sent = now;
+
+    return true;
+}
+
+void HCPCommandQueue::complete(Entry& entry, Result result, uint8_t status)
+{
+    if(entry.state == ENTRY_SENT) m_inFlight--;
+
+    entry.state = ENTRY_DONE;
+    entry.result = result;
+    entry.status = status;
+}
+
+void HCPCommandQueue::reportCompleted()
+{
+    // Popped before the callback runs, which may submit more
+    while(!m_entries.empty() && m_entries.front().state == ENTRY_DONE)
+    {
+        Entry& entry = m_entries.front();
+        Completion completion = { entry.seq, entry.result, entry.status, entry.attempts };
+        Callback callback = std::move(entry.callback);
+        m_entries.pop_front();
+
+        if(callback) callback(completion);
+    }
+}
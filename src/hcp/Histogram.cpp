@@ -0,0 +1,107 @@
+#include "hcp/Histogram.hpp"
+
+static int i_highestBit(uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while(value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+HCPHistogram::HCPHistogram()
+{
+    reset();
+}
+
+void HCPHistogram::record(uint64_t value)
+{
+    if(MAX_VALUE < value) value = MAX_VALUE;
+
+    m_buckets[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while(max < value && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+
+    // Last, so readers never see a count that the buckets don't add up to yet
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+void HCPHistogram::reset()
+{
+    for(std::atomic<uint64_t>& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_release);
+}
+
+uint64_t HCPHistogram::getCount() const
+{
+    return m_count.load(std::memory_order_acquire);
+}
+
+uint64_t HCPHistogram::getMax() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+double HCPHistogram::getMean() const
+{
+    uint64_t count = getCount();
+    return count ? (double) m_sum.load(std::memory_order_relaxed) / count : 0.0;
+}
+
+uint64_t HCPHistogram::getPercentile(double percentile) const
+{
+    uint64_t count = getCount();
+    if(!count) return 0;
+
+    uint64_t target = (uint64_t) (percentile / 100.0 * count + 0.5);
+    if(target < 1) target = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen < target) continue;
+
+        // Report the top of the bucket, like HdrHistogram does
+        uint64_t highest = i + 1 < BUCKET_COUNT ? lowestValueAt(i + 1) - 1 : MAX_VALUE;
+        uint64_t max = getMax();
+        return highest < max ? highest : max;
+    }
+
+    return getMax();
+}
+
+void HCPHistogram::print(FILE* file, const char* title, double unitDivisor, const char* unit) const
+{
+    fprintf(file, "%s: %llu samples, mean %.3f %s\n", title, (unsigned long long) getCount(), getMean() / unitDivisor, unit);
+
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    for(double percentile : percentiles)
+        fprintf(file, "  p%-6g %10.3f %s\n", percentile, getPercentile(percentile) / unitDivisor, unit);
+
+    fprintf(file, "  max     %10.3f %s\n", getMax() / unitDivisor, unit);
+}
+
+size_t HCPHistogram::indexOf(uint64_t value)
+{
+    if(value < SUB_BUCKET_COUNT * 2) return (size_t) value;
+
+    int shift = i_highestBit(value) - SUB_BUCKET_BITS;
+    return SUB_BUCKET_COUNT * shift + (size_t) (value >> shift);
+}
+
+uint64_t HCPHistogram::lowestValueAt(size_t index)
+{
+    if(index < SUB_BUCKET_COUNT * 2) return index;
+
+    int shift = (int) (index / SUB_BUCKET_COUNT) - 1;
+    return (uint64_t) (index - SUB_BUCKET_COUNT * shift) << shift;
+}
@@ -0,0 +1,46 @@
+#include "hcp/HotplugWatch.hpp"
+
+#include <cstdio>
+
+HCPLogger HCPHotplugWatch::s_logger("HotplugWatch");
+
+HCPHotplugWatch::HCPHotplugWatch() :
+    m_impl(nullptr)
+{
+    m_path[0] = '\0';
+    impl_init();
+}
+
+HCPHotplugWatch::~HCPHotplugWatch()
+{
+    unwatch();
+    impl_destroy();
+}
+
+bool HCPHotplugWatch::watch(const char* path)
+{
+    unwatch();
+    if(!path || path[0] != '/') return false;
+
+    snprintf(m_path, sizeof(m_path), "%s", path);
+    if(impl_watch()) return true;
+
+    m_path[0] = '\0';
+    return false;
+}
+
+void HCPHotplugWatch::unwatch()
+{
+    impl_unwatch();
+    m_path[0] = '\0';
+}
+
+bool HCPHotplugWatch::isWatching() const
+{
+    return m_path[0] != '\0';
+}
+
+intptr_t HCPHotplugWatch::getPollHandle() const
+{
+    return impl_getPollHandle();
+}
@@ -0,0 +1,132 @@
+#ifdef __linux__
+#include "hcp/HotplugWatch.hpp"
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+
+struct ImplHotplugLinux
+{
+    int inotify;
+    int watch;
+    size_t dirLen; // length of the watched directory's part of the path, 0 for /
+};
+
+#define getImpl() (*((ImplHotplugLinux*) m_impl))
+
+// Watches the deepest directory on the path that exists right now
+static bool i_arm(ImplHotplugLinux& impl, const char* path)
+{
+    if(0 <= impl.watch) inotify_rm_watch(impl.inotify, impl.watch);
+    impl.watch = -1;
+
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", path);
+
+    for(char* slash = strrchr(dir, '/'); slash; slash = strrchr(dir, '/'))
+    {
+        if(slash == dir) slash[1] = '\0';
+        else *slash = '\0';
+
+        struct stat info;
+        if(stat(dir, &info) != 0 || !S_ISDIR(info.st_mode))
+        {
+            if(slash == dir) break;
+            continue;
+        }
+
+        impl.watch = inotify_add_watch(impl.inotify, dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+        impl.dirLen = slash == dir ? 0 : strlen(dir);
+        break;
+    }
+
+    return 0 <= impl.watch;
+}
+
+void IMPL_FUNC HCPHotplugWatch::impl_init()
+{
+    m_impl = new ImplHotplugLinux();
+    ImplHotplugLinux& impl = getImpl();
+
+    impl.inotify = -1;
+    impl.watch = -1;
+    impl.dirLen = 0;
+}
+
+bool IMPL_FUNC HCPHotplugWatch::impl_watch()
+{
+    ImplHotplugLinux& impl = getImpl();
+
+    if(impl.inotify < 0) impl.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if(impl.inotify < 0 || !i_arm(impl, m_path))
+    {
+        s_logger.errorf("Failed to watch for %s (%s)", m_path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPHotplugWatch::impl_unwatch()
+{
+    ImplHotplugLinux& impl = getImpl();
+
+    if(0 <= impl.inotify) ::close(impl.inotify);
+    impl.inotify = impl.watch = -1;
+}
+
+intptr_t IMPL_FUNC HCPHotplugWatch::impl_getPollHandle() const
+{
+    return ((ImplHotplugLinux*) m_impl)->inotify;
+}
+
+bool IMPL_FUNC HCPHotplugWatch::check()
+{
+    ImplHotplugLinux& impl = getImpl();
+    if(impl.inotify < 0) return false;
+
+    // The next path component below the watched directory
+    const char* next = m_path + impl.dirLen + 1;
+    const char* nextEnd = strchr(next, '/');
+    size_t nextLen = nextEnd ? nextEnd - next : strlen(next);
+
+    bool found = false;
+    bool rearm = false;
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while(0 < (len = ::read(impl.inotify, buffer, sizeof(buffer))))
+    {
+        for(ssize_t offset = 0; offset < len;)
+        {
+            const inotify_event* event = (const inotify_event*) (buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            // The watched directory went away or a deeper one on the path appeared
+            if(event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) rearm = true;
+            else if(event->len && strlen(event->name) == nextLen && strncmp(event->name, next, nextLen) == 0)
+            {
+                if(nextEnd) rearm = true;
+                else found = true;
+            }
+        }
+    }
+
+    if(!rearm) return found;
+
+    // The node may have been created before the deeper directory was watched
+    struct stat info;
+    i_arm(impl, m_path);
+    return found || stat(m_path, &info) == 0;
+}
+
+void IMPL_FUNC HCPHotplugWatch::impl_destroy()
+{
+    if(m_impl) delete (ImplHotplugLinux*) m_impl;
+}
+
+#endif // Linux
@@ -0,0 +1,34 @@
+#ifdef _WIN32
+#include "hcp/HotplugWatch.hpp"
+
+// COM ports have no path to watch, and device arrival notifications need a
+// window to be delivered to. Lost ports are retried on the backoff alone.
+
+void IMPL_FUNC HCPHotplugWatch::impl_init()
+{
+}
+
+bool IMPL_FUNC HCPHotplugWatch::impl_watch()
+{
+    return false;
+}
+
+void IMPL_FUNC HCPHotplugWatch::impl_unwatch()
+{
+}
+
+intptr_t IMPL_FUNC HCPHotplugWatch::impl_getPollHandle() const
+{
+    return -1;
+}
+
+bool IMPL_FUNC HCPHotplugWatch::check()
+{
+    return false;
+}
+
+void IMPL_FUNC HCPHotplugWatch::impl_destroy()
+{
+}
+
+#endif // Windows
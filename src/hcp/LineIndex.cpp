@@ -0,0 +1,399 @@
+#include "hcp/LineIndex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static uint32_t i_trigram(const char* text)
+{
+    return (uint32_t) (uint8_t) text[0] << 16 | (uint32_t) (uint8_t) text[1] << 8 | (uint8_t) text[2];
+}
+
+// Lower case with the § codes taken out, what both the index and the
+// matching see
+static void i_toPlainText(std::string& dst, const char* text, size_t len)
+{
+    dst.clear();
+
+    for(size_t i = 0; i < len; i++)
+    {
+        // § is 0xC2 0xA7 in UTF-8, the format key follows it
+        if((uint8_t) text[i] == 0xC2 && i + 2 < len && (uint8_t) text[i + 1] == 0xA7)
+        {
+            i += 2;
+            continue;
+        }
+
+        dst.push_back((char) tolower((uint8_t) text[i]));
+    }
+}
+
+static void i_addTrigrams(std::vector<uint32_t>& trigrams, const std::string& literal)
+{
+    for(size_t i = 0; i + 3 <= literal.size(); i++) trigrams.push_back(i_trigram(literal.data() + i));
+}
+
+// Runs of plain characters every match of the regex has to contain. Anything
+// it can't be sure about ends the run, and with an alternation anywhere
+// nothing is certain.
+static std::vector<std::string> i_requiredLiterals(const std::string& pattern)
+{
+    std::vector<std::string> literals;
+    if(pattern.find('|') != std::string::npos) return literals;
+
+    std::string run;
+    auto endRun = [&]()
+    {
+        if(3 <= run.size()) literals.push_back(run);
+        run.clear();
+    };
+
+    for(size_t i = 0; i < pattern.size(); i++)
+    {
+        char c = pattern[i];
+
+        switch(c)
+        {
+        case '*':
+        case '?':
+        case '{':
+            // The character before is optional
+            if(!run.empty()) run.pop_back();
+            endRun();
+            if(c == '{') i = std::min(pattern.find('}', i), pattern.size());
+            break;
+        case '+':
+            endRun();
+            break;
+        case '(':
+        {
+            // Groups may be optional, skip to the matching parenthesis
+            endRun();
+            int depth = 0;
+            for(; i < pattern.size(); i++)
+            {
+                if(pattern[i] == '\\') i++;
+                else if(pattern[i] == '(') depth++;
+                else if(pattern[i] == ')' && --depth == 0) break;
+            }
+            break;
+        }
+        case '[':
+            endRun();
+            if(i + 1 < pattern.size() && pattern[i + 1] == ']') i++;
+            i = std::min(pattern.find(']', i + 1), pattern.size());
+            break;
+        case '\\':
+            if(i + 1 < pattern.size() && !isalnum((uint8_t) pattern[i + 1]))
+            {
+                run.push_back((char) tolower((uint8_t) pattern[++i]));
+                break;
+            }
+            endRun();
+            i++;
+            break;
+        case '.':
+        case '^':
+        case '$':
+        case ')':
+        case ']':
+        case '}':
+            endRun();
+            break;
+        default:
+            run.push_back((char) tolower((uint8_t) c));
+        }
+    }
+
+    endRun();
+    return literals;
+}
+
+HCPLineIndex::HCPLineIndex(size_t maxLines, size_t maxBytes) :
+    m_running(true),
+    m_clearPending(false),
+    m_queryChanged(false),
+    m_searching(false),
+    m_lines(maxLines, maxBytes),
+    m_indexedEnd(0),
+    m_trimmedBlock(0)
+{
+    m_thread = std::thread(&HCPLineIndex::run, this);
+}
+
+HCPLineIndex::~HCPLineIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = false;
+    }
+
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void HCPLineIndex::append(const char* text, size_t len)
+{
+    if(!len) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pending.append(text, len);
+    }
+
+    m_wake.notify_one();
+}
+
+void HCPLineIndex::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pending.clear();
+        m_clearPending = true;
+        m_matches.clear();
+    }
+
+    m_wake.notify_one();
+}
+
+bool HCPLineIndex::setQuery(const char* text, bool regex)
+{
+    Query query;
+    query.active = text[0] != '\0';
+    query.regex = regex;
+
+    if(query.active && regex)
+    {
+        try
+        {
+            query.pattern.assign(text, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+        }
+        catch(const std::regex_error&)
+        {
+            query.active = false;
+        }
+
+        for(const std::string& literal : i_requiredLiterals(text)) i_addTrigrams(query.trigrams, literal);
+    }
+    else if(query.active)
+    {
+        i_toPlainText(query.text, text, strlen(text));
+        i_addTrigrams(query.trigrams, query.text);
+    }
+
+    std::sort(query.trigrams.begin(), query.trigrams.end());
+    query.trigrams.erase(std::unique(query.trigrams.begin(), query.trigrams.end()), query.trigrams.end());
+
+    bool valid = query.active || !regex || !text[0];
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        query.version = m_nextQuery.version + 1;
+        m_nextQuery = std::move(query);
+        m_queryChanged = true;
+        m_matches.clear();
+        m_searching = m_nextQuery.active;
+    }
+
+    m_wake.notify_one();
+    return valid;
+}
+
+bool HCPLineIndex::isSearching() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_searching;
+}
+
+size_t HCPLineIndex::getMatchCount() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_matches.size();
+}
+
+size_t HCPLineIndex::getMatches(size_t first, size_t count, uint64_t* lines) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_matches.size() <= first) return 0;
+
+    count = std::min(count, m_matches.size() - first);
+    std::copy(m_matches.begin() + first, m_matches.begin() + first + count, lines);
+    return count;
+}
+
+bool HCPLineIndex::isMatch(uint64_t line) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return std::binary_search(m_matches.begin(), m_matches.end(), line);
+}
+
+bool HCPLineIndex::findMatchBefore(uint64_t line, uint64_t* match) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto next = std::lower_bound(m_matches.begin(), m_matches.end(), line);
+    if(next == m_matches.begin()) return false;
+
+    *match = *(next - 1);
+    return true;
+}
+
+void HCPLineIndex::run()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while(true)
+    {
+        m_wake.wait(lock, [this]() { return !m_running || !m_pending.empty() || m_clearPending || m_queryChanged; });
+        if(!m_running) break;
+
+        bool clear = m_clearPending;
+        m_clearPending = false;
+
+        std::string text;
+        text.swap(m_pending);
+
+        bool queryChanged = m_queryChanged;
+        m_queryChanged = false;
+        if(queryChanged) m_query = m_nextQuery;
+
+        lock.unlock();
+
+        if(clear)
+        {
+            m_lines.clear();
+            m_postings.clear();
+            m_indexedEnd = m_lines.getEndLine();
+            m_trimmedBlock = (uint32_t) (m_indexedEnd / BLOCK_LINES);
+        }
+
+        // New lines are indexed and matched before a new query runs, which
+        // then covers them as well
+        std::vector<uint64_t> newMatches;
+        m_lines.append(text.data(), text.size());
+        indexLines(queryChanged ? nullptr : &newMatches);
+        trimPostings();
+
+        std::vector<uint64_t> found;
+        if(queryChanged) search(&found);
+
+        lock.lock();
+
+        // Published unless the query changed again in the meantime
+        if(m_query.version == m_nextQuery.version)
+        {
+            if(queryChanged)
+            {
+                m_matches.assign(found.begin(), found.end());
+                m_searching = false;
+            }
+            else m_matches.insert(m_matches.end(), newMatches.begin(), newMatches.end());
+        }
+
+        while(!m_matches.empty() && m_matches.front() < m_lines.getFirstLine()) m_matches.pop_front();
+    }
+}
+
+void HCPLineIndex::indexLines(std::vector<uint64_t>* found)
+{
+    uint64_t end = m_lines.getEndLine() - m_lines.isLastLineOpen();
+    m_indexedEnd = std::max(m_indexedEnd, m_lines.getFirstLine());
+
+    for(; m_indexedEnd < end; m_indexedEnd++)
+    {
+        uint32_t block = (uint32_t) (m_indexedEnd / BLOCK_LINES);
+        const std::string& plain = plainText(m_indexedEnd);
+
+        for(size_t i = 0; i + 3 <= plain.size(); i++)
+        {
+            std::vector<uint32_t>& blocks = m_postings[i_trigram(plain.data() + i)];
+            if(blocks.empty() || blocks.back() != block) blocks.push_back(block);
+        }
+
+        if(found && m_query.active && matchLine(m_indexedEnd)) found->push_back(m_indexedEnd);
+    }
+}
+
+void HCPLineIndex::search(std::vector<uint64_t>* found)
+{
+    if(!m_query.active) return;
+
+    uint64_t first = m_lines.getFirstLine();
+    uint32_t firstBlock = (uint32_t) (first / BLOCK_LINES);
+
+    if(m_query.trigrams.empty())
+    {
+        for(uint64_t line = first; line < m_indexedEnd; line++)
+        {
+            if(matchLine(line)) found->push_back(line);
+        }
+
+        return;
+    }
+
+    // Intersect the block lists, shortest first so the candidates only shrink
+    std::vector<const std::vector<uint32_t>*> lists;
+    for(uint32_t trigram : m_query.trigrams)
+    {
+        auto postings = m_postings.find(trigram);
+        if(postings == m_postings.end()) return;
+        lists.push_back(&postings->second);
+    }
+
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b)
+    {
+        return a->size() < b->size();
+    });
+
+    std::vector<uint32_t> candidates(std::lower_bound(lists[0]->begin(), lists[0]->end(), firstBlock), lists[0]->end());
+    std::vector<uint32_t> narrowed;
+    for(size_t i = 1; i < lists.size() && !candidates.empty(); i++)
+    {
+        narrowed.clear();
+        std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(narrowed));
+        candidates.swap(narrowed);
+    }
+
+    for(uint32_t block : candidates)
+    {
+        uint64_t start = std::max(first, block * BLOCK_LINES);
+        uint64_t end = std::min(m_indexedEnd, (block + 1) * BLOCK_LINES);
+
+        for(uint64_t line = start; line < end; line++)
+        {
+            if(matchLine(line)) found->push_back(line);
+        }
+    }
+}
+
+bool HCPLineIndex::matchLine(uint64_t line)
+{
+    const std::string& plain = plainText(line);
+
+    if(m_query.regex) return std::regex_search(plain, m_query.pattern);
+    return plain.find(m_query.text) != std::string::npos;
+}
+
+void HCPLineIndex::trimPostings()
+{
+    uint32_t firstBlock = (uint32_t) (m_lines.getFirstLine() / BLOCK_LINES);
+    if(firstBlock - m_trimmedBlock < TRIM_BLOCKS) return;
+
+    for(auto postings = m_postings.begin(); postings != m_postings.end();)
+    {
+        std::vector<uint32_t>& blocks = postings->second;
+        blocks.erase(blocks.begin(), std::lower_bound(blocks.begin(), blocks.end(), firstBlock));
+
+        if(blocks.empty()) postings = m_postings.erase(postings);
+        else postings++;
+    }
+
+    m_trimmedBlock = firstBlock;
+}
+
+const std::string& HCPLineIndex::plainText(uint64_t line)
+{
+    HCPLineStore::Line text = m_lines.getLine(line);
+    i_toPlainText(m_plain, text.text, text.len);
+    return m_plain;
+}
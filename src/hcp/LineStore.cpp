@@ -0,0 +1,145 @@
+#include "hcp/LineStore.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+HCPLineStore::HCPLineStore(size_t maxLines, size_t maxBytes) :
+    m_maxLines(std::max((size_t) 1, maxLines)),
+    m_maxChunks(std::max((size_t) 2, maxBytes / CHUNK_SIZE)),
+    m_indexStart(0),
+    m_firstLine(0),
+    m_endLine(0),
+    m_lineOpen(false)
+{
+}
+
+void HCPLineStore::append(const char* text, size_t len)
+{
+    size_t start = 0;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        if(text[i] != '\n' && text[i] != '\r' && text[i] != '\0') continue;
+
+        if(start < i) extendLine(text + start, i - start);
+        m_lineOpen = false;
+        start = i + 1;
+    }
+
+    if(start < len) extendLine(text + start, len - start);
+
+    dropOldLines();
+}
+
+void HCPLineStore::clear()
+{
+    // Numbering carries on, so line numbers held elsewhere never alias new lines
+    m_chunks.clear();
+    m_index.clear();
+    m_firstLine = m_endLine;
+    m_indexStart = m_endLine - m_endLine % INDEX_BLOCK_SIZE;
+    m_lineOpen = false;
+}
+
+uint64_t HCPLineStore::getFirstLine() const
+{
+    return m_firstLine;
+}
+
+uint64_t HCPLineStore::getEndLine() const
+{
+    return m_endLine;
+}
+
+size_t HCPLineStore::getLineCount() const
+{
+    return (size_t) (m_endLine - m_firstLine);
+}
+
+bool HCPLineStore::isLastLineOpen() const
+{
+    return m_lineOpen;
+}
+
+HCPLineStore::Line HCPLineStore::getLine(uint64_t line) const
+{
+    uint64_t entry = line - m_indexStart;
+    return m_index[(size_t) (entry / INDEX_BLOCK_SIZE)][entry % INDEX_BLOCK_SIZE];
+}
+
+HCPLineStore::Line& HCPLineStore::lineAt(uint64_t line)
+{
+    uint64_t entry = line - m_indexStart;
+    return m_index[(size_t) (entry / INDEX_BLOCK_SIZE)][entry % INDEX_BLOCK_SIZE];
+}
+
+void HCPLineStore::extendLine(const char* text, size_t len)
+{
+    if(!m_lineOpen)
+    {
+        if(m_index.size() <= (m_endLine - m_indexStart) / INDEX_BLOCK_SIZE)
+            m_index.emplace_back(new Line[INDEX_BLOCK_SIZE]);
+        if(m_chunks.empty()) addChunk();
+
+        Chunk& chunk = m_chunks.back();
+
+        Line& line = lineAt(m_endLine++);
+        line.text = chunk.text.get() + chunk.used;
+        line.len = 0;
+        m_lineOpen = true;
+    }
+
+    Line& line = lineAt(m_endLine - 1);
+    len = std::min(len, MAX_LINE_LENGTH - line.len);
+    if(!len) return;
+
+    // A line never straddles two chunks. The open one moves to a new chunk
+    // when it outgrows its own, it can't be the chunk's first line since
+    // those always fit.
+    if(CHUNK_SIZE - m_chunks.back().used < len)
+    {
+        const char* lineText = line.text;
+        addChunk();
+
+        Chunk& chunk = m_chunks.back();
+        chunk.firstLine = m_endLine - 1;
+        memcpy(chunk.text.get(), lineText, line.len);
+        chunk.used = line.len;
+        line.text = chunk.text.get();
+    }
+
+    Chunk& chunk = m_chunks.back();
+    memcpy(chunk.text.get() + chunk.used, text, len);
+    chunk.used += len;
+    line.len += (uint32_t) len;
+}
+
+void HCPLineStore::addChunk()
+{
+    Chunk chunk;
+    chunk.text.reset(new char[CHUNK_SIZE]);
+    chunk.used = 0;
+    chunk.firstLine = m_endLine;
+    m_chunks.push_back(std::move(chunk));
+}
+
+void HCPLineStore::dropOldLines()
+{
+    if(m_maxLines < m_endLine - m_firstLine) m_firstLine = m_endLine - m_maxLines;
+
+    while(m_maxChunks < m_chunks.size())
+    {
+        m_chunks.pop_front();
+        m_firstLine = std::max(m_firstLine, m_chunks.front().firstLine);
+    }
+
+    // Chunks and index blocks go once none of their lines are left
+    while(1 < m_chunks.size() && m_chunks[1].firstLine <= m_firstLine)
+        m_chunks.pop_front();
+
+    while(!m_index.empty() && m_indexStart + INDEX_BLOCK_SIZE <= m_firstLine)
+    {
+        m_index.pop_front();
+        m_indexStart += INDEX_BLOCK_SIZE;
+    }
+}
@@ -0,0 +1,121 @@
+#include "hcp/LinkMonitor.hpp"
+
+#include <algorithm>
+
+constexpr std::chrono::milliseconds HCPLinkMonitor::SAMPLE_INTERVAL;
+constexpr double HCPLinkMonitor::SATURATED_LOAD;
+
+HCPLinkMonitor::HCPLinkMonitor() :
+    m_lineRate(0.0),
+    m_sampleCount(0),
+    m_newest(0),
+    m_stats(),
+    m_crcErrors(0),
+    m_framingErrors(0),
+    m_rates()
+{
+}
+
+void HCPLinkMonitor::setLineRate(double bytesPerSecond)
+{
+    m_lineRate = bytesPerSecond;
+}
+
+void HCPLinkMonitor::update(const HCPTransport& transport, const HCPFrameDecoder& decoder)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(m_sampleCount && now - m_samples[m_newest].time < SAMPLE_INTERVAL) return;
+
+    m_stats = transport.getStats();
+    m_crcErrors = decoder.getCRCErrors();
+    m_framingErrors = decoder.getFramingErrors();
+
+    if(m_sampleCount) m_newest = (m_newest + 1) % SAMPLE_COUNT;
+    m_sampleCount = std::min(m_sampleCount + 1, SAMPLE_COUNT);
+
+    Sample& newest = m_samples[m_newest];
+    newest.time = now;
+    newest.bytesReceived = m_stats.bytesReceived;
+    newest.bytesSent = m_stats.bytesSent;
+    newest.framesReceived = m_stats.framesReceived;
+    newest.framesSent = m_stats.framesSent;
+    newest.errors = getErrors();
+
+    // Until the window has filled the rates are over what there is
+    const Sample& oldest = m_samples[(m_newest + SAMPLE_COUNT - m_sampleCount + 1) % SAMPLE_COUNT];
+    double elapsed = std::chrono::duration<double>(newest.time - oldest.time).count();
+    if(elapsed <= 0.0) return;
+
+    m_rates.bytesReceived = (newest.bytesReceived - oldest.bytesReceived) / elapsed;
+    m_rates.bytesSent = (newest.bytesSent - oldest.bytesSent) / elapsed;
+    m_rates.framesReceived = (newest.framesReceived - oldest.framesReceived) / elapsed;
+    m_rates.framesSent = (newest.framesSent - oldest.framesSent) / elapsed;
+    m_rates.errors = (newest.errors - oldest.errors) / elapsed;
+}
+
+const HCPTransport::Stats& HCPLinkMonitor::getStats() const
+{
+    return m_stats;
+}
+
+const HCPLinkMonitor::Rates& HCPLinkMonitor::getRates() const
+{
+    return m_rates;
+}
+
+uint32_t HCPLinkMonitor::getCRCErrors() const
+{
+    return m_crcErrors;
+}
+
+uint32_t HCPLinkMonitor::getFramingErrors() const
+{
+    return m_framingErrors;
+}
+
+uint64_t HCPLinkMonitor::getErrors() const
+{
+    const HCPTransport::LineErrors& line = m_stats.lineErrors;
+    return (uint64_t) m_crcErrors + m_framingErrors + line.overruns + line.parity + line.framing + line.breaks;
+}
+
+double HCPLinkMonitor::getLoad() const
+{
+    if(m_lineRate <= 0.0) return 0.0;
+    return std::max(m_rates.bytesReceived, m_rates.bytesSent) / m_lineRate;
+}
+
+bool HCPLinkMonitor::isSaturated() const
+{
+    return SATURATED_LOAD <= getLoad();
+}
+
+bool HCPLinkMonitor::isNoisy() const
+{
+    return 0.0 < m_rates.errors;
+}
+
+void HCPLinkMonitor::printHeader(FILE* file)
+{
+    fprintf(file, "time,link,rx_bytes_per_s,tx_bytes_per_s,rx_frames_per_s,tx_frames_per_s,errors_per_s,load,"
+        "rx_bytes,tx_bytes,rx_frames,tx_frames,crc_errors,framing_errors,overruns,parity_errors,line_framing_errors,breaks,"
+        "input_stalls,input_max_queued,control_max_queued,interactive_max_queued,bulk_max_queued,failures,reconnects\n");
+}
+
+void HCPLinkMonitor::print(FILE* file, double time, const char* name) const
+{
+    const HCPTransport::Stats& stats = m_stats;
+
+    fprintf(file, "%.3f,%s,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f,%llu,%llu,%llu,%llu,%u,%u,%u,%u,%u,%u,%u,%zu,%zu,%zu,%zu,%u,%u\n",
+        time, name,
+        m_rates.bytesReceived, m_rates.bytesSent, m_rates.framesReceived, m_rates.framesSent, m_rates.errors, getLoad(),
+        (unsigned long long) stats.bytesReceived, (unsigned long long) stats.bytesSent,
+        (unsigned long long) stats.framesReceived, (unsigned long long) stats.framesSent,
+        m_crcErrors, m_framingErrors,
+        stats.lineErrors.overruns, stats.lineErrors.parity, stats.lineErrors.framing, stats.lineErrors.breaks,
+        stats.inputStalls, stats.inputMaxQueued,
+        stats.lanes[HCPTransport::PRIORITY_CONTROL].maxQueued,
+        stats.lanes[HCPTransport::PRIORITY_INTERACTIVE].maxQueued,
+        stats.lanes[HCPTransport::PRIORITY_BULK].maxQueued,
+        stats.failures, stats.reconnects);
+}
@@ -1,6 +1,9 @@
 #include "hcp/MainMenu.hpp"
 
 #include "hcp/RobotRenderer.hpp"
+#include "hcp/Application.hpp"
+#include "hcp/Capture.hpp"
+#include "hcp/Serial.hpp"
 
 #include "UIRender.hpp"
 #include "Shaders.hpp"
@@ -8,15 +11,62 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <cstring>
+#include <cstdlib>
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <string>
+
+static HCPLogger i_logger("MainMenu");
 
 static const int edgeSize = 5;
+static const std::chrono::milliseconds pingInterval(200);
+static const std::chrono::seconds statsLogInterval(1);
+
+static uint64_t i_toMicros(std::chrono::steady_clock::duration duration)
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+static void i_formatLatency(char* dst, size_t dstLen, const char* name, const HCPHistogram& histogram)
+{
+    if(!histogram.getCount())
+    {
+        snprintf(dst, dstLen, "%s -", name);
+        return;
+    }
+
+    snprintf(dst, dstLen, "%s %.2f/%.2f/%.2f/%.2f ms", name,
+        histogram.getPercentile(50.0) / 1000.0, histogram.getPercentile(99.0) / 1000.0,
+        histogram.getPercentile(99.9) / 1000.0, histogram.getMax() / 1000.0);
+}
+
+// Bytes with k and M, short enough for the stats panel
+static void i_formatBytes(char* dst, size_t dstLen, double bytes)
+{
+    if(bytes < 1e3) snprintf(dst, dstLen, "%.0f", bytes);
+    else if(bytes < 1e6) snprintf(dst, dstLen, "%.1fk", bytes / 1e3);
+    else snprintf(dst, dstLen, "%.1fM", bytes / 1e6);
+}
+
+HCPMainMenu::Rack::Rack(const char* address, size_t telemetrySamples) :
+    transport(HCPTransport::create(address)),
+    txSeq(0),
+    reconnects(0),
+    awaitingState(false),
+    telemetry(telemetrySamples)
+{
+    stops.setPriority(HCPTransport::PRIORITY_CONTROL);
+    recipes.setPriority(HCPTransport::PRIORITY_BULK);
+}
 
 HCPMainMenu::HCPMainMenu() :
     HCPScreen(Type::MAIN_MENU, "Main Menu"),
     m_manualControlEnabled(true),
-    m_serial(nullptr)
+    m_rack(0),
+    m_statsLog(nullptr),
+    m_showChart(false),
+    m_setpointResume(HCPSetpointStreamer::RESUME_DISCARD)
 {
     snprintf(m_splashText, 256, "Hydroponic Control Panel - %s", hcpr::getAppVersion());
 
@@ -29,31 +79,140 @@ HCPMainMenu::HCPMainMenu() :
     m_clawJoystick.axesLabels[2] = "Open";
     m_clawJoystick.axesLabels[3] = "Close";
 
+    // A series per channel the protocol defines, the bands are where a
+    // lettuce crop is happy
+    static const uint32_t seriesColors[] = { 0xFF66CCFF, 0xFFFFCC66, 0xFFFF7766, 0xFF7799FF, 0xFFFFFF99, 0xFFCC88FF };
+    m_chart.setText("Sensors");
+    for(uint8_t channel = 0; channel <= HCPMessage::CHANNEL_PUMP_CURRENT; channel++)
+    {
+        size_t series = m_chart.addSeries(HCPTelemetryStore::getChannelName(channel), HCPTelemetryStore::getChannelUnit(channel), seriesColors[channel]);
+        m_chart.setArchiveChannel(series, channel);
+    }
+
+    m_chart.setThresholds(HCPMessage::CHANNEL_PH, 5.5f, 6.5f);
+    m_chart.setThresholds(HCPMessage::CHANNEL_EC, 1.2f, 2.4f);
+    m_chart.setThresholds(HCPMessage::CHANNEL_WATER_TEMPERATURE, 18.0f, 24.0f);
+    m_chart.setThresholds(HCPMessage::CHANNEL_WATER_LEVEL, 50.0f, 100.0f);
+    m_chart.setRange(HCPMessage::CHANNEL_WATER_LEVEL, 0.0f, 105.0f);
+
     m_robX = m_robY = m_robSwivel = m_robClaw = 0.0f;
+    m_robReported = false;
+
+    for(float& target : m_targets) target = 0.0f;
 }
 
-HCPMainMenu::HCPMainMenu(const char* comPort) :
+HCPMainMenu::HCPMainMenu(const std::vector<std::string>& addresses) :
     HCPMainMenu()
 {
-    m_serial = new HCPSerial(comPort);
-    m_serial->setTimeout(HCPSerial::Timeout::fromTimeout(2000));
+    HCPApplication* app = HCPApplication::getInstance();
+    double setpointRate = atof(app->getOption("setpoint-rate", "50"));
+    const char* capture = app->getOption("capture");
+    int commandWindow = atoi(app->getOption("command-window", "8"));
+    int commandTimeout = atoi(app->getOption("command-timeout", "500"));
+    size_t telemetrySamples = (size_t) strtoull(app->getOption("telemetry-samples", "65536"), nullptr, 10);
+    const char* archive = app->getOption("telemetry-archive");
+    double archiveDays = atof(app->getOption("telemetry-archive-days", "0"));
+
+    if(strcmp(app->getOption("setpoint-resume", "discard"), "replay") == 0)
+        m_setpointResume = HCPSetpointStreamer::RESUME_REPLAY;
+
+    if(const char* statsLog = app->getOption("stats-log"))
+    {
+        m_statsLog = fopen(statsLog, "w");
+        if(m_statsLog)
+        {
+            HCPLinkMonitor::printHeader(m_statsLog);
+            m_statsLogStart = m_nextStatsLog = std::chrono::steady_clock::now();
+        }
+        else i_logger.errorf("Could not open stats log %s", statsLog);
+    }
+
+    uint32_t baudRate = (uint32_t) strtoul(app->getOption("baud", "9600"), nullptr, 10);
+    const char* flow = app->getOption("flow", "none");
+    HCPSerial::FlowControl flowControl = HCPSerial::FLOWCONTROL_NONE;
+    if(strcmp(flow, "rtscts") == 0) flowControl = HCPSerial::FLOWCONTROL_HARDWARE;
+    else if(strcmp(flow, "xonxoff") == 0)
+    {
+        i_logger.warnf("XON/XOFF eats 0x11 and 0x13 out of protocol frames, use --flow=rtscts");
+        flowControl = HCPSerial::FLOWCONTROL_SOFTWARE;
+    }
+
+    for(const std::string& address : addresses)
+    {
+        Rack* rack = new Rack(address.c_str(), telemetrySamples);
+        m_racks.emplace_back(rack);
+
+        if(HCPSerial* serial = dynamic_cast<HCPSerial*>(rack->transport.get()))
+        {
+            if(baudRate) serial->setBaudRate(baudRate);
+            serial->setFlowControl(flowControl);
+
+            // Start and stop bit around every byte
+            rack->monitor.setLineRate(serial->getBaudRate() / 10.0);
+        }
+
+        // One file per rack, numbered in the order they were given
+        if(capture)
+        {
+            std::string path = capture;
+            if(1 < addresses.size()) path += "." + std::to_string(m_racks.size() - 1);
+            rack->transport->setCapture(path.c_str());
+        }
+
+        // A directory per rack, numbered the same way
+        if(archive)
+        {
+            std::string path = archive;
+            if(1 < addresses.size()) path += "." + std::to_string(m_racks.size() - 1);
+            if(rack->archive.open(path.c_str()))
+            {
+                rack->archive.setRetention((int64_t) (archiveDays * 86400 * 1e6));
+                rack->telemetry.setArchive(&rack->archive);
+            }
+        }
+
+        // A thread per transport doesn't scale to a greenhouse full of racks
+        if(1 < addresses.size()) rack->transport->setReactor(&m_reactor);
+        else rack->transport->setThreaded(app->hasOption("serial-thread"));
+
+        if(0.0 < setpointRate) rack->setpoints.attach(*rack->transport, setpointRate);
+        rack->setpoints.setResumePolicy(m_setpointResume);
+
+        for(HCPCommandQueue* queue : { &rack->commands, &rack->recipes })
+        {
+            queue->setWindow(commandWindow < 1 ? 1 : (size_t) commandWindow);
+            queue->setTimeout(std::chrono::milliseconds(commandTimeout));
+        }
+        rack->stops.setTimeout(std::chrono::milliseconds(commandTimeout));
+    }
 }
 
 void HCPMainMenu::setup()
 {
     m_nasaMindsLogo = hcpr::getImage("nasa_minds_logo");
     m_manualControlButton.setText("Manual Control: §2On");
-    m_serial->begin();
+    m_stopButton.setText("§4E-Stop");
+    m_chartButton.setText("Charts: §7Off");
+
+    double replaySpeed = atof(HCPApplication::getInstance()->getOption("replay-speed", "1"));
+
+    for(std::unique_ptr<Rack>& rack : m_racks)
+    {
+        rack->transport->begin();
+        if(HCPCaptureReplay* replay = rack->transport->getReplay()) replay->setSpeed(replaySpeed);
+    }
+
+    attachRack(0);
 }
 
 void HCPMainMenu::draw()
 {
     hcpui::setupUIRendering();
 
-    hcpui::genString(m_splashText, 0, 0, 18.0f, 0xFF777777);
+    hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_splashStyled, m_splashText), 0, 0, 18.0f, 0xFF777777);
 
     HCPInputContext* inputs = hcpi::get();
-    hcpui::genString(std::to_string(inputs->numGameControllers()).c_str(), 0, 20, 18.0f, 0xFFFFFFFF);
+    hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_controllerCountText, std::to_string(inputs->numGameControllers()).c_str()), 0, 20, 18.0f, 0xFFFFFFFF);
 
     m_viewport.width = glm::max(800.0f, hcpui::getUIWidth() * 0.85f);
     m_viewport.height = glm::max(600.0f, m_viewport.width * 0.5625f);
@@ -75,9 +234,13 @@ void HCPMainMenu::draw()
 
         drawJoysticks();
 
-        drawRobotView();
+        if(m_showChart) drawChart();
+        else
+        {
+            drawRobotView();
 
-        drawRobotArmView();
+            drawRobotArmView();
+        }
     }
     m_viewport.end();
 
@@ -90,7 +253,42 @@ void HCPMainMenu::draw()
 
 void HCPMainMenu::close()
 {
-    m_serial->close();
+    bool dumpLatency = HCPApplication::getInstance()->hasOption("dump-latency");
+
+    for(std::unique_ptr<Rack>& rack : m_racks)
+    {
+        rack->transport->close();
+        rack->archive.close();
+        rack->stops.cancel();
+        rack->commands.cancel();
+        rack->recipes.cancel();
+        if(!dumpLatency) continue;
+
+        char title[192];
+        snprintf(title, sizeof(title), "%s ping round trip", rack->transport->getAddress());
+        rack->pingLatency.print(stdout, title);
+        snprintf(title, sizeof(title), "%s command to ack", rack->transport->getAddress());
+        rack->commands.getAckLatency().print(stdout, title);
+
+        static const char* const laneNames[] = { "control", "interactive", "bulk" };
+        HCPTransport::Stats stats = rack->transport->getStats();
+        for(int i = 0; i < HCPTransport::PRIORITY_COUNT; i++)
+            printf("%s %s lane: %llu bytes sent, at most %zu queued\n", rack->transport->getAddress(), laneNames[i],
+                (unsigned long long) stats.lanes[i].bytesSent, stats.lanes[i].maxQueued);
+
+        const HCPTransport::LineErrors& line = stats.lineErrors;
+        printf("%s link: %llu frames received, %llu sent, %u CRC and %u framing errors, "
+            "%u overruns, %u parity, %u line framing, %u breaks, at most %zu bytes received queued\n",
+            rack->transport->getAddress(), (unsigned long long) stats.framesReceived, (unsigned long long) stats.framesSent,
+            rack->decoder.getCRCErrors(), rack->decoder.getFramingErrors(),
+            line.overruns, line.parity, line.framing, line.breaks, stats.inputMaxQueued);
+    }
+
+    if(m_statsLog)
+    {
+        fclose(m_statsLog);
+        m_statsLog = nullptr;
+    }
 }
 
 void HCPMainMenu::drawHeader()
@@ -111,20 +309,69 @@ void HCPMainMenu::drawHeader()
         {
             hcpui::translate(edgeSize, edgeSize);
             float titleSize = (headerViewport.height - edgeSize * 2) * 0.35f;
-            hcpui::genString("Hydroponics System Control Panel", 4, 4, titleSize, 0x22000000);
-            hcpui::genString("Hydroponics System Control Panel", 0, 0, titleSize, 0xFFFFFFFF);
-
-            char serialPortStatus[256];
-            if (m_serial->isOpen())
-                snprintf(serialPortStatus, 256, "Serial Port: %s §2Online", m_serial->getPort());
-            else
-                snprintf(serialPortStatus, 256, "Serial Port: %s §4Offline", m_serial->getPort());
-            hcpui::genString(serialPortStatus, 0, titleSize + edgeSize * 2, titleSize * 0.68f, 0xFFAAAAAA);
+            const HCPStyledText& title = hcpui::cacheText(m_titleText, "Hydroponics System Control Panel");
+            hcpui::genString(HCPAlignment::TOP_LEFT, title, 4, 4, titleSize, 0x22000000);
+            hcpui::genString(HCPAlignment::TOP_LEFT, title, 0, 0, titleSize, 0xFFFFFFFF);
+
+            Rack& rack = *m_racks[m_rack];
+            char portStatus[256];
+            HCPCaptureReplay* replay = rack.transport->getReplay();
+            if(replay && rack.transport->isOpen())
+            {
+                snprintf(portStatus, 256, "Port: %s §bReplay §7%.1f / %.1f s", rack.transport->getAddress(),
+                    (replay->getPosition() - replay->getStartTime()) / 1e9, (replay->getEndTime() - replay->getStartTime()) / 1e9);
+            }
+            else switch(rack.transport->getState())
+            {
+            case HCPTransport::STATE_OPEN:
+            {
+                char ping[64], ack[64];
+                i_formatLatency(ping, 64, "Ping", rack.pingLatency);
+                i_formatLatency(ack, 64, "Ack", rack.commands.getAckLatency());
+                // Errors say more about the link than how busy it is
+                const char* online = "§2Online";
+                if(rack.monitor.isNoisy()) online = "§4Noisy";
+                else if(rack.monitor.isSaturated()) online = "§6Saturated";
+                snprintf(portStatus, 256, "Port: %s %s §7%s  %s (p50/p99/p99.9/max)", rack.transport->getAddress(), online, ping, ack);
+                break;
+            }
+            case HCPTransport::STATE_RECONNECTING:
+                snprintf(portStatus, 256, "Port: %s §6Reconnecting", rack.transport->getAddress());
+                break;
+            default:
+                snprintf(portStatus, 256, "Port: %s §4Offline", rack.transport->getAddress());
+                break;
+            }
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_portStatusText, portStatus), 0, titleSize + edgeSize * 2, titleSize * 0.68f, 0xFFAAAAAA);
             m_manualControlButton.height = titleSize * 0.68f;
             m_manualControlButton.y = titleSize + edgeSize * 3 + titleSize * 0.68f;
             m_manualControlButton.draw();
+
+            float statusX = m_manualControlButton.width + edgeSize;
+
+            m_stopButton.height = m_manualControlButton.height;
+            m_stopButton.x = statusX;
+            m_stopButton.y = m_manualControlButton.y;
+            m_stopButton.draw();
+            statusX += m_stopButton.width + edgeSize;
+
+            m_chartButton.height = m_manualControlButton.height;
+            m_chartButton.x = statusX;
+            m_chartButton.y = m_manualControlButton.y;
+            m_chartButton.draw();
+            statusX += m_chartButton.width + edgeSize;
+
+            if(1 < m_racks.size())
+            {
+                m_rackButton.height = m_manualControlButton.height;
+                m_rackButton.x = statusX;
+                m_rackButton.y = m_manualControlButton.y;
+                m_rackButton.draw();
+                statusX += m_rackButton.width + edgeSize;
+            }
+
             const char* controllerStatus = HCPInputContext::numGameControllers() == 0 ? "No Controllers Detected" : "Controller Detected";
-            hcpui::genString(controllerStatus, m_manualControlButton.width + edgeSize, m_manualControlButton.y, titleSize * 0.68f, 0xFFAAAAAA);
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_controllerStatusText, controllerStatus), statusX, m_manualControlButton.y, titleSize * 0.68f, 0xFFAAAAAA);
         }
         hcpui::popStack();
     }
@@ -174,11 +421,21 @@ void HCPMainMenu::drawRobotView()
             snprintf(info[0], 32, "X Axis: %2.2f", m_robX);
             snprintf(info[1], 32, "Y Axis: %2.2f", m_robY);
 
-            hcpui::genString(info[0], 0, 0, textSize, 0xFFFFFFFF);
-            hcpui::genString(info[1], 0, textSize + edgeSize, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_robotText[0], info[0]), 0, 0, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_robotText[1], info[1]), 0, textSize + edgeSize, textSize, 0xFFFFFFFF);
         }
         infoArea.end();
 
+        HCPViewport statsArea;
+        statsArea.width = infoArea.width;
+        statsArea.height = body.height - infoArea.height - edgeSize;
+        statsArea.x = infoArea.x;
+        statsArea.y = infoArea.height + edgeSize;
+
+        statsArea.start(false);
+        drawLinkStats(statsArea.width, statsArea.height);
+        statsArea.end();
+
         HCPViewport cameraViewport;
         cameraViewport.width = body.width - infoArea.width - edgeSize;
         cameraViewport.height = body.height;
@@ -218,6 +475,51 @@ void HCPMainMenu::drawRobotView()
     body.end();
 }
 
+void HCPMainMenu::drawChart()
+{
+    // Channels appear with their first sample and change with the rack
+    const Rack& rack = *m_racks[m_rack];
+    for(uint8_t channel = 0; channel <= HCPMessage::CHANNEL_PUMP_CURRENT; channel++)
+        m_chart.setChannel(channel, rack.telemetry.getChannel(channel));
+    m_chart.setArchive(rack.archive.isOpen() ? &rack.archive : nullptr, rack.telemetry.getWallClockOffset());
+
+    m_chart.width = m_viewport.width - edgeSize * 2;
+    m_chart.height = m_viewport.height * 0.52f - edgeSize * 4;
+    m_chart.x = edgeSize;
+    m_chart.y = m_viewport.height * 0.20f + edgeSize * 2;
+
+    m_chart.draw();
+}
+
+void HCPMainMenu::drawLinkStats(float width, float height)
+{
+    const float textSize = 14.0f;
+    const Rack& rack = *m_racks[m_rack];
+    const HCPLinkMonitor& monitor = rack.monitor;
+    const HCPTransport::Stats& stats = monitor.getStats();
+    const HCPLinkMonitor::Rates& rates = monitor.getRates();
+
+    hcpui::genGradientQuad(HCPDirection::BOTTOM, 0, 0, width, height, 0x22000000, 0x00000000);
+    hcpui::translate(edgeSize, edgeSize);
+
+    char rx[16], tx[16], queued[16];
+    i_formatBytes(rx, sizeof(rx), rates.bytesReceived);
+    i_formatBytes(tx, sizeof(tx), rates.bytesSent);
+    i_formatBytes(queued, sizeof(queued), (double) stats.inputMaxQueued);
+
+    char lines[5][48];
+    snprintf(lines[0], 48, "RX %sB/s %.0ff/s", rx, rates.framesReceived);
+    snprintf(lines[1], 48, "TX %sB/s %.0ff/s", tx, rates.framesSent);
+    if(monitor.isSaturated()) snprintf(lines[2], 48, "Line §6%.0f%% §7Q %s", monitor.getLoad() * 100.0, queued);
+    else snprintf(lines[2], 48, "Line %.0f%% Q %s", monitor.getLoad() * 100.0, queued);
+    if(monitor.isNoisy()) snprintf(lines[3], 48, "Errors §4%llu", (unsigned long long) monitor.getErrors());
+    else snprintf(lines[3], 48, "Errors %llu", (unsigned long long) monitor.getErrors());
+    snprintf(lines[4], 48, "Reconnects %u", stats.reconnects);
+
+    for(int i = 0; i < 5; i++)
+        hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_linkStatsText[i], lines[i]), 0, (textSize + edgeSize) * i, textSize, 0xFFAAAAAA);
+}
+
 void HCPMainMenu::drawRobotArmView()
 {
     HCPViewport body;
@@ -263,8 +565,8 @@ void HCPMainMenu::drawRobotArmView()
             snprintf(info[0], 32, "Swivel: %2.2f", m_robSwivel);
             snprintf(info[1], 32, "Claw: %2.2f", m_robClaw);
 
-            hcpui::genString(info[0], 0, 0, textSize, 0xFFFFFFFF);
-            hcpui::genString(info[1], 0, textSize + edgeSize, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_robotText[2], info[0]), 0, 0, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_robotText[3], info[1]), 0, textSize + edgeSize, textSize, 0xFFFFFFFF);
         }
         infoArea.end();
     }
@@ -289,16 +591,29 @@ void HCPMainMenu::handleInput()
         const HCPGameController& controller = HCPInputContext::getGameController(0);
         m_xyJoystick.joyX = controller.axis(0);
         m_xyJoystick.joyY = controller.axis(1);
-        m_robX += controller.axis(0) * 0.15f;
-        m_robY -= controller.axis(1) * 0.15f;
-        m_robX = glm::max(0.0f, glm::min(m_robX, 65.0f));
-        m_robY = glm::max(0.0f, glm::min(m_robY, 28.0f));
+        m_targets[0] += controller.axis(0) * 0.15f;
+        m_targets[1] -= controller.axis(1) * 0.15f;
+        m_targets[0] = glm::max(0.0f, glm::min(m_targets[0], 65.0f));
+        m_targets[1] = glm::max(0.0f, glm::min(m_targets[1], 28.0f));
 
         m_clawJoystick.joyX = controller.axis(2);
         m_clawJoystick.joyY = controller.axis(3);
-        m_robSwivel -= controller.axis(2) * 0.01f;
-        m_robClaw += controller.axis(3) * 0.005f;
-        m_robClaw = glm::max(-0.5f, glm::min(m_robClaw, 0.37f));
+        m_targets[2] -= controller.axis(2) * 0.01f;
+        m_targets[3] += controller.axis(3) * 0.005f;
+        m_targets[3] = glm::max(-0.5f, glm::min(m_targets[3], 0.37f));
+
+        // Sent from the I/O side at the setpoint rate, only the latest counts
+        Rack& rack = *m_racks[m_rack];
+        if(m_manualControlEnabled && !rack.awaitingState) rack.setpoints.setTargets(m_targets);
+    }
+
+    // Until the rack reports where it is, preview the setpoints
+    if(!m_robReported)
+    {
+        m_robX = m_targets[0];
+        m_robY = m_targets[1];
+        m_robSwivel = m_targets[2];
+        m_robClaw = m_targets[3];
     }
 
     if(m_manualControlButton.isPressed())
@@ -308,6 +623,20 @@ void HCPMainMenu::handleInput()
         .setText(m_manualControlEnabled && m_manualControlButton.isEnabled() ? "Manual Control: §2On" : "Manual Control: §4Off");
     }
 
+    if(m_stopButton.isPressed())
+        emergencyStop();
+
+    if(m_chartButton.isPressed())
+    {
+        m_showChart = !m_showChart;
+        m_chartButton.setText(m_showChart ? "Charts: §2On" : "Charts: §7Off");
+    }
+
+    if(m_rackButton.isPressed())
+        attachRack((m_rack + 1) % m_racks.size());
+
+    Rack& attached = *m_racks[m_rack];
+
     if(m_console.commandSendTriggered())
     {
         if(strcmp(m_console.getCommand(), "clear") == 0)
@@ -316,29 +645,275 @@ void HCPMainMenu::handleInput()
             return;
         }
 
-        char command[512];
-        snprintf(command, 512, "%s\n", m_console.getCommand());
+        const char* command = m_console.getCommand();
         m_console.addLog(command);
+        m_console.addLog("\n");
+
+        if(!attached.transport->isOpen())
+            m_console.addLog("§4Not connected, command dropped\n");
+        else if(strncmp(command, "run ", 4) == 0)
+            runRecipe(attached, command + 4);
+        else
+            sendCommand(attached, attached.commands, HCPProtocol::consoleMessage(command, strlen(command), attached.txSeq++));
+    }
+
+    for(std::unique_ptr<Rack>& rack : m_racks)
+        serviceRack(*rack);
+
+    if(m_statsLog) logStats();
+}
+
+void HCPMainMenu::attachRack(size_t index)
+{
+    m_rack = index;
+    Rack& rack = *m_racks[m_rack];
+
+    // The view follows the new rack once it reports its position
+    m_robReported = false;
+
+    char text[64];
+    snprintf(text, sizeof(text), "Rack: %zu/%zu", m_rack + 1, m_racks.size());
+    m_rackButton.setText(text);
+
+    if(m_racks.size() < 2) return;
+
+    char log[192];
+    snprintf(log, sizeof(log), "§7Attached to rack %zu on %s\n", m_rack + 1, rack.transport->getAddress());
+    m_console.clearLog();
+    m_console.addLog(log);
+}
+
+void HCPMainMenu::serviceRack(Rack& rack)
+{
+    HCPTransport& transport = *rack.transport;
+
+    // Sampled whether or not the link is up, so the rates fall to nothing
+    rack.monitor.update(transport, rack.decoder);
 
-        if(m_serial->isOpen())
-            m_serial->write((const uint8_t*) command, strlen(command));
+    // In polled mode a lost port is reopened from here
+    if(!transport.isOpen()) transport.poll();
+    if(!transport.isOpen()) return;
 
+    uint32_t reconnects = transport.getStats().reconnects;
+    if(reconnects != rack.reconnects)
+    {
+        rack.reconnects = reconnects;
+
+        // Where the joysticks drifted to while the link was down is stale.
+        // Jogging picks up from wherever the rack reports it is.
+        if(m_setpointResume == HCPSetpointStreamer::RESUME_DISCARD)
+        {
+            rack.awaitingState = true;
+            if(&rack == m_racks[m_rack].get()) m_robReported = false;
+        }
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(rack.nextPing <= now)
+    {
+        HCPMessage ping(HCPMessage::PING, rack.txSeq++);
+        ping.ping.timestamp = i_toMicros(now.time_since_epoch());
+        HCPProtocol::send(transport, ping);
+        rack.nextPing = now + pingInterval;
     }
 
-    if(m_serial->isOpen())
-    {   
-        m_serial->poll();
+    // Never blocks, only picks up what the transport already has. In threaded or
+    // reactor mode this is a no-op and the ring is filled by the I/O thread.
+    transport.poll();
 
-        if(m_serial->available())
+    // Decode frames straight out of the ring
+    HCPRingBuffer::Span spans[2];
+    HCPMessage message;
+    size_t received = transport.peek(spans);
+    size_t spanStart = 0;
+    for(const HCPRingBuffer::Span& span : spans)
+    {
+        size_t offset = 0;
+        while(offset < span.len)
         {
-            char buffer[512];
-            int bytesRead = m_serial->read((uint8_t*) buffer, 512);
-            if(bytesRead > 0)
-            {
-                buffer[bytesRead] = 0;
-                m_console.addLog(buffer);
-            }
+            offset += rack.decoder.feed(span.data + offset, span.len - offset, &message);
+            if(message.type != HCPMessage::NONE) handleMessage(rack, message, spanStart + offset - 1);
         }
+        spanStart += span.len;
+    }
+    transport.consume(received);
+
+    // After the acks are in, so the windows have room again. The lanes decide
+    // what goes out first, not the order here.
+    rack.stops.service(transport);
+    rack.commands.service(transport);
+    rack.recipes.service(transport);
+}
+
+void HCPMainMenu::logStats()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now < m_nextStatsLog) return;
+    m_nextStatsLog += statsLogInterval;
+    if(m_nextStatsLog < now) m_nextStatsLog = now + statsLogInterval;
+
+    double time = std::chrono::duration<double>(now - m_statsLogStart).count();
+    for(std::unique_ptr<Rack>& rack : m_racks)
+        rack->monitor.print(m_statsLog, time, rack->transport->getAddress());
+    fflush(m_statsLog);
+}
+
+bool HCPMainMenu::sendCommand(Rack& rack, HCPCommandQueue& queue, const HCPMessage& message, HCPCommandQueue::Callback done)
+{
+    Rack* target = &rack;
+
+    return queue.submit(message, [this, target, done](const HCPCommandQueue::Completion& completion)
+    {
+        bool attached = target == m_racks[m_rack].get();
+        char log[64] = "";
+
+        if(completion.result == HCPCommandQueue::RESULT_FAILED)
+            snprintf(log, sizeof(log), "§4Command %u failed with status %u\n", completion.seq, completion.status);
+        else if(completion.result == HCPCommandQueue::RESULT_TIMEOUT)
+            snprintf(log, sizeof(log), "§4Command %u timed out after %u attempts\n", completion.seq, completion.attempts);
+
+        if(attached && log[0]) m_console.addLog(log);
+        if(done) done(completion);
+    });
+}
+
+// Sends every line of the file as a console command, all pipelined through
+// the rack's bulk queue. Blank lines and lines starting with # are skipped.
+void HCPMainMenu::runRecipe(Rack& rack, const char* path)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        char log[320];
+        snprintf(log, sizeof(log), "§4Failed to open recipe: %s\n", path);
+        m_console.addLog(log);
+        return;
+    }
+
+    struct Progress
+    {
+        std::string name;
+        std::chrono::steady_clock::time_point start;
+        size_t steps;
+        size_t completed;
+        size_t failed;
+    };
+    std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    progress->name = path;
+    progress->start = std::chrono::steady_clock::now();
+    progress->steps = progress->completed = progress->failed = 0;
+
+    std::vector<std::string> lines;
+    for(std::string line; std::getline(file, line);)
+    {
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        if(!line.empty() && line[0] != '#') lines.push_back(line);
+    }
+
+    Rack* target = &rack;
+    for(const std::string& line : lines)
+    {
+        HCPMessage message = HCPProtocol::consoleMessage(line.c_str(), line.size(), rack.txSeq++);
+        progress->steps++;
+
+        sendCommand(rack, rack.recipes, message, [this, target, progress](const HCPCommandQueue::Completion& completion)
+        {
+            progress->completed++;
+            if(completion.result != HCPCommandQueue::RESULT_OK) progress->failed++;
+
+            if(progress->completed < progress->steps || target != m_racks[m_rack].get()) return;
+
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - progress->start).count();
+            char log[384];
+            snprintf(log, sizeof(log), "%sRecipe %s: %zu steps in %.1f ms, %zu failed\n",
+                progress->failed ? "§4" : "§2", progress->name.c_str(), progress->steps, ms, progress->failed);
+            m_console.addLog(log);
+        });
+    }
+}
+
+// Stops every rack, not only the attached one. Recipe steps that haven't gone
+// out yet are dropped and manual control is turned off, so nothing moves the
+// gantry again until someone turns it back on.
+void HCPMainMenu::emergencyStop()
+{
+    m_manualControlEnabled = false;
+    m_manualControlButton.setText("Manual Control: §4Off");
+
+    // Jogging carries on from where the rack stopped, not the old setpoints
+    m_robReported = false;
+
+    for(std::unique_ptr<Rack>& rack : m_racks)
+    {
+        rack->recipes.cancel();
+        if(!rack->transport->isOpen()) continue;
+
+        HCPMessage stop(HCPMessage::COMMAND, rack->txSeq++);
+        stop.command.opcode = HCPMessage::CMD_STOP;
+        stop.command.len = 0;
+        sendCommand(*rack, rack->stops, stop);
+    }
+
+    m_console.addLog("§4Emergency stop\n");
+}
+
+// The offset is where the frame ended in the current peek() of the rack's port
+void HCPMainMenu::handleMessage(Rack& rack, const HCPMessage& message, size_t offset)
+{
+    bool attached = &rack == m_racks[m_rack].get();
+
+    switch(message.type)
+    {
+    case HCPMessage::ROBOT_STATE:
+        rack.awaitingState = false;
+        if(!attached) break;
+
+        // The rack reports where the gantry actually is, that wins over the
+        // joysticks. Jogging carries on from there.
+        if(!m_robReported)
+        {
+            m_targets[0] = message.robot.x;
+            m_targets[1] = message.robot.y;
+            m_targets[2] = message.robot.swivel;
+            m_targets[3] = message.robot.claw;
+            m_robReported = true;
+        }
+
+        m_robX = message.robot.x;
+        m_robY = message.robot.y;
+        m_robSwivel = message.robot.swivel;
+        m_robClaw = message.robot.claw;
+
+        HCPRobotRenderer::setX(m_robX);
+        HCPRobotRenderer::setY(m_robY);
+        HCPRobotRenderer::setSwivel(m_robSwivel);
+        HCPRobotRenderer::setClaw(m_robClaw);
+        break;
+    case HCPMessage::SENSOR_SAMPLES:
+        // Kept for every rack, the view only shows the attached one
+        rack.telemetry.append(message.sensors);
+        break;
+    case HCPMessage::CONSOLE:
+        if(!attached) break;
+        m_console.addLog(message.console.text, message.console.len);
+        m_console.addLog("\n");
+        break;
+    case HCPMessage::PONG:
+    {
+        uint64_t received = i_toMicros(rack.transport->getReceiveTime(offset).time_since_epoch());
+        if(message.ping.timestamp <= received) rack.pingLatency.record(received - message.ping.timestamp);
+        break;
+    }
+    case HCPMessage::ACK:
+        // Failures are logged when the queue reports the command. Seqs are
+        // shared by the queues, so only one of them takes it.
+        {
+            std::chrono::steady_clock::time_point receivedAt = rack.transport->getReceiveTime(offset);
+            rack.stops.handleAck(message, receivedAt) || rack.commands.handleAck(message, receivedAt) || rack.recipes.handleAck(message, receivedAt);
+        }
+        break;
+    default:
+        break;
     }
 }
 
@@ -370,7 +945,7 @@ void HCPMainMenu::JoyStickVisual::doDraw()
         header.start(false);
         {
             hcpui::genQuad(0, 0, header.width, header.height, 0x11000000);
-            hcpui::genString(getText(), edgeSize, edgeSize, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, getStyledText(), edgeSize, edgeSize, textSize, 0xFFFFFFFF);
         }
         header.end();
 
@@ -391,10 +966,10 @@ void HCPMainMenu::JoyStickVisual::doDraw()
             hcpui::genDisc(centerX + xTravel, centerY + yTravel, radius * 0.56f, 0x22000000);
             hcpui::genDisc(centerX + xTravel, centerY + yTravel, radius * 0.46f, 0xAAFFFFFF);
 
-            hcpui::genString(HCPAlignment::CENTER, axesLabels[0], centerX + radius, centerY, textSize, 0xFFAAAAAA);
-            hcpui::genString(HCPAlignment::CENTER, axesLabels[1], centerX - radius, centerY, textSize, 0xFFAAAAAA);
-            hcpui::genString(HCPAlignment::CENTER, axesLabels[2], centerX, centerY - radius, textSize, 0xFFAAAAAA);
-            hcpui::genString(HCPAlignment::CENTER, axesLabels[3], centerX, centerY + radius, textSize, 0xFFAAAAAA);
+            hcpui::genString(HCPAlignment::CENTER, hcpui::cacheText(m_axesText[0], axesLabels[0]), centerX + radius, centerY, textSize, 0xFFAAAAAA);
+            hcpui::genString(HCPAlignment::CENTER, hcpui::cacheText(m_axesText[1], axesLabels[1]), centerX - radius, centerY, textSize, 0xFFAAAAAA);
+            hcpui::genString(HCPAlignment::CENTER, hcpui::cacheText(m_axesText[2], axesLabels[2]), centerX, centerY - radius, textSize, 0xFFAAAAAA);
+            hcpui::genString(HCPAlignment::CENTER, hcpui::cacheText(m_axesText[3], axesLabels[3]), centerX, centerY + radius, textSize, 0xFFAAAAAA);
         }
         joystickArea.end();
     }
@@ -403,56 +978,32 @@ void HCPMainMenu::JoyStickVisual::doDraw()
 
 HCPMainMenu::Console::Console() :
     m_scroll(0),
-    m_logLen(0),
-    m_logIndex(0)
+    m_frame(0),
+    m_queryValid(true),
+    m_filter(false)
 {
     m_sendButton.setText(">");
     m_commandField.setTitle("Command");
+    m_searchField.setTitle("Search, /regex/");
+    m_filterButton.setText("Filter: §7Off");
 }
 
 void HCPMainMenu::Console::addLog(const char* log)
 {
-    int newLogLen = (int) strlen(log);
-
-    for(int i = 0; i < newLogLen; i++)
-    {
-        m_logIndex = m_logIndex % (m_log.size() - 1);
-        m_log[m_logIndex] = log[i];
-        m_logIndex++;
-        m_logLen++;
-    }
-
-    if(m_log.size() - 1 < m_logLen)
-    {
-        std::rotate(m_log.begin(), m_log.begin() + m_logIndex, m_log.end() - 1);
-
-        m_logIndex = 0;
-    }
-
-    if(!newLogLen) return;
-
-    const char* line = m_log.data();
-    size_t lineLen = 0;
-    m_lines.clear();
-    for(int i = 0; i < m_log.size() - 1; i++)
-    {
-        if(m_log[i] == '\n' || m_log[i] == '\r' || m_log[i] == '\0')
-        {
-            if(lineLen) m_lines.emplace_back(line, lineLen);
-            line = m_log.data() + i + 1;
-            lineLen = 0;
+    addLog(log, strlen(log));
+}
 
-            if(m_log[i] == '\0') break;
-        }
-        else lineLen++;
-    }
+void HCPMainMenu::Console::addLog(const char* log, size_t len)
+{
+    m_lines.append(log, len);
+    m_index.append(log, len);
 }
 
 void HCPMainMenu::Console::clearLog()
 {
-    m_logLen = 0;
-    m_logIndex = 0;
-    m_log.fill(0);
+    m_lines.clear();
+    m_index.clear();
+    m_scroll = 0;
 }
 
 const char* HCPMainMenu::Console::getCommand()
@@ -490,10 +1041,32 @@ void HCPMainMenu::Console::doDraw()
         header.start(false);
         {
             hcpui::genQuad(0, 0, header.width, header.height, 0x11000000);
-            hcpui::genString(getText(), edgeSize, edgeSize, textSize, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_LEFT, getStyledText(), edgeSize, edgeSize, textSize, 0xFFFFFFFF);
+
+            char status[64] = "";
+            if(!m_queryValid) snprintf(status, sizeof(status), "§4Bad regex");
+            else if(m_index.isSearching()) snprintf(status, sizeof(status), "§7Searching...");
+            else if(!m_query.empty()) snprintf(status, sizeof(status), "§7%zu matches", m_index.getMatchCount());
+
+            float statusX = edgeSize + hcpui::getStringwidth(getStyledText(), textSize) + textSize;
+            hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_statusText, status), statusX, edgeSize, textSize, 0xFFFFFFFF);
         }
         header.end();
 
+        m_filterButton.height = header.height - edgeSize * 2;
+        m_filterButton.width = m_filterButton.height * 5;
+        m_filterButton.x = body.width - m_filterButton.width - edgeSize;
+        m_filterButton.y = edgeSize;
+
+        m_searchField.height = m_filterButton.height;
+        m_searchField.width = body.width * 0.35f;
+        m_searchField.x = m_filterButton.x - m_searchField.width - edgeSize;
+        m_searchField.y = edgeSize;
+
+        m_searchField.draw();
+        m_filterButton.draw();
+        updateSearch();
+
         m_commandField.height = header.height * 0.9f;
         m_commandField.width = body.width - m_commandField.height;
         m_commandField.x = m_commandField.height;
@@ -517,14 +1090,54 @@ void HCPMainMenu::Console::doDraw()
 
         m_viewport.start(true);
         {
-            float y = m_viewport.height + m_scroll * 14;
-            for(auto i = m_lines.rbegin(); i != m_lines.rend(); i++)
+            // Only the lines in the viewport, counted up from the newest. When
+            // filtering the rows are the matches instead.
+            const float lineHeight = 14;
+            bool filtering = m_filter && !m_query.empty();
+            size_t lineCount = filtering ? m_index.getMatchCount() : m_lines.getLineCount();
+            size_t first = std::min((size_t) std::max(0, m_scroll - 1), lineCount);
+            size_t last = std::min((size_t) m_scroll + (size_t) (m_viewport.height / lineHeight) + 2, lineCount);
+            m_frame++;
+
+            m_visibleLines.resize(last - first);
+            if(filtering)
+            {
+                m_visibleLines.resize(m_index.getMatches(lineCount - last, last - first, m_visibleLines.data()));
+                std::reverse(m_visibleLines.begin(), m_visibleLines.end());
+            }
+            else
+            {
+                for(size_t i = first; i < last; i++) m_visibleLines[i - first] = m_lines.getEndLine() - 1 - i;
+            }
+
+            for(size_t i = first; i < first + m_visibleLines.size(); i++)
             {
-                // Draw line if it is in the viewport
-                if(y > -14 && y < m_viewport.height + 14)
-                    hcpui::genString(HCPAlignment::BOTTOM_LEFT, i->first, i->second, 0, y, 14, 0xFFFFFFFF);
+                // Matches can outlive the line here until the index drops it too
+                uint64_t number = m_visibleLines[i - first];
+                if(number < m_lines.getFirstLine()) continue;
 
-                y -= 14;
+                HCPLineStore::Line line = m_lines.getLine(number);
+                float y = m_viewport.height + (m_scroll - (int) i) * lineHeight;
+
+                if(!filtering && !m_query.empty() && m_index.isMatch(number))
+                    hcpui::genQuad(0, y - lineHeight, m_viewport.width, y, 0x33FFAA00);
+
+                CachedLine& cached = m_lineCache[number];
+                if(!cached.frame || cached.len != line.len)
+                {
+                    hcpui::buildText(cached.mesh, line.text, line.len, lineHeight, 0xFFFFFFFF);
+                    cached.len = line.len;
+                }
+                cached.frame = m_frame;
+
+                hcpui::genText(HCPAlignment::BOTTOM_LEFT, cached.mesh, 0, y);
+            }
+
+            // Whatever scrolled out of view or was cleared
+            for(auto i = m_lineCache.begin(); i != m_lineCache.end();)
+            {
+                if(i->second.frame != m_frame) i = m_lineCache.erase(i);
+                else i++;
             }
         }
         m_viewport.end();
@@ -534,6 +1147,41 @@ void HCPMainMenu::Console::doDraw()
     handleInput();
 }
 
+void HCPMainMenu::Console::updateSearch()
+{
+    HCPInputContext* input = hcpi::get();
+
+    if(m_filterButton.isPressed())
+    {
+        m_filter = !m_filter;
+        m_filterButton.setText(m_filter ? "Filter: §2On" : "Filter: §7Off");
+        m_scroll = 0;
+    }
+
+    const char* text = m_searchField.getText();
+    if(m_query != text)
+    {
+        // A regex between slashes, the closing one is optional
+        m_query = text;
+        bool regex = 1 < m_query.size() && m_query[0] == '/';
+        bool closed = regex && 2 < m_query.size() && m_query.back() == '/';
+        std::string query = regex ? m_query.substr(1, m_query.size() - 1 - closed) : m_query;
+
+        m_queryValid = m_index.setQuery(query.c_str(), regex);
+        if(m_filter) m_scroll = 0;
+    }
+
+    // Enter steps to the next match above the newest line in view
+    bool enterIsPressed = input->iskeyPressed(GLFW_KEY_ENTER) || input->iskeyPressed(GLFW_KEY_KP_ENTER);
+    if(!m_filter && m_searchField.isFocused() && enterIsPressed)
+    {
+        uint64_t match;
+        uint64_t newest = m_lines.getEndLine() - 1 - m_scroll;
+        if(m_index.findMatchBefore(newest, &match) && m_lines.getFirstLine() <= match)
+            m_scroll = (int) (m_lines.getEndLine() - 1 - match);
+    }
+}
+
 void HCPMainMenu::Console::handleInput()
 {
     HCPInputContext* input = hcpi::get();
@@ -548,5 +1196,6 @@ void HCPMainMenu::Console::handleInput()
     if(m_viewport.isHovered() && (input->iskeyPressed(GLFW_KEY_DOWN) || input->iskeyRepeating(GLFW_KEY_DOWN)))
         m_scroll--;
 
-    m_scroll = std::max(0, std::min(m_scroll, (int)m_lines.size() - 1));
+    int lineCount = (int) (m_filter && !m_query.empty() ? m_index.getMatchCount() : m_lines.getLineCount());
+    m_scroll = std::max(0, std::min(m_scroll, lineCount - 1));
 }
\ No newline at end of file
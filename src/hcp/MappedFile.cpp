@@ -0,0 +1,84 @@
+#include "hcp/MappedFile.hpp"
+
+#include <cstdio>
+
+HCPLogger HCPMappedFile::s_logger("MappedFile");
+
+HCPMappedFile::HCPMappedFile() :
+    m_mode(MODE_READ),
+    m_open(false),
+    m_data(nullptr),
+    m_size(0),
+    m_impl(nullptr)
+{
+    m_path[0] = '\0';
+    impl_init();
+}
+
+HCPMappedFile::~HCPMappedFile()
+{
+    close();
+    impl_destroy();
+}
+
+bool HCPMappedFile::open(const char* path, Mode mode)
+{
+    close();
+
+    snprintf(m_path, sizeof(m_path), "%s", path);
+    m_mode = mode;
+
+    m_open = impl_open();
+    return m_open;
+}
+
+void HCPMappedFile::close()
+{
+    impl_close();
+    m_open = false;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool HCPMappedFile::isOpen() const
+{
+    return m_open;
+}
+
+bool HCPMappedFile::resize(size_t size)
+{
+    if(!m_open) return false;
+
+    if(m_mode != MODE_READ_WRITE)
+    {
+        s_logger.errorf("Cannot resize read only file: %s", m_path);
+        return false;
+    }
+
+    return size == m_size || impl_resize(size);
+}
+
+void HCPMappedFile::flush()
+{
+    if(m_data) impl_flush();
+}
+
+uint8_t* HCPMappedFile::data()
+{
+    return m_data;
+}
+
+const uint8_t* HCPMappedFile::data() const
+{
+    return m_data;
+}
+
+size_t HCPMappedFile::size() const
+{
+    return m_size;
+}
+
+const char* HCPMappedFile::getPath() const
+{
+    return m_path;
+}
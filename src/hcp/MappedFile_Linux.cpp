@@ -0,0 +1,110 @@
+#ifdef __linux__
+#include "hcp/MappedFile.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+struct ImplMappedLinux
+{
+    int handle;
+};
+
+#define getImpl() (*((ImplMappedLinux*) m_impl))
+
+void IMPL_FUNC HCPMappedFile::impl_init()
+{
+    m_impl = new ImplMappedLinux();
+    getImpl().handle = -1;
+}
+
+bool IMPL_FUNC HCPMappedFile::impl_open()
+{
+    ImplMappedLinux& impl = getImpl();
+
+    bool writable = m_mode == MODE_READ_WRITE;
+    impl.handle = ::open(m_path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+
+    if(impl.handle < 0)
+    {
+        s_logger.errorf("Failed to open %s (%s)", m_path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if(fstat(impl.handle, &info) < 0)
+    {
+        s_logger.errorf("Failed to stat %s (%s)", m_path, strerror(errno));
+        impl_close();
+        return false;
+    }
+
+    // An empty file has nothing to map until it grows
+    m_size = (size_t) info.st_size;
+    if(!m_size) return true;
+
+    void* data = mmap(nullptr, m_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, impl.handle, 0);
+    if(data == MAP_FAILED)
+    {
+        s_logger.errorf("Failed to map %s (%s)", m_path, strerror(errno));
+        impl_close();
+        return false;
+    }
+
+    m_data = (uint8_t*) data;
+    return true;
+}
+
+void IMPL_FUNC HCPMappedFile::impl_close()
+{
+    ImplMappedLinux& impl = getImpl();
+
+    if(m_data) munmap(m_data, m_size);
+    if(0 <= impl.handle) ::close(impl.handle);
+    impl.handle = -1;
+}
+
+bool IMPL_FUNC HCPMappedFile::impl_resize(size_t size)
+{
+    ImplMappedLinux& impl = getImpl();
+
+    if(ftruncate(impl.handle, (off_t) size) < 0)
+    {
+        s_logger.errorf("Failed to resize %s (%s)", m_path, strerror(errno));
+        return false;
+    }
+
+    void* data = MAP_FAILED;
+    if(!size)
+    {
+        if(m_data) munmap(m_data, m_size);
+        data = nullptr;
+    }
+    else if(m_data) data = mremap(m_data, m_size, size, MREMAP_MAYMOVE);
+    else data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, impl.handle, 0);
+
+    if(data == MAP_FAILED)
+    {
+        s_logger.errorf("Failed to map %s (%s)", m_path, strerror(errno));
+        return false;
+    }
+
+    m_data = (uint8_t*) data;
+    m_size = size;
+    return true;
+}
+
+void IMPL_FUNC HCPMappedFile::impl_flush()
+{
+    msync(m_data, m_size, MS_ASYNC);
+}
+
+void IMPL_FUNC HCPMappedFile::impl_destroy()
+{
+    if(m_impl) delete (ImplMappedLinux*) m_impl;
+}
+
+#endif // Linux
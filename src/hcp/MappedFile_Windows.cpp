@@ -0,0 +1,111 @@
+#ifdef _WIN32
+#include "hcp/MappedFile.hpp"
+
+#include <Windows.h>
+
+struct ImplMappedWindows
+{
+    HANDLE handle;
+    HANDLE mapping;
+};
+
+#define getImpl() (*((ImplMappedWindows*) m_impl))
+
+// A view can't grow in place, so resizing maps the file again from scratch
+static bool i_map(ImplMappedWindows& impl, bool writable, size_t size, uint8_t** data)
+{
+    *data = nullptr;
+    if(!size) return true;
+
+    impl.mapping = CreateFileMappingA(impl.handle, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+        (DWORD) ((uint64_t) size >> 32), (DWORD) size, NULL);
+    if(!impl.mapping) return false;
+
+    *data = (uint8_t*) MapViewOfFile(impl.mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if(*data) return true;
+
+    CloseHandle(impl.mapping);
+    impl.mapping = NULL;
+    return false;
+}
+
+static void i_unmap(ImplMappedWindows& impl, uint8_t* data)
+{
+    if(data) UnmapViewOfFile(data);
+    if(impl.mapping) CloseHandle(impl.mapping);
+    impl.mapping = NULL;
+}
+
+void IMPL_FUNC HCPMappedFile::impl_init()
+{
+    m_impl = new ImplMappedWindows();
+    getImpl().handle = INVALID_HANDLE_VALUE;
+    getImpl().mapping = NULL;
+}
+
+bool IMPL_FUNC HCPMappedFile::impl_open()
+{
+    ImplMappedWindows& impl = getImpl();
+
+    bool writable = m_mode == MODE_READ_WRITE;
+    impl.handle = CreateFileA(m_path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if(impl.handle == INVALID_HANDLE_VALUE)
+    {
+        s_logger.errorf("Failed to open %s error %d", m_path, GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(impl.handle, &size) || !i_map(impl, writable, (size_t) size.QuadPart, &m_data))
+    {
+        s_logger.errorf("Failed to map %s error %d", m_path, GetLastError());
+        impl_close();
+        return false;
+    }
+
+    m_size = (size_t) size.QuadPart;
+    return true;
+}
+
+void IMPL_FUNC HCPMappedFile::impl_close()
+{
+    ImplMappedWindows& impl = getImpl();
+
+    i_unmap(impl, m_data);
+    if(impl.handle != INVALID_HANDLE_VALUE) CloseHandle(impl.handle);
+    impl.handle = INVALID_HANDLE_VALUE;
+}
+
+bool IMPL_FUNC HCPMappedFile::impl_resize(size_t size)
+{
+    ImplMappedWindows& impl = getImpl();
+
+    i_unmap(impl, m_data);
+    m_data = nullptr;
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG) size;
+    if(!SetFilePointerEx(impl.handle, end, NULL, FILE_BEGIN) || !SetEndOfFile(impl.handle) || !i_map(impl, true, size, &m_data))
+    {
+        s_logger.errorf("Failed to resize %s error %d", m_path, GetLastError());
+        m_size = 0;
+        return false;
+    }
+
+    m_size = size;
+    return true;
+}
+
+void IMPL_FUNC HCPMappedFile::impl_flush()
+{
+    FlushViewOfFile(m_data, 0);
+}
+
+void IMPL_FUNC HCPMappedFile::impl_destroy()
+{
+    if(m_impl) delete (ImplMappedWindows*) m_impl;
+}
+
+#endif // Windows
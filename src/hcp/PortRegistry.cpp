@@ -0,0 +1,170 @@
+#include "hcp/PortRegistry.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+HCPLogger HCPPortRegistry::s_logger("PortRegistry");
+
+HCPPortRegistry::Port::Port() :
+    vendorId(0),
+    productId(0)
+{
+}
+
+std::string HCPPortRegistry::Port::describe() const
+{
+    std::string description = path;
+
+    if(!product.empty()) description += " - " + product;
+    else if(vendorId)
+    {
+        char ids[16];
+        snprintf(ids, sizeof(ids), " - %04x:%04x", vendorId, productId);
+        description += ids;
+    }
+    else if(!driver.empty()) description += " - " + driver;
+
+    if(!serialNumber.empty()) description += " (" + serialNumber + ")";
+
+    return description;
+}
+
+HCPPortRegistry* HCPPortRegistry::getInstance()
+{
+    static HCPPortRegistry registry;
+    return &registry;
+}
+
+HCPPortRegistry::HCPPortRegistry() :
+    m_running(false),
+    m_ready(false),
+    m_version(0),
+    m_impl(nullptr)
+{
+    impl_init();
+}
+
+HCPPortRegistry::~HCPPortRegistry()
+{
+    stop();
+    impl_destroy();
+}
+
+void HCPPortRegistry::start()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_thread.joinable()) return;
+
+    m_running = true;
+    m_thread = std::thread(&HCPPortRegistry::impl_run, this);
+}
+
+void HCPPortRegistry::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if(!m_thread.joinable()) return;
+        m_running = false;
+    }
+
+    impl_wake();
+    m_thread.join();
+}
+
+bool HCPPortRegistry::isReady() const
+{
+    return m_ready.load(std::memory_order_acquire);
+}
+
+uint32_t HCPPortRegistry::getVersion() const
+{
+    return m_version.load(std::memory_order_acquire);
+}
+
+std::vector<HCPPortRegistry::Port> HCPPortRegistry::getPorts() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    std::vector<Port> ports;
+    ports.reserve(m_ports.size());
+    for(const auto& entry : m_ports) ports.push_back(entry.second);
+
+    return ports;
+}
+
+bool HCPPortRegistry::findPort(const char* path, Port* port) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_ports.find(path);
+    if(it == m_ports.end())
+    {
+        auto link = m_byId.find(path);
+        if(link == m_byId.end()) return false;
+
+        it = m_ports.find(link->second);
+        if(it == m_ports.end()) return false;
+    }
+
+    if(port) *port = it->second;
+    return true;
+}
+
+void HCPPortRegistry::update(const Port& port)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_ports.find(port.path);
+    if(it != m_ports.end())
+    {
+        const Port& old = it->second;
+        if(old.driver == port.driver && old.byId == port.byId && old.vendorId == port.vendorId && old.productId == port.productId
+        && old.serialNumber == port.serialNumber && old.manufacturer == port.manufacturer && old.product == port.product) return;
+
+        if(!old.byId.empty()) m_byId.erase(old.byId);
+    }
+    else if(m_ready) s_logger.infof("Found %s", port.describe().c_str());
+
+    if(!port.byId.empty()) m_byId[port.byId] = port.path;
+    m_ports[port.path] = port;
+
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+void HCPPortRegistry::remove(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_ports.find(path);
+    if(it == m_ports.end()) return;
+
+    s_logger.infof("Lost %s", path.c_str());
+
+    if(!it->second.byId.empty()) m_byId.erase(it->second.byId);
+    m_ports.erase(it);
+
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+void HCPPortRegistry::retain(const std::vector<std::string>& paths)
+{
+    std::vector<std::string> gone;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(const auto& entry : m_ports)
+        {
+            if(std::find(paths.begin(), paths.end(), entry.first) == paths.end()) gone.push_back(entry.first);
+        }
+    }
+
+    for(const std::string& path : gone) remove(path);
+}
+
+void HCPPortRegistry::setReady()
+{
+    if(m_ready.exchange(true, std::memory_order_acq_rel)) return;
+
+    s_logger.infof("Found %zu serial ports", m_ports.size());
+    m_version.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,335 @@
+#ifdef __linux__
+#include "hcp/PortRegistry.hpp"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+struct ImplPortRegistryLinux
+{
+    int inotify;
+    int wake; // eventfd for stop()
+    int devWatch;
+    int serialWatch; // /dev/serial, where udev creates by-id
+    int byIdWatch;
+    std::unordered_map<std::string, std::string> links; // tty name to its by-id link
+};
+
+#define getImpl() (*((ImplPortRegistryLinux*) m_impl))
+
+static const char* BY_ID_DIR = "/dev/serial/by-id";
+
+// Reads a sysfs attribute without its trailing newline
+static bool i_readAttribute(const char* path, char* value, size_t size)
+{
+    int handle = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(handle < 0) return false;
+
+    ssize_t len = ::read(handle, value, size - 1);
+    ::close(handle);
+    if(len < 0) return false;
+
+    while(0 < len && (value[len - 1] == '\n' || value[len - 1] == ' ')) len--;
+    value[len] = '\0';
+    return true;
+}
+
+static const char* i_baseName(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static std::string i_readLinkName(const char* dir, const char* link)
+{
+    char path[PATH_MAX + 32];
+    char target[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, link);
+
+    ssize_t len = readlink(path, target, sizeof(target) - 1);
+    if(len <= 0) return std::string();
+
+    target[len] = '\0';
+    return i_baseName(target);
+}
+
+// Newer kernels put serial core's own port and controller devices between
+// the tty and the UART, their drivers say nothing about the hardware
+static void i_readDriver(const char* ttyDevice, HCPPortRegistry::Port& port)
+{
+    char dir[PATH_MAX];
+    if(!realpath(ttyDevice, dir)) return;
+
+    for(int level = 0; level < 4; level++)
+    {
+        if(i_readLinkName(dir, "subsystem") != "serial-base")
+        {
+            port.driver = i_readLinkName(dir, "driver");
+            return;
+        }
+
+        char* slash = strrchr(dir, '/');
+        if(!slash || slash == dir) return;
+        *slash = '\0';
+    }
+}
+
+// USB attributes live on the device a few levels above the tty's interface
+static void i_readUsbAttributes(const char* ttyDevice, HCPPortRegistry::Port& port)
+{
+    char dir[PATH_MAX];
+    if(!realpath(ttyDevice, dir)) return;
+
+    char path[PATH_MAX + 32];
+    char value[256];
+
+    for(int level = 0; level < 4; level++)
+    {
+        snprintf(path, sizeof(path), "%s/idVendor", dir);
+        if(i_readAttribute(path, value, sizeof(value)))
+        {
+            port.vendorId = (uint16_t) strtoul(value, nullptr, 16);
+
+            snprintf(path, sizeof(path), "%s/idProduct", dir);
+            if(i_readAttribute(path, value, sizeof(value))) port.productId = (uint16_t) strtoul(value, nullptr, 16);
+            snprintf(path, sizeof(path), "%s/serial", dir);
+            if(i_readAttribute(path, value, sizeof(value))) port.serialNumber = value;
+            snprintf(path, sizeof(path), "%s/manufacturer", dir);
+            if(i_readAttribute(path, value, sizeof(value))) port.manufacturer = value;
+            snprintf(path, sizeof(path), "%s/product", dir);
+            if(i_readAttribute(path, value, sizeof(value))) port.product = value;
+            return;
+        }
+
+        char* slash = strrchr(dir, '/');
+        if(!slash || slash == dir) return;
+        *slash = '\0';
+    }
+}
+
+// Fills in the port for a tty name, false if it isn't a serial port that
+// can be opened right now
+static bool i_probe(ImplPortRegistryLinux& impl, const char* name, HCPPortRegistry::Port& port)
+{
+    if(!name[0] || name[0] == '.' || strchr(name, '/')) return false;
+
+    // Virtual terminals and ptys have no backing device
+    char device[300];
+    snprintf(device, sizeof(device), "/sys/class/tty/%s/device", name);
+    struct stat info;
+    if(stat(device, &info) != 0) return false;
+
+    // Serial core registers placeholder ports whether or not a UART is
+    // there, those have no type. Other drivers have no type attribute.
+    char path[PATH_MAX];
+    char value[256];
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/type", name);
+    if(i_readAttribute(path, value, sizeof(value)) && strcmp(value, "0") == 0) return false;
+
+    port = HCPPortRegistry::Port();
+    port.path = std::string("/dev/") + name;
+
+    // Without the node there is nothing to open yet, udev will create it
+    if(stat(port.path.c_str(), &info) != 0 || !S_ISCHR(info.st_mode)) return false;
+
+    i_readDriver(device, port);
+    i_readUsbAttributes(device, port);
+
+    auto link = impl.links.find(name);
+    if(link != impl.links.end()) port.byId = link->second;
+
+    return true;
+}
+
+// Returns the tty name the by-id link points to, empty if it doesn't
+static std::string i_readLink(const char* linkName)
+{
+    return i_readLinkName(BY_ID_DIR, linkName);
+}
+
+// True if by-id has just been watched, links made before that were missed
+static bool i_watchById(ImplPortRegistryLinux& impl)
+{
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+    if(impl.serialWatch < 0) impl.serialWatch = inotify_add_watch(impl.inotify, "/dev/serial", mask);
+    if(0 <= impl.byIdWatch) return false;
+
+    impl.byIdWatch = inotify_add_watch(impl.inotify, BY_ID_DIR, mask);
+    return 0 <= impl.byIdWatch;
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_init()
+{
+    m_impl = new ImplPortRegistryLinux();
+    ImplPortRegistryLinux& impl = getImpl();
+
+    impl.inotify = -1;
+    impl.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    impl.devWatch = impl.serialWatch = impl.byIdWatch = -1;
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_run()
+{
+    ImplPortRegistryLinux& impl = getImpl();
+
+    // Watched before the scan so that nothing in between is missed
+    impl.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(impl.inotify < 0) s_logger.errorf("Failed to watch /dev, ports won't be updated (%s)", strerror(errno));
+    else
+    {
+        impl.devWatch = inotify_add_watch(impl.inotify, "/dev", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR);
+        i_watchById(impl);
+    }
+
+    bool rescan = true;
+    std::unordered_set<std::string> names; // ttys to probe again
+
+    while(m_running)
+    {
+        if(rescan)
+        {
+            impl.links.clear();
+            if(DIR* links = opendir(BY_ID_DIR))
+            {
+                while(dirent* entry = readdir(links))
+                {
+                    if(entry->d_name[0] == '.') continue;
+                    std::string name = i_readLink(entry->d_name);
+                    if(!name.empty()) impl.links[name] = std::string(BY_ID_DIR) + "/" + entry->d_name;
+                }
+                closedir(links);
+            }
+
+            std::vector<std::string> present;
+            if(DIR* ttys = opendir("/sys/class/tty"))
+            {
+                Port port;
+                while(dirent* entry = readdir(ttys))
+                {
+                    if(!i_probe(impl, entry->d_name, port)) continue;
+                    present.push_back(port.path);
+                    update(port);
+                }
+                closedir(ttys);
+            }
+
+            retain(present);
+            setReady();
+
+            rescan = false;
+            names.clear();
+        }
+
+        for(const std::string& name : names)
+        {
+            Port port;
+            if(i_probe(impl, name.c_str(), port)) update(port);
+            else remove("/dev/" + name);
+        }
+        names.clear();
+
+        if(impl.inotify < 0)
+        {
+            pollfd wake = { impl.wake, POLLIN, 0 };
+            uint64_t wakes;
+            if(0 < ::poll(&wake, 1, -1) && ::read(impl.wake, &wakes, sizeof(wakes)) < 0) {}
+            continue;
+        }
+
+        pollfd fds[2] = { { impl.inotify, POLLIN, 0 }, { impl.wake, POLLIN, 0 } };
+        if(::poll(fds, 2, -1) < 0 && errno != EINTR)
+        {
+            s_logger.errorf("Failed to wait for port changes (%s)", strerror(errno));
+            break;
+        }
+
+        uint64_t wakes;
+        if(fds[1].revents && ::read(impl.wake, &wakes, sizeof(wakes)) < 0) {}
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t len;
+        while(0 < (len = ::read(impl.inotify, buffer, sizeof(buffer))))
+        {
+            for(ssize_t offset = 0; offset < len;)
+            {
+                const inotify_event* event = (const inotify_event*) (buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                if(event->mask & IN_Q_OVERFLOW) rescan = true;
+                else if(event->mask & IN_IGNORED)
+                {
+                    if(event->wd == impl.serialWatch) impl.serialWatch = -1;
+                    if(event->wd == impl.byIdWatch)
+                    {
+                        impl.byIdWatch = -1;
+                        rescan = true;
+                    }
+                }
+                else if(!event->len) continue;
+                else if(event->wd == impl.devWatch)
+                {
+                    if(strcmp(event->name, "serial") != 0) names.insert(event->name);
+                    else if(i_watchById(impl)) rescan = true;
+                }
+                else if(event->wd == impl.serialWatch)
+                {
+                    if(strcmp(event->name, "by-id") == 0 && i_watchById(impl)) rescan = true;
+                }
+                else if(event->wd == impl.byIdWatch)
+                {
+                    std::string link = std::string(BY_ID_DIR) + "/" + event->name;
+
+                    if(event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        std::string name = i_readLink(event->name);
+                        if(name.empty()) continue;
+                        impl.links[name] = link;
+                        names.insert(name);
+                    }
+                    else
+                    {
+                        for(auto it = impl.links.begin(); it != impl.links.end(); ++it)
+                        {
+                            if(it->second != link) continue;
+                            names.insert(it->first);
+                            impl.links.erase(it);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if(0 <= impl.inotify) ::close(impl.inotify);
+    impl.inotify = impl.devWatch = impl.serialWatch = impl.byIdWatch = -1;
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_wake()
+{
+    uint64_t one = 1;
+    if(::write(getImpl().wake, &one, sizeof(one)) < 0) {}
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_destroy()
+{
+    if(!m_impl) return;
+
+    ImplPortRegistryLinux& impl = getImpl();
+    if(0 <= impl.wake) ::close(impl.wake);
+
+    delete (ImplPortRegistryLinux*) m_impl;
+}
+
+#endif // Linux
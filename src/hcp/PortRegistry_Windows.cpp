@@ -0,0 +1,126 @@
+#ifdef _WIN32
+#include "hcp/PortRegistry.hpp"
+
+#include <Windows.h>
+#include <SetupAPI.h>
+#include <devguid.h>
+#include <cstring>
+#include <cstdlib>
+
+// Device arrival notifications need a window to be delivered to, so the
+// ports are rescanned on a timer instead
+
+struct ImplPortRegistryWindows
+{
+    HANDLE wake; // event for stop()
+};
+
+#define getImpl() (*((ImplPortRegistryWindows*) m_impl))
+
+static const DWORD RESCAN_INTERVAL_MS = 1000;
+
+static std::string i_getProperty(HDEVINFO devInfo, SP_DEVINFO_DATA& devInfoData, DWORD property)
+{
+    char data[512];
+    DWORD dataType;
+    if(!SetupDiGetDeviceRegistryPropertyA(devInfo, &devInfoData, property, &dataType, (PBYTE) data, sizeof(data) - 1, nullptr)) return std::string();
+
+    data[sizeof(data) - 1] = '\0';
+    return data;
+}
+
+static uint16_t i_parseId(const std::string& hardwareId, const char* key)
+{
+    size_t at = hardwareId.find(key);
+    if(at == std::string::npos) return 0;
+    return (uint16_t) strtoul(hardwareId.c_str() + at + strlen(key), nullptr, 16);
+}
+
+static bool i_readPort(HDEVINFO devInfo, SP_DEVINFO_DATA& devInfoData, HCPPortRegistry::Port& port)
+{
+    HKEY key = SetupDiOpenDevRegKey(devInfo, &devInfoData, DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
+    if(key == INVALID_HANDLE_VALUE) return false;
+
+    char portName[64];
+    DWORD size = sizeof(portName) - 1;
+    DWORD type;
+    LONG result = RegQueryValueExA(key, "PortName", nullptr, &type, (LPBYTE) portName, &size);
+    RegCloseKey(key);
+
+    if(result != ERROR_SUCCESS || type != REG_SZ || strncmp(portName, "COM", 3) != 0) return false;
+    portName[size] = '\0';
+
+    port = HCPPortRegistry::Port();
+    port.path = portName;
+    port.driver = i_getProperty(devInfo, devInfoData, SPDRP_SERVICE);
+    port.manufacturer = i_getProperty(devInfo, devInfoData, SPDRP_MFG);
+    port.product = i_getProperty(devInfo, devInfoData, SPDRP_DEVICEDESC);
+
+    // USB\VID_0403&PID_6001&REV_0600
+    std::string hardwareId = i_getProperty(devInfo, devInfoData, SPDRP_HARDWAREID);
+    port.vendorId = i_parseId(hardwareId, "VID_");
+    port.productId = i_parseId(hardwareId, "PID_");
+
+    // USB\VID_0403&PID_6001\A12345, generated instance ids have an & in them
+    char instanceId[256];
+    if(port.vendorId && SetupDiGetDeviceInstanceIdA(devInfo, &devInfoData, instanceId, sizeof(instanceId), nullptr))
+    {
+        const char* serial = strrchr(instanceId, '\\');
+        if(serial && !strchr(serial, '&')) port.serialNumber = serial + 1;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_init()
+{
+    m_impl = new ImplPortRegistryWindows();
+    getImpl().wake = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_run()
+{
+    ImplPortRegistryWindows& impl = getImpl();
+
+    while(m_running)
+    {
+        HDEVINFO devInfo = SetupDiGetClassDevsA(&GUID_DEVCLASS_PORTS, nullptr, nullptr, DIGCF_PRESENT);
+        if(devInfo != INVALID_HANDLE_VALUE)
+        {
+            std::vector<std::string> present;
+
+            SP_DEVINFO_DATA devInfoData;
+            devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+
+            Port port;
+            for(DWORD i = 0; SetupDiEnumDeviceInfo(devInfo, i, &devInfoData); i++)
+            {
+                if(!i_readPort(devInfo, devInfoData, port)) continue;
+                present.push_back(port.path);
+                update(port);
+            }
+
+            SetupDiDestroyDeviceInfoList(devInfo);
+            retain(present);
+        }
+
+        setReady();
+
+        WaitForSingleObject(impl.wake, RESCAN_INTERVAL_MS);
+    }
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_wake()
+{
+    SetEvent(getImpl().wake);
+}
+
+void IMPL_FUNC HCPPortRegistry::impl_destroy()
+{
+    if(!m_impl) return;
+
+    CloseHandle(getImpl().wake);
+    delete (ImplPortRegistryWindows*) m_impl;
+}
+
+#endif // Windows
@@ -0,0 +1,423 @@
+#include "hcp/Protocol.hpp"
+
+#include <cstring>
+
+// Largest frame before COBS encoding: header, payload and CRC
+static const size_t MAX_RAW_SIZE = 1 + 2 + HCPMessage::MAX_PAYLOAD + 2;
+
+struct i_CRCTable
+{
+    uint16_t entries[256];
+
+    constexpr i_CRCTable() : entries()
+    {
+        for(int i = 0; i < 256; i++)
+        {
+            uint16_t crc = (uint16_t) (i << 8);
+            for(int bit = 0; bit < 8; bit++)
+                crc = (uint16_t) (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+            entries[i] = crc;
+        }
+    }
+};
+
+static constexpr i_CRCTable s_crcTable;
+
+// Lets the COBS encoder write into either a flat buffer or the two spans of a
+// ring reservation
+struct i_SplitOutput
+{
+    uint8_t* first;
+    size_t firstLen;
+    uint8_t* second;
+
+    uint8_t& operator[](size_t i) { return i < firstLen ? first[i] : second[i - firstLen]; }
+};
+
+template<typename Output>
+static size_t i_cobsEncode(const uint8_t* src, size_t len, Output& dst)
+{
+    size_t codeIndex = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        if(src[i])
+        {
+            dst[out++] = src[i];
+            code++;
+        }
+
+        if(!src[i] || code == 0xFF)
+        {
+            dst[codeIndex] = code;
+            codeIndex = out++;
+            code = 1;
+        }
+    }
+
+    dst[codeIndex] = code;
+    return out;
+}
+
+static void i_putU16(uint8_t* dst, uint16_t value)
+{
+    dst[0] = (uint8_t) value;
+    dst[1] = (uint8_t) (value >> 8);
+}
+
+static void i_putU32(uint8_t* dst, uint32_t value)
+{
+    for(int i = 0; i < 4; i++) dst[i] = (uint8_t) (value >> (i * 8));
+}
+
+static void i_putU64(uint8_t* dst, uint64_t value)
+{
+    for(int i = 0; i < 8; i++) dst[i] = (uint8_t) (value >> (i * 8));
+}
+
+static void i_putF32(uint8_t* dst, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    i_putU32(dst, bits);
+}
+
+static uint16_t i_getU16(const uint8_t* src)
+{
+    return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+static uint32_t i_getU32(const uint8_t* src)
+{
+    return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static uint64_t i_getU64(const uint8_t* src)
+{
+    return (uint64_t) i_getU32(src) | ((uint64_t) i_getU32(src + 4) << 32);
+}
+
+static float i_getF32(const uint8_t* src)
+{
+    uint32_t bits = i_getU32(src);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+HCPMessage::HCPMessage(Type type, uint16_t seq) :
+    type(type),
+    seq(seq)
+{
+    memset(&sensors, 0, sizeof(sensors)); // largest member of the union
+}
+
+uint16_t HCPProtocol::crc16(const uint8_t* data, size_t len, uint16_t crc)
+{
+    for(size_t i = 0; i < len; i++)
+        crc = (uint16_t) ((crc << 8) ^ s_crcTable.entries[(crc >> 8) ^ data[i]]);
+
+    return crc;
+}
+
+size_t HCPProtocol::cobsEncode(const uint8_t* src, size_t len, uint8_t* dst)
+{
+    return i_cobsEncode(src, len, dst);
+}
+
+size_t HCPProtocol::cobsDecode(const uint8_t* src, size_t len, uint8_t* dst)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while(in < len)
+    {
+        uint8_t code = src[in++];
+        if(!code || len < in + code - 1) return 0;
+
+        for(uint8_t i = 1; i < code; i++)
+        {
+            if(!src[in]) return 0;
+            dst[out++] = src[in++];
+        }
+
+        // A full block carries no implied zero, neither does the last one
+        if(code != 0xFF && in < len) dst[out++] = 0;
+    }
+
+    return out;
+}
+
+size_t HCPProtocol::serialize(const HCPMessage& message, uint8_t* dst)
+{
+    size_t len = 0;
+
+    dst[len++] = message.type;
+    i_putU16(dst + len, message.seq);
+    len += 2;
+
+    switch(message.type)
+    {
+    case HCPMessage::SENSOR_SAMPLES:
+    {
+        uint8_t count = message.sensors.count < HCPMessage::MAX_SAMPLES ? message.sensors.count : HCPMessage::MAX_SAMPLES;
+
+        i_putU32(dst + len, message.sensors.timestamp);
+        dst[len + 4] = count;
+        len += 5;
+
+        for(uint8_t i = 0; i < count; i++)
+        {
+            dst[len] = message.sensors.samples[i].channel;
+            i_putF32(dst + len + 1, message.sensors.samples[i].value);
+            len += 5;
+        }
+        break;
+    }
+    case HCPMessage::ROBOT_STATE:
+        i_putF32(dst + len, message.robot.x);
+        i_putF32(dst + len + 4, message.robot.y);
+        i_putF32(dst + len + 8, message.robot.swivel);
+        i_putF32(dst + len + 12, message.robot.claw);
+        len += 16;
+        break;
+    case HCPMessage::PING:
+    case HCPMessage::PONG:
+        i_putU64(dst + len, message.ping.timestamp);
+        len += 8;
+        break;
+    case HCPMessage::ACK:
+        i_putU16(dst + len, message.ack.seq);
+        dst[len + 2] = message.ack.status;
+        len += 3;
+        break;
+    case HCPMessage::COMMAND:
+    {
+        uint8_t argLen = message.command.len < sizeof(message.command.args) ? message.command.len : sizeof(message.command.args);
+
+        dst[len] = message.command.opcode;
+        dst[len + 1] = argLen;
+        memcpy(dst + len + 2, message.command.args, argLen);
+        len += 2 + argLen;
+        break;
+    }
+    case HCPMessage::CONSOLE:
+    {
+        size_t textLen = message.console.len < HCPMessage::MAX_PAYLOAD ? message.console.len : HCPMessage::MAX_PAYLOAD;
+
+        memcpy(dst + len, message.console.text, textLen);
+        len += textLen;
+        break;
+    }
+    default:
+        break;
+    }
+
+    i_putU16(dst + len, crc16(dst, len));
+    return len + 2;
+}
+
+size_t HCPProtocol::encode(const HCPMessage& message, uint8_t* dst, size_t dstLen)
+{
+    uint8_t raw[MAX_RAW_SIZE];
+    size_t rawLen = serialize(message, raw);
+
+    // Worst case COBS overhead is one byte per 254 plus the leading code byte
+    if(dstLen < rawLen + rawLen / 254 + 2) return 0;
+
+    size_t len = i_cobsEncode(raw, rawLen, dst);
+    dst[len++] = 0;
+
+    return len;
+}
+
+bool HCPProtocol::send(HCPTransport& transport, const HCPMessage& message, HCPTransport::Priority priority)
+{
+    uint8_t raw[MAX_RAW_SIZE];
+    size_t rawLen = serialize(message, raw);
+    size_t maxLen = rawLen + rawLen / 254 + 2;
+
+    HCPRingBuffer::Span spans[2];
+    if(transport.reserveWrite(spans, maxLen, priority) < maxLen) return false;
+
+    i_SplitOutput output = { spans[0].data, spans[0].len, spans[1].data };
+    size_t len = i_cobsEncode(raw, rawLen, output);
+    output[len++] = 0;
+
+    transport.commitWrite(len, priority);
+    return true;
+}
+
+HCPMessage HCPProtocol::consoleMessage(const char* text, size_t len, uint16_t seq)
+{
+    HCPMessage message(HCPMessage::CONSOLE, seq);
+    message.console.len = (uint8_t) (len < HCPMessage::MAX_PAYLOAD ? len : HCPMessage::MAX_PAYLOAD);
+    message.console.text = text;
+    return message;
+}
+
+void HCPProtocol::putF32(uint8_t* dst, float value)
+{
+    i_putF32(dst, value);
+}
+
+float HCPProtocol::getF32(const uint8_t* src)
+{
+    return i_getF32(src);
+}
+
+HCPFrameDecoder::HCPFrameDecoder()
+{
+    reset();
+
+    m_frameCount = 0;
+    m_crcErrors = 0;
+    m_framingErrors = 0;
+}
+
+size_t HCPFrameDecoder::feed(const uint8_t* data, size_t len, HCPMessage* message)
+{
+    message->type = HCPMessage::NONE;
+
+    size_t i = 0;
+    while(i < len)
+    {
+        // Copy everything up to the next delimiter in one go
+        const uint8_t* end = (const uint8_t*) memchr(data + i, 0, len - i);
+        size_t chunk = (end ? end - data : len) - i;
+
+        if(!m_discarding)
+        {
+            if(sizeof(m_frame) < m_frameLen + chunk)
+            {
+                // Too long to be one of ours, drop it and wait for the next delimiter
+                m_discarding = true;
+                m_framingErrors++;
+            }
+            else
+            {
+                memcpy(m_frame + m_frameLen, data + i, chunk);
+                m_frameLen += chunk;
+            }
+        }
+
+        i += chunk;
+        if(!end) break;
+        i++;
+
+        bool complete = !m_discarding && m_frameLen;
+        size_t frameLen = m_frameLen;
+        reset();
+
+        if(!complete) continue;
+
+        size_t decodedLen = HCPProtocol::cobsDecode(m_frame, frameLen, m_decoded);
+
+        if(decodedLen < 5)
+            m_framingErrors++;
+        else if(HCPProtocol::crc16(m_decoded, decodedLen - 2) != i_getU16(m_decoded + decodedLen - 2))
+            m_crcErrors++;
+        else if(!parse(m_decoded, decodedLen - 2, message))
+            m_framingErrors++;
+        else
+        {
+            m_frameCount++;
+            return i;
+        }
+    }
+
+    return len;
+}
+
+void HCPFrameDecoder::reset()
+{
+    m_frameLen = 0;
+    m_discarding = false;
+}
+
+uint32_t HCPFrameDecoder::getFrameCount() const
+{
+    return m_frameCount;
+}
+
+uint32_t HCPFrameDecoder::getCRCErrors() const
+{
+    return m_crcErrors;
+}
+
+uint32_t HCPFrameDecoder::getFramingErrors() const
+{
+    return m_framingErrors;
+}
+
+bool HCPFrameDecoder::parse(const uint8_t* data, size_t len, HCPMessage* message)
+{
+    HCPMessage::Type type = (HCPMessage::Type) data[0];
+    uint16_t seq = i_getU16(data + 1);
+
+    data += 3;
+    len -= 3;
+
+    switch(type)
+    {
+    case HCPMessage::SENSOR_SAMPLES:
+    {
+        if(len < 5) return false;
+
+        uint8_t count = data[4];
+        if(HCPMessage::MAX_SAMPLES < count || len != 5 + count * 5u) return false;
+
+        message->sensors.timestamp = i_getU32(data);
+        message->sensors.count = count;
+
+        for(uint8_t i = 0; i < count; i++)
+        {
+            message->sensors.samples[i].channel = data[5 + i * 5];
+            message->sensors.samples[i].value = i_getF32(data + 6 + i * 5);
+        }
+        break;
+    }
+    case HCPMessage::ROBOT_STATE:
+        if(len != 16) return false;
+
+        message->robot.x = i_getF32(data);
+        message->robot.y = i_getF32(data + 4);
+        message->robot.swivel = i_getF32(data + 8);
+        message->robot.claw = i_getF32(data + 12);
+        break;
+    case HCPMessage::PING:
+    case HCPMessage::PONG:
+        if(len != 8) return false;
+
+        message->ping.timestamp = i_getU64(data);
+        break;
+    case HCPMessage::ACK:
+        if(len != 3) return false;
+
+        message->ack.seq = i_getU16(data);
+        message->ack.status = data[2];
+        break;
+    case HCPMessage::COMMAND:
+        if(len < 2 || len != 2u + data[1] || sizeof(message->command.args) < data[1]) return false;
+
+        message->command.opcode = data[0];
+        message->command.len = data[1];
+        memcpy(message->command.args, data + 2, data[1]);
+        break;
+    case HCPMessage::CONSOLE:
+        if(HCPMessage::MAX_PAYLOAD < len) return false;
+
+        message->console.len = (uint8_t) len;
+        message->console.text = (const char*) data;
+        break;
+    default:
+        return false;
+    }
+
+    message->type = type;
+    message->seq = seq;
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#include "hcp/ReplayTransport.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+HCPLogger HCPReplayTransport::s_logger("Replay");
+
+HCPReplayTransport::HCPReplayTransport(const char* address_) :
+    HCPTransport(address_)
+{
+}
+
+HCPReplayTransport::~HCPReplayTransport()
+{
+    close();
+}
+
+HCPCaptureReplay* HCPReplayTransport::getReplay()
+{
+    return &m_replay;
+}
+
+bool HCPReplayTransport::impl_open()
+{
+    const char* path = m_address + strlen(PREFIX);
+    if(!m_replay.open(path)) return false;
+
+    s_logger.infof("Replaying capture: %s", path);
+    return true;
+}
+
+void HCPReplayTransport::impl_close()
+{
+}
+
+bool HCPReplayTransport::impl_service(int timeoutMs)
+{
+    impl_handleEvents(0);
+
+    // A full ring is only checked back on, the replay can't be waited for
+    if(!m_readBuffer.space()) timeoutMs = std::min(timeoutMs, 1);
+    else timeoutMs = m_replay.getTimeout(timeoutMs);
+
+    timeoutMs = std::min(timeoutMs, MAX_WAIT_MS);
+    if(0 < timeoutMs)
+    {
+        m_ioWakePending = false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    }
+
+    return true;
+}
+
+bool HCPReplayTransport::impl_handleEvents(uint32_t)
+{
+    for(;;)
+    {
+        HCPRingBuffer::Span spans[2];
+        if(!m_readBuffer.reserve(spans, m_readBuffer.capacity())) break;
+
+        size_t bytesRead = m_replay.read(spans[0].data, spans[0].len);
+        if(bytesRead == spans[0].len && spans[1].len) bytesRead += m_replay.read(spans[1].data, spans[1].len);
+        if(!bytesRead) break;
+
+        commitReceived(bytesRead);
+    }
+
+    return impl_flush();
+}
+
+bool HCPReplayTransport::impl_attach(intptr_t)
+{
+    return false;
+}
+
+bool HCPReplayTransport::impl_flush()
+{
+    // Output goes nowhere, the rack it was meant for is long gone
+    HCPRingBuffer::Span spans[2];
+    while(size_t pending = peekOutput(spans)) consumeOutput(pending);
+
+    return true;
+}
+
+void HCPReplayTransport::impl_wake()
+{
+}
+
+bool HCPReplayTransport::impl_isPollable() const
+{
+    return false;
+}
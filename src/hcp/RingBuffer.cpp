@@ -0,0 +1,162 @@
+#include "hcp/RingBuffer.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+static size_t i_nextPowerOfTwo(size_t value)
+{
+    size_t pow2 = 1;
+    while(pow2 < value) pow2 <<= 1;
+    return pow2;
+}
+
+HCPRingBuffer::HCPRingBuffer(size_t capacity) :
+    m_data(nullptr),
+    m_mask(0),
+    m_head(0),
+    m_tail(0)
+{
+    if(capacity) resize(capacity);
+}
+
+HCPRingBuffer::~HCPRingBuffer()
+{
+    delete[] m_data;
+}
+
+void HCPRingBuffer::resize(size_t capacity)
+{
+    capacity = i_nextPowerOfTwo(capacity);
+
+    delete[] m_data;
+    m_data = new uint8_t[capacity];
+    m_mask = capacity - 1;
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+}
+
+size_t HCPRingBuffer::capacity() const
+{
+    return m_data ? m_mask + 1 : 0;
+}
+
+size_t HCPRingBuffer::size() const
+{
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+size_t HCPRingBuffer::space() const
+{
+    return capacity() - size();
+}
+
+bool HCPRingBuffer::empty() const
+{
+    return size() == 0;
+}
+
+size_t HCPRingBuffer::write(const uint8_t* data, size_t len)
+{
+    size_t written = 0;
+
+    // At most two copies, one up to the end of the storage and one after wrapping
+    while(written < len)
+    {
+        uint8_t* dst;
+        size_t span = std::min(writeSpan(&dst), len - written);
+        if(!span) break;
+
+        memcpy(dst, data + written, span);
+        commitWrite(span);
+        written += span;
+    }
+
+    return written;
+}
+
+size_t HCPRingBuffer::writeSpan(uint8_t** dst)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+
+    size_t free = capacity() - (head - tail);
+    size_t index = head & m_mask;
+
+    *dst = m_data + index;
+    return std::min(free, capacity() - index);
+}
+
+size_t HCPRingBuffer::reserve(Span spans[2], size_t len)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+
+    len = std::min(len, capacity() - (head - tail));
+    size_t index = head & m_mask;
+    size_t first = std::min(len, capacity() - index);
+
+    spans[0] = { m_data + index, first };
+    spans[1] = { m_data, len - first };
+
+    return len;
+}
+
+void HCPRingBuffer::commitWrite(size_t len)
+{
+    m_head.store(m_head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+size_t HCPRingBuffer::read(uint8_t* data, size_t len)
+{
+    size_t bytesRead = 0;
+
+    while(bytesRead < len)
+    {
+        const uint8_t* src;
+        size_t span = std::min(readSpan(&src), len - bytesRead);
+        if(!span) break;
+
+        memcpy(data + bytesRead, src, span);
+        consume(span);
+        bytesRead += span;
+    }
+
+    return bytesRead;
+}
+
+size_t HCPRingBuffer::readSpan(const uint8_t** src)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+
+    size_t used = head - tail;
+    size_t index = tail & m_mask;
+
+    *src = m_data + index;
+    return std::min(used, capacity() - index);
+}
+
+size_t HCPRingBuffer::peek(Span spans[2])
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+
+    size_t used = head - tail;
+    size_t index = tail & m_mask;
+    size_t first = std::min(used, capacity() - index);
+
+    spans[0] = { m_data + index, first };
+    spans[1] = { m_data, used - first };
+
+    return used;
+}
+
+void HCPRingBuffer::consume(size_t len)
+{
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+void HCPRingBuffer::clear()
+{
+    m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
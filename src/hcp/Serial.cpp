@@ -1,4 +1,9 @@
 #include "hcp/Serial.hpp"
+#include "hcp/PortRegistry.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
 
 HCPLogger HCPSerial::s_logger("Serial");
 
@@ -21,16 +26,15 @@ HCPSerial::Timeout HCPSerial::Timeout::fromTimeout(uint32_t timeout_)
     return Timeout(0xFFFFFFF, timeout_, 0, timeout_, 0);
 }
 
-HCPSerial::HCPSerial(const char* port_, uint32_t baudRate_, Parity parity_, StopBits stopBits_, Timeout timeout_) :
+HCPSerial::HCPSerial(const char* port_, uint32_t baudRate_, Parity parity_, StopBits stopBits_, Timeout timeout_, FlowControl flowControl_) :
+    HCPTransport(port_),
     m_baudRate(baudRate_),
     m_parity(parity_),
     m_stopBits(stopBits_),
     m_timeout(timeout_),
-    m_impl(nullptr),
-    m_open(false)
+    m_flowControl(flowControl_),
+    m_impl(nullptr)
 {
-    if(port_) strcpy_s(m_port, sizeof(m_port), port_);
-    else m_port[0] = '\0';
     impl_init();
 }
 
@@ -40,34 +44,9 @@ HCPSerial::~HCPSerial()
     impl_destory();
 }
 
-bool HCPSerial::isOpen() const
-{
-    return m_open;
-}
-
-int HCPSerial::available() const
-{
-    return (int) m_readBuffer.size();
-}
-
-void HCPSerial::write(const uint8_t* data, size_t len)
-{
-    // Append data to write buffer
-    m_writeBuffer.insert(m_writeBuffer.end(), data, data + len);
-}
-
-int HCPSerial::read(uint8_t* data, size_t len)
-{
-    // Read data from read buffer
-    size_t readLen = std::min(len, m_readBuffer.size());
-    memcpy(data, m_readBuffer.data(), readLen);
-    m_readBuffer.erase(m_readBuffer.begin(), m_readBuffer.begin() + readLen);
-    return (int) readLen;
-}
-
 const char* HCPSerial::getPort() const
 {
-    return m_port;
+    return m_address;
 }
 
 uint32_t HCPSerial::getBaudRate() const
@@ -90,6 +69,22 @@ HCPSerial::Timeout HCPSerial::getTimeout() const
     return m_timeout;
 }
 
+HCPSerial::FlowControl HCPSerial::getFlowControl() const
+{
+    return m_flowControl;
+}
+
+const char* HCPSerial::impl_getHotplugPath() const
+{
+    return m_address;
+}
+
+size_t HCPSerial::getOutputQueueLimit() const
+{
+    // Ten bits a byte on the wire, a five hundredth of a second of it
+    return std::max(MIN_OUTPUT_QUEUE, (size_t) m_baudRate / 5000);
+}
+
 void HCPSerial::setBaudRate(uint32_t baudRate)
 {
     m_baudRate = baudRate;
@@ -112,4 +107,21 @@ void HCPSerial::setTimeout(Timeout timeout)
 {
     m_timeout = timeout;
     impl_setTimeout(timeout);
-}
\ No newline at end of file
+}
+
+void HCPSerial::setFlowControl(FlowControl flowControl)
+{
+    m_flowControl = flowControl;
+    impl_setFlowControl(flowControl);
+}
+
+std::vector<std::string> HCPSerial::getSerialPorts()
+{
+    HCPPortRegistry* registry = HCPPortRegistry::getInstance();
+    registry->start();
+
+    std::vector<std::string> ports;
+    for(const HCPPortRegistry::Port& port : registry->getPorts()) ports.push_back(port.path);
+
+    return ports;
+}
@@ -1,88 +1,356 @@
 #ifdef __linux__
 #include "hcp/Serial.hpp"
 
+// termios2 is used instead of <termios.h> so that any baud rate can be set
+// through BOTHER. The two headers cannot be included together.
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <chrono>
+#include <atomic>
+
 struct ImplLinux
 {
-    int m_handle;
+    int handle;
+    bool inputHeld; // I/O side, sent XOFF while the input ring was full
+    // Whether to hold the device off with XOFF. The I/O side only reads
+    // this, and lets a held device go itself once it is turned off.
+    std::atomic<bool> softwareFlow;
+
+    // Line error counts of the driver when last read, ptys and some USB
+    // adapters don't keep them
+    bool hasCounters;
+    serial_icounter_struct counters;
+    std::chrono::steady_clock::time_point nextCounters;
 };
 
-#define implGet() (*((ImplLinux*) m_impl))
+#define getImpl() (*((ImplLinux*) m_impl))
+
+// The line error counts cost a syscall, so they're only read this often
+static const std::chrono::milliseconds COUNTER_INTERVAL(100);
 
-void HCPSerial::begin()
+static bool i_applyTermios(int handle, uint32_t baudRate, HCPSerial::Parity parity, HCPSerial::StopBits stopBits, HCPSerial::FlowControl flowControl)
 {
+    struct termios2 tio;
+    if(ioctl(handle, TCGETS2, &tio) < 0) return false;
 
-}
+    // Raw mode, same as cfmakeraw()
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY | INPCK);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CS8 | CREAD | CLOCAL;
 
-void HCPSerial::close()
-{
+    switch(parity)
+    {
+    case HCPSerial::PARITY_ODD:
+        tio.c_cflag |= PARENB | PARODD;
+        tio.c_iflag |= INPCK;
+        break;
+    case HCPSerial::PARITY_EVEN:
+        tio.c_cflag |= PARENB;
+        tio.c_iflag |= INPCK;
+        break;
+    default:
+        break;
+    }
 
+    // termios has no 1.5 stop bits, two is the closest match
+    if(stopBits != HCPSerial::STOPBITS_ONE) tio.c_cflag |= CSTOPB;
+
+    switch(flowControl)
+    {
+    case HCPSerial::FLOWCONTROL_HARDWARE:
+        tio.c_cflag |= CRTSCTS;
+        break;
+    case HCPSerial::FLOWCONTROL_SOFTWARE:
+        tio.c_iflag |= IXON | IXOFF;
+        tio.c_cc[VSTART] = 0x11;
+        tio.c_cc[VSTOP] = 0x13;
+        break;
+    default:
+        break;
+    }
+
+    // Arbitrary baud rate for both directions
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = baudRate;
+    tio.c_ospeed = baudRate;
+
+    // Never block in read(), readiness comes from epoll
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    return ioctl(handle, TCSETS2, &tio) == 0;
 }
 
-int HCPSerial::available() const
+// The driver's counts run from when it was loaded, only the growth is ours
+static bool i_readCounters(int handle, serial_icounter_struct* counters)
 {
-    return 0;
+    return ioctl(handle, TIOCGICOUNT, counters) == 0;
 }
 
-void HCPSerial::write(const uint8_t* data, size_t len)
+static void i_setLowLatency(int handle)
 {
+    // Not every tty supports this (ptys and some USB adapters don't)
+    struct serial_struct serial;
+    if(ioctl(handle, TIOCGSERIAL, &serial) < 0) return;
 
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(handle, TIOCSSERIAL, &serial);
 }
 
-int HCPSerial::read(uint8_t* data, size_t len)
+bool IMPL_FUNC HCPSerial::impl_open()
 {
-    return 0;
+    ImplLinux& impl = getImpl();
+
+    impl.handle = ::open(m_address, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if(impl.handle < 0)
+    {
+        s_logger.errorf("Failed to open serial port: %s (%s)", m_address, strerror(errno));
+        return false;
+    }
+
+    // Keep other processes from opening the port behind our back
+    ioctl(impl.handle, TIOCEXCL);
+
+    if(!i_applyTermios(impl.handle, m_baudRate, m_parity, m_stopBits, m_flowControl))
+    {
+        s_logger.errorf("Failed to set serial port parameters: %s (%s)", m_address, strerror(errno));
+        impl_close();
+        return false;
+    }
+
+    i_setLowLatency(impl.handle);
+    impl.inputHeld = false;
+    impl.hasCounters = i_readCounters(impl.handle, &impl.counters);
+    impl.nextCounters = std::chrono::steady_clock::now() + COUNTER_INTERVAL;
+
+    // Drop whatever was sitting in the kernel buffers before we opened
+    ioctl(impl.handle, TCFLSH, TCIOFLUSH);
+
+    if(!impl_watch(impl.handle))
+    {
+        impl_close();
+        return false;
+    }
+
+    return true;
 }
 
-void HCPSerial::flush()
+void IMPL_FUNC HCPSerial::impl_close()
 {
+    ImplLinux& impl = getImpl();
 
+    impl_unwatch();
+    if(0 <= impl.handle) ::close(impl.handle);
+    impl.handle = -1;
 }
 
-void HCPSerial::flushInput()
+bool IMPL_FUNC HCPSerial::impl_handleEvents(uint32_t events)
 {
+    ImplLinux& impl = getImpl();
+
+    if(!resumeInput()) return false;
+
+    // Let the device go again once the ring has drained some way, so it
+    // isn't paused and resumed for every read, or once software flow control
+    // is turned off. A held device sends nothing that would get us serviced,
+    // so stay stalled and polled until then.
+    if(impl.inputHeld && (m_readBuffer.capacity() / 2 <= m_readBuffer.space() || !impl.softwareFlow))
+    {
+        if(ioctl(impl.handle, TCXONC, TCION) < 0)
+        {
+            s_logger.errorf("Failed to send XON: %s (%s)", m_address, strerror(errno));
+            return false;
+        }
+        impl.inputHeld = false;
+    }
+    else if(impl.inputHeld) m_inputStalled = true;
 
+    if(events & EPOLLIN)
+    {
+        // Only drain what the kernel already has, never wait for more. Reads
+        // go straight into the ring, both halves at once if it wraps.
+        for(;;)
+        {
+            HCPRingBuffer::Span spans[2];
+            size_t space = m_readBuffer.reserve(spans, m_readBuffer.capacity());
+
+            if(!space)
+            {
+                if(!impl_watchInput(false)) return false;
+                m_inputStalled = true;
+                m_inputStalls++;
+
+                // With RTS/CTS and for XON/XOFF on real UARTs the driver holds
+                // the device off once its own buffer fills too. Ptys don't.
+                if(impl.softwareFlow && !impl.inputHeld)
+                    impl.inputHeld = ioctl(impl.handle, TCXONC, TCIOFF) == 0;
+                break;
+            }
+
+            iovec iov[2] = { { spans[0].data, spans[0].len }, { spans[1].data, spans[1].len } };
+            ssize_t bytesRead = ::readv(impl.handle, iov, spans[1].len ? 2 : 1);
+
+            if(0 < bytesRead)
+            {
+                commitReceived(bytesRead);
+                if((size_t) bytesRead < space) break;
+            }
+            // With VMIN = VTIME = 0 an empty port reads as 0 rather than
+            // EAGAIN, hang ups are reported through EPOLLHUP instead
+            else if(bytesRead == 0) break;
+            else if(errno == EINTR) continue;
+            else if(errno == EAGAIN) break;
+            else
+            {
+                s_logger.errorf("Failed to read from serial port: %s (%s)", m_address, strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    if(events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+    {
+        s_logger.errorf("Serial port hung up: %s", m_address);
+        return false;
+    }
+
+    if(impl.hasCounters && impl.nextCounters <= std::chrono::steady_clock::now())
+    {
+        serial_icounter_struct counters;
+        if(i_readCounters(impl.handle, &counters))
+        {
+            m_lineOverruns += (counters.overrun - impl.counters.overrun) + (counters.buf_overrun - impl.counters.buf_overrun);
+            m_lineParityErrors += counters.parity - impl.counters.parity;
+            m_lineFramingErrors += counters.frame - impl.counters.frame;
+            m_lineBreaks += counters.brk - impl.counters.brk;
+            impl.counters = counters;
+        }
+        impl.nextCounters = std::chrono::steady_clock::now() + COUNTER_INTERVAL;
+    }
+
+    return impl_flush();
 }
 
-void HCPSerial::flushOuput()
+bool IMPL_FUNC HCPSerial::impl_flush()
 {
+    ImplLinux& impl = getImpl();
+
+    int driverQueued = 0;
+    if(ioctl(impl.handle, TIOCOUTQ, &driverQueued) < 0) driverQueued = 0;
+
+    size_t limit = getOutputQueueLimit();
+    size_t room = (size_t) driverQueued < limit ? limit - driverQueued : 0;
 
+    // A pass per output source at most, each one picked at a frame boundary
+    for(int pass = 0; pass < PRIORITY_COUNT + 1 && room; pass++)
+    {
+        HCPRingBuffer::Span spans[2];
+        size_t pending = peekOutput(spans);
+        if(!pending) break;
+
+        pending = limitSpans(spans, room);
+
+        iovec iov[2] = { { spans[0].data, spans[0].len }, { spans[1].data, spans[1].len } };
+        ssize_t bytesWritten = ::writev(impl.handle, iov, spans[1].len ? 2 : 1);
+
+        if(bytesWritten < 0)
+        {
+            if(errno == EAGAIN || errno == EINTR) break;
+
+            s_logger.errorf("Failed to write to serial port: %s (%s)", m_address, strerror(errno));
+            return false;
+        }
+
+        consumeOutput(bytesWritten);
+        room -= bytesWritten;
+        if((size_t) bytesWritten < pending) break;
+    }
+
+    // Let epoll tell us when the kernel can take the rest, unless it's the
+    // limit holding output back. Then the I/O side polls for the driver to drain.
+    m_outputThrottled = !room && hasOutput();
+    return impl_watchOutput(hasOutput() && !m_outputThrottled);
 }
 
-void HCPSerial::impl_init()
+void IMPL_FUNC HCPSerial::impl_init()
 {
     m_impl = new ImplLinux();
+    ImplLinux& impl = getImpl();
+
+    impl.handle = -1;
+    impl.inputHeld = false;
+    impl.softwareFlow = m_flowControl == FLOWCONTROL_SOFTWARE;
+    impl.hasCounters = false;
 }
 
-void HCPSerial::impl_setBaudRate(uint32_t baudRate)
+void IMPL_FUNC HCPSerial::impl_setBaudRate(uint32_t baudRate)
 {
+    if(!m_open) return;
 
+    if(!i_applyTermios(getImpl().handle, baudRate, m_parity, m_stopBits, m_flowControl))
+    {
+        s_logger.errorf("Failed to set serial port baud rate: %s", m_address);
+        close();
+    }
 }
 
-void HCPSerial::impl_setParity(Parity parity)
+void IMPL_FUNC HCPSerial::impl_setParity(Parity parity)
 {
+    if(!m_open) return;
 
+    if(!i_applyTermios(getImpl().handle, m_baudRate, parity, m_stopBits, m_flowControl))
+    {
+        s_logger.errorf("Failed to set serial port parity: %s", m_address);
+        close();
+    }
 }
 
-void HCPSerial::impl_setStopBits(StopBits stopBits)
+void IMPL_FUNC HCPSerial::impl_setStopBits(StopBits stopBits)
 {
+    if(!m_open) return;
 
+    if(!i_applyTermios(getImpl().handle, m_baudRate, m_parity, stopBits, m_flowControl))
+    {
+        s_logger.errorf("Failed to set serial port stop bits: %s", m_address);
+        close();
+    }
 }
 
-void HCPSerial::impl_setTimeout(Timeout timeout)
+void IMPL_FUNC HCPSerial::impl_setFlowControl(FlowControl flowControl)
 {
+    ImplLinux& impl = getImpl();
 
+    // A held device is let go from the I/O side, which polls while it holds one
+    impl.softwareFlow = flowControl == FLOWCONTROL_SOFTWARE;
+    if(!m_open) return;
+
+    if(!i_applyTermios(impl.handle, m_baudRate, m_parity, m_stopBits, flowControl))
+    {
+        s_logger.errorf("Failed to set serial port flow control: %s", m_address);
+        close();
+    }
 }
 
-void HCPSerial::impl_destory()
+void IMPL_FUNC HCPSerial::impl_setTimeout(Timeout)
 {
-    delete (ImplLinux*) m_impl;
+    // The port is always non-blocking (VMIN = VTIME = 0), so there is
+    // nothing to apply here. Timeouts only affect the Windows backend.
 }
 
-std::vector<std::string> HCPSerial::getSerialPorts()
+void IMPL_FUNC HCPSerial::impl_destory()
 {
-    std::vector<std::string> ports;
-
-    return ports;
+    if(m_impl) delete (ImplLinux*) m_impl;
 }
 
-#endif // Linux
\ No newline at end of file
+#endif // Linux
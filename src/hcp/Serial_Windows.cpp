@@ -2,30 +2,37 @@
 #include "hcp/Serial.hpp"
 
 #include <Windows.h>
-#include <SetupAPI.h>
-#include <devguid.h>
-#include <regstr.h>
-#include <map>
-
-#define READ_BUFFER_SIZE 4096
 
 struct ImplWindows
 {
     char port[128];
     HANDLE handle;
-
-    uint8_t readBuffer[READ_BUFFER_SIZE];
-    std::vector<uint8_t> writeBuffer;
 };
 
 static HCPLogger* i_logger = nullptr;
 
+static void i_applyFlowControl(DCB& dcb, HCPSerial::FlowControl flowControl)
+{
+    dcb.fOutxCtsFlow = flowControl == HCPSerial::FLOWCONTROL_HARDWARE;
+    dcb.fOutxDsrFlow = FALSE;
+    dcb.fDtrControl = DTR_CONTROL_ENABLE;
+    dcb.fRtsControl = flowControl == HCPSerial::FLOWCONTROL_HARDWARE ? RTS_CONTROL_HANDSHAKE : RTS_CONTROL_ENABLE;
+
+    // The driver sends XOFF when its input buffer is down to XoffLim free
+    // bytes and XON once it holds no more than XonLim, which is what happens
+    // after the input ring fills and reading stops
+    dcb.fOutX = dcb.fInX = flowControl == HCPSerial::FLOWCONTROL_SOFTWARE;
+    dcb.fTXContinueOnXoff = TRUE;
+    dcb.XonChar = 0x11;
+    dcb.XoffChar = 0x13;
+    dcb.XonLim = 2048;
+    dcb.XoffLim = 512;
+}
+
 #define getImpl() (*((ImplWindows*) m_impl))
 
-void IMPL_FUNC HCPSerial::begin()
+bool IMPL_FUNC HCPSerial::impl_open()
 {
-    if(!m_port[0]) return;
-
     ImplWindows& impl = getImpl();
 
     impl.handle = CreateFileA(impl.port, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
@@ -33,12 +40,7 @@ void IMPL_FUNC HCPSerial::begin()
     if (impl.handle == INVALID_HANDLE_VALUE)
     {
         s_logger.errorf("Failed to open serial port: %s", impl.port);
-        return;
-    }
-    else
-    {
-        m_open = true;
-        s_logger.infof("Opened serial port: %s", impl.port);
+        return false;
     }
 
     DCB dcbSerialParams = { 0 };
@@ -47,32 +49,45 @@ void IMPL_FUNC HCPSerial::begin()
     dcbSerialParams.ByteSize = 8;
     dcbSerialParams.StopBits = m_stopBits;
     dcbSerialParams.Parity = m_parity;
+    i_applyFlowControl(dcbSerialParams, m_flowControl);
 
     if (!SetCommState(impl.handle, &dcbSerialParams))
     {
         s_logger.errorf("Failed to set serial port parameters: %s", impl.port);
-        close();
-        return;
+        impl_close();
+        return false;
+    }
+
+    COMMTIMEOUTS timeouts = { 0 };
+    timeouts.ReadIntervalTimeout = m_timeout.perByteTimeout;
+    timeouts.ReadTotalTimeoutConstant = m_timeout.readTimeoutConstant;
+    timeouts.ReadTotalTimeoutMultiplier = m_timeout.readTimeoutMultiplier;
+    timeouts.WriteTotalTimeoutConstant = m_timeout.writeTimeoutConstant;
+    timeouts.WriteTotalTimeoutMultiplier = m_timeout.writeTimeoutMultiplier;
+
+    if (!SetCommTimeouts(impl.handle, &timeouts))
+    {
+        s_logger.errorf("Failed to set serial port timeouts: %s", impl.port);
+        impl_close();
+        return false;
     }
 
-    impl_setTimeout(m_timeout);
-}   
+    return true;
+}
 
-void IMPL_FUNC HCPSerial::close()
+void IMPL_FUNC HCPSerial::impl_close()
 {
     ImplWindows& impl = getImpl();
 
-    if (m_open)
+    if (impl.handle != INVALID_HANDLE_VALUE)
     {
         CloseHandle(impl.handle);
-        m_open = false;
+        impl.handle = INVALID_HANDLE_VALUE;
     }
 }
 
-void IMPL_FUNC HCPSerial::poll()
+bool IMPL_FUNC HCPSerial::impl_handleEvents(uint32_t)
 {
-    if(!m_open) return;
-
     ImplWindows& impl = getImpl();
 
     COMSTAT comStat;
@@ -80,61 +95,97 @@ void IMPL_FUNC HCPSerial::poll()
     if(!ClearCommError(impl.handle, &errorFlags, &comStat))
     {
         s_logger.errorf("Failed to get comm status of port: %s", impl.port);
-        close();
-        return;
+        return false;
     }
 
+    // Windows only reports that an error happened since the last call, not
+    // how many bytes it cost
+    if(errorFlags & (CE_OVERRUN | CE_RXOVER)) m_lineOverruns++;
+    if(errorFlags & CE_RXPARITY) m_lineParityErrors++;
+    if(errorFlags & CE_FRAME) m_lineFramingErrors++;
+
     if(errorFlags & CE_BREAK)
     {
+        m_lineBreaks++;
         s_logger.errorf("Serial port break detected: %s", impl.port);
-        close();
-        return;
+        return false;
     }
 
-    if(comStat.cbInQue)
+    // Read at most what is already queued so ReadFile never waits
+    DWORD queued = comStat.cbInQue;
+    while(queued)
     {
-        DWORD bytesRead;
-        
-        size_t maxBytesRead = min(comStat.cbInQue, READ_BUFFER_SIZE);
-        ReadFile(impl.handle, impl.readBuffer, maxBytesRead, &bytesRead, NULL);
+        uint8_t* dst;
+        size_t span = m_readBuffer.writeSpan(&dst);
+        if(!span)
+        {
+            if(!m_inputStalled) m_inputStalls++;
+            m_inputStalled = true;
+            break;
+        }
+        m_inputStalled = false;
 
-        DWORD error = GetLastError();
-        if(error != ERROR_SUCCESS && error != ERROR_IO_PENDING)
+        DWORD bytesRead = 0;
+        DWORD maxBytesRead = (DWORD) min((size_t) queued, span);
+        if(!ReadFile(impl.handle, dst, maxBytesRead, &bytesRead, NULL))
         {
-            s_logger.errorf("Failed to read from serial port: %s error %d", impl.port, error);
-            close();
-            return;
+            DWORD error = GetLastError();
+            if(error != ERROR_IO_PENDING)
+            {
+                s_logger.errorf("Failed to read from serial port: %s error %d", impl.port, error);
+                return false;
+            }
         }
 
-        m_readBuffer.insert(m_readBuffer.end(), impl.readBuffer, impl.readBuffer + bytesRead);
-        
+        commitReceived(bytesRead);
+        queued -= bytesRead;
+        if(bytesRead < maxBytesRead) break;
     }
 
-    flushOuput();
+    return impl_flush();
 }
 
-bool IMPL_FUNC HCPSerial::flushOuput()
+bool IMPL_FUNC HCPSerial::impl_flush()
 {
-    if(!m_open || m_writeBuffer.empty()) return false;
-
     ImplWindows& impl = getImpl();
 
     COMSTAT comStat;
-    if(!ClearCommError(impl.handle, NULL, &comStat))
+    DWORD errorFlags;
+    if(!ClearCommError(impl.handle, &errorFlags, &comStat))
     {
         s_logger.errorf("Failed to get comm status of port: %s", impl.port);
-        close();
         return false;
     }
 
-    // Copy write buffer to impl write buffer
-    impl.writeBuffer.resize(m_writeBuffer.size());
-    memcpy(impl.writeBuffer.data(), m_writeBuffer.data(), m_writeBuffer.size());
+    // Reading the status clears the errors, count them here as well
+    if(errorFlags & (CE_OVERRUN | CE_RXOVER)) m_lineOverruns++;
+    if(errorFlags & CE_RXPARITY) m_lineParityErrors++;
+    if(errorFlags & CE_FRAME) m_lineFramingErrors++;
+    if(errorFlags & CE_BREAK) m_lineBreaks++;
 
-    WriteFile(impl.handle, impl.writeBuffer.data(), impl.writeBuffer.size(), NULL, NULL);
+    size_t limit = getOutputQueueLimit();
+    size_t room = comStat.cbOutQue < limit ? limit - comStat.cbOutQue : 0;
 
-    m_writeBuffer.clear();
+    // A pass per output source and ring wrap at most
+    for(int i = 0; i < 2 * (PRIORITY_COUNT + 1) && room; i++)
+    {
+        HCPRingBuffer::Span spans[2];
+        if(!peekOutput(spans)) break;
+        limitSpans(spans, room);
 
+        DWORD bytesWritten = 0;
+        if(!WriteFile(impl.handle, spans[0].data, (DWORD) spans[0].len, &bytesWritten, NULL))
+        {
+            s_logger.errorf("Failed to write to serial port: %s error %d", impl.port, GetLastError());
+            return false;
+        }
+
+        consumeOutput(bytesWritten);
+        room -= bytesWritten;
+        if(bytesWritten < spans[0].len) break;
+    }
+
+    m_outputThrottled = !room && hasOutput();
     return true;
 }
 
@@ -147,7 +198,7 @@ void IMPL_FUNC HCPSerial::impl_init()
 
     // Append '\\.\' prefix to COM port name
     strcpy_s(impl.port, sizeof(impl.port), "\\\\.\\");
-    strcat_s(impl.port, sizeof(impl.port), m_port);
+    strcat_s(impl.port, sizeof(impl.port), m_address);
 
     impl.handle = INVALID_HANDLE_VALUE;
 }
@@ -206,6 +257,24 @@ void IMPL_FUNC HCPSerial::impl_setStopBits(StopBits stopBits)
     }
 }
 
+void IMPL_FUNC HCPSerial::impl_setFlowControl(FlowControl flowControl)
+{
+    if(!m_open) return;
+
+    ImplWindows& impl = getImpl();
+
+    DCB dcbSerialParams = { 0 };
+
+    GetCommState(impl.handle, &dcbSerialParams);
+    i_applyFlowControl(dcbSerialParams, flowControl);
+
+    if (!SetCommState(impl.handle, &dcbSerialParams))
+    {
+        s_logger.errorf("Failed to set serial port flow control: %s", impl.port);
+        close();
+    }
+}
+
 void IMPL_FUNC HCPSerial::impl_setTimeout(Timeout timeout)
 {
     if(!m_open) return;
@@ -231,45 +300,4 @@ void IMPL_FUNC HCPSerial::impl_destory()
     if(m_impl) delete (ImplWindows*) m_impl;
 }
 
-std::vector<std::string> IMPL_FUNC HCPSerial::getSerialPorts()
-{
-    std::vector<std::string> ports;
-
-    HDEVINFO hDevInfo = SetupDiGetClassDevs(&GUID_DEVCLASS_PORTS, 0, 0, DIGCF_PRESENT);
-    if (hDevInfo == INVALID_HANDLE_VALUE)
-    {
-        return ports;
-    }
-
-    SP_DEVINFO_DATA devInfoData;
-    devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
-
-    for (DWORD i = 0; SetupDiEnumDeviceInfo(hDevInfo, i, &devInfoData); i++)
-    {
-        DWORD dataType;
-        DWORD dataSize = 0;
-        SetupDiGetDeviceRegistryProperty(hDevInfo, &devInfoData, SPDRP_FRIENDLYNAME, &dataType, 0, 0, &dataSize);
-        if (dataSize == 0)
-            continue;
-
-        std::vector<char> data(dataSize);
-        if (!SetupDiGetDeviceRegistryProperty(hDevInfo, &devInfoData, SPDRP_FRIENDLYNAME, &dataType, (PBYTE)data.data(), dataSize, &dataSize))
-            continue;
-
-        std::string friendlyName(data.begin(), data.end());
-        if (friendlyName.find("COM") == std::string::npos)
-            continue;
-
-        std::string portName = friendlyName.substr(friendlyName.find("COM"));
-        
-        // Replace ')' with '\0'
-        portName[portName.find(')')] = '\0';
-        ports.push_back(portName);
-    }
-
-    SetupDiDestroyDeviceInfoList(hDevInfo);
-
-    return ports;
-}
-
 #endif // Windows
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "hcp/SetpointStreamer.hpp"
+
+#include "hcp/Protocol.hpp"
+
+#include <cmath>
+#include <cstring>
+
+static int32_t i_quantize(float value)
+{
+    double scaled = std::round((double) value * 1000.0);
+    if(scaled < INT32_MIN) return INT32_MIN;
+    if(INT32_MAX < scaled) return INT32_MAX;
+    return (int32_t) scaled;
+}
+
+HCPSetpointStreamer::HCPSetpointStreamer() :
+    m_version(0),
+    m_transport(nullptr),
+    m_resumePolicy(RESUME_DISCARD),
+    m_reconnects(0),
+    m_sentVersion(0),
+    m_synced(false),
+    m_settled(true),
+    m_deltasInRow(0),
+    m_seq(0),
+    m_framesSent(0),
+    m_bytesSent(0)
+{
+    for(int i = 0; i < JOINT_COUNT; i++)
+    {
+        m_targets[i].store(0.0f, std::memory_order_relaxed);
+        m_sent[i] = 0;
+    }
+}
+
+void HCPSetpointStreamer::attach(HCPTransport& transport, double rateHz)
+{
+    m_transport = &transport;
+    m_reconnects = transport.getStats().reconnects;
+
+    auto period = std::chrono::microseconds((int64_t) (1000000.0 / rateHz));
+    transport.setOutputTask(period, [this](uint8_t* dst, size_t len) { return produce(dst, len); });
+}
+
+void HCPSetpointStreamer::setResumePolicy(ResumePolicy policy)
+{
+    m_resumePolicy = policy;
+}
+
+void HCPSetpointStreamer::setTargets(const float targets[JOINT_COUNT])
+{
+    uint32_t version = m_version.load(std::memory_order_relaxed);
+
+    m_version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(int i = 0; i < JOINT_COUNT; i++)
+        m_targets[i].store(targets[i], std::memory_order_relaxed);
+
+    m_version.store(version + 2, std::memory_order_release);
+}
+
+uint32_t HCPSetpointStreamer::getFramesSent() const
+{
+    return m_framesSent.load(std::memory_order_relaxed);
+}
+
+uint32_t HCPSetpointStreamer::getBytesSent() const
+{
+    return m_bytesSent.load(std::memory_order_relaxed);
+}
+
+size_t HCPSetpointStreamer::produce(uint8_t* dst, size_t len)
+{
+    // Take a consistent copy of the latest targets. The writer only holds the
+    // version odd for four stores, so this never spins for long.
+    float targets[JOINT_COUNT];
+    uint32_t version;
+
+    for(;;)
+    {
+        version = m_version.load(std::memory_order_acquire);
+
+        for(int i = 0; i < JOINT_COUNT; i++)
+            targets[i] = m_targets[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(!(version & 1) && m_version.load(std::memory_order_relaxed) == version) break;
+    }
+
+    uint32_t reconnects = m_transport->getStats().reconnects;
+    if(reconnects != m_reconnects)
+    {
+        m_reconnects = reconnects;
+        m_synced = false;
+
+        // Replaying sends the latest targets even if they didn't change
+        if(m_resumePolicy == RESUME_REPLAY) m_settled = false;
+        else
+        {
+            m_sentVersion = version;
+            m_settled = true;
+            return 0;
+        }
+    }
+
+    if(version == m_sentVersion && m_settled) return 0;
+    m_sentVersion = version;
+
+    int32_t quantized[JOINT_COUNT];
+    uint8_t mask = 0;
+    bool fitsDelta = true;
+
+    for(int i = 0; i < JOINT_COUNT; i++)
+    {
+        quantized[i] = i_quantize(targets[i]);
+
+        int64_t delta = (int64_t) quantized[i] - m_sent[i];
+        if(delta) mask |= 1 << i;
+        if(delta < INT16_MIN || INT16_MAX < delta) fitsDelta = false;
+    }
+
+    // Nothing moved since the last absolute frame
+    if(!mask && m_settled) return 0;
+
+    HCPMessage message(HCPMessage::COMMAND, m_seq++);
+    bool absolute = !m_synced || !fitsDelta || !mask || KEYFRAME_INTERVAL <= m_deltasInRow;
+
+    if(absolute)
+    {
+        message.command.opcode = HCPMessage::CMD_STREAM_TARGET;
+        message.command.len = JOINT_COUNT * 4;
+
+        for(int i = 0; i < JOINT_COUNT; i++)
+            HCPProtocol::putF32(message.command.args + i * 4, quantized[i] / 1000.0f);
+
+        m_deltasInRow = 0;
+    }
+    else
+    {
+        message.command.opcode = HCPMessage::CMD_STREAM_DELTA;
+        message.command.args[0] = mask;
+        message.command.len = 1;
+
+        for(int i = 0; i < JOINT_COUNT; i++)
+        {
+            if(!(mask & (1 << i))) continue;
+
+            uint16_t delta = (uint16_t) (int16_t) (quantized[i] - m_sent[i]);
+            message.command.args[message.command.len++] = (uint8_t) delta;
+            message.command.args[message.command.len++] = (uint8_t) (delta >> 8);
+        }
+
+        m_deltasInRow++;
+    }
+
+    size_t frameLen = HCPProtocol::encode(message, dst, len);
+    if(!frameLen) return 0;
+
+    memcpy(m_sent, quantized, sizeof(m_sent));
+    m_synced = true;
+    m_settled = absolute;
+
+    m_framesSent.fetch_add(1, std::memory_order_relaxed);
+    m_bytesSent.fetch_add((uint32_t) frameLen, std::memory_order_relaxed);
+
+    return frameLen;
+}
@@ -0,0 +1,64 @@
+#include "hcp/SocketTransport.hpp"
+
+#include <cstring>
+#include <cstdio>
+
+HCPLogger HCPSocketTransport::s_logger("Socket");
+
+bool HCPSocketTransport::isSocketAddress(const char* address)
+{
+    return strncmp(address, TCP_PREFIX, strlen(TCP_PREFIX)) == 0 || strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0;
+}
+
+HCPSocketTransport::HCPSocketTransport(const char* address_) :
+    HCPTransport(address_),
+    m_impl(nullptr)
+{
+    impl_init();
+}
+
+HCPSocketTransport::~HCPSocketTransport()
+{
+    close();
+    impl_destroy();
+}
+
+bool HCPSocketTransport::isTcp() const
+{
+    return strncmp(m_address, TCP_PREFIX, strlen(TCP_PREFIX)) == 0;
+}
+
+const char* HCPSocketTransport::impl_getHotplugPath() const
+{
+    return isTcp() ? nullptr : m_address + strlen(UNIX_PREFIX);
+}
+
+bool HCPSocketTransport::splitHostPort(char* host, size_t hostLen, char* port, size_t portLen) const
+{
+    const char* start = m_address + strlen(TCP_PREFIX);
+    const char* hostEnd;
+    const char* colon;
+
+    if(*start == '[')
+    {
+        start++;
+        hostEnd = strchr(start, ']');
+        colon = hostEnd ? hostEnd + 1 : nullptr;
+        if(colon && *colon != ':') colon = nullptr;
+    }
+    else
+    {
+        colon = strrchr(start, ':');
+        hostEnd = colon;
+    }
+
+    if(!hostEnd || !colon || hostEnd == start || !colon[1])
+    {
+        s_logger.errorf("Expected tcp://host:port, got %s", m_address);
+        return false;
+    }
+
+    snprintf(host, hostLen, "%.*s", (int) (hostEnd - start), start);
+    snprintf(port, portLen, "%s", colon + 1);
+    return true;
+}
@@ -0,0 +1,262 @@
+#ifdef __linux__
+#include "hcp/SocketTransport.hpp"
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+struct ImplSocketLinux
+{
+    int handle;
+    bool connecting; // waiting for the non-blocking connect to finish
+};
+
+#define getImpl() (*((ImplSocketLinux*) m_impl))
+
+bool IMPL_FUNC HCPSocketTransport::impl_open()
+{
+    ImplSocketLinux& impl = getImpl();
+
+    sockaddr_storage address;
+    socklen_t addressLen;
+    memset(&address, 0, sizeof(address));
+
+    if(isTcp())
+    {
+        char host[128];
+        char port[16];
+        if(!splitHostPort(host, sizeof(host), port, sizeof(port))) return false;
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result;
+        int error = getaddrinfo(host, port, &hints, &result);
+        if(error)
+        {
+            s_logger.errorf("Failed to resolve %s (%s)", m_address, gai_strerror(error));
+            return false;
+        }
+
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        addressLen = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+    else
+    {
+        sockaddr_un* unixAddress = (sockaddr_un*) &address;
+        const char* path = m_address + strlen(UNIX_PREFIX);
+
+        if(!*path || sizeof(unixAddress->sun_path) <= strlen(path))
+        {
+            s_logger.errorf("Invalid socket path: %s", m_address);
+            return false;
+        }
+
+        unixAddress->sun_family = AF_UNIX;
+        strcpy(unixAddress->sun_path, path);
+        addressLen = sizeof(sockaddr_un);
+    }
+
+    impl.handle = ::socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(impl.handle < 0)
+    {
+        s_logger.errorf("Failed to create socket for %s (%s)", m_address, strerror(errno));
+        return false;
+    }
+
+    if(isTcp())
+    {
+        int noDelay = 1;
+        setsockopt(impl.handle, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        // Only report the socket writable once the unsent data is below the
+        // limit, so the cap in impl_flush() needs no polling over TCP
+        int lowWater = OUTPUT_QUEUE_LIMIT;
+        setsockopt(impl.handle, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowWater, sizeof(lowWater));
+    }
+
+    int result = ::connect(impl.handle, (sockaddr*) &address, addressLen);
+    if(result < 0 && errno != EINPROGRESS)
+    {
+        s_logger.errorf("Failed to connect to %s (%s)", m_address, strerror(errno));
+        impl_close();
+        return false;
+    }
+
+    // The socket turns writable once the connect is done either way
+    impl.connecting = result < 0;
+    if(!impl_watch(impl.handle) || (impl.connecting && !impl_watchOutput(true)))
+    {
+        impl_close();
+        return false;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_close()
+{
+    ImplSocketLinux& impl = getImpl();
+
+    impl_unwatch();
+
+    if(0 <= impl.handle)
+    {
+        ::close(impl.handle);
+        impl.handle = -1;
+    }
+
+    impl.connecting = false;
+}
+
+bool IMPL_FUNC HCPSocketTransport::impl_handleEvents(uint32_t events)
+{
+    ImplSocketLinux& impl = getImpl();
+
+    if(impl.connecting)
+    {
+        if(!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return true;
+
+        int error = 0;
+        socklen_t errorLen = sizeof(error);
+        if(getsockopt(impl.handle, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0) error = errno;
+
+        if(error)
+        {
+            s_logger.errorf("Failed to connect to %s (%s)", m_address, strerror(error));
+            return false;
+        }
+
+        impl.connecting = false;
+        s_logger.infof("Connected to %s", m_address);
+    }
+
+    if(!resumeInput()) return false;
+
+    if(events & EPOLLIN)
+    {
+        for(;;)
+        {
+            HCPRingBuffer::Span spans[2];
+            size_t space = m_readBuffer.reserve(spans, m_readBuffer.capacity());
+
+            if(!space)
+            {
+                if(!impl_watchInput(false)) return false;
+                m_inputStalled = true;
+                m_inputStalls++;
+                break;
+            }
+
+            iovec iov[2] = { { spans[0].data, spans[0].len }, { spans[1].data, spans[1].len } };
+            ssize_t bytesRead = ::readv(impl.handle, iov, spans[1].len ? 2 : 1);
+
+            if(0 < bytesRead)
+            {
+                commitReceived(bytesRead);
+                if((size_t) bytesRead < space) break;
+            }
+            else if(bytesRead == 0)
+            {
+                s_logger.errorf("Connection closed by %s", m_address);
+                return false;
+            }
+            else if(errno == EINTR) continue;
+            else if(errno == EAGAIN) break;
+            else
+            {
+                s_logger.errorf("Failed to read from %s (%s)", m_address, strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    // A half close with data still queued is read out above first
+    if(events & (EPOLLERR | EPOLLHUP))
+    {
+        s_logger.errorf("Connection lost: %s", m_address);
+        return false;
+    }
+
+    return impl_flush();
+}
+
+bool IMPL_FUNC HCPSocketTransport::impl_flush()
+{
+    ImplSocketLinux& impl = getImpl();
+
+    // Anything written before the connect is done stays queued
+    if(impl.connecting) return true;
+
+    // Sent but unacked TCP data is gone from our hands either way, only what
+    // the kernel hasn't sent yet counts
+    int socketQueued = 0;
+    if(ioctl(impl.handle, isTcp() ? SIOCOUTQNSD : SIOCOUTQ, &socketQueued) < 0) socketQueued = 0;
+
+    size_t room = (size_t) socketQueued < OUTPUT_QUEUE_LIMIT ? OUTPUT_QUEUE_LIMIT - socketQueued : 0;
+
+    // Same passes as the serial port. Each one goes out as a single sendmsg()
+    // so a wrapped ring doesn't cost an extra segment.
+    for(int pass = 0; pass < PRIORITY_COUNT + 1 && room; pass++)
+    {
+        HCPRingBuffer::Span spans[2];
+        size_t pending = peekOutput(spans);
+        if(!pending) break;
+
+        pending = limitSpans(spans, room);
+
+        iovec iov[2] = { { spans[0].data, spans[0].len }, { spans[1].data, spans[1].len } };
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = spans[1].len ? 2 : 1;
+
+        // No SIGPIPE when the peer is gone, it is reported as EPIPE instead
+        ssize_t bytesWritten = ::sendmsg(impl.handle, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if(bytesWritten < 0)
+        {
+            if(errno == EAGAIN || errno == EINTR) break;
+
+            s_logger.errorf("Failed to write to %s (%s)", m_address, strerror(errno));
+            return false;
+        }
+
+        consumeOutput(bytesWritten);
+        room -= bytesWritten;
+        if((size_t) bytesWritten < pending) break;
+    }
+
+    // Unix sockets have no low water mark for EPOLLOUT, the I/O side polls
+    // for the peer to catch up instead
+    m_outputThrottled = !isTcp() && !room && hasOutput();
+    return impl_watchOutput(hasOutput() && !m_outputThrottled);
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_init()
+{
+    m_impl = new ImplSocketLinux();
+    ImplSocketLinux& impl = getImpl();
+
+    impl.handle = -1;
+    impl.connecting = false;
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_destroy()
+{
+    if(m_impl) delete (ImplSocketLinux*) m_impl;
+}
+
+#endif // Linux
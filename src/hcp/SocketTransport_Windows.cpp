@@ -0,0 +1,242 @@
+#ifdef _WIN32
+// Winsock has to come before anything that pulls in Windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+
+#include "hcp/SocketTransport.hpp"
+
+#include <cstring>
+#include <climits>
+
+struct ImplSocketWindows
+{
+    SOCKET handle;
+    bool connecting; // waiting for the non-blocking connect to finish
+};
+
+#define getImpl() (*((ImplSocketWindows*) m_impl))
+
+static bool i_startup()
+{
+    static const bool started = []()
+    {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+
+    return started;
+}
+
+bool IMPL_FUNC HCPSocketTransport::impl_open()
+{
+    ImplSocketWindows& impl = getImpl();
+
+    if(!i_startup())
+    {
+        s_logger.errorf("Failed to start Winsock");
+        return false;
+    }
+
+    sockaddr_storage address;
+    int addressLen;
+    memset(&address, 0, sizeof(address));
+
+    if(isTcp())
+    {
+        char host[128];
+        char port[16];
+        if(!splitHostPort(host, sizeof(host), port, sizeof(port))) return false;
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result;
+        int error = getaddrinfo(host, port, &hints, &result);
+        if(error)
+        {
+            s_logger.errorf("Failed to resolve %s error %d", m_address, error);
+            return false;
+        }
+
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        addressLen = (int) result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+    else
+    {
+        sockaddr_un* unixAddress = (sockaddr_un*) &address;
+        const char* path = m_address + strlen(UNIX_PREFIX);
+
+        if(!*path || sizeof(unixAddress->sun_path) <= strlen(path))
+        {
+            s_logger.errorf("Invalid socket path: %s", m_address);
+            return false;
+        }
+
+        unixAddress->sun_family = AF_UNIX;
+        strcpy_s(unixAddress->sun_path, sizeof(unixAddress->sun_path), path);
+        addressLen = sizeof(sockaddr_un);
+    }
+
+    impl.handle = ::socket(address.ss_family, SOCK_STREAM, 0);
+    if(impl.handle == INVALID_SOCKET)
+    {
+        s_logger.errorf("Failed to create socket for %s error %d", m_address, WSAGetLastError());
+        return false;
+    }
+
+    u_long nonBlocking = 1;
+    ioctlsocket(impl.handle, FIONBIO, &nonBlocking);
+
+    if(isTcp())
+    {
+        BOOL noDelay = TRUE;
+        setsockopt(impl.handle, IPPROTO_TCP, TCP_NODELAY, (const char*) &noDelay, sizeof(noDelay));
+    }
+
+    if(::connect(impl.handle, (sockaddr*) &address, addressLen) == SOCKET_ERROR)
+    {
+        int error = WSAGetLastError();
+        if(error != WSAEWOULDBLOCK)
+        {
+            s_logger.errorf("Failed to connect to %s error %d", m_address, error);
+            impl_close();
+            return false;
+        }
+
+        impl.connecting = true;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_close()
+{
+    ImplSocketWindows& impl = getImpl();
+
+    if(impl.handle != INVALID_SOCKET)
+    {
+        closesocket(impl.handle);
+        impl.handle = INVALID_SOCKET;
+    }
+
+    impl.connecting = false;
+}
+
+bool IMPL_FUNC HCPSocketTransport::impl_handleEvents(uint32_t)
+{
+    ImplSocketWindows& impl = getImpl();
+
+    if(impl.connecting)
+    {
+        // A failed connect shows up in the except set
+        fd_set writable, failed;
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        FD_SET(impl.handle, &writable);
+        FD_SET(impl.handle, &failed);
+
+        timeval timeout = { 0, 0 };
+        if(select(0, NULL, &writable, &failed, &timeout) == SOCKET_ERROR || FD_ISSET(impl.handle, &failed))
+        {
+            int error = 0;
+            int errorLen = sizeof(error);
+            getsockopt(impl.handle, SOL_SOCKET, SO_ERROR, (char*) &error, &errorLen);
+
+            s_logger.errorf("Failed to connect to %s error %d", m_address, error);
+            return false;
+        }
+
+        if(!FD_ISSET(impl.handle, &writable)) return true;
+
+        impl.connecting = false;
+        s_logger.infof("Connected to %s", m_address);
+    }
+
+    for(;;)
+    {
+        uint8_t* dst;
+        size_t span = m_readBuffer.writeSpan(&dst);
+        if(!span)
+        {
+            if(!m_inputStalled) m_inputStalls++;
+            m_inputStalled = true;
+            break;
+        }
+        m_inputStalled = false;
+
+        int bytesRead = recv(impl.handle, (char*) dst, (int) min(span, (size_t) INT_MAX), 0);
+
+        if(0 < bytesRead)
+        {
+            commitReceived(bytesRead);
+            if((size_t) bytesRead < span) break;
+        }
+        else if(bytesRead == 0)
+        {
+            s_logger.errorf("Connection closed by %s", m_address);
+            return false;
+        }
+        else if(WSAGetLastError() == WSAEWOULDBLOCK) break;
+        else
+        {
+            s_logger.errorf("Failed to read from %s error %d", m_address, WSAGetLastError());
+            return false;
+        }
+    }
+
+    return impl_flush();
+}
+
+bool IMPL_FUNC HCPSocketTransport::impl_flush()
+{
+    ImplSocketWindows& impl = getImpl();
+
+    // Anything written before the connect is done stays queued
+    if(impl.connecting) return true;
+
+    // Winsock has no way to ask for the unsent bytes, so output isn't capped
+    // here and a frame can wait behind whatever the socket buffer holds
+    for(int pass = 0; pass < PRIORITY_COUNT + 1; pass++)
+    {
+        HCPRingBuffer::Span spans[2];
+        size_t pending = peekOutput(spans);
+        if(!pending) break;
+
+        WSABUF buffers[2] = { { (ULONG) spans[0].len, (CHAR*) spans[0].data }, { (ULONG) spans[1].len, (CHAR*) spans[1].data } };
+        DWORD bytesWritten = 0;
+
+        if(WSASend(impl.handle, buffers, spans[1].len ? 2 : 1, &bytesWritten, 0, NULL, NULL) == SOCKET_ERROR)
+        {
+            int error = WSAGetLastError();
+            if(error == WSAEWOULDBLOCK) break;
+
+            s_logger.errorf("Failed to write to %s error %d", m_address, error);
+            return false;
+        }
+
+        consumeOutput(bytesWritten);
+        if(bytesWritten < pending) break;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_init()
+{
+    m_impl = new ImplSocketWindows();
+    ImplSocketWindows& impl = getImpl();
+
+    impl.handle = INVALID_SOCKET;
+    impl.connecting = false;
+}
+
+void IMPL_FUNC HCPSocketTransport::impl_destroy()
+{
+    if(m_impl) delete (ImplSocketWindows*) m_impl;
+}
+
+#endif // Windows
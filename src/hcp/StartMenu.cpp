@@ -2,14 +2,16 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 #include "UIRender.hpp"
-#include "hcp/Serial.hpp"
+#include "hcp/PortRegistry.hpp"
 #include "hcp/Application.hpp"
 #include "hcp/MainMenu.hpp"
 
 HCPStartMenu::HCPStartMenu() :
     HCPScreen(Type::START_MENU, "Start Menu"),
+    m_serialPortsVersion((uint32_t) -1),
     m_selectedSerialPort(-1)
 {
     snprintf(m_splashText, 256, "Hydroponics Control Panel - %s", hcpr::getAppVersion());
@@ -20,23 +22,75 @@ void HCPStartMenu::setup()
     m_nasaMindsLogo = hcpr::getImage("nasa_minds_logo");
     m_selectSerialPortButton.setText("§7Unselected");
     m_okButton.setText("OK");
+    m_addressField.setTitle("Or connect to tcp://host:port or unix:/path");
 
-    std::vector<std::string> serialPorts = HCPSerial::getSerialPorts();
+    // Scans in the background, the list fills in once it's done
+    HCPPortRegistry::getInstance()->start();
+    updateSerialPorts();
+}
+
+void HCPStartMenu::updateSerialPorts()
+{
+    HCPPortRegistry* registry = HCPPortRegistry::getInstance();
+
+    // The open selection window indexes the current list
+    uint32_t version = registry->getVersion();
+    if(version == m_serialPortsVersion || !m_serialPortSelectionWindow.expired()) return;
+    m_serialPortsVersion = version;
+
+    std::string selected = m_selectedSerialPort != -1 ? m_serialPorts[m_selectedSerialPort] : std::string();
+
+    freeSerialPortNames();
+    m_serialPorts.clear();
+
+    std::vector<std::string> names;
+
+    // Ports the scan can't see, like the pty of the rack emulator
+    if(const char* port = HCPApplication::getInstance()->getOption("port"))
+    {
+        m_serialPorts.push_back(port);
+        names.push_back(port);
+    }
+
+    for(const HCPPortRegistry::Port& port : registry->getPorts())
+    {
+        if(!m_serialPorts.empty() && m_serialPorts.front() == port.path) continue;
+
+        m_serialPorts.push_back(port.path);
+        names.push_back(port.describe());
+    }
+
+    for(const std::string& name : names)
+    {
+        char* copy = new char[name.size() + 1];
+        memcpy(copy, name.c_str(), name.size() + 1);
+        m_serialPortNames.push_back(copy);
+    }
+
+    // Keep the selection if the port is still there
+    auto it = std::find(m_serialPorts.begin(), m_serialPorts.end(), selected);
+    if(it != m_serialPorts.end()) m_selectedSerialPort = (int) (it - m_serialPorts.begin());
+    else if(m_selectedSerialPort != -1)
+    {
+        m_selectedSerialPort = -1;
+        m_selectSerialPortButton.setText("§7Unselected");
+    }
+}
 
-    m_serialPorts.resize(serialPorts.size());
-    for (size_t i = 0; i < serialPorts.size(); i++)
+void HCPStartMenu::freeSerialPortNames()
+{
+    for(char* name : m_serialPortNames)
     {
-        serialPorts[i].push_back('\0');
-        m_serialPorts[i] = new char[serialPorts[i].size()];
-        memcpy(m_serialPorts[i], serialPorts[i].c_str(), serialPorts[i].size());
+        delete[] name;
     }
+    m_serialPortNames.clear();
 }
 
 void HCPStartMenu::draw()
 {
     hcpui::setupUIRendering();
 
-    hcpui::genString(m_splashText, 0, 0, 18.0f, 0xFF777777);
+    hcpui::genString(HCPAlignment::TOP_LEFT, hcpui::cacheText(m_splashStyled, m_splashText), 0, 0, 18.0f, 0xFF777777);
 
     m_viewport.width = 800;
     m_viewport.height = 600;
@@ -65,13 +119,13 @@ void HCPStartMenu::draw()
 
         HCPViewport buttonViewport;
         buttonViewport.width = 600;
-        buttonViewport.height = 80;
+        buttonViewport.height = 130;
         buttonViewport.x = (m_viewport.width - buttonViewport.width) / 2.0f;
         buttonViewport.y = m_viewport.height * 0.71f - buttonViewport.height / 2.0f;
 
         buttonViewport.start(false);
         {
-            hcpui::genString(HCPAlignment::TOP_CENTER, "Select Serial Port", buttonViewport.width / 2.0f, 0, 22.0f, 0xFFFFFFFF);
+            hcpui::genString(HCPAlignment::TOP_CENTER, hcpui::cacheText(m_promptText, "Select Serial Port"), buttonViewport.width / 2.0f, 0, 22.0f, 0xFFFFFFFF);
 
             m_selectSerialPortButton.width = buttonViewport.width * 0.9f;
             m_selectSerialPortButton.height = buttonViewport.height - 22.0f;
@@ -83,6 +137,11 @@ void HCPStartMenu::draw()
             m_okButton.x = buttonViewport.width - m_okButton.width;
             m_okButton.y = 30.0f;
             m_okButton.draw();
+
+            m_addressField.width = m_selectSerialPortButton.width;
+            m_addressField.height = 40.0f;
+            m_addressField.y = m_selectSerialPortButton.y + m_selectSerialPortButton.height + 10.0f;
+            m_addressField.draw();
         }
         buttonViewport.end();
     }
@@ -97,18 +156,17 @@ void HCPStartMenu::draw()
 
 void HCPStartMenu::close()
 {
-    for(char* portName : m_serialPorts)
-    {
-        delete[] portName;
-    }
+    freeSerialPortNames();
 }
 
 void HCPStartMenu::handleInput()
 {
+    updateSerialPorts();
+
     if(m_selectSerialPortButton.isPressed())
     {
         m_serialPortSelectionWindow =
-        HCPUIWindow::createWindow<HCPSelectionWindow>("Select Serial Port", (const char**) m_serialPorts.data(), (int) m_serialPorts.size(), &m_selectedSerialPort);
+        HCPUIWindow::createWindow<HCPSelectionWindow>("Select Serial Port", (const char**) m_serialPortNames.data(), (int) m_serialPortNames.size(), &m_selectedSerialPort);
     }
 
     if(!m_serialPortSelectionWindow.expired())
@@ -119,13 +177,31 @@ void HCPStartMenu::handleInput()
         {
             serialPortSelectionWindow->setShouldClose(true);
             m_serialPortSelectionWindow.reset();
-            m_selectSerialPortButton.setText(m_serialPorts[m_selectedSerialPort]);
+            m_selectSerialPortButton.setText(m_serialPortNames[m_selectedSerialPort]);
         }
     }
 
-    if(m_okButton.isPressed() && m_selectedSerialPort != -1)
+    bool hasAddress = m_addressField.getText()[0] != '\0';
+    if(m_okButton.isPressed() && (hasAddress || m_selectedSerialPort != -1))
     {
-        HCPMainMenu* mainMenu = new HCPMainMenu(m_serialPorts[m_selectedSerialPort]);
+        std::vector<std::string> ports = { hasAddress ? m_addressField.getText() : m_serialPorts[m_selectedSerialPort] };
+
+        // More racks to service alongside the selected one
+        if(const char* racks = HCPApplication::getInstance()->getOption("racks"))
+        {
+            for(const char* rack = racks; *rack;)
+            {
+                const char* end = strchr(rack, ',');
+                std::string port(rack, end ? end - rack : strlen(rack));
+
+                if(!port.empty() && std::find(ports.begin(), ports.end(), port) == ports.end())
+                    ports.push_back(port);
+
+                rack = end ? end + 1 : rack + port.size();
+            }
+        }
+
+        HCPMainMenu* mainMenu = new HCPMainMenu(ports);
         HCPApplication::getInstance()->setCurrentScreen(mainMenu);
     }
 }
\ No newline at end of file
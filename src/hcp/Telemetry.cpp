@@ -0,0 +1,487 @@
+#include "hcp/Telemetry.hpp"
+#include "hcp/TelemetryArchive.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+void HCPTelemetryChannel::merge(Summary& into, const Summary& from)
+{
+    if(!from.count) return;
+
+    if(!into.count)
+    {
+        into = from;
+        return;
+    }
+
+    uint32_t count = into.count + from.count;
+    into.mean = (float) (((double) into.mean * into.count + (double) from.mean * from.count) / count);
+    into.count = count;
+    into.start = std::min(into.start, from.start);
+    into.end = std::max(into.end, from.end);
+    into.min = std::min(into.min, from.min);
+    into.max = std::max(into.max, from.max);
+}
+
+HCPTelemetryChannel::HCPTelemetryChannel(size_t capacity) :
+    m_blockMask(0),
+    m_newest(std::numeric_limits<int64_t>::min()),
+    m_end(0)
+{
+    size_t blocks = 1;
+    while(blocks * BLOCK_SAMPLES < capacity) blocks <<= 1;
+
+    m_blocks.reset(new std::unique_ptr<Block>[blocks]);
+    m_blockMask = blocks - 1;
+
+    for(Level& level : m_levels)
+    {
+        level.end.store(0, std::memory_order_relaxed);
+        level.partial = Summary();
+        level.sum = 0.0;
+        level.parts = 0;
+    }
+}
+
+void HCPTelemetryChannel::append(int64_t timestamp, float value)
+{
+    uint64_t end = m_end.load(std::memory_order_relaxed);
+
+    std::unique_ptr<Block>& block = m_blocks[(end / BLOCK_SAMPLES) & m_blockMask];
+    if(!block) block.reset(new Block);
+
+    m_newest = std::max(m_newest, timestamp);
+
+    size_t slot = end % BLOCK_SAMPLES;
+    block->timestamps[slot] = m_newest;
+    block->values[slot] = value;
+
+    m_end.store(end + 1, std::memory_order_release);
+
+    Summary sample = {m_newest, m_newest, value, value, value, 1};
+    addToLevel(0, sample, value);
+}
+
+uint64_t HCPTelemetryChannel::getStart() const
+{
+    return getValidStart(getEnd());
+}
+
+uint64_t HCPTelemetryChannel::getEnd() const
+{
+    return m_end.load(std::memory_order_acquire);
+}
+
+size_t HCPTelemetryChannel::getCapacity() const
+{
+    return (m_blockMask + 1) * BLOCK_SAMPLES;
+}
+
+size_t HCPTelemetryChannel::getMemoryUsage() const
+{
+    uint64_t blocks = (getEnd() + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+    size_t bytes = (size_t) std::min(blocks, (uint64_t) m_blockMask + 1) * sizeof(Block) + (m_blockMask + 1) * sizeof(m_blocks[0]);
+
+    for(const Level& level : m_levels)
+        if(level.end.load(std::memory_order_acquire)) bytes += LEVEL_BUCKETS * sizeof(Summary);
+
+    return bytes;
+}
+
+bool HCPTelemetryChannel::getLatest(int64_t* timestamp, float* value) const
+{
+    uint64_t newest = getEnd();
+    if(!newest) return false;
+
+    newest--;
+    return read(&newest, 1, timestamp, value) == 1;
+}
+
+uint64_t HCPTelemetryChannel::lowerBound(int64_t timestamp) const
+{
+    uint64_t end = getEnd();
+    uint64_t low = getValidStart(end);
+    uint64_t high = end;
+
+    while(low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+
+        if(timestampAt(middle) < timestamp) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+size_t HCPTelemetryChannel::read(uint64_t* first, size_t count, int64_t* timestamps, float* values) const
+{
+    uint64_t end = getEnd();
+    uint64_t start = std::max(*first, getValidStart(end));
+    if(end <= start) return 0;
+
+    count = (size_t) std::min((uint64_t) count, end - start);
+
+    for(size_t copied = 0; copied < count;)
+    {
+        uint64_t sample = start + copied;
+        const Block& block = *m_blocks[(sample / BLOCK_SAMPLES) & m_blockMask];
+        size_t slot = sample % BLOCK_SAMPLES;
+        size_t span = std::min(count - copied, BLOCK_SAMPLES - slot);
+
+        if(timestamps) memcpy(timestamps + copied, block.timestamps + slot, span * sizeof(int64_t));
+        if(values) memcpy(values + copied, block.values + slot, span * sizeof(float));
+        copied += span;
+    }
+
+    // Whatever the writer got to in the meantime may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t valid = getValidStart(m_end.load(std::memory_order_relaxed));
+
+    if(start < valid)
+    {
+        size_t dropped = (size_t) std::min((uint64_t) count, valid - start);
+        count -= dropped;
+        start += dropped;
+
+        if(timestamps) memmove(timestamps, timestamps + dropped, count * sizeof(int64_t));
+        if(values) memmove(values, values + dropped, count * sizeof(float));
+    }
+
+    *first = start;
+    return count;
+}
+
+// The sample the writer is storing next reuses the oldest slot, so that one
+// is never handed out
+uint64_t HCPTelemetryChannel::getValidStart(uint64_t end) const
+{
+    uint64_t capacity = getCapacity();
+    return end < capacity ? 0 : end + 1 - capacity;
+}
+
+int64_t HCPTelemetryChannel::timestampAt(uint64_t sample) const
+{
+    const Block& block = *m_blocks[(sample / BLOCK_SAMPLES) & m_blockMask];
+    return block.timestamps[sample % BLOCK_SAMPLES];
+}
+
+void HCPTelemetryChannel::summarize(int64_t from, int64_t to, Summary* columns, size_t numColumns) const
+{
+    for(size_t i = 0; i < numColumns; i++) columns[i] = Summary();
+
+    int64_t oldest, newest;
+    if(!numColumns || to <= from || !getCoverage(RAW_SOURCE, &oldest, &newest)) return;
+
+    Columns target = {from, (double) (to - from) / numColumns, columns, numColumns};
+
+    // Levels fill from the bottom up, so stop at the first one still empty
+    int preferred = RAW_SOURCE;
+    for(size_t level = 0; level < LEVELS; level++)
+    {
+        if(!getCoverage((int) level, &oldest, &newest)) break;
+
+        uint64_t held = std::min(m_levels[level].end.load(std::memory_order_acquire), (uint64_t) LEVEL_BUCKETS - 1);
+        if((double) (newest - oldest) / held > target.width) break;
+
+        preferred = (int) level;
+    }
+
+    for(int64_t cursor = from; cursor < to;)
+    {
+        int source = preferred;
+        int64_t limit = to;
+        getCoverage(source, &oldest, &newest);
+
+        if(newest < cursor)
+        {
+            // Finer levels hold the stretch that is not in a full bucket yet
+            while(source > RAW_SOURCE && newest < cursor) getCoverage(--source, &oldest, &newest);
+            if(newest < cursor) break;
+        }
+        else
+        {
+            // Coarser ones reach further back, used up to where the finer one starts
+            int64_t coarseOldest, coarseNewest;
+            while(cursor < oldest && source + 1 < (int) LEVELS && getCoverage(source + 1, &coarseOldest, &coarseNewest) && coarseOldest < oldest)
+            {
+                limit = std::min(to, oldest);
+                oldest = coarseOldest;
+                source++;
+            }
+        }
+
+        int64_t next = addSource(source, cursor, limit, target);
+        if(next <= cursor) break;
+        cursor = next;
+    }
+}
+
+void HCPTelemetryChannel::addToLevel(size_t level, const Summary& summary, double sum)
+{
+    Level& target = m_levels[level];
+
+    if(target.parts)
+    {
+        merge(target.partial, summary);
+        target.sum += sum;
+    }
+    else
+    {
+        target.partial = summary;
+        target.sum = sum;
+    }
+
+    if(++target.parts == (level ? FANOUT : LEVEL0_SAMPLES)) pushBucket(level);
+}
+
+void HCPTelemetryChannel::pushBucket(size_t level)
+{
+    Level& source = m_levels[level];
+    source.partial.mean = (float) (source.sum / source.partial.count);
+
+    uint64_t end = source.end.load(std::memory_order_relaxed);
+    if(!source.buckets) source.buckets.reset(new Summary[LEVEL_BUCKETS]);
+
+    source.buckets[end % LEVEL_BUCKETS] = source.partial;
+    source.end.store(end + 1, std::memory_order_release);
+    source.parts = 0;
+
+    if(level + 1 < LEVELS) addToLevel(level + 1, source.partial, source.sum);
+}
+
+// Timestamps of the oldest and newest sample a source holds, false if empty
+bool HCPTelemetryChannel::getCoverage(int source, int64_t* oldest, int64_t* newest) const
+{
+    if(source == RAW_SOURCE)
+    {
+        uint64_t first = getStart();
+        return read(&first, 1, oldest, nullptr) == 1 && getLatest(newest, nullptr);
+    }
+
+    uint64_t end = m_levels[source].end.load(std::memory_order_acquire);
+    if(!end) return false;
+
+    Summary bucket;
+    uint64_t first = 0;
+    if(readBuckets((size_t) source, &first, &bucket, 1) != 1) return false;
+    *oldest = bucket.start;
+
+    first = end - 1;
+    if(readBuckets((size_t) source, &first, &bucket, 1) != 1) return false;
+    *newest = bucket.end;
+    return true;
+}
+
+// Like read(), for the buckets of one level
+size_t HCPTelemetryChannel::readBuckets(size_t level, uint64_t* first, Summary* buckets, size_t count) const
+{
+    const Level& source = m_levels[level];
+    uint64_t end = source.end.load(std::memory_order_acquire);
+    uint64_t start = std::max(*first, end < LEVEL_BUCKETS ? 0 : end + 1 - LEVEL_BUCKETS);
+    if(end <= start) return 0;
+
+    count = (size_t) std::min((uint64_t) count, end - start);
+    for(size_t i = 0; i < count; i++) buckets[i] = source.buckets[(start + i) % LEVEL_BUCKETS];
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    end = source.end.load(std::memory_order_relaxed);
+    uint64_t valid = end < LEVEL_BUCKETS ? 0 : end + 1 - LEVEL_BUCKETS;
+
+    if(start < valid)
+    {
+        size_t dropped = (size_t) std::min((uint64_t) count, valid - start);
+        count -= dropped;
+        start += dropped;
+        memmove(buckets, buckets + dropped, count * sizeof(Summary));
+    }
+
+    *first = start;
+    return count;
+}
+
+size_t HCPTelemetryChannel::getColumn(const Columns& columns, int64_t timestamp)
+{
+    double offset = (double) (timestamp - columns.from) / columns.width;
+    return offset <= 0.0 ? 0 : std::min((size_t) offset, columns.count - 1);
+}
+
+// Adds the samples or buckets of a source that end at or after from and
+// start before to. Returns the time just past the last one added, or to if
+// there were none.
+int64_t HCPTelemetryChannel::addSource(int source, int64_t from, int64_t to, Columns& columns) const
+{
+    const size_t BATCH = 256;
+    Summary batch[BATCH];
+    int64_t timestamps[BATCH];
+    float values[BATCH];
+
+    uint64_t next;
+    if(source == RAW_SOURCE) next = lowerBound(from);
+    else
+    {
+        const Level& level = m_levels[source];
+        uint64_t end = level.end.load(std::memory_order_acquire);
+        uint64_t low = end < LEVEL_BUCKETS ? 0 : end + 1 - LEVEL_BUCKETS;
+        uint64_t high = end;
+
+        while(low < high)
+        {
+            uint64_t middle = low + (high - low) / 2;
+
+            if(level.buckets[middle % LEVEL_BUCKETS].end < from) low = middle + 1;
+            else high = middle;
+        }
+
+        next = low;
+    }
+
+    int64_t reached = to;
+
+    for(;;)
+    {
+        size_t count;
+        if(source == RAW_SOURCE)
+        {
+            count = read(&next, BATCH, timestamps, values);
+            for(size_t i = 0; i < count; i++) batch[i] = {timestamps[i], timestamps[i], values[i], values[i], values[i], 1};
+        }
+        else count = readBuckets((size_t) source, &next, batch, BATCH);
+
+        if(!count) break;
+        next += count;
+
+        for(size_t i = 0; i < count; i++)
+        {
+            const Summary& summary = batch[i];
+            if(to <= summary.start) return reached;
+
+            // A bucket wider than a column goes in each it overlaps, so a
+            // coarse level leaves no gaps
+            size_t last = getColumn(columns, summary.end);
+            for(size_t column = getColumn(columns, summary.start); column <= last; column++)
+                merge(columns.columns[column], summary);
+
+            reached = summary.end + 1;
+        }
+    }
+
+    return reached;
+}
+
+HCPTelemetryStore::HCPTelemetryStore(size_t capacity) :
+    m_capacity(capacity),
+    m_deviceTimeKnown(false),
+    m_lastDeviceTime(0),
+    m_deviceTime(0),
+    m_wallClockKnown(false),
+    m_archive(nullptr),
+    m_wallClockOffset(0)
+{
+    for(std::atomic<HCPTelemetryChannel*>& channel : m_channels) channel.store(nullptr, std::memory_order_relaxed);
+}
+
+HCPTelemetryStore::~HCPTelemetryStore()
+{
+    for(std::atomic<HCPTelemetryChannel*>& channel : m_channels) delete channel.load(std::memory_order_relaxed);
+}
+
+void HCPTelemetryStore::append(const HCPMessage::Sensors& sensors)
+{
+    // Forward steps only, measured the short way round the 32 bit wrap
+    if(m_deviceTimeKnown) m_deviceTime += std::max(0, (int32_t) (sensors.timestamp - m_lastDeviceTime));
+    else m_deviceTime = sensors.timestamp;
+
+    m_deviceTimeKnown = true;
+    m_lastDeviceTime = sensors.timestamp;
+
+    int64_t timestamp = m_deviceTime * 1000;
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    int64_t offset = m_wallClockOffset.load(std::memory_order_relaxed);
+    if(!m_wallClockKnown || std::abs(now - (timestamp + offset)) > MAX_CLOCK_DRIFT)
+    {
+        // Only ever forward, the archive can't take samples older than what it
+        // has. A system clock set back is caught up with on the device clock.
+        if(!m_wallClockKnown) offset = m_archive ? m_archive->getEndTime() - timestamp : INT64_MIN;
+        offset = std::max(offset, now - timestamp);
+        m_wallClockOffset.store(offset, std::memory_order_relaxed);
+        m_wallClockKnown = true;
+    }
+
+    for(size_t i = 0; i < sensors.count; i++)
+    {
+        append(sensors.samples[i].channel, timestamp, sensors.samples[i].value);
+        if(m_archive) m_archive->append(sensors.samples[i].channel, timestamp + offset, sensors.samples[i].value);
+    }
+}
+
+void HCPTelemetryStore::append(uint8_t channel, int64_t timestamp, float value)
+{
+    HCPTelemetryChannel* samples = m_channels[channel].load(std::memory_order_relaxed);
+
+    if(!samples)
+    {
+        samples = new HCPTelemetryChannel(m_capacity);
+        m_channels[channel].store(samples, std::memory_order_release);
+    }
+
+    samples->append(timestamp, value);
+}
+
+void HCPTelemetryStore::setArchive(HCPTelemetryArchive* archive)
+{
+    m_archive = archive;
+}
+
+const HCPTelemetryChannel* HCPTelemetryStore::getChannel(uint8_t channel) const
+{
+    return m_channels[channel].load(std::memory_order_acquire);
+}
+
+size_t HCPTelemetryStore::getMemoryUsage() const
+{
+    size_t bytes = sizeof(*this);
+
+    for(const std::atomic<HCPTelemetryChannel*>& channel : m_channels)
+    {
+        const HCPTelemetryChannel* samples = channel.load(std::memory_order_acquire);
+        if(samples) bytes += sizeof(*samples) + samples->getMemoryUsage();
+    }
+
+    return bytes;
+}
+
+int64_t HCPTelemetryStore::getWallClockOffset() const
+{
+    return m_wallClockOffset.load(std::memory_order_relaxed);
+}
+
+const char* HCPTelemetryStore::getChannelName(uint8_t channel)
+{
+    switch(channel)
+    {
+    case HCPMessage::CHANNEL_PH:                return "pH";
+    case HCPMessage::CHANNEL_EC:                return "EC";
+    case HCPMessage::CHANNEL_WATER_TEMPERATURE: return "Water temperature";
+    case HCPMessage::CHANNEL_WATER_LEVEL:       return "Water level";
+    case HCPMessage::CHANNEL_LIGHT:             return "Light";
+    case HCPMessage::CHANNEL_PUMP_CURRENT:      return "Pump current";
+    default:                                    return nullptr;
+    }
+}
+
+const char* HCPTelemetryStore::getChannelUnit(uint8_t channel)
+{
+    switch(channel)
+    {
+    case HCPMessage::CHANNEL_EC:                return "mS/cm";
+    case HCPMessage::CHANNEL_WATER_TEMPERATURE: return "°C";
+    case HCPMessage::CHANNEL_WATER_LEVEL:       return "%";
+    case HCPMessage::CHANNEL_LIGHT:             return "lux";
+    case HCPMessage::CHANNEL_PUMP_CURRENT:      return "A";
+    default:                                    return "";
+    }
+}
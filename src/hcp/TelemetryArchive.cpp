@@ -0,0 +1,794 @@
+#include "hcp/TelemetryArchive.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static const char i_magic[8] = { 'H', 'C', 'P', 'T', 'E', 'L', 0, 0 };
+static const size_t HEADER_SIZE = 16;  // magic, version u32, reserved u32
+static const size_t TRAILER_SIZE = 32; // index offset u64, block count u32, version u32, reserved u64, magic
+
+static const char* CHUNK_EXTENSION = ".hcpt";
+
+template<typename T>
+static T i_load(const uint8_t* src)
+{
+    T value;
+    memcpy(&value, src, sizeof(T));
+    return value;
+}
+
+static void i_append(std::vector<uint8_t>& dst, const void* src, size_t len)
+{
+    size_t offset = dst.size();
+    dst.resize(offset + len);
+    memcpy(dst.data() + offset, src, len);
+}
+
+template<typename T>
+static void i_append(std::vector<uint8_t>& dst, T value)
+{
+    i_append(dst, &value, sizeof(T));
+}
+
+// Most significant bit first
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& dst) : m_dst(dst), m_bits(0), m_used(0) {}
+
+    void write(uint64_t value, int count)
+    {
+        if(count > 32)
+        {
+            write(value >> 32, count - 32);
+            count = 32;
+        }
+
+        m_bits = (m_bits << count) | (value & (0xFFFFFFFFULL >> (32 - count)));
+        m_used += count;
+
+        while(m_used >= 8)
+        {
+            m_used -= 8;
+            m_dst.push_back((uint8_t) (m_bits >> m_used));
+        }
+    }
+
+    void finish()
+    {
+        if(m_used) m_dst.push_back((uint8_t) (m_bits << (8 - m_used)));
+        m_used = 0;
+    }
+private:
+    std::vector<uint8_t>& m_dst;
+    uint64_t m_bits;
+    int m_used;
+};
+
+// Reads zeros past the end, which a damaged block decodes to garbage rather
+// than out of bounds. The next bits sit at the top of a 64 bit window.
+class BitReader
+{
+public:
+    BitReader(const uint8_t* src, size_t len) : m_src(src), m_end(src + len), m_window(0), m_available(0) {}
+
+    uint64_t read(int count)
+    {
+        if(count > 32)
+        {
+            uint64_t high = read(count - 32);
+            return (high << 32) | read(32);
+        }
+
+        uint64_t value = window(count) >> (64 - count);
+        skip(count);
+        return value;
+    }
+
+    // The next bits, at least count of them up to 56
+    uint64_t window(int count)
+    {
+        if(m_available < count) refill();
+        return m_window;
+    }
+
+    void skip(int count)
+    {
+        m_window <<= count;
+        m_available -= count;
+    }
+private:
+    const uint8_t* m_src;
+    const uint8_t* m_end;
+    uint64_t m_window;
+    int m_available;
+
+    void refill()
+    {
+        m_available = std::max(m_available, 0);
+
+        // Whole bytes below the bits still there, eight at a time while they last
+        if(m_end - m_src >= 8)
+        {
+            uint64_t next = 0;
+            for(int i = 0; i < 8; i++) next = (next << 8) | m_src[i];
+
+            int bytes = (63 - m_available) >> 3;
+            m_window |= next >> m_available;
+            m_src += bytes;
+            m_available += bytes * 8;
+            return;
+        }
+
+        while(m_available <= 56)
+        {
+            if(m_src < m_end) m_window |= (uint64_t) *m_src++ << (56 - m_available);
+            m_available += 8;
+        }
+    }
+};
+
+static int i_leadingZeros(uint32_t value)
+{
+    int zeros = 0;
+    while(!(value & 0x80000000u)) { value <<= 1; zeros++; }
+    return zeros;
+}
+
+static int i_trailingZeros(uint32_t value)
+{
+    int zeros = 0;
+    while(!(value & 1)) { value >>= 1; zeros++; }
+    return zeros;
+}
+
+// Size of a delta change's prefix and of the value after it, by the next
+// four bits: 0, 10 and 7 bits, 110 and 9, 1110 and 12, 1111 and 64
+static const uint8_t i_prefixBits[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 4 };
+static const uint8_t i_changeBits[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 7, 7, 7, 7, 9, 9, 12, 64 };
+
+static uint32_t i_floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float i_bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+HCPLogger HCPTelemetryArchive::s_logger("TelemetryArchive");
+
+HCPTelemetryArchive::HCPTelemetryArchive() :
+    m_open(false),
+    m_retention(0),
+    m_mapped(0),
+    m_reads(0),
+    m_chunkOpened(INT64_MIN)
+{
+    static_assert(sizeof(BlockEntry) == 56 && sizeof(Segment) == 20, "BlockEntry and Segment are stored as they are");
+}
+
+HCPTelemetryArchive::~HCPTelemetryArchive()
+{
+    close();
+}
+
+bool HCPTelemetryArchive::open(const char* directory)
+{
+    close();
+
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if(error)
+    {
+        s_logger.errorf("Failed to create %s (%s)", directory, error.message().c_str());
+        return false;
+    }
+
+    fs::directory_iterator entries(directory, error);
+    if(error)
+    {
+        s_logger.errorf("Failed to list %s (%s)", directory, error.message().c_str());
+        return false;
+    }
+
+    // Only names are read here, a chunk is mapped when a read first needs it
+    uint64_t bytes = 0;
+    for(const fs::directory_entry& entry : entries)
+    {
+        std::string name = entry.path().filename().string();
+
+        // Left over from a chunk that was being written
+        if(entry.path().extension() == ".tmp")
+        {
+            fs::remove(entry.path(), error);
+            continue;
+        }
+
+        long long start, end;
+        int nameLen = 0;
+        if(sscanf(name.c_str(), "%lld-%lld.hcpt%n", &start, &end, &nameLen) != 2 || (size_t) nameLen != name.size()) continue;
+
+        Chunk chunk;
+        chunk.path = entry.path().string();
+        chunk.start = start;
+        chunk.end = end;
+        chunk.size = entry.file_size(error);
+        chunk.index = nullptr;
+        chunk.blockCount = 0;
+        chunk.lastRead = 0;
+        chunk.broken = false;
+
+        bytes += chunk.size;
+        m_chunks.push_back(std::move(chunk));
+    }
+
+    std::sort(m_chunks.begin(), m_chunks.end(), [](const Chunk& a, const Chunk& b) { return a.start < b.start; });
+
+    m_directory = directory;
+    m_pending.assign(HCPTelemetryStore::MAX_CHANNELS, Pending());
+    for(Pending& pending : m_pending) pending.newest = INT64_MIN;
+    m_chunkData.clear();
+    m_chunkIndex.clear();
+    m_chunkOpened = INT64_MIN;
+    m_open = true;
+
+    s_logger.infof("Archiving telemetry to %s, %zu chunks and %.1f MiB so far", directory, m_chunks.size(), bytes / 1048576.0);
+    return true;
+}
+
+void HCPTelemetryArchive::close()
+{
+    if(!m_open) return;
+
+    flush();
+
+    for(Chunk& chunk : m_chunks) unmapChunk(chunk);
+    m_chunks.clear();
+    m_pending.clear();
+    m_open = false;
+}
+
+bool HCPTelemetryArchive::isOpen() const
+{
+    return m_open;
+}
+
+void HCPTelemetryArchive::setRetention(int64_t micros)
+{
+    m_retention = micros;
+    if(m_open) applyRetention();
+}
+
+void HCPTelemetryArchive::append(uint8_t channel, int64_t timestamp, float value)
+{
+    if(!m_open) return;
+
+    Pending& pending = m_pending[channel];
+    timestamp = std::max(timestamp, pending.newest);
+    pending.newest = timestamp;
+
+    // Before the sample goes in, so no block spans more than a chunk's time
+    if(m_chunkOpened != INT64_MIN && (timestamp - m_chunkOpened >= CHUNK_TIME || m_chunkData.size() >= CHUNK_BYTES)) flush();
+    if(m_chunkOpened == INT64_MIN) m_chunkOpened = timestamp;
+
+    pending.timestamps.push_back(timestamp);
+    pending.values.push_back(value);
+    if(pending.timestamps.size() == BLOCK_SAMPLES) encodeBlock(channel);
+}
+
+void HCPTelemetryArchive::flush()
+{
+    if(!m_open) return;
+
+    for(size_t channel = 0; channel < m_pending.size(); channel++)
+        if(!m_pending[channel].timestamps.empty()) encodeBlock((uint8_t) channel);
+
+    m_chunkOpened = INT64_MIN;
+    if(m_chunkIndex.empty()) return;
+
+    // Index, aligned so it can be used in place, then the trailer
+    std::sort(m_chunkIndex.begin(), m_chunkIndex.end(), [](const BlockEntry& a, const BlockEntry& b)
+    {
+        return a.channel != b.channel ? a.channel < b.channel : a.start < b.start;
+    });
+
+    m_chunkData.resize((m_chunkData.size() + 7) & ~(size_t) 7);
+    uint64_t indexOffset = m_chunkData.size();
+    i_append(m_chunkData, m_chunkIndex.data(), m_chunkIndex.size() * sizeof(BlockEntry));
+
+    i_append<uint64_t>(m_chunkData, indexOffset);
+    i_append<uint32_t>(m_chunkData, (uint32_t) m_chunkIndex.size());
+    i_append<uint32_t>(m_chunkData, VERSION);
+    i_append<uint64_t>(m_chunkData, 0);
+    i_append(m_chunkData, i_magic, sizeof(i_magic));
+
+    Chunk chunk;
+    chunk.start = INT64_MAX;
+    chunk.end = INT64_MIN;
+    for(const BlockEntry& entry : m_chunkIndex)
+    {
+        chunk.start = std::min(chunk.start, entry.start);
+        chunk.end = std::max(chunk.end, entry.end);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%017lld-%017lld%s", (long long) chunk.start, (long long) chunk.end, CHUNK_EXTENSION);
+    chunk.path = (fs::path(m_directory) / name).string();
+    chunk.size = m_chunkData.size();
+    chunk.index = nullptr;
+    chunk.blockCount = 0;
+    chunk.lastRead = 0;
+    chunk.broken = false;
+
+    m_chunkIndex.clear();
+
+    // Written under a temporary name, so a chunk is either whole or not there
+    std::string tempPath = chunk.path + ".tmp";
+    {
+        HCPMappedFile file;
+        if(!file.open(tempPath.c_str(), HCPMappedFile::MODE_READ_WRITE) || !file.resize(m_chunkData.size()))
+        {
+            m_chunkData.clear();
+            return;
+        }
+
+        memcpy(file.data(), m_chunkData.data(), m_chunkData.size());
+        file.flush();
+    }
+    m_chunkData.clear();
+
+    std::error_code error;
+    fs::rename(tempPath, chunk.path, error);
+    if(error)
+    {
+        s_logger.errorf("Failed to write %s (%s)", chunk.path.c_str(), error.message().c_str());
+        fs::remove(tempPath, error);
+        return;
+    }
+
+    auto position = std::upper_bound(m_chunks.begin(), m_chunks.end(), chunk.start, [](int64_t start, const Chunk& other) { return start < other.start; });
+    m_chunks.insert(position, std::move(chunk));
+
+    applyRetention();
+}
+
+int64_t HCPTelemetryArchive::getStartTime() const
+{
+    return m_chunks.empty() ? 0 : m_chunks.front().start;
+}
+
+int64_t HCPTelemetryArchive::getEndTime() const
+{
+    int64_t end = INT64_MIN;
+    for(const Chunk& chunk : m_chunks) end = std::max(end, chunk.end);
+    return m_chunks.empty() ? 0 : end;
+}
+
+size_t HCPTelemetryArchive::getChunkCount() const
+{
+    return m_chunks.size();
+}
+
+uint64_t HCPTelemetryArchive::getDiskUsage() const
+{
+    uint64_t bytes = 0;
+    for(const Chunk& chunk : m_chunks) bytes += chunk.size;
+    return bytes;
+}
+
+size_t HCPTelemetryArchive::read(uint8_t channel, int64_t from, int64_t to, std::vector<int64_t>& timestamps, std::vector<float>& values) const
+{
+    size_t total = 0;
+
+    forEachBlock(channel, from, to, [&](const Chunk& chunk, const BlockEntry& entry)
+    {
+        size_t count = decodeBlock(chunk, entry);
+        size_t first = std::lower_bound(m_timestamps.begin(), m_timestamps.begin() + count, from) - m_timestamps.begin();
+        size_t last = std::lower_bound(m_timestamps.begin() + first, m_timestamps.begin() + count, to) - m_timestamps.begin();
+
+        timestamps.insert(timestamps.end(), m_timestamps.begin() + first, m_timestamps.begin() + last);
+        values.insert(values.end(), m_values.begin() + first, m_values.begin() + last);
+        total += last - first;
+    });
+
+    return total;
+}
+
+void HCPTelemetryArchive::summarize(uint8_t channel, int64_t from, int64_t to, HCPTelemetryChannel::Summary* columns, size_t numColumns) const
+{
+    std::fill(columns, columns + numColumns, HCPTelemetryChannel::Summary());
+    if(!numColumns || to <= from) return;
+
+    double width = (double) (to - from) / numColumns;
+    auto getColumn = [&](int64_t timestamp)
+    {
+        return std::min((size_t) ((timestamp - from) / width), numColumns - 1);
+    };
+
+    // A summary no wider than a column counts in each column it overlaps,
+    // like a bucket of HCPTelemetryChannel's
+    auto addSummary = [&](const HCPTelemetryChannel::Summary& summary)
+    {
+        size_t last = getColumn(std::min(summary.end, to - 1));
+        for(size_t column = getColumn(std::max(summary.start, from)); column <= last; column++) HCPTelemetryChannel::merge(columns[column], summary);
+    };
+
+    forEachBlock(channel, from, to, [&](const Chunk& chunk, const BlockEntry& entry)
+    {
+        if(entry.end - entry.start <= width)
+        {
+            addSummary({ entry.start, entry.end, entry.min, entry.max, entry.mean, entry.count });
+            return;
+        }
+
+        const Segment* segments = (const Segment*) (chunk.file->data() + entry.offset);
+        size_t decoded = 0;
+
+        for(size_t first = 0; first < entry.count; first += SEGMENT_SAMPLES)
+        {
+            const Segment& segment = segments[first / SEGMENT_SAMPLES];
+            uint32_t count = (uint32_t) std::min(entry.count - first, SEGMENT_SAMPLES);
+            HCPTelemetryChannel::Summary summary = { entry.start + segment.start, entry.start + segment.end, segment.min, segment.max, segment.mean, count };
+
+            if(summary.end < from || to <= summary.start) continue;
+            if(summary.end - summary.start <= width)
+            {
+                addSummary(summary);
+                continue;
+            }
+
+            if(!decoded) decoded = decodeBlock(chunk, entry);
+
+            // Runs of samples in the same column, folded in at once
+            HCPTelemetryChannel::Summary run = {};
+            double sum = 0.0;
+            size_t runColumn = 0;
+
+            for(size_t i = first; i < first + count; i++)
+            {
+                int64_t timestamp = m_timestamps[i];
+                if(timestamp < from || to <= timestamp) continue;
+
+                float value = m_values[i];
+                size_t column = getColumn(timestamp);
+                if(!run.count || column != runColumn)
+                {
+                    if(run.count)
+                    {
+                        run.mean = (float) (sum / run.count);
+                        HCPTelemetryChannel::merge(columns[runColumn], run);
+                    }
+
+                    run = { timestamp, timestamp, value, value, value, 0 };
+                    sum = 0.0;
+                    runColumn = column;
+                }
+
+                run.end = timestamp;
+                run.min = std::min(run.min, value);
+                run.max = std::max(run.max, value);
+                run.count++;
+                sum += value;
+            }
+
+            if(run.count)
+            {
+                run.mean = (float) (sum / run.count);
+                HCPTelemetryChannel::merge(columns[runColumn], run);
+            }
+        }
+    });
+}
+
+// Gorilla style. The first timestamp is the block's start in the index and
+// the first value is stored whole. After that come the changes in delta,
+// in units of the block's unit, with a prefix choosing their size, and each
+// value XORed with the one before, reusing the previous run of meaningful
+// bits when the new one fits in it.
+void HCPTelemetryArchive::encodeBlock(uint8_t channel)
+{
+    Pending& pending = m_pending[channel];
+    size_t count = pending.timestamps.size();
+    const int64_t* timestamps = pending.timestamps.data();
+    const float* values = pending.values.data();
+
+    if(m_chunkData.empty())
+    {
+        i_append(m_chunkData, i_magic, sizeof(i_magic));
+        i_append<uint32_t>(m_chunkData, VERSION);
+        i_append<uint32_t>(m_chunkData, 0);
+    }
+
+    // Samples every few milliseconds in microseconds, so the deltas share a
+    // large factor that need not be stored
+    uint64_t unit = 0;
+    for(size_t i = 1; i < count; i++)
+    {
+        uint64_t a = (uint64_t) (timestamps[i] - timestamps[i - 1]), b = unit;
+        while(b) { uint64_t r = a % b; a = b; b = r; }
+        unit = a;
+    }
+    if(!unit || unit > UINT32_MAX) unit = 1;
+
+    // Aligned for the segments to be read in place
+    m_chunkData.resize((m_chunkData.size() + 3) & ~(size_t) 3);
+
+    BlockEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.start = timestamps[0];
+    entry.end = timestamps[count - 1];
+    entry.offset = m_chunkData.size();
+    entry.count = (uint32_t) count;
+    entry.unit = (uint32_t) unit;
+    entry.channel = channel;
+    entry.min = entry.max = values[0];
+
+    double sum = 0.0;
+    for(size_t first = 0; first < count; first += SEGMENT_SAMPLES)
+    {
+        size_t last = std::min(first + SEGMENT_SAMPLES, count) - 1;
+
+        // A block spans at most a chunk's time, well within 32 bits
+        Segment segment;
+        segment.start = (uint32_t) std::min(timestamps[first] - entry.start, (int64_t) UINT32_MAX);
+        segment.end = (uint32_t) std::min(timestamps[last] - entry.start, (int64_t) UINT32_MAX);
+        segment.min = segment.max = values[first];
+
+        double segmentSum = 0.0;
+        for(size_t i = first; i <= last; i++)
+        {
+            segment.min = std::min(segment.min, values[i]);
+            segment.max = std::max(segment.max, values[i]);
+            segmentSum += values[i];
+        }
+        segment.mean = (float) (segmentSum / (last - first + 1));
+
+        entry.min = std::min(entry.min, segment.min);
+        entry.max = std::max(entry.max, segment.max);
+        sum += segmentSum;
+        i_append(m_chunkData, &segment, sizeof(segment));
+    }
+    entry.mean = (float) (sum / count);
+
+    BitWriter bits(m_chunkData);
+    uint32_t previousValue = i_floatBits(values[0]);
+    bits.write(previousValue, 32);
+
+    int64_t previousDelta = 0;
+    int leading = 32, trailing = 0; // no run of meaningful bits yet
+
+    for(size_t i = 1; i < count; i++)
+    {
+        int64_t delta = (timestamps[i] - timestamps[i - 1]) / (int64_t) unit;
+        int64_t change = delta - previousDelta;
+        previousDelta = delta;
+
+        if(change == 0) bits.write(0, 1);
+        else if(-64 <= change && change < 64) { bits.write(0x2, 2); bits.write((uint64_t) change, 7); }
+        else if(-256 <= change && change < 256) { bits.write(0x6, 3); bits.write((uint64_t) change, 9); }
+        else if(-2048 <= change && change < 2048) { bits.write(0xE, 4); bits.write((uint64_t) change, 12); }
+        else { bits.write(0xF, 4); bits.write((uint64_t) change, 64); }
+
+        uint32_t value = i_floatBits(values[i]);
+        uint32_t difference = value ^ previousValue;
+        previousValue = value;
+
+        if(!difference)
+        {
+            bits.write(0, 1);
+            continue;
+        }
+
+        int newLeading = i_leadingZeros(difference);
+        int newTrailing = i_trailingZeros(difference);
+        if(newLeading >= leading && newTrailing >= trailing)
+        {
+            bits.write(0x2, 2);
+            bits.write(difference >> trailing, 32 - leading - trailing);
+        }
+        else
+        {
+            leading = newLeading;
+            trailing = newTrailing;
+            int meaningful = 32 - leading - trailing;
+
+            bits.write(0x3, 2);
+            bits.write((uint64_t) leading, 5);
+            bits.write((uint64_t) (meaningful - 1), 5);
+            bits.write(difference >> trailing, meaningful);
+        }
+    }
+    bits.finish();
+
+    entry.size = (uint32_t) (m_chunkData.size() - entry.offset);
+    m_chunkIndex.push_back(entry);
+
+    pending.timestamps.clear();
+    pending.values.clear();
+}
+
+void HCPTelemetryArchive::applyRetention()
+{
+    if(m_retention <= 0 || m_chunks.empty()) return;
+
+    int64_t cutoff = getEndTime() - m_retention;
+
+    for(size_t i = 0; i < m_chunks.size();)
+    {
+        Chunk& chunk = m_chunks[i];
+        if(cutoff <= chunk.end)
+        {
+            i++;
+            continue;
+        }
+
+        unmapChunk(chunk);
+
+        std::error_code error;
+        fs::remove(chunk.path, error);
+        if(error) s_logger.errorf("Failed to delete %s (%s)", chunk.path.c_str(), error.message().c_str());
+
+        m_chunks.erase(m_chunks.begin() + i);
+    }
+}
+
+bool HCPTelemetryArchive::mapChunk(Chunk& chunk) const
+{
+    chunk.lastRead = ++m_reads;
+    if(chunk.file) return true;
+    if(chunk.broken) return false;
+
+    if(m_mapped >= MAX_MAPPED)
+    {
+        Chunk* oldest = nullptr;
+        for(Chunk& other : m_chunks)
+            if(other.file && (!oldest || other.lastRead < oldest->lastRead)) oldest = &other;
+
+        if(oldest) unmapChunk(*oldest);
+    }
+
+    std::unique_ptr<HCPMappedFile> file(new HCPMappedFile());
+    if(!file->open(chunk.path.c_str(), HCPMappedFile::MODE_READ))
+    {
+        chunk.broken = true;
+        return false;
+    }
+
+    // Everything the index points at has to be in the file
+    const uint8_t* data = file->data();
+    size_t size = file->size();
+    bool valid = size >= HEADER_SIZE + TRAILER_SIZE && memcmp(data, i_magic, sizeof(i_magic)) == 0
+        && memcmp(data + size - sizeof(i_magic), i_magic, sizeof(i_magic)) == 0;
+
+    const uint8_t* trailer = data + size - TRAILER_SIZE;
+    uint64_t indexOffset = valid ? i_load<uint64_t>(trailer) : 0;
+    uint32_t blockCount = valid ? i_load<uint32_t>(trailer + 8) : 0;
+    uint32_t version = valid ? i_load<uint32_t>(trailer + 12) : 0;
+
+    valid = valid && version == VERSION && indexOffset % 8 == 0 && indexOffset >= HEADER_SIZE
+        && indexOffset + (uint64_t) blockCount * sizeof(BlockEntry) + TRAILER_SIZE == size;
+
+    const BlockEntry* index = valid ? (const BlockEntry*) (data + indexOffset) : nullptr;
+    for(uint32_t i = 0; valid && i < blockCount; i++)
+        valid = index[i].count && index[i].unit && index[i].offset % 4 == 0 && index[i].offset + index[i].size <= indexOffset
+            && (index[i].count + SEGMENT_SAMPLES - 1) / SEGMENT_SAMPLES * sizeof(Segment) + 4 <= index[i].size;
+
+    if(!valid)
+    {
+        s_logger.errorf("Skipping damaged telemetry chunk %s", chunk.path.c_str());
+        chunk.broken = true;
+        return false;
+    }
+
+    chunk.file = std::move(file);
+    chunk.index = index;
+    chunk.blockCount = blockCount;
+    m_mapped++;
+    return true;
+}
+
+void HCPTelemetryArchive::unmapChunk(Chunk& chunk) const
+{
+    if(!chunk.file) return;
+
+    chunk.file.reset();
+    chunk.index = nullptr;
+    chunk.blockCount = 0;
+    m_mapped--;
+}
+
+// Calls visit(chunk, entry) for every block of the channel overlapping
+// [from, to), in each chunk's index order
+template<typename Visit>
+void HCPTelemetryArchive::forEachBlock(uint8_t channel, int64_t from, int64_t to, Visit visit) const
+{
+    for(Chunk& chunk : m_chunks)
+    {
+        if(to <= chunk.start) break;
+        if(chunk.end < from || !mapChunk(chunk)) continue;
+
+        const BlockEntry* blocks = chunk.index;
+        const BlockEntry* blocksEnd = blocks + chunk.blockCount;
+        blocks = std::lower_bound(blocks, blocksEnd, channel, [](const BlockEntry& entry, uint8_t channel) { return entry.channel < channel; });
+        blocksEnd = std::upper_bound(blocks, blocksEnd, channel, [](uint8_t channel, const BlockEntry& entry) { return channel < entry.channel; });
+
+        // A channel's blocks follow each other, so their ends are in order too
+        blocks = std::lower_bound(blocks, blocksEnd, from, [](const BlockEntry& entry, int64_t from) { return entry.end < from; });
+        for(; blocks < blocksEnd && blocks->start < to; blocks++) visit(chunk, *blocks);
+    }
+}
+
+// Into m_timestamps and m_values, returns the block's sample count
+size_t HCPTelemetryArchive::decodeBlock(const Chunk& chunk, const BlockEntry& entry) const
+{
+    size_t count = entry.count;
+    if(m_timestamps.size() < count)
+    {
+        m_timestamps.resize(count);
+        m_values.resize(count);
+    }
+
+    size_t segmentBytes = (count + SEGMENT_SAMPLES - 1) / SEGMENT_SAMPLES * sizeof(Segment);
+    BitReader bits(chunk.file->data() + entry.offset + segmentBytes, entry.size - segmentBytes);
+
+    int64_t timestamp = entry.start;
+    int64_t delta = 0;
+    uint32_t value = (uint32_t) bits.read(32);
+    int leading = 0, meaningful = 32;
+
+    m_timestamps[0] = timestamp;
+    m_values[0] = i_bitsFloat(value);
+
+    // Which case a sample is in is as good as random for a noisy sensor, so
+    // fields are cut out of the window with selects rather than branches
+    for(size_t i = 1; i < count; i++)
+    {
+        uint64_t window = bits.window(16);
+        uint32_t code = (uint32_t) (window >> 60);
+        int prefixBits = i_prefixBits[code];
+        int changeBits = i_changeBits[code];
+
+        if(changeBits == 64)
+        {
+            bits.skip(prefixBits);
+            delta += (int64_t) bits.read(64);
+        }
+        else
+        {
+            int64_t change = (int64_t) (window << prefixBits) >> (64 - std::max(changeBits, 1));
+            delta += changeBits ? change : 0;
+            bits.skip(prefixBits + changeBits);
+        }
+        timestamp += delta * entry.unit;
+
+        // 0, or 10 and the bits in the last run, or 11, the new run's leading
+        // zeros and length and its bits
+        window = bits.window(44);
+        bool changed = (window >> 63) != 0;
+        bool newRun = (window >> 62) == 3;
+        leading = newRun ? (int) ((window >> 57) & 31) : leading;
+        meaningful = newRun ? (int) ((window >> 52) & 31) + 1 : meaningful;
+        meaningful = std::min(meaningful, 32 - leading);
+
+        int headerBits = newRun ? 12 : changed ? 2 : 1;
+        uint32_t difference = (uint32_t) ((window << headerBits) >> (64 - meaningful)) << (32 - leading - meaningful);
+        value ^= changed ? difference : 0;
+        bits.skip(headerBits + (changed ? meaningful : 0));
+
+        m_timestamps[i] = timestamp;
+        m_values[i] = i_bitsFloat(value);
+    }
+
+    return count;
+}
@@ -0,0 +1,707 @@
+#include "hcp/Transport.hpp"
+#include "hcp/TransportReactor.hpp"
+#include "hcp/Serial.hpp"
+#include "hcp/SocketTransport.hpp"
+#include "hcp/ReplayTransport.hpp"
+#include "hcp/Capture.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+HCPLogger HCPTransport::s_logger("Transport");
+uint8_t HCPTransport::s_delimiter = 0;
+
+const size_t HCPTransport::WRITE_BUFFER_SIZES[PRIORITY_COUNT] = { 1 << 12, 1 << 16, 1 << 18 };
+constexpr std::chrono::milliseconds HCPTransport::RETRY_DELAY_MIN;
+constexpr std::chrono::milliseconds HCPTransport::RETRY_DELAY_MAX;
+
+HCPTransport* HCPTransport::create(const char* address)
+{
+    if(HCPSocketTransport::isSocketAddress(address)) return new HCPSocketTransport(address);
+    if(strncmp(address, HCPReplayTransport::PREFIX, strlen(HCPReplayTransport::PREFIX)) == 0) return new HCPReplayTransport(address);
+
+    // Writes to a wedged port give up instead of stalling the I/O side
+    return new HCPSerial(address, 9600, HCPSerial::PARITY_NONE, HCPSerial::STOPBITS_ONE, HCPSerial::Timeout::fromTimeout(2000));
+}
+
+HCPTransport::HCPTransport(const char* address_) :
+    m_readBuffer(READ_BUFFER_SIZE),
+    m_open(false),
+    m_reactor(nullptr),
+    m_ioWakePending(false),
+    m_bytesReceived(0),
+    m_inputStalls(0),
+    m_lineOverruns(0),
+    m_lineParityErrors(0),
+    m_lineFramingErrors(0),
+    m_lineBreaks(0),
+    m_inputStalled(false),
+    m_outputThrottled(false),
+    m_stampHead(0),
+    m_stampTail(0),
+    m_lastReceive(0),
+    m_received(0),
+    m_consumed(0),
+    m_reconnecting(false),
+    m_retryDelay(RETRY_DELAY_MIN),
+    m_threaded(false),
+    m_ioRunning(false),
+    m_bytesSent(0),
+    m_framesReceived(0),
+    m_framesSent(0),
+    m_inputMaxQueued(0),
+    m_failures(0),
+    m_reconnects(0),
+    m_outputTaskPeriod(0),
+    m_taskOutputLen(0),
+    m_taskOutputSent(0),
+    m_outputSource(PRIORITY_INTERACTIVE),
+    m_outputAtBoundary(true),
+    m_ioImpl(nullptr)
+{
+    snprintf(m_address, sizeof(m_address), "%s", address_ ? address_ : "");
+
+    for(int lane = 0; lane < PRIORITY_COUNT; lane++)
+    {
+        m_writeBuffers[lane].resize(WRITE_BUFFER_SIZES[lane]);
+        m_laneBytesSent[lane] = 0;
+        m_laneMaxQueued[lane] = 0;
+    }
+
+    impl_initIO();
+}
+
+HCPTransport::~HCPTransport()
+{
+    impl_destroyIO();
+}
+
+void HCPTransport::begin()
+{
+    if(!m_address[0] || m_open || m_reconnecting) return;
+
+    m_readBuffer.clear();
+    m_stampHead = m_stampTail = 0;
+    m_received = m_consumed = 0;
+    for(HCPRingBuffer& writeBuffer : m_writeBuffers) writeBuffer.clear();
+    m_taskOutputLen = m_taskOutputSent = 0;
+    m_outputAtBoundary = true;
+    m_inputStalled = false;
+    m_outputThrottled = false;
+    m_nextOutputTask = std::chrono::steady_clock::now();
+
+    // Devices that aren't there yet are retried like lost ones
+    if(impl_open())
+    {
+        m_open = true;
+        s_logger.infof("Opened %s", m_address);
+    }
+    else startReconnecting();
+
+    if(m_reactor && impl_isPollable())
+    {
+        m_reactor->add(this);
+        return;
+    }
+
+    if(m_threaded || m_reactor)
+    {
+        m_ioRunning = true;
+        m_ioWakePending = false;
+        m_ioThread = std::thread(&HCPTransport::ioLoop, this);
+    }
+}
+
+void HCPTransport::close()
+{
+    // Once removed the reactor no longer touches the transport
+    if(m_reactor) m_reactor->remove(this);
+
+    if(m_ioThread.joinable())
+    {
+        m_ioRunning = false;
+        impl_wake();
+        m_ioThread.join();
+    }
+
+    impl_close();
+    m_hotplug.unwatch();
+    m_open = false;
+    m_reconnecting = false;
+}
+
+bool HCPTransport::isOpen() const
+{
+    return m_open;
+}
+
+HCPTransport::State HCPTransport::getState() const
+{
+    if(m_open) return STATE_OPEN;
+    return m_reconnecting ? STATE_RECONNECTING : STATE_CLOSED;
+}
+
+HCPTransport::Stats HCPTransport::getStats() const
+{
+    Stats stats;
+    stats.bytesReceived = m_bytesReceived.load(std::memory_order_relaxed);
+    stats.bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+    stats.framesReceived = m_framesReceived.load(std::memory_order_relaxed);
+    stats.framesSent = m_framesSent.load(std::memory_order_relaxed);
+    stats.inputStalls = m_inputStalls.load(std::memory_order_relaxed);
+    stats.inputMaxQueued = m_inputMaxQueued.load(std::memory_order_relaxed);
+    stats.failures = m_failures.load(std::memory_order_relaxed);
+    stats.reconnects = m_reconnects.load(std::memory_order_relaxed);
+    stats.lineErrors.overruns = m_lineOverruns.load(std::memory_order_relaxed);
+    stats.lineErrors.parity = m_lineParityErrors.load(std::memory_order_relaxed);
+    stats.lineErrors.framing = m_lineFramingErrors.load(std::memory_order_relaxed);
+    stats.lineErrors.breaks = m_lineBreaks.load(std::memory_order_relaxed);
+
+    for(int lane = 0; lane < PRIORITY_COUNT; lane++)
+    {
+        stats.lanes[lane].queued = m_writeBuffers[lane].size();
+        stats.lanes[lane].maxQueued = m_laneMaxQueued[lane].load(std::memory_order_relaxed);
+        stats.lanes[lane].bytesSent = m_laneBytesSent[lane].load(std::memory_order_relaxed);
+    }
+
+    return stats;
+}
+
+const char* HCPTransport::getAddress() const
+{
+    return m_address;
+}
+
+void HCPTransport::setThreaded(bool threaded)
+{
+    if(m_open)
+    {
+        s_logger.warnf("Cannot change threading of open transport: %s", m_address);
+        return;
+    }
+
+    m_threaded = threaded;
+}
+
+bool HCPTransport::isThreaded() const
+{
+    return m_threaded;
+}
+
+void HCPTransport::setReactor(HCPTransportReactor* reactor)
+{
+    if(m_open)
+    {
+        s_logger.warnf("Cannot change the reactor of open transport: %s", m_address);
+        return;
+    }
+
+    m_reactor = reactor;
+}
+
+HCPTransportReactor* HCPTransport::getReactor() const
+{
+    return m_reactor;
+}
+
+bool HCPTransport::setCapture(const char* path)
+{
+    if(m_open || m_reconnecting)
+    {
+        s_logger.warnf("Cannot change the capture of open transport: %s", m_address);
+        return false;
+    }
+
+    if(!path)
+    {
+        m_capture.reset();
+        return true;
+    }
+
+    std::unique_ptr<HCPCaptureWriter> capture(new HCPCaptureWriter());
+    if(!capture->open(path)) return false;
+
+    m_capture = std::move(capture);
+    return true;
+}
+
+bool HCPTransport::isCapturing() const
+{
+    return m_capture != nullptr;
+}
+
+HCPCaptureReplay* HCPTransport::getReplay()
+{
+    return nullptr;
+}
+
+int HCPTransport::available() const
+{
+    return (int) m_readBuffer.size();
+}
+
+size_t HCPTransport::write(const uint8_t* data, size_t len, Priority priority)
+{
+    // All or nothing, and committed at once so the sender never sees part of
+    // it. Half a frame would leave the lane without its delimiter.
+    HCPRingBuffer::Span spans[2];
+    if(m_writeBuffers[priority].reserve(spans, len) < len)
+    {
+        s_logger.warnf("Output buffer full, dropped %zu bytes: %s", len, m_address);
+        return 0;
+    }
+
+    memcpy(spans[0].data, data, spans[0].len);
+    memcpy(spans[1].data, data + spans[0].len, spans[1].len);
+    commitWrite(len, priority);
+
+    return len;
+}
+
+int HCPTransport::read(uint8_t* data, size_t len)
+{
+    size_t bytesRead = m_readBuffer.read(data, len);
+    releaseStamps(bytesRead);
+    return (int) bytesRead;
+}
+
+size_t HCPTransport::peek(HCPRingBuffer::Span spans[2])
+{
+    return m_readBuffer.peek(spans);
+}
+
+void HCPTransport::consume(size_t len)
+{
+    m_readBuffer.consume(len);
+    releaseStamps(len);
+}
+
+size_t HCPTransport::reserveWrite(HCPRingBuffer::Span spans[2], size_t len, Priority priority)
+{
+    return m_writeBuffers[priority].reserve(spans, len);
+}
+
+void HCPTransport::commitWrite(size_t len, Priority priority)
+{
+    m_writeBuffers[priority].commitWrite(len);
+    if(!len) return;
+
+    noteQueued(priority);
+    wakeIO();
+}
+
+void HCPTransport::setOutputTask(std::chrono::microseconds period, OutputTask task)
+{
+    if(m_open)
+    {
+        s_logger.warnf("Cannot change the output task of open transport: %s", m_address);
+        return;
+    }
+
+    m_outputTaskPeriod = period;
+    m_outputTask = std::move(task);
+}
+
+std::chrono::steady_clock::time_point HCPTransport::getReceiveTime(size_t offset)
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t position = m_consumed + offset;
+    size_t head = m_stampHead.load(std::memory_order_acquire);
+
+    for(size_t i = m_stampTail.load(std::memory_order_relaxed); i != head; i++)
+    {
+        const ReceiveStamp& stamp = m_receiveStamps[i % RECEIVE_STAMP_COUNT];
+        if(position < stamp.end) return Clock::time_point(Clock::duration(stamp.time));
+    }
+
+    return Clock::time_point(Clock::duration(m_lastReceive.load(std::memory_order_relaxed)));
+}
+
+void HCPTransport::poll()
+{
+    if(m_threaded || m_reactor) return;
+
+    // Opening a serial port or starting a connect doesn't block, only
+    // resolving a host name for one might
+    if(m_reconnecting && retry()) reconnected();
+    if(!m_open) return;
+
+    runOutputTask();
+
+    if(!impl_service(0)) fail();
+}
+
+bool HCPTransport::flushOuput()
+{
+    if(!m_open) return false;
+
+    if(m_threaded || m_reactor)
+    {
+        wakeIO();
+        return !hasQueuedOutput();
+    }
+
+    if(!impl_flush())
+    {
+        fail();
+        return false;
+    }
+
+    return !hasQueuedOutput();
+}
+
+bool HCPTransport::impl_isPollable() const
+{
+    return true;
+}
+
+const char* HCPTransport::impl_getHotplugPath() const
+{
+    return nullptr;
+}
+
+bool HCPTransport::resumeInput()
+{
+    if(!m_inputStalled || !m_readBuffer.space()) return true;
+    if(!impl_watchInput(true)) return false;
+
+    m_inputStalled = false;
+    return true;
+}
+
+void HCPTransport::ioLoop()
+{
+    while(m_ioRunning)
+    {
+        if(m_reconnecting)
+        {
+            if(retry()) reconnected();
+            else impl_waitRetry(getRetryTimeout(100));
+            continue;
+        }
+
+        // The wait is cut short by impl_wake() when there is output or on close
+        int timeoutMs = runOutputTask() ? 0 : getOutputTaskTimeout(100);
+
+        if(!impl_service(timeoutMs)) fail();
+    }
+}
+
+void HCPTransport::fail()
+{
+    s_logger.warnf("Lost %s, reconnecting", m_address);
+
+    m_failures++;
+    impl_close();
+    startReconnecting();
+}
+
+void HCPTransport::startReconnecting()
+{
+    m_open = false;
+    m_reconnecting = true;
+    m_inputStalled = false;
+    m_outputThrottled = false;
+    dropPartialFrame();
+
+    m_retryDelay = RETRY_DELAY_MIN;
+    retryLater();
+
+    // Without a watch the retries alone bring it back
+    m_hotplug.watch(impl_getHotplugPath());
+    if(m_reactor && impl_isPollable()) impl_watchHotplug(m_reactor->impl_getPollHandle());
+}
+
+bool HCPTransport::retry()
+{
+    bool reappeared = m_hotplug.check();
+    if(!reappeared && std::chrono::steady_clock::now() < m_retryAt) return false;
+
+    // A device that just appeared may not be ready yet, a socket file exists
+    // before the listen() and a node before udev fixes its permissions
+    if(reappeared) m_retryDelay = RETRY_DELAY_MIN;
+
+    if(impl_open()) return true;
+
+    retryLater();
+    return false;
+}
+
+void HCPTransport::retryLater()
+{
+    m_retryAt = std::chrono::steady_clock::now() + m_retryDelay;
+    m_retryDelay = std::min<std::chrono::steady_clock::duration>(m_retryDelay * 2, RETRY_DELAY_MAX);
+}
+
+void HCPTransport::reconnected()
+{
+    m_hotplug.unwatch();
+    m_open = true;
+    m_reconnecting = false;
+    m_reconnects++;
+
+    s_logger.infof("Reconnected %s", m_address);
+}
+
+int HCPTransport::getRetryTimeout(int timeoutMs) const
+{
+    auto untilRetry = std::chrono::duration_cast<std::chrono::milliseconds>(m_retryAt - std::chrono::steady_clock::now());
+    return (int) std::max<int64_t>(0, std::min<int64_t>(timeoutMs, untilRetry.count() + 1));
+}
+
+// Only the start of the frame that was going out reached the device, the
+// rest would be garbage to a freshly reopened one
+void HCPTransport::dropPartialFrame()
+{
+    if(m_outputAtBoundary) return;
+    m_outputAtBoundary = true;
+    if(m_outputSource == OUTPUT_DELIMITER) return;
+
+    if(m_outputSource == OUTPUT_TASK)
+    {
+        m_taskOutputLen = m_taskOutputSent = 0;
+        return;
+    }
+
+    HCPRingBuffer& writeBuffer = m_writeBuffers[m_outputSource];
+    HCPRingBuffer::Span spans[2];
+    writeBuffer.peek(spans);
+
+    size_t len = 0;
+    for(const HCPRingBuffer::Span& span : spans)
+    {
+        const uint8_t* end = span.len ? (const uint8_t*) memchr(span.data, 0, span.len) : nullptr;
+        if(end)
+        {
+            writeBuffer.consume(len + (end - span.data) + 1);
+            return;
+        }
+
+        len += span.len;
+    }
+}
+
+void HCPTransport::wakeIO()
+{
+    if(!m_threaded && !m_reactor) return;
+
+    // Only the first write after the I/O side went idle pays for a wakeup
+    if(m_ioWakePending.exchange(true)) return;
+
+    if(m_reactor && impl_isPollable()) m_reactor->wake();
+    else impl_wake();
+}
+
+void HCPTransport::commitReceived(size_t len)
+{
+    std::chrono::steady_clock::rep now = std::chrono::steady_clock::now().time_since_epoch().count();
+    m_received += len;
+
+    // Stamped before the commit so a reader that sees the bytes sees their time
+    size_t head = m_stampHead.load(std::memory_order_relaxed);
+    if(head - m_stampTail.load(std::memory_order_acquire) < RECEIVE_STAMP_COUNT)
+    {
+        m_receiveStamps[head % RECEIVE_STAMP_COUNT] = { m_received, now };
+        m_stampHead.store(head + 1, std::memory_order_release);
+    }
+
+    m_lastReceive.store(now, std::memory_order_relaxed);
+    m_bytesReceived.fetch_add(len, std::memory_order_relaxed);
+
+    // The bytes were read into the start of the free space
+    HCPRingBuffer::Span spans[2];
+    m_readBuffer.reserve(spans, len);
+    m_framesReceived.fetch_add(std::count(spans[0].data, spans[0].data + spans[0].len, 0)
+        + std::count(spans[1].data, spans[1].data + spans[1].len, 0), std::memory_order_relaxed);
+
+    if(m_capture)
+    {
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::duration(now)).count();
+        m_capture->record(HCPCapture::RX, spans[0].data, spans[0].len, timestamp);
+        m_capture->record(HCPCapture::RX, spans[1].data, spans[1].len, timestamp);
+    }
+
+    m_readBuffer.commitWrite(len);
+
+    // Only the producer raises the maximum
+    size_t queued = m_readBuffer.size();
+    if(m_inputMaxQueued.load(std::memory_order_relaxed) < queued) m_inputMaxQueued.store(queued, std::memory_order_relaxed);
+}
+
+void HCPTransport::releaseStamps(size_t len)
+{
+    m_consumed += len;
+
+    size_t tail = m_stampTail.load(std::memory_order_relaxed);
+    size_t head = m_stampHead.load(std::memory_order_acquire);
+
+    while(tail != head && m_receiveStamps[tail % RECEIVE_STAMP_COUNT].end <= m_consumed)
+        tail++;
+
+    m_stampTail.store(tail, std::memory_order_release);
+}
+
+bool HCPTransport::runOutputTask()
+{
+    if(!m_outputTask) return false;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now < m_nextOutputTask) return false;
+
+    // Skip ticks that were missed rather than bursting to catch up
+    m_nextOutputTask += m_outputTaskPeriod;
+    if(m_nextOutputTask < now) m_nextOutputTask = now + m_outputTaskPeriod;
+
+    // The previous frame has to go out first. The task reads its inputs when
+    // it runs, so waiting a tick never sends anything stale.
+    if(m_taskOutputLen) return false;
+
+    size_t len = std::min(m_outputTask(m_taskOutput, sizeof(m_taskOutput)), sizeof(m_taskOutput));
+    m_taskOutputLen = len;
+
+    return len != 0;
+}
+
+int HCPTransport::getOutputTaskTimeout(int timeoutMs) const
+{
+    if(!m_outputTask) return timeoutMs;
+
+    auto untilTask = std::chrono::duration_cast<std::chrono::milliseconds>(m_nextOutputTask - std::chrono::steady_clock::now());
+    return (int) std::max<int64_t>(0, std::min<int64_t>(timeoutMs, untilTask.count()));
+}
+
+bool HCPTransport::hasOutput() const
+{
+    return m_taskOutputSent < m_taskOutputLen || hasQueuedOutput();
+}
+
+bool HCPTransport::hasQueuedOutput() const
+{
+    for(const HCPRingBuffer& writeBuffer : m_writeBuffers)
+        if(!writeBuffer.empty()) return true;
+
+    return false;
+}
+
+size_t HCPTransport::peekOutput(HCPRingBuffer::Span spans[2])
+{
+    // A source that ran dry mid-frame was given bytes without a delimiter.
+    // Ending its frame costs the device that broken frame, rather than the
+    // next one as well, and frees the sender to move on.
+    if(!m_outputAtBoundary && m_outputSource != OUTPUT_DELIMITER)
+    {
+        bool empty = m_outputSource == OUTPUT_TASK ? m_taskOutputSent == m_taskOutputLen : m_writeBuffers[m_outputSource].empty();
+        if(empty) m_outputSource = OUTPUT_DELIMITER;
+    }
+
+    // A frame that is partly out has to finish first, otherwise the next
+    // frame goes to the most urgent source with one waiting
+    if(m_outputAtBoundary)
+    {
+        if(!m_writeBuffers[PRIORITY_CONTROL].empty()) m_outputSource = PRIORITY_CONTROL;
+        else if(m_taskOutputSent < m_taskOutputLen) m_outputSource = OUTPUT_TASK;
+        else if(!m_writeBuffers[PRIORITY_INTERACTIVE].empty()) m_outputSource = PRIORITY_INTERACTIVE;
+        else m_outputSource = PRIORITY_BULK;
+    }
+
+    if(m_outputSource == OUTPUT_DELIMITER)
+    {
+        spans[0] = { &s_delimiter, 1 };
+        spans[1] = { nullptr, 0 };
+        return 1;
+    }
+
+    if(m_outputSource == OUTPUT_TASK)
+    {
+        spans[0] = { m_taskOutput + m_taskOutputSent, m_taskOutputLen - m_taskOutputSent };
+        spans[1] = { nullptr, 0 };
+        return spans[0].len;
+    }
+
+    size_t len = m_writeBuffers[m_outputSource].peek(spans);
+
+    // Writes cut short by the device's queue limit rarely end on a frame
+    // boundary, so with something more urgent waiting only the rest of the
+    // current frame goes out
+    bool urgent = !m_writeBuffers[PRIORITY_CONTROL].empty();
+    if(PRIORITY_CONTROL < m_outputSource) urgent = urgent || m_taskOutputSent < m_taskOutputLen;
+    if(PRIORITY_INTERACTIVE < m_outputSource) urgent = urgent || !m_writeBuffers[PRIORITY_INTERACTIVE].empty();
+    if(!urgent || m_outputSource == PRIORITY_CONTROL) return len;
+
+    for(int i = 0; i < 2; i++)
+    {
+        const uint8_t* end = spans[i].len ? (const uint8_t*) memchr(spans[i].data, 0, spans[i].len) : nullptr;
+        if(!end) continue;
+
+        spans[i].len = end - spans[i].data + 1;
+        if(i == 0) spans[1] = { nullptr, 0 };
+        return spans[0].len + spans[1].len;
+    }
+
+    return len;
+}
+
+void HCPTransport::consumeOutput(size_t len)
+{
+    if(!len) return;
+
+    m_bytesSent.fetch_add(len, std::memory_order_relaxed);
+
+    if(m_outputSource == OUTPUT_DELIMITER)
+    {
+        if(m_capture) m_capture->record(HCPCapture::TX, &s_delimiter, 1, HCPCapture::now());
+
+        m_outputAtBoundary = true;
+        return;
+    }
+
+    if(m_outputSource == OUTPUT_TASK)
+    {
+        if(m_capture) m_capture->record(HCPCapture::TX, m_taskOutput + m_taskOutputSent, len, HCPCapture::now());
+
+        m_framesSent.fetch_add(std::count(m_taskOutput + m_taskOutputSent, m_taskOutput + m_taskOutputSent + len, 0), std::memory_order_relaxed);
+        m_taskOutputSent += len;
+        m_outputAtBoundary = m_taskOutput[m_taskOutputSent - 1] == 0;
+        if(m_taskOutputSent == m_taskOutputLen) m_taskOutputLen = m_taskOutputSent = 0;
+        return;
+    }
+
+    HCPRingBuffer& writeBuffer = m_writeBuffers[m_outputSource];
+    m_laneBytesSent[m_outputSource].fetch_add(len, std::memory_order_relaxed);
+
+    HCPRingBuffer::Span spans[2];
+    writeBuffer.peek(spans);
+    size_t first = std::min(len, spans[0].len);
+
+    m_framesSent.fetch_add(std::count(spans[0].data, spans[0].data + first, 0)
+        + std::count(spans[1].data, spans[1].data + (len - first), 0), std::memory_order_relaxed);
+
+    if(m_capture)
+    {
+        int64_t timestamp = HCPCapture::now();
+        m_capture->record(HCPCapture::TX, spans[0].data, first, timestamp);
+        m_capture->record(HCPCapture::TX, spans[1].data, len - first, timestamp);
+    }
+
+    uint8_t last = len <= spans[0].len ? spans[0].data[len - 1] : spans[1].data[len - spans[0].len - 1];
+    m_outputAtBoundary = last == 0;
+
+    writeBuffer.consume(len);
+}
+
+size_t HCPTransport::limitSpans(HCPRingBuffer::Span spans[2], size_t maxLen)
+{
+    spans[0].len = std::min(spans[0].len, maxLen);
+    spans[1].len = std::min(spans[1].len, maxLen - spans[0].len);
+    return spans[0].len + spans[1].len;
+}
+
+void HCPTransport::noteQueued(Priority priority)
+{
+    // Only the producer raises the maximum, so no compare and swap needed
+    size_t queued = m_writeBuffers[priority].size();
+    if(m_laneMaxQueued[priority].load(std::memory_order_relaxed) < queued)
+        m_laneMaxQueued[priority].store(queued, std::memory_order_relaxed);
+}
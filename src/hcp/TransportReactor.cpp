@@ -0,0 +1,191 @@
+#include "hcp/TransportReactor.hpp"
+
+#include <algorithm>
+
+HCPLogger HCPTransportReactor::s_logger("TransportReactor");
+
+HCPTransportReactor::HCPTransportReactor() :
+    m_version(0),
+    m_running(false),
+    m_wakePending(false),
+    m_pollAll(false),
+    m_cpuTime(0),
+    m_impl(nullptr)
+{
+    impl_init();
+}
+
+HCPTransportReactor::~HCPTransportReactor()
+{
+    if(m_thread.joinable())
+    {
+        m_running = false;
+        impl_wake();
+        m_thread.join();
+    }
+
+    // Close what is left so those transports don't call back into a dead reactor
+    for(HCPTransport* transport : m_transports)
+    {
+        s_logger.warnf("Closing transport that outlived its reactor: %s", transport->m_address);
+
+        transport->impl_close();
+        transport->m_hotplug.unwatch();
+        transport->m_open = false;
+        transport->m_reconnecting = false;
+        transport->m_reactor = nullptr;
+    }
+
+    impl_destroy();
+}
+
+size_t HCPTransportReactor::getTransportCount() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_transports.size();
+}
+
+const HCPHistogram& HCPTransportReactor::getDispatchLatency() const
+{
+    return m_dispatchLatency;
+}
+
+std::chrono::microseconds HCPTransportReactor::getCpuTime() const
+{
+    return std::chrono::microseconds(m_cpuTime.load(std::memory_order_relaxed));
+}
+
+void HCPTransportReactor::add(HCPTransport* transport)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(transport->m_open && !attach(transport))
+    {
+        transport->impl_close();
+        transport->startReconnecting();
+    }
+
+    m_transports.push_back(transport);
+
+    if(!m_thread.joinable())
+    {
+        m_running = true;
+        m_thread = std::thread(&HCPTransportReactor::loop, this);
+    }
+    else impl_wake(); // the new transport may shorten the wait
+}
+
+void HCPTransportReactor::remove(HCPTransport* transport)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = std::find(m_transports.begin(), m_transports.end(), transport);
+    if(it == m_transports.end()) return;
+
+    m_transports.erase(it);
+
+    // Events for the transport may already be on their way out of the wait
+    m_version++;
+}
+
+void HCPTransportReactor::wake()
+{
+    // A burst of writes to many transports only wakes the thread once
+    if(!m_wakePending.exchange(true)) impl_wake();
+}
+
+bool HCPTransportReactor::attach(HCPTransport* transport)
+{
+    return transport->impl_attach(impl_getPollHandle());
+}
+
+void HCPTransportReactor::loop()
+{
+    using Clock = std::chrono::steady_clock;
+
+    Ready ready[MAX_READY];
+
+    while(m_running)
+    {
+        int timeoutMs = 100;
+        uint32_t version;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            Clock::time_point now = Clock::now();
+
+            for(HCPTransport* transport : m_transports)
+            {
+                if(!transport->m_open)
+                {
+                    if(transport->m_retryAt <= now) reconnect(transport);
+                    if(!transport->m_open) timeoutMs = transport->getRetryTimeout(timeoutMs);
+                    continue;
+                }
+
+                if(transport->runOutputTask()) service(transport, 0);
+                timeoutMs = transport->getOutputTaskTimeout(timeoutMs);
+
+                // Stalled and throttled transports aren't in the wait, check
+                // back soon for room
+                if(transport->m_inputStalled || transport->m_outputThrottled) timeoutMs = std::min(timeoutMs, 1);
+            }
+
+            version = m_version.load(std::memory_order_relaxed);
+        }
+
+        bool woken = false;
+        int numReady = impl_wait(timeoutMs, ready, MAX_READY, &woken);
+        Clock::time_point dispatchStart = Clock::now();
+
+        // Cleared before the transports are checked, so one that asks for a wake
+        // after its check always gets one
+        if(woken) m_wakePending = false;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        // A transport left during the wait and may be gone. The wait is level
+        // triggered, so anything skipped here is reported again.
+        if(version != m_version.load(std::memory_order_relaxed)) continue;
+
+        for(int i = 0; i < numReady; i++)
+        {
+            // Readiness of a closed transport is from its hotplug watch
+            if(!ready[i].transport->m_open) reconnect(ready[i].transport);
+            else service(ready[i].transport, ready[i].events);
+
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - dispatchStart);
+            m_dispatchLatency.record((uint64_t) latency.count());
+        }
+
+        for(HCPTransport* transport : m_transports)
+        {
+            if(!transport->m_open) continue;
+
+            bool wakePending = woken && transport->m_ioWakePending.exchange(false);
+            if(m_pollAll || wakePending || transport->m_inputStalled || transport->m_outputThrottled) service(transport, 0);
+        }
+
+        m_cpuTime.store(impl_threadCpuTime(), std::memory_order_relaxed);
+    }
+}
+
+void HCPTransportReactor::service(HCPTransport* transport, uint32_t events)
+{
+    if(!transport->m_open || transport->impl_handleEvents(events)) return;
+    transport->fail();
+}
+
+void HCPTransportReactor::reconnect(HCPTransport* transport)
+{
+    if(!transport->retry()) return;
+
+    if(!attach(transport))
+    {
+        transport->impl_close();
+        transport->retryLater();
+        return;
+    }
+
+    transport->reconnected();
+}
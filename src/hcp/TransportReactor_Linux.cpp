@@ -0,0 +1,101 @@
+#ifdef __linux__
+#include "hcp/TransportReactor.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <time.h>
+#include <algorithm>
+
+struct ImplReactorLinux
+{
+    int epoll;
+    int wake; // eventfd, registered with null data
+};
+
+#define getImpl() (*((ImplReactorLinux*) m_impl))
+
+void IMPL_FUNC HCPTransportReactor::impl_init()
+{
+    m_impl = new ImplReactorLinux();
+    ImplReactorLinux& impl = getImpl();
+
+    impl.epoll = epoll_create1(EPOLL_CLOEXEC);
+    impl.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event wakeEvent = {};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = nullptr;
+
+    if(impl.epoll < 0 || impl.wake < 0 || epoll_ctl(impl.epoll, EPOLL_CTL_ADD, impl.wake, &wakeEvent) < 0)
+        s_logger.errorf("Failed to create reactor epoll (%s)", strerror(errno));
+}
+
+void IMPL_FUNC HCPTransportReactor::impl_destroy()
+{
+    if(!m_impl) return;
+
+    ImplReactorLinux& impl = getImpl();
+    if(0 <= impl.epoll) ::close(impl.epoll);
+    if(0 <= impl.wake) ::close(impl.wake);
+
+    delete (ImplReactorLinux*) m_impl;
+}
+
+intptr_t IMPL_FUNC HCPTransportReactor::impl_getPollHandle() const
+{
+    return ((ImplReactorLinux*) m_impl)->epoll;
+}
+
+int IMPL_FUNC HCPTransportReactor::impl_wait(int timeoutMs, Ready* ready, int maxReady, bool* woken)
+{
+    ImplReactorLinux& impl = getImpl();
+
+    epoll_event events[MAX_READY + 1];
+    int numEvents = epoll_wait(impl.epoll, events, std::min(maxReady, MAX_READY) + 1, timeoutMs);
+
+    if(numEvents < 0)
+    {
+        if(errno != EINTR) s_logger.errorf("Failed to poll transports (%s)", strerror(errno));
+        return 0;
+    }
+
+    int numReady = 0;
+    for(int i = 0; i < numEvents; i++)
+    {
+        if(!events[i].data.ptr)
+        {
+            uint64_t count;
+            ::read(impl.wake, &count, sizeof(count));
+            *woken = true;
+        }
+        else if(numReady < maxReady)
+        {
+            ready[numReady++] = { (HCPTransport*) events[i].data.ptr, events[i].events };
+        }
+    }
+
+    return numReady;
+}
+
+void IMPL_FUNC HCPTransportReactor::impl_wake()
+{
+    ImplReactorLinux& impl = getImpl();
+
+    if(impl.wake < 0) return;
+
+    uint64_t one = 1;
+    ::write(impl.wake, &one, sizeof(one));
+}
+
+int64_t IMPL_FUNC HCPTransportReactor::impl_threadCpuTime() const
+{
+    timespec time;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) return 0;
+
+    return (int64_t) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+#endif // Linux
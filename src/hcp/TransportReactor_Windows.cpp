@@ -0,0 +1,47 @@
+#ifdef _WIN32
+#include "hcp/TransportReactor.hpp"
+
+#include <Windows.h>
+
+// Transports aren't waited on for readiness here, so the reactor services
+// every one of them each round and naps for a millisecond in between, the
+// same as a threaded transport does on its own
+
+void IMPL_FUNC HCPTransportReactor::impl_init()
+{
+    m_pollAll = true;
+}
+
+void IMPL_FUNC HCPTransportReactor::impl_destroy()
+{
+}
+
+intptr_t IMPL_FUNC HCPTransportReactor::impl_getPollHandle() const
+{
+    return 0;
+}
+
+int IMPL_FUNC HCPTransportReactor::impl_wait(int timeoutMs, Ready* ready, int maxReady, bool* woken)
+{
+    if(timeoutMs != 0) Sleep(1);
+
+    *woken = true;
+    return 0;
+}
+
+void IMPL_FUNC HCPTransportReactor::impl_wake()
+{
+}
+
+int64_t IMPL_FUNC HCPTransportReactor::impl_threadCpuTime() const
+{
+    FILETIME creation, exit, kernel, user;
+    if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+
+    // 100 ns units
+    uint64_t kernelTime = ((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t userTime = ((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (int64_t) ((kernelTime + userTime) / 10);
+}
+
+#endif // Windows
@@ -0,0 +1,223 @@
+#ifdef __linux__
+#include "hcp/Transport.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+struct ImplTransportLinux
+{
+    int handle; // owned by the subclass
+    int epoll;
+    int wake; // eventfd used to interrupt the I/O thread's wait, lives as long as the transport
+    bool sharedEpoll; // epoll belongs to a reactor
+    uint32_t interest; // events currently registered for the handle
+};
+
+#define getImpl() (*((ImplTransportLinux*) m_ioImpl))
+
+// Epoll data for the handle is the transport, the wake eventfd uses null
+static bool i_setInterest(ImplTransportLinux& impl, HCPTransport* owner, uint32_t interest)
+{
+    if(impl.interest == interest) return true;
+
+    // Not attached to a reactor yet, it registers the latest interest
+    if(impl.epoll < 0)
+    {
+        impl.interest = interest;
+        return true;
+    }
+
+    epoll_event event = {};
+    event.events = interest;
+    event.data.ptr = owner;
+    if(epoll_ctl(impl.epoll, EPOLL_CTL_MOD, impl.handle, &event) < 0) return false;
+
+    impl.interest = interest;
+    return true;
+}
+
+void IMPL_FUNC HCPTransport::impl_initIO()
+{
+    m_ioImpl = new ImplTransportLinux();
+    ImplTransportLinux& impl = getImpl();
+
+    impl.handle = -1;
+    impl.epoll = -1;
+    impl.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    impl.sharedEpoll = false;
+    impl.interest = 0;
+}
+
+void IMPL_FUNC HCPTransport::impl_destroyIO()
+{
+    if(!m_ioImpl) return;
+
+    ImplTransportLinux& impl = getImpl();
+    if(0 <= impl.wake) ::close(impl.wake);
+
+    delete (ImplTransportLinux*) m_ioImpl;
+}
+
+bool IMPL_FUNC HCPTransport::impl_watch(intptr_t handle)
+{
+    ImplTransportLinux& impl = getImpl();
+
+    impl.handle = (int) handle;
+    impl.interest = EPOLLIN | EPOLLRDHUP;
+
+    // The reactor registers the handle with its own epoll, see impl_attach()
+    if(m_reactor) return true;
+
+    impl.epoll = epoll_create1(EPOLL_CLOEXEC);
+    impl.sharedEpoll = false;
+
+    epoll_event event = {};
+    event.events = impl.interest;
+    event.data.ptr = this;
+
+    epoll_event wakeEvent = {};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = nullptr;
+
+    if(impl.epoll < 0 || impl.wake < 0
+    || epoll_ctl(impl.epoll, EPOLL_CTL_ADD, impl.handle, &event) < 0
+    || epoll_ctl(impl.epoll, EPOLL_CTL_ADD, impl.wake, &wakeEvent) < 0)
+    {
+        s_logger.errorf("Failed to watch %s (%s)", m_address, strerror(errno));
+        impl_unwatch();
+        return false;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPTransport::impl_unwatch()
+{
+    ImplTransportLinux& impl = getImpl();
+
+    if(0 <= impl.epoll)
+    {
+        if(!impl.sharedEpoll) ::close(impl.epoll);
+        else if(0 <= impl.handle) epoll_ctl(impl.epoll, EPOLL_CTL_DEL, impl.handle, nullptr);
+    }
+    impl.epoll = impl.handle = -1;
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchInput(bool watch)
+{
+    ImplTransportLinux& impl = getImpl();
+    return i_setInterest(impl, this, watch ? impl.interest | EPOLLIN : impl.interest & ~EPOLLIN);
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchOutput(bool watch)
+{
+    ImplTransportLinux& impl = getImpl();
+    return i_setInterest(impl, this, watch ? impl.interest | EPOLLOUT : impl.interest & ~EPOLLOUT);
+}
+
+bool IMPL_FUNC HCPTransport::impl_attach(intptr_t pollHandle)
+{
+    ImplTransportLinux& impl = getImpl();
+
+    impl.epoll = (int) pollHandle;
+    impl.sharedEpoll = true;
+
+    epoll_event event = {};
+    event.events = impl.interest;
+    event.data.ptr = this;
+
+    if(epoll_ctl(impl.epoll, EPOLL_CTL_ADD, impl.handle, &event) < 0)
+    {
+        s_logger.errorf("Failed to watch %s (%s)", m_address, strerror(errno));
+        impl.epoll = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool IMPL_FUNC HCPTransport::impl_service(int timeoutMs)
+{
+    ImplTransportLinux& impl = getImpl();
+
+    // While the input ring is full the device is left unread, so poll back
+    // soon to see if the consumer has made room. Same for output held back
+    // until the device's queue drains.
+    if(!resumeInput()) return false;
+    if((m_inputStalled || m_outputThrottled) && timeoutMs != 0) timeoutMs = 1;
+
+    epoll_event events[2];
+    int numEvents = epoll_wait(impl.epoll, events, 2, timeoutMs);
+
+    if(numEvents < 0)
+    {
+        if(errno == EINTR) return true;
+
+        s_logger.errorf("Failed to poll %s (%s)", m_address, strerror(errno));
+        return false;
+    }
+
+    uint32_t flags = 0;
+    for(int i = 0; i < numEvents; i++)
+    {
+        if(!events[i].data.ptr)
+        {
+            uint64_t count;
+            ::read(impl.wake, &count, sizeof(count));
+            m_ioWakePending = false;
+        }
+        else flags = events[i].events;
+    }
+
+    return impl_handleEvents(flags);
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchHotplug(intptr_t pollHandle)
+{
+    int handle = (int) m_hotplug.getPollHandle();
+    if(handle < 0) return true;
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = this;
+
+    // Leaves the epoll by itself when the watch is closed
+    if(epoll_ctl((int) pollHandle, EPOLL_CTL_ADD, handle, &event) < 0)
+    {
+        s_logger.errorf("Failed to watch for %s (%s)", m_address, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void IMPL_FUNC HCPTransport::impl_waitRetry(int timeoutMs)
+{
+    ImplTransportLinux& impl = getImpl();
+
+    pollfd fds[2] = { { impl.wake, POLLIN, 0 }, { (int) m_hotplug.getPollHandle(), POLLIN, 0 } };
+    if(::poll(fds, 2, timeoutMs) <= 0) return;
+
+    if(fds[0].revents & POLLIN)
+    {
+        uint64_t count;
+        ::read(impl.wake, &count, sizeof(count));
+        m_ioWakePending = false;
+    }
+}
+
+void IMPL_FUNC HCPTransport::impl_wake()
+{
+    ImplTransportLinux& impl = getImpl();
+
+    if(impl.wake < 0) return;
+
+    uint64_t one = 1;
+    ::write(impl.wake, &one, sizeof(one));
+}
+
+#endif // Linux
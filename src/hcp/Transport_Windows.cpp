@@ -0,0 +1,75 @@
+#ifdef _WIN32
+#include "hcp/Transport.hpp"
+
+#include <Windows.h>
+
+// Neither synchronous comm handles nor sockets polled without an event object
+// can be waited on for readiness here. The I/O side services the device and
+// naps for a millisecond when there was nothing to do, and the reactor
+// services every transport each round.
+
+void IMPL_FUNC HCPTransport::impl_initIO()
+{
+}
+
+void IMPL_FUNC HCPTransport::impl_destroyIO()
+{
+}
+
+bool IMPL_FUNC HCPTransport::impl_watch(intptr_t handle)
+{
+    return true;
+}
+
+void IMPL_FUNC HCPTransport::impl_unwatch()
+{
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchInput(bool watch)
+{
+    return true;
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchOutput(bool watch)
+{
+    return true;
+}
+
+bool IMPL_FUNC HCPTransport::impl_attach(intptr_t pollHandle)
+{
+    return true;
+}
+
+bool IMPL_FUNC HCPTransport::impl_service(int timeoutMs)
+{
+    uint64_t received = m_bytesReceived.load(std::memory_order_relaxed);
+    if(!impl_handleEvents(0)) return false;
+    bool idle = m_bytesReceived.load(std::memory_order_relaxed) == received && (!hasOutput() || m_outputThrottled);
+
+    if(idle && timeoutMs != 0)
+    {
+        m_ioWakePending = false;
+        Sleep(1);
+    }
+
+    return true;
+}
+
+bool IMPL_FUNC HCPTransport::impl_watchHotplug(intptr_t pollHandle)
+{
+    return true;
+}
+
+void IMPL_FUNC HCPTransport::impl_waitRetry(int timeoutMs)
+{
+    // Nothing wakes a sleeping I/O thread, keep close() from waiting long
+    m_ioWakePending = false;
+    Sleep((DWORD) (timeoutMs < 10 ? timeoutMs : 10));
+}
+
+void IMPL_FUNC HCPTransport::impl_wake()
+{
+    // The I/O thread never blocks for more than a millisecond, see impl_service()
+}
+
+#endif // Windows
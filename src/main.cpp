@@ -2,7 +2,7 @@
 
 int main(int argc, char** argv)
 {
-    HCPApplication app("Hydroponics Control Panel");
+    HCPApplication app("Hydroponics Control Panel", argc, argv);
     app.setup();
 
     while(!app.shouldClose())
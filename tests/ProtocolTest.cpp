@@ -0,0 +1,217 @@
+// Frame decoder tests, run by ctest
+//
+// Feeds hand built frames through HCPFrameDecoder and checks what comes out,
+// including frames a well behaved peer would never send, and what the
+// transport's output lanes make of frames queued out of order.
+
+#include "hcp/Protocol.hpp"
+#include "hcp/Transport.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define CHECK(condition) \
+    if(!(condition)) \
+    { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    }
+
+// Wraps a raw frame, type and sequence number included, in its CRC and COBS
+static size_t i_buildFrame(const uint8_t* raw, size_t rawLen, uint8_t* dst)
+{
+    uint8_t crced[HCPProtocol::MAX_FRAME_SIZE];
+    memcpy(crced, raw, rawLen);
+
+    uint16_t crc = HCPProtocol::crc16(raw, rawLen);
+    crced[rawLen] = (uint8_t) crc;
+    crced[rawLen + 1] = (uint8_t) (crc >> 8);
+
+    size_t len = HCPProtocol::cobsEncode(crced, rawLen + 2, dst);
+    dst[len++] = 0;
+    return len;
+}
+
+static bool i_testCommandRoundTrip()
+{
+    HCPMessage message(HCPMessage::COMMAND, 7);
+    message.command.opcode = HCPMessage::CMD_STOP;
+    message.command.len = sizeof(message.command.args);
+    for(size_t i = 0; i < sizeof(message.command.args); i++) message.command.args[i] = (uint8_t) (i + 1);
+
+    uint8_t frame[HCPProtocol::MAX_FRAME_SIZE];
+    size_t frameLen = HCPProtocol::encode(message, frame, sizeof(frame));
+    CHECK(frameLen);
+
+    HCPFrameDecoder decoder;
+    HCPMessage decoded;
+    CHECK(decoder.feed(frame, frameLen, &decoded) == frameLen);
+    CHECK(decoded.type == HCPMessage::COMMAND);
+    CHECK(decoded.seq == 7);
+    CHECK(decoded.command.len == sizeof(message.command.args));
+    CHECK(memcmp(decoded.command.args, message.command.args, sizeof(message.command.args)) == 0);
+    return true;
+}
+
+// Argument lengths past Command::args still fit a frame and the decode
+// buffer, so only the length check keeps them out of the message
+static bool i_testOversizedCommand()
+{
+    for(size_t argLen = sizeof(HCPMessage::Command::args) + 1; argLen <= HCPMessage::MAX_PAYLOAD; argLen++)
+    {
+        uint8_t raw[HCPProtocol::MAX_FRAME_SIZE] = {};
+        raw[0] = HCPMessage::COMMAND;
+        raw[3] = HCPMessage::CMD_STOP;
+        raw[4] = (uint8_t) argLen;
+        memset(raw + 5, 0xAB, argLen);
+
+        uint8_t frame[HCPProtocol::MAX_FRAME_SIZE + 8];
+        size_t frameLen = i_buildFrame(raw, 5 + argLen, frame);
+
+        HCPFrameDecoder decoder;
+        HCPMessage decoded;
+        decoder.feed(frame, frameLen, &decoded);
+        CHECK(decoded.type == HCPMessage::NONE);
+        CHECK(decoder.getFrameCount() == 0);
+        CHECK(decoder.getFramingErrors() == 1);
+        CHECK(decoder.getCRCErrors() == 0);
+    }
+
+    return true;
+}
+
+// Sends straight from the output lanes into a buffer, no device behind it
+class i_LoopbackTransport : public HCPTransport
+{
+public:
+    std::vector<uint8_t> sent;
+
+    i_LoopbackTransport() : HCPTransport("loopback") {}
+    ~i_LoopbackTransport() { close(); }
+
+    // Sends up to maxLen bytes the way a device with that much room would
+    void send(size_t maxLen)
+    {
+        while(maxLen)
+        {
+            HCPRingBuffer::Span spans[2];
+            if(!peekOutput(spans)) return;
+
+            size_t len = limitSpans(spans, maxLen);
+            for(const HCPRingBuffer::Span& span : spans) sent.insert(sent.end(), span.data, span.data + span.len);
+
+            consumeOutput(len);
+            maxLen -= len;
+        }
+    }
+protected:
+    bool impl_open() override { return true; }
+    void impl_close() override {}
+    bool impl_handleEvents(uint32_t) override { return true; }
+    bool impl_flush() override { return true; }
+};
+
+static HCPMessage i_stopCommand(uint16_t seq, uint8_t argLen)
+{
+    HCPMessage message(HCPMessage::COMMAND, seq);
+    message.command.opcode = HCPMessage::CMD_STOP;
+    message.command.len = argLen;
+    memset(message.command.args, 0x5A, argLen);
+    return message;
+}
+
+// Decodes everything sent, returns the sequence numbers of the good frames
+static std::vector<uint16_t> i_decodeSent(const std::vector<uint8_t>& sent, HCPFrameDecoder& decoder)
+{
+    std::vector<uint16_t> seqs;
+
+    for(size_t offset = 0; offset < sent.size();)
+    {
+        HCPMessage message;
+        offset += decoder.feed(sent.data() + offset, sent.size() - offset, &message);
+        if(message.type != HCPMessage::NONE) seqs.push_back(message.seq);
+    }
+
+    return seqs;
+}
+
+// A write the lane hasn't room for queues nothing, so the lane stays whole
+// frames and a control frame goes out as soon as the one on the wire ends
+static bool i_testTruncatedWrite()
+{
+    i_LoopbackTransport transport;
+
+    uint8_t frame[HCPProtocol::MAX_FRAME_SIZE];
+    size_t frameLen = HCPProtocol::encode(i_stopCommand(0, 200), frame, sizeof(frame));
+    CHECK(frameLen);
+
+    size_t queued = 0;
+    uint16_t seq = 0;
+    for(;;)
+    {
+        size_t len = HCPProtocol::encode(i_stopCommand(seq, 200), frame, sizeof(frame));
+        size_t written = transport.write(frame, len, HCPTransport::PRIORITY_BULK);
+        if(!written) break;
+
+        CHECK(written == len);
+        queued += written;
+        seq++;
+    }
+
+    CHECK(transport.getStats().lanes[HCPTransport::PRIORITY_BULK].queued == queued);
+
+    // Halfway through the first bulk frame
+    transport.send(frameLen / 2);
+    CHECK(HCPProtocol::send(transport, i_stopCommand(1000, 0), HCPTransport::PRIORITY_CONTROL));
+    transport.send(SIZE_MAX);
+
+    // And once the bulk lane has drained
+    CHECK(HCPProtocol::send(transport, i_stopCommand(1001, 0), HCPTransport::PRIORITY_CONTROL));
+    transport.send(SIZE_MAX);
+
+    HCPFrameDecoder decoder;
+    std::vector<uint16_t> seqs = i_decodeSent(transport.sent, decoder);
+    CHECK(seqs.size() == (size_t) seq + 2);
+    CHECK(seqs[0] == 0);
+    CHECK(seqs[1] == 1000);
+    CHECK(seqs.back() == 1001);
+    CHECK(decoder.getCRCErrors() == 0);
+    CHECK(decoder.getFramingErrors() == 0);
+    return true;
+}
+
+// Raw bytes with no delimiter leave the lane mid-frame once they are out.
+// The control frame still goes, behind a delimiter that ends the raw bytes.
+static bool i_testUndelimitedWrite()
+{
+    i_LoopbackTransport transport;
+
+    const uint8_t raw[8] = { 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55 };
+    CHECK(transport.write(raw, sizeof(raw), HCPTransport::PRIORITY_BULK) == sizeof(raw));
+    transport.send(sizeof(raw));
+    CHECK(transport.sent.size() == sizeof(raw));
+
+    CHECK(HCPProtocol::send(transport, i_stopCommand(1000, 4), HCPTransport::PRIORITY_CONTROL));
+    transport.send(SIZE_MAX);
+    CHECK(transport.sent.size() > sizeof(raw) + 1);
+    CHECK(transport.sent[sizeof(raw)] == 0);
+
+    HCPFrameDecoder decoder;
+    std::vector<uint16_t> seqs = i_decodeSent(transport.sent, decoder);
+    CHECK(seqs.size() == 1);
+    CHECK(seqs[0] == 1000);
+    return true;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= i_testCommandRoundTrip();
+    passed &= i_testOversizedCommand();
+    passed &= i_testTruncatedWrite();
+    passed &= i_testUndelimitedWrite();
+
+    printf("%s\n", passed ? "All protocol tests passed" : "Protocol tests failed");
+    return passed ? 0 : 1;
+}
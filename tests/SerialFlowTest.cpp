@@ -0,0 +1,158 @@
+// XON/XOFF flow control test on a pty, run by ctest
+//
+// The device end floods a reactor-serviced HCPSerial until its input ring
+// fills and the panel sends XOFF. The device then goes quiet, as a real one
+// would, and a slow consumer drains the ring. The panel has to send XON by
+// itself once the ring is half empty, with nothing arriving to wake it, or
+// once flow control is turned off from another thread.
+
+#include "hcp/Serial.hpp"
+#include "hcp/TransportReactor.hpp"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define CHECK(condition) \
+    if(!(condition)) \
+    { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    }
+
+using TestClock = std::chrono::steady_clock;
+
+static const uint8_t XON = 0x11;
+static const uint8_t XOFF = 0x13;
+
+static int i_openPty(std::string& slaveName)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return -1;
+
+    slaveName = ptsname(master);
+    return master;
+}
+
+// Returns the last flow control character the panel sent, 0 for none
+static uint8_t i_readControl(int master)
+{
+    uint8_t control[64];
+    uint8_t last = 0;
+    ssize_t len;
+
+    while(0 < (len = ::read(master, control, sizeof(control))))
+    {
+        for(ssize_t i = 0; i < len; i++)
+            if(control[i] == XON || control[i] == XOFF) last = control[i];
+    }
+
+    return last;
+}
+
+// Floods until the panel holds the device off
+static bool i_floodUntilHeld(int master)
+{
+    uint8_t chunk[4096];
+    memset(chunk, 'A', sizeof(chunk));
+
+    TestClock::time_point deadline = TestClock::now() + std::chrono::seconds(10);
+    uint8_t control = 0;
+    while(control != XOFF && TestClock::now() < deadline)
+    {
+        if(::write(master, chunk, sizeof(chunk)) < 0 && errno != EAGAIN) break;
+        control = i_readControl(master);
+        if(control != XOFF) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    CHECK(control == XOFF);
+
+    return true;
+}
+
+static bool i_testResumeAfterFullRing(int master, HCPSerial& serial)
+{
+    CHECK(i_floodUntilHeld(master));
+
+    // Drain slowly, a kilobyte every couple of milliseconds, and wait for XON
+    uint8_t buffer[1024];
+    uint8_t control = 0;
+    TestClock::time_point deadline = TestClock::now() + std::chrono::seconds(10);
+    while(control != XON && TestClock::now() < deadline)
+    {
+        serial.read(buffer, sizeof(buffer));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+        uint8_t latest = i_readControl(master);
+        if(latest) control = latest;
+    }
+    CHECK(control == XON);
+
+    // Let go, the device's next bytes come through
+    while(0 < serial.read(buffer, sizeof(buffer))) {}
+
+    CHECK(::write(master, "B", 1) == 1);
+    deadline = TestClock::now() + std::chrono::seconds(2);
+    bool received = false;
+    while(!received && TestClock::now() < deadline)
+    {
+        int len = serial.read(buffer, sizeof(buffer));
+        received = 0 < len && memchr(buffer, 'B', len);
+        if(!received) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(received);
+
+    return true;
+}
+
+// Turning flow control off lets a held device go, the I/O side sends the XON
+static bool i_testResumeOnFlowControlOff(int master, HCPSerial& serial)
+{
+    CHECK(i_floodUntilHeld(master));
+
+    serial.setFlowControl(HCPSerial::FLOWCONTROL_NONE);
+
+    TestClock::time_point deadline = TestClock::now() + std::chrono::seconds(2);
+    uint8_t control = 0;
+    while(control != XON && TestClock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        control = i_readControl(master);
+    }
+    CHECK(control == XON);
+
+    return true;
+}
+
+int main()
+{
+    std::string slaveName;
+    int master = i_openPty(slaveName);
+    if(master < 0)
+    {
+        fprintf(stderr, "Failed to open pty: %s\n", strerror(errno));
+        return 1;
+    }
+
+    bool passed;
+    {
+        HCPTransportReactor reactor;
+        HCPSerial serial(slaveName.c_str(), 115200);
+        serial.setFlowControl(HCPSerial::FLOWCONTROL_SOFTWARE);
+        serial.setReactor(&reactor);
+        serial.begin();
+
+        passed = serial.isOpen() && i_testResumeAfterFullRing(master, serial) && i_testResumeOnFlowControlOff(master, serial);
+        serial.close();
+    }
+
+    ::close(master);
+
+    printf("%s\n", passed ? "All serial flow control tests passed" : "Serial flow control tests failed");
+    return passed ? 0 : 1;
+}
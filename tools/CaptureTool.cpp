@@ -0,0 +1,274 @@
+// Capture file tool
+//
+// info summarises a capture made with --capture. dump prints its records, or
+// with --frames the messages decoded from each direction, optionally only
+// between two times in seconds from the start. bench replays it through a
+// threaded HCPReplayTransport as fast as it decodes, or at --speed times real
+// time, and times random seeks.
+//
+// Usage: hcp-capture info <file>
+//        hcp-capture dump <file> [--from=0] [--to=end] [--frames]
+//        hcp-capture bench <file> [--speed=0] [--seeks=10000]
+
+#include "hcp/Capture.hpp"
+#include "hcp/ReplayTransport.hpp"
+#include "hcp/Protocol.hpp"
+
+#include <stdlib.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <string>
+
+using ToolClock = std::chrono::steady_clock;
+
+static const char* i_getArg(int argc, char** argv, const char* name)
+{
+    size_t nameLen = strlen(name);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], name, nameLen) == 0 && (argv[i][nameLen] == '=' || argv[i][nameLen] == '\0'))
+            return argv[i][nameLen] ? argv[i] + nameLen + 1 : argv[i] + nameLen;
+    }
+
+    return nullptr;
+}
+
+static double i_seconds(int64_t nanoseconds)
+{
+    return nanoseconds / 1e9;
+}
+
+static const char* i_typeName(HCPMessage::Type type)
+{
+    switch(type)
+    {
+    case HCPMessage::SENSOR_SAMPLES: return "SENSOR_SAMPLES";
+    case HCPMessage::ROBOT_STATE: return "ROBOT_STATE";
+    case HCPMessage::ACK: return "ACK";
+    case HCPMessage::COMMAND: return "COMMAND";
+    case HCPMessage::CONSOLE: return "CONSOLE";
+    case HCPMessage::PING: return "PING";
+    case HCPMessage::PONG: return "PONG";
+    default: return "?";
+    }
+}
+
+static void i_printMessage(double time, const char* direction, const HCPMessage& message)
+{
+    printf("%12.6f  %s  %-14s  seq=%-5u", time, direction, i_typeName(message.type), message.seq);
+
+    switch(message.type)
+    {
+    case HCPMessage::SENSOR_SAMPLES:
+        printf("  t=%u ms, %u samples", message.sensors.timestamp, message.sensors.count);
+        break;
+    case HCPMessage::ROBOT_STATE:
+        printf("  x=%.3f y=%.3f swivel=%.3f claw=%.3f", message.robot.x, message.robot.y, message.robot.swivel, message.robot.claw);
+        break;
+    case HCPMessage::ACK:
+        printf("  seq=%u status=%u", message.ack.seq, message.ack.status);
+        break;
+    case HCPMessage::COMMAND:
+        printf("  opcode=%u, %u bytes", message.command.opcode, message.command.len);
+        break;
+    case HCPMessage::CONSOLE:
+        printf("  \"%.*s\"", message.console.len, message.console.text);
+        break;
+    default:
+        break;
+    }
+
+    printf("\n");
+}
+
+static int i_info(const char* path)
+{
+    HCPCaptureReader reader;
+    if(!reader.open(path)) return 1;
+
+    uint64_t records[2] = { 0, 0 };
+    uint64_t bytes[2] = { 0, 0 };
+
+    HCPCapture::Record record;
+    while(reader.next(record))
+    {
+        records[record.direction]++;
+        bytes[record.direction] += record.len;
+    }
+
+    time_t started = (time_t) (reader.getWallClockStart() / 1000000000);
+    char startedText[64];
+    strftime(startedText, sizeof(startedText), "%Y-%m-%d %H:%M:%S", localtime(&started));
+
+    printf("Started:  %s\n", startedText);
+    printf("Duration: %.3f s\n", i_seconds(reader.getEndTime() - reader.getStartTime()));
+    printf("Blocks:   %zu of %zu KiB\n", reader.getBlockCount(), HCPCapture::BLOCK_SIZE / 1024);
+    printf("Received: %llu bytes in %llu records\n", (unsigned long long) bytes[HCPCapture::RX], (unsigned long long) records[HCPCapture::RX]);
+    printf("Sent:     %llu bytes in %llu records\n", (unsigned long long) bytes[HCPCapture::TX], (unsigned long long) records[HCPCapture::TX]);
+
+    return 0;
+}
+
+static int i_dump(const char* path, double from, double to, bool frames)
+{
+    HCPCaptureReader reader;
+    if(!reader.open(path)) return 1;
+
+    int64_t start = reader.getStartTime();
+    int64_t end = to < 0.0 ? reader.getEndTime() : start + (int64_t) (to * 1e9);
+
+    reader.seek(start + (int64_t) (from * 1e9));
+
+    // A seek can land mid frame, the decoders drop the partial one
+    HCPFrameDecoder decoders[2];
+
+    HCPCapture::Record record;
+    while(reader.next(record) && record.timestamp <= end)
+    {
+        double time = i_seconds(record.timestamp - start);
+        const char* direction = record.direction == HCPCapture::RX ? "RX" : "TX";
+
+        if(!frames)
+        {
+            printf("%12.6f  %s  %5u bytes ", time, direction, record.len);
+            for(uint32_t i = 0; i < record.len && i < 16; i++) printf(" %02x", record.data[i]);
+            printf(record.len > 16 ? " ...\n" : "\n");
+            continue;
+        }
+
+        HCPFrameDecoder& decoder = decoders[record.direction];
+        for(size_t offset = 0; offset < record.len;)
+        {
+            HCPMessage message;
+            offset += decoder.feed(record.data + offset, record.len - offset, &message);
+            if(message.type != HCPMessage::NONE) i_printMessage(time, direction, message);
+        }
+    }
+
+    if(frames)
+    {
+        printf("\nRX: %u frames, %u CRC errors, %u framing errors\n",
+            decoders[HCPCapture::RX].getFrameCount(), decoders[HCPCapture::RX].getCRCErrors(), decoders[HCPCapture::RX].getFramingErrors());
+        printf("TX: %u frames, %u CRC errors, %u framing errors\n",
+            decoders[HCPCapture::TX].getFrameCount(), decoders[HCPCapture::TX].getCRCErrors(), decoders[HCPCapture::TX].getFramingErrors());
+    }
+
+    return 0;
+}
+
+static int i_bench(const char* path, double speed, int seeks)
+{
+    HCPCaptureReader reader;
+    if(!reader.open(path)) return 1;
+
+    int64_t start = reader.getStartTime();
+    int64_t duration = reader.getEndTime() - start;
+
+    uint64_t expected = 0;
+    HCPCapture::Record record;
+    while(reader.next(record))
+        if(record.direction == HCPCapture::RX) expected += record.len;
+
+    // Seeks, spread over the whole capture
+    if(0 < seeks)
+    {
+        std::mt19937_64 random(1);
+
+        ToolClock::time_point seekStart = ToolClock::now();
+        for(int i = 0; i < seeks; i++)
+        {
+            reader.seek(start + (int64_t) (random() % (uint64_t) (duration + 1)));
+            reader.next(record);
+        }
+        double seekTime = std::chrono::duration<double, std::micro>(ToolClock::now() - seekStart).count();
+
+        printf("%d seeks over %zu blocks: %.2f us each\n", seeks, reader.getBlockCount(), seekTime / seeks);
+    }
+
+    // Replay, the way the panel would see it
+    std::string address = std::string(HCPReplayTransport::PREFIX) + path;
+    HCPReplayTransport transport(address.c_str());
+    transport.setThreaded(true);
+    transport.begin();
+    if(!transport.isOpen()) return 1;
+
+    HCPCaptureReplay* replay = transport.getReplay();
+    replay->setSpeed(speed);
+
+    HCPFrameDecoder decoder;
+    uint64_t received = 0;
+
+    ToolClock::time_point replayStart = ToolClock::now();
+
+    while(received < expected)
+    {
+        HCPRingBuffer::Span spans[2];
+        size_t pending = transport.peek(spans);
+
+        if(!pending)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        for(int i = 0; i < 2; i++)
+        {
+            for(size_t offset = 0; offset < spans[i].len;)
+            {
+                HCPMessage message;
+                offset += decoder.feed(spans[i].data + offset, spans[i].len - offset, &message);
+            }
+        }
+
+        transport.consume(pending);
+        received += pending;
+    }
+
+    double elapsed = std::chrono::duration<double>(ToolClock::now() - replayStart).count();
+    transport.close();
+
+    printf("Replayed %.3f s of capture in %.3f s (%.1fx)\n", i_seconds(duration), elapsed, elapsed ? i_seconds(duration) / elapsed : 0.0);
+    printf("%llu bytes, %.1f MiB/s, %u frames, %u CRC errors, %u framing errors\n",
+        (unsigned long long) received, elapsed ? received / elapsed / (1024.0 * 1024.0) : 0.0,
+        decoder.getFrameCount(), decoder.getCRCErrors(), decoder.getFramingErrors());
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "Usage: %s info|dump|bench <file> [options]\n", argv[0]);
+        return 2;
+    }
+
+    const char* command = argv[1];
+    const char* path = argv[2];
+
+    if(strcmp(command, "info") == 0) return i_info(path);
+
+    if(strcmp(command, "dump") == 0)
+    {
+        const char* from = i_getArg(argc, argv, "--from");
+        const char* to = i_getArg(argc, argv, "--to");
+
+        return i_dump(path, from ? atof(from) : 0.0, to ? atof(to) : -1.0, i_getArg(argc, argv, "--frames") != nullptr);
+    }
+
+    if(strcmp(command, "bench") == 0)
+    {
+        const char* speed = i_getArg(argc, argv, "--speed");
+        const char* seeks = i_getArg(argc, argv, "--seeks");
+
+        return i_bench(path, speed ? atof(speed) : 0.0, seeks ? atoi(seeks) : 10000);
+    }
+
+    fprintf(stderr, "Unknown command: %s\n", command);
+    return 2;
+}
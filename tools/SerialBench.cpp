@@ -0,0 +1,1107 @@
+// Serial throughput benchmark
+//
+// Streams a paced byte pattern from the device side of a pty into HCPSerial
+// while the "UI" thread only services the port at a fixed frame rate. The
+// device never blocks: whatever the kernel can't take is counted as overrun,
+// which is what a real UART would drop. Polled and threaded mode are run back
+// to back for every baud rate and flow control setting. With --consume the UI
+// takes at most that many bytes a second, a deliberately slow consumer. The
+// device honours XON/XOFF and leaves 0x11 and 0x13 out of the pattern. A pty
+// has no modem lines, so RTS/CTS can't be benched here.
+//
+// Reactor mode instead attaches one HCPTransportReactor to the ports of a
+// running hcp-sim --ports=N --link=<prefix>, pings every port and reports the
+// round trip times, the reactor's dispatch latency and how much of a core it
+// used.
+//
+// Command mode runs a recipe of acked console commands against hcp-sim, best
+// started with --latency, through an HCPCommandQueue for each window size and
+// reports how long the whole recipe took.
+//
+// E-stop mode queues a backlog of bulk frames to a device that reads at the
+// given baud rate, then measures how long a stop frame takes to reach the
+// device, once on the control lane and once behind the backlog in the bulk
+// lane as it was with a single output FIFO. The device is the other end of a
+// Unix socket, since a pty doesn't report what it has buffered.
+//
+// Sweep mode measures the raw I/O path of a threaded transport, HCPSerial on a
+// pty and the socket transport on a Unix socket. The device end runs in a
+// forked process so each side's CPU time is its own. For every chunk size it
+// reports the sustained rate each way, the panel's read and write syscalls
+// (/proc/self/io) and how often its I/O thread blocked per MB. Then it echoes
+// timestamped probes for one-way and round trip latencies.
+//
+// Usage: hcp-serial-bench [--baud=921600,3000000] [--seconds=5] [--fps=10] [--stall-ms=0] [--flow=none,xonxoff] [--consume=0]
+//        hcp-serial-bench --reactor=<prefix> --ports=64 [--seconds=5] [--fps=60] [--ping-hz=50]
+//        hcp-serial-bench --commands=<address> [--steps=20] [--windows=1,4,20] [--runs=10]
+//        hcp-serial-bench --estop [--baud=115200] [--backlog=16384] [--runs=10]
+//        hcp-serial-bench --sweep [--peers=pty,unix] [--chunks=1,16,256,4096,65536] [--seconds=2] [--probe-hz=1000] [--baud=3000000]
+
+#include "hcp/Serial.hpp"
+#include "hcp/TransportReactor.hpp"
+#include "hcp/Protocol.hpp"
+#include "hcp/Histogram.hpp"
+#include "hcp/CommandQueue.hpp"
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <new>
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+    std::vector<uint32_t> baudRates = { 921600, 3000000 };
+    double seconds = 5.0;
+    double fps = 10.0;
+    int stallMs = 0; // one frame per second takes this much longer
+    std::vector<HCPSerial::FlowControl> flowControls = { HCPSerial::FLOWCONTROL_NONE };
+    double consumeRate = 0.0; // bytes per second the UI reads at most, 0 for no limit
+};
+
+struct BenchResult
+{
+    uint64_t offered = 0;
+    uint64_t overrun = 0;
+    uint64_t received = 0;
+    uint64_t gaps = 0;
+    double paused = 0.0; // seconds the device was held off
+    double elapsed = 0.0;
+};
+
+static const uint8_t XON = 0x11;
+static const uint8_t XOFF = 0x13;
+
+// Pattern bytes, skipping the flow control characters
+static uint8_t i_nextPattern(uint8_t value)
+{
+    value++;
+    if(value == XON || value == XOFF) value++;
+    return value;
+}
+
+static const char* i_getArg(int argc, char** argv, const char* name)
+{
+    size_t nameLen = strlen(name);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], name, nameLen) == 0 && argv[i][nameLen] == '=')
+            return argv[i] + nameLen + 1;
+    }
+
+    return nullptr;
+}
+
+static bool i_hasArg(int argc, char** argv, const char* name)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], name) == 0) return true;
+    }
+
+    return false;
+}
+
+static int i_openPty(std::string& slaveName)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return -1;
+
+    slaveName = ptsname(master);
+    return master;
+}
+
+// Writes the pattern at the line rate of the given baud (8N1, 10 bits a byte).
+// While held off by XOFF the device sends nothing and its schedule slips.
+static void i_deviceLoop(int master, uint32_t baudRate, std::atomic<bool>* running, BenchResult* result)
+{
+    const double bytesPerSecond = baudRate / 10.0;
+    uint8_t chunk[4096];
+    uint8_t pattern = 0;
+    bool held = false;
+    double sent = 0.0; // line time spent sending, in bytes
+
+    BenchClock::time_point last = BenchClock::now();
+
+    while(*running)
+    {
+        uint8_t control[64];
+        ssize_t controlLen;
+        while(0 < (controlLen = ::read(master, control, sizeof(control))))
+        {
+            for(ssize_t i = 0; i < controlLen; i++)
+            {
+                if(control[i] == XOFF) held = true;
+                else if(control[i] == XON) held = false;
+            }
+        }
+
+        BenchClock::time_point now = BenchClock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        if(held)
+        {
+            result->paused += elapsed;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+
+        sent += elapsed * bytesPerSecond;
+        uint64_t due = (uint64_t) sent;
+        sent -= due;
+
+        while(due)
+        {
+            size_t len = due < sizeof(chunk) ? (size_t) due : sizeof(chunk);
+            for(size_t i = 0; i < len; i++)
+            {
+                chunk[i] = pattern;
+                pattern = i_nextPattern(pattern);
+            }
+
+            ssize_t written = ::write(master, chunk, len);
+            if(written < 0) written = 0;
+
+            // Bytes the receiver had no room for are lost, like on a real UART.
+            // The pattern still advances so the reader can spot the gap.
+            result->offered += len;
+            result->overrun += len - written;
+            due -= len;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+static BenchResult i_run(const BenchOptions& options, uint32_t baudRate, HCPSerial::FlowControl flowControl, bool threaded)
+{
+    BenchResult result;
+
+    std::string slaveName;
+    int master = i_openPty(slaveName);
+    if(master < 0)
+    {
+        fprintf(stderr, "Failed to open pty: %s\n", strerror(errno));
+        return result;
+    }
+
+    HCPSerial serial(slaveName.c_str(), baudRate);
+    serial.setFlowControl(flowControl);
+    serial.setThreaded(threaded);
+    serial.begin();
+
+    if(!serial.isOpen())
+    {
+        ::close(master);
+        return result;
+    }
+
+    std::atomic<bool> running(true);
+    BenchResult deviceResult;
+    std::thread device(i_deviceLoop, master, baudRate, &running, &deviceResult);
+
+    const auto frameTime = std::chrono::duration<double>(1.0 / options.fps);
+    BenchClock::time_point start = BenchClock::now();
+    BenchClock::time_point nextFrame = start;
+    BenchClock::time_point nextStall = start + std::chrono::seconds(1);
+
+    uint8_t expected = 0;
+    bool synced = false;
+    uint8_t buffer[4096];
+    double allowance = 0.0; // bytes the slow consumer may still read
+
+    while(std::chrono::duration<double>(BenchClock::now() - start).count() < options.seconds)
+    {
+        nextFrame += std::chrono::duration_cast<BenchClock::duration>(frameTime);
+        std::this_thread::sleep_until(nextFrame);
+
+        if(options.stallMs && nextStall <= BenchClock::now())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.stallMs));
+            nextStall += std::chrono::seconds(1);
+            nextFrame = BenchClock::now();
+        }
+
+        // What HCPMainMenu::handleInput() does once per frame
+        serial.poll();
+
+        size_t budget = sizeof(buffer);
+        if(options.consumeRate)
+        {
+            allowance += options.consumeRate * frameTime.count();
+            budget = (size_t) allowance;
+        }
+
+        int bytesRead;
+        while(budget && 0 < (bytesRead = serial.read(buffer, std::min(budget, sizeof(buffer)))))
+        {
+            for(int i = 0; i < bytesRead; i++)
+            {
+                if(synced && buffer[i] != expected) result.gaps++;
+                expected = i_nextPattern(buffer[i]);
+                synced = true;
+            }
+
+            result.received += bytesRead;
+            if(options.consumeRate)
+            {
+                allowance -= bytesRead;
+                budget -= bytesRead;
+            }
+        }
+    }
+
+    result.elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+    running = false;
+    device.join();
+    serial.close();
+    ::close(master);
+
+    result.offered = deviceResult.offered;
+    result.overrun = deviceResult.overrun;
+    result.paused = deviceResult.paused;
+
+    return result;
+}
+
+static uint64_t i_toMicros(BenchClock::time_point time)
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+struct ReactorPort
+{
+    std::unique_ptr<HCPSerial> serial;
+    HCPFrameDecoder decoder;
+    uint16_t seq = 0;
+    uint64_t frames = 0;
+};
+
+// Services every port of the emulator from one reactor while the "UI" thread
+// drains them at a fixed frame rate, like HCPMainMenu does for the attached rack
+static int i_runReactor(const char* prefix, int numPorts, double seconds, double fps, double pingHz)
+{
+    HCPTransportReactor reactor;
+    std::vector<ReactorPort> ports(numPorts);
+
+    for(int i = 0; i < numPorts; i++)
+    {
+        std::string path = std::string(prefix) + std::to_string(i);
+        ports[i].serial.reset(new HCPSerial(path.c_str(), 3000000));
+        ports[i].serial->setReactor(&reactor);
+        ports[i].serial->begin();
+    }
+
+    HCPHistogram roundTrip;
+    uint64_t pings = 0;
+
+    const auto frameTime = std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(1.0 / fps));
+    const auto pingTime = std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(1.0 / pingHz));
+
+    BenchClock::time_point start = BenchClock::now();
+    BenchClock::time_point nextFrame = start;
+    BenchClock::time_point nextPing = start;
+    std::chrono::microseconds startCpu = reactor.getCpuTime();
+
+    while(BenchClock::now() - start < std::chrono::duration<double>(seconds))
+    {
+        nextFrame += frameTime;
+        std::this_thread::sleep_until(nextFrame);
+
+        BenchClock::time_point now = BenchClock::now();
+        bool ping = nextPing <= now;
+        if(ping) nextPing = std::max(nextPing + pingTime, now);
+
+        for(ReactorPort& port : ports)
+        {
+            HCPSerial& serial = *port.serial;
+
+            if(ping && serial.isOpen())
+            {
+                HCPMessage message(HCPMessage::PING, port.seq++);
+                message.ping.timestamp = i_toMicros(BenchClock::now());
+                if(HCPProtocol::send(serial, message)) pings++;
+            }
+
+            HCPRingBuffer::Span spans[2];
+            size_t received = serial.peek(spans);
+            size_t offset = 0;
+
+            for(const HCPRingBuffer::Span& span : spans)
+            {
+                for(size_t used = 0; used < span.len;)
+                {
+                    HCPMessage message;
+                    used += port.decoder.feed(span.data + used, span.len - used, &message);
+
+                    if(message.type == HCPMessage::PONG)
+                        roundTrip.record(i_toMicros(serial.getReceiveTime(offset + used - 1)) - message.ping.timestamp);
+                    if(message.type != HCPMessage::NONE)
+                        port.frames++;
+                }
+
+                offset += span.len;
+            }
+
+            serial.consume(received);
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+    double cpu = (reactor.getCpuTime() - startCpu).count() / 1e6;
+
+    uint64_t frames = 0, crcErrors = 0, open = 0;
+    for(ReactorPort& port : ports)
+    {
+        frames += port.frames;
+        crcErrors += port.decoder.getCRCErrors() + port.decoder.getFramingErrors();
+        open += port.serial->isOpen();
+        port.serial->close();
+    }
+
+    printf("%d ports (%llu open), %.1f s, UI at %.1f fps, %.1f pings/s per port\n", numPorts, (unsigned long long) open, elapsed, fps, pingHz);
+    printf("%llu frames received, %llu pings sent, %llu CRC/framing errors\n",
+        (unsigned long long) frames, (unsigned long long) pings, (unsigned long long) crcErrors);
+    printf("reactor thread CPU: %.3f s (%.1f%% of one core)\n\n", cpu, 100.0 * cpu / elapsed);
+
+    reactor.getDispatchLatency().print(stdout, "Reactor dispatch latency", 1.0, "us");
+    printf("\n");
+    roundTrip.print(stdout, "Ping round trip", 1.0, "us");
+
+    return open == (uint64_t) numPorts ? 0 : 1;
+}
+
+// Submits the whole recipe at once and drains the transport until the queue
+// has reported every step
+static int i_runCommands(const char* address, int steps, const std::vector<int>& windows, int runs)
+{
+    std::unique_ptr<HCPTransport> transport(HCPTransport::create(address));
+    transport->setThreaded(true);
+    transport->begin();
+    if(!transport->isOpen()) return 1;
+
+    HCPFrameDecoder decoder;
+    uint16_t seq = 0;
+
+    auto drain = [&](HCPCommandQueue& queue)
+    {
+        transport->poll();
+
+        HCPRingBuffer::Span spans[2];
+        size_t received = transport->peek(spans);
+        size_t offset = 0;
+
+        for(const HCPRingBuffer::Span& span : spans)
+        {
+            for(size_t used = 0; used < span.len;)
+            {
+                HCPMessage message;
+                used += decoder.feed(span.data + used, span.len - used, &message);
+                if(message.type == HCPMessage::ACK) queue.handleAck(message, transport->getReceiveTime(offset + used - 1));
+            }
+
+            offset += span.len;
+        }
+
+        transport->consume(received);
+        queue.service(*transport);
+    };
+
+    printf("%d step recipe on %s, %d runs per window\n\n", steps, address, runs);
+    printf("%8s  %10s  %10s  %10s  %10s  %8s  %8s\n", "window", "min ms", "median ms", "max ms", "ms/step", "retries", "failed");
+
+    int status = 0;
+    for(int window : windows)
+    {
+        HCPCommandQueue queue((size_t) window);
+        std::vector<double> times;
+        uint64_t retries = 0, failed = 0;
+
+        for(int run = 0; run < runs; run++)
+        {
+            int completed = 0;
+            BenchClock::time_point start = BenchClock::now();
+
+            for(int step = 0; step < steps; step++)
+            {
+                char command[32];
+                snprintf(command, sizeof(command), "dose %d %.1f", step % 4, 0.5 * (step + 1));
+
+                queue.submit(HCPProtocol::consoleMessage(command, strlen(command), seq++), [&](const HCPCommandQueue::Completion& completion)
+                {
+                    completed++;
+                    retries += completion.attempts - 1;
+                    failed += completion.result != HCPCommandQueue::RESULT_OK;
+                });
+            }
+
+            while(completed < steps)
+            {
+                drain(queue);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            times.push_back(std::chrono::duration<double, std::milli>(BenchClock::now() - start).count());
+        }
+
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+
+        printf("%8d  %10.2f  %10.2f  %10.2f  %10.2f  %8llu  %8llu\n", window, times.front(), median, times.back(),
+            median / steps, (unsigned long long) retries, (unsigned long long) failed);
+
+        if(failed) status = 1;
+    }
+
+    transport->close();
+    return status;
+}
+
+// The device end, reads no faster than the wire would and notes when the stop
+// frame arrives
+static void i_estopDeviceLoop(int handle, uint32_t baudRate, std::atomic<bool>* running,
+    std::atomic<uint64_t>* bytesRead, std::atomic<int64_t>* stopReceived)
+{
+    HCPFrameDecoder decoder;
+    BenchClock::time_point last = BenchClock::now();
+    double budget = 0.0;
+
+    while(*running)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+        BenchClock::time_point now = BenchClock::now();
+        budget = std::min(budget + std::chrono::duration<double>(now - last).count() * baudRate / 10.0, 64.0);
+        last = now;
+
+        uint8_t buffer[64];
+        ssize_t len = ::recv(handle, buffer, (size_t) budget, MSG_DONTWAIT);
+        if(len <= 0) continue;
+
+        budget -= len;
+        *bytesRead += len;
+
+        for(size_t offset = 0; offset < (size_t) len;)
+        {
+            HCPMessage message;
+            offset += decoder.feed(buffer + offset, len - offset, &message);
+            if(message.type == HCPMessage::COMMAND && message.command.opcode == HCPMessage::CMD_STOP)
+                *stopReceived = BenchClock::now().time_since_epoch().count();
+        }
+    }
+}
+
+static int i_runEStop(uint32_t baudRate, size_t backlog, int runs)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/hcp-bench-estop-%d.sock", (int) getpid());
+    unlink(path);
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0 || ::bind(listener, (sockaddr*) &address, sizeof(address)) < 0 || ::listen(listener, 1) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+
+    std::string transportAddress = std::string("unix:") + path;
+    std::unique_ptr<HCPTransport> transport(HCPTransport::create(transportAddress.c_str()));
+    transport->setThreaded(true);
+    transport->begin();
+
+    int device = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    unlink(path);
+    if(device < 0 || !transport->isOpen()) return 1;
+
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> bytesRead(0);
+    std::atomic<int64_t> stopReceived(0);
+    std::thread deviceThread(i_estopDeviceLoop, device, baudRate, &running, &bytesRead, &stopReceived);
+
+    double frameMs = 1000.0 * HCPProtocol::MAX_FRAME_SIZE * 10.0 / baudRate;
+    printf("%zu byte bulk backlog at %u baud, a full frame is %.2f ms on the wire, %d runs\n\n", backlog, baudRate, frameMs, runs);
+    printf("%-12s  %10s  %10s  %10s\n", "stop lane", "min ms", "median ms", "max ms");
+
+    uint16_t seq = 0;
+    std::string filler(200, '#');
+
+    for(HCPTransport::Priority priority : { HCPTransport::PRIORITY_CONTROL, HCPTransport::PRIORITY_BULK })
+    {
+        std::vector<double> times;
+
+        for(int run = 0; run < runs; run++)
+        {
+            for(size_t queued = 0; queued < backlog; queued += filler.size())
+                HCPProtocol::send(*transport, HCPProtocol::consoleMessage(filler.c_str(), filler.size(), seq++), HCPTransport::PRIORITY_BULK);
+
+            // Let the backlog start flowing, so the stop lands mid frame
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            HCPMessage stop(HCPMessage::COMMAND, seq++);
+            stop.command.opcode = HCPMessage::CMD_STOP;
+            stop.command.len = 0;
+
+            stopReceived = 0;
+            BenchClock::time_point sent = BenchClock::now();
+            HCPProtocol::send(*transport, stop, priority);
+
+            while(!stopReceived) std::this_thread::sleep_for(std::chrono::microseconds(100));
+            times.push_back(std::chrono::duration<double, std::milli>(BenchClock::duration(stopReceived.load()) - sent.time_since_epoch()).count());
+
+            // Start the next run with nothing queued anywhere
+            while(bytesRead < transport->getStats().bytesSent || transport->getStats().lanes[HCPTransport::PRIORITY_BULK].queued)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::sort(times.begin(), times.end());
+        printf("%-12s  %10.2f  %10.2f  %10.2f\n", priority == HCPTransport::PRIORITY_CONTROL ? "control" : "bulk (FIFO)",
+            times.front(), times[times.size() / 2], times.back());
+    }
+
+    running = false;
+    deviceThread.join();
+    transport->close();
+    ::close(device);
+
+    return 0;
+}
+
+enum SweepTest
+{
+    SWEEP_RECEIVE, // device to panel
+    SWEEP_SEND,    // panel to device
+    SWEEP_LATENCY  // probes echoed by the device
+};
+
+// Lives in memory shared with the forked device process, latencies are in
+// nanoseconds
+struct SweepShared
+{
+    std::atomic<bool> started;
+    std::atomic<bool> stop;
+    std::atomic<uint64_t> bytes; // read by the device
+    double cpu;                  // the device's, in seconds
+    HCPHistogram toDevice;
+    HCPHistogram toPanel;
+    HCPHistogram roundTrip;
+};
+
+struct SweepUsage
+{
+    double cpu = 0.0;
+    uint64_t ioCalls = 0; // read and write family syscalls
+    uint64_t waits = 0;   // times the I/O thread blocked
+};
+
+// A probe is the panel's send time followed by the device's, both in
+// nanoseconds of the shared monotonic clock
+static const size_t PROBE_SIZE = 16;
+
+static uint64_t i_toNanos(BenchClock::time_point time)
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static double i_toSeconds(const timeval& time)
+{
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// The whole process minus the calling thread, which is the I/O thread plus
+// the bench's own consumer for the CPU time. The consumer makes no I/O calls.
+static SweepUsage i_getUsage()
+{
+    SweepUsage usage;
+
+    rusage process, thread;
+    getrusage(RUSAGE_SELF, &process);
+    getrusage(RUSAGE_THREAD, &thread);
+    usage.cpu = i_toSeconds(process.ru_utime) + i_toSeconds(process.ru_stime);
+    usage.waits = process.ru_nvcsw - thread.ru_nvcsw;
+
+    if(FILE* io = fopen("/proc/self/io", "r"))
+    {
+        char line[64];
+        unsigned long long value;
+        while(fgets(line, sizeof(line), io))
+        {
+            if(sscanf(line, "syscr: %llu", &value) == 1 || sscanf(line, "syscw: %llu", &value) == 1)
+                usage.ioCalls += value;
+        }
+        fclose(io);
+    }
+
+    return usage;
+}
+
+// Waits for the handle to be ready, bailing out every 10 ms to check for stop
+static bool i_waitHandle(int handle, short events, SweepShared* shared)
+{
+    pollfd fd = { handle, events, 0 };
+    while(!shared->stop)
+    {
+        if(0 < ::poll(&fd, 1, 10)) return true;
+    }
+
+    return false;
+}
+
+static void i_writeAll(int handle, const uint8_t* data, size_t len, SweepShared* shared)
+{
+    while(len)
+    {
+        ssize_t written = ::write(handle, data, len);
+        if(0 < written)
+        {
+            data += written;
+            len -= written;
+        }
+        else if(written < 0 && errno != EAGAIN) return;
+        else if(!i_waitHandle(handle, POLLOUT, shared)) return;
+    }
+}
+
+// The device process. Writes chunks as fast as the peer takes them, reads
+// everything or echoes probes.
+static void i_sweepDevice(int handle, SweepTest test, size_t chunk, SweepShared* shared)
+{
+    fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK);
+
+    std::vector<uint8_t> buffer(std::max(chunk, (size_t) 65536));
+    for(size_t i = 0; i < buffer.size(); i++) buffer[i] = (uint8_t) i;
+
+    uint8_t probe[PROBE_SIZE];
+    size_t probeLen = 0;
+
+    while(!shared->started) std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    while(!shared->stop)
+    {
+        if(test == SWEEP_RECEIVE)
+        {
+            i_writeAll(handle, buffer.data(), chunk, shared);
+            continue;
+        }
+
+        ssize_t len = ::read(handle, buffer.data(), buffer.size());
+        if(len == 0) break;
+        if(len < 0)
+        {
+            if(errno != EAGAIN) break;
+            i_waitHandle(handle, POLLIN, shared);
+            continue;
+        }
+
+        shared->bytes += len;
+        if(test != SWEEP_LATENCY) continue;
+
+        BenchClock::time_point now = BenchClock::now();
+        for(ssize_t i = 0; i < len; i++)
+        {
+            probe[probeLen++] = buffer[i];
+            if(probeLen < PROBE_SIZE) continue;
+            probeLen = 0;
+
+            uint64_t sent;
+            memcpy(&sent, probe, sizeof(sent));
+            shared->toDevice.record(i_toNanos(now) - sent);
+
+            uint64_t echoed = i_toNanos(BenchClock::now());
+            memcpy(probe + 8, &echoed, sizeof(echoed));
+            i_writeAll(handle, probe, PROBE_SIZE, shared);
+        }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    shared->cpu = i_toSeconds(usage.ru_utime) + i_toSeconds(usage.ru_stime);
+}
+
+struct SweepResult
+{
+    bool ok = false;
+    uint64_t bytes = 0;
+    double elapsed = 0.0;
+    SweepUsage panel;
+    double deviceCpu = 0.0;
+};
+
+// Forks the device before the transport starts any thread, then runs one test
+// from this side. The device end is the pty master or the accepted socket.
+static SweepResult i_runSweep(const char* peer, SweepTest test, size_t chunk, uint32_t baudRate, double seconds, double probeHz,
+    SweepShared* shared)
+{
+    SweepResult result;
+
+    std::string address;
+    char socketPath[64] = "";
+    int handle;
+
+    if(strcmp(peer, "unix") == 0)
+    {
+        snprintf(socketPath, sizeof(socketPath), "/tmp/hcp-bench-sweep-%d.sock", (int) getpid());
+        unlink(socketPath);
+
+        sockaddr_un socketAddress;
+        memset(&socketAddress, 0, sizeof(socketAddress));
+        socketAddress.sun_family = AF_UNIX;
+        strcpy(socketAddress.sun_path, socketPath);
+
+        handle = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(handle < 0 || ::bind(handle, (sockaddr*) &socketAddress, sizeof(socketAddress)) < 0 || ::listen(handle, 1) < 0)
+        {
+            perror("listen");
+            return result;
+        }
+
+        address = std::string("unix:") + socketPath;
+    }
+    else if((handle = i_openPty(address)) < 0)
+    {
+        fprintf(stderr, "Failed to open pty: %s\n", strerror(errno));
+        return result;
+    }
+
+    shared->started = false;
+    shared->stop = false;
+    shared->bytes = 0;
+    shared->cpu = 0.0;
+
+    pid_t device = fork();
+    if(device == 0)
+    {
+        // Writes after the panel closed fail instead of ending the process early
+        signal(SIGPIPE, SIG_IGN);
+
+        if(socketPath[0])
+        {
+            int listener = handle;
+            handle = ::accept(listener, nullptr, nullptr);
+            ::close(listener);
+        }
+
+        if(0 <= handle) i_sweepDevice(handle, test, chunk, shared);
+        _exit(0);
+    }
+
+    // The pty master stays open in the device, the listener is its to accept on
+    ::close(handle);
+
+    std::unique_ptr<HCPTransport> transport(HCPTransport::create(address.c_str()));
+    if(HCPSerial* serial = dynamic_cast<HCPSerial*>(transport.get())) serial->setBaudRate(baudRate);
+    transport->setThreaded(true);
+    transport->begin();
+
+    BenchClock::time_point deadline = BenchClock::now() + std::chrono::seconds(2);
+    while(!transport->isOpen() && BenchClock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if(transport->isOpen())
+    {
+        std::vector<uint8_t> data(chunk);
+        for(size_t i = 0; i < chunk; i++) data[i] = (uint8_t) i;
+
+        uint8_t probe[PROBE_SIZE];
+        size_t probeLen = 0;
+        const auto probeTime = std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(1.0 / probeHz));
+
+        SweepUsage startUsage = i_getUsage();
+        BenchClock::time_point start = BenchClock::now();
+        BenchClock::time_point end = start + std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(seconds));
+        BenchClock::time_point nextProbe = start;
+        size_t written = 0; // of the current chunk
+        shared->started = true;
+
+        while(BenchClock::now() < end)
+        {
+            bool idle = false;
+
+            if(test == SWEEP_SEND)
+            {
+                // Only what fits, write() would log the rest as dropped
+                HCPRingBuffer::Span spans[2];
+                size_t accepted = transport->reserveWrite(spans, chunk - written);
+                for(const HCPRingBuffer::Span& span : spans)
+                {
+                    memcpy(span.data, data.data() + written, span.len);
+                    written += span.len;
+                }
+                transport->commitWrite(accepted);
+
+                if(written == chunk) written = 0;
+                idle = accepted == 0;
+            }
+            else if(test == SWEEP_LATENCY && nextProbe <= BenchClock::now())
+            {
+                uint64_t sent = i_toNanos(BenchClock::now());
+                uint8_t out[PROBE_SIZE] = {};
+                memcpy(out, &sent, sizeof(sent));
+                transport->write(out, PROBE_SIZE);
+                nextProbe += probeTime;
+            }
+
+            HCPRingBuffer::Span spans[2];
+            size_t received = transport->peek(spans);
+            size_t offset = 0;
+
+            for(const HCPRingBuffer::Span& span : spans)
+            {
+                if(test == SWEEP_LATENCY)
+                {
+                    for(size_t i = 0; i < span.len; i++)
+                    {
+                        probe[probeLen++] = span.data[i];
+                        if(probeLen < PROBE_SIZE) continue;
+                        probeLen = 0;
+
+                        uint64_t sent, echoed;
+                        memcpy(&sent, probe, sizeof(sent));
+                        memcpy(&echoed, probe + 8, sizeof(echoed));
+
+                        uint64_t arrived = i_toNanos(transport->getReceiveTime(offset + i));
+                        shared->roundTrip.record(arrived - sent);
+                        shared->toPanel.record(arrived - echoed);
+                    }
+                }
+
+                offset += span.len;
+            }
+
+            transport->consume(received);
+            result.bytes += received;
+
+            if(test != SWEEP_SEND) idle = received == 0;
+            if(idle) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        result.elapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+        SweepUsage endUsage = i_getUsage();
+        result.panel.cpu = endUsage.cpu - startUsage.cpu;
+        result.panel.ioCalls = endUsage.ioCalls - startUsage.ioCalls;
+        result.panel.waits = endUsage.waits - startUsage.waits;
+        if(test == SWEEP_SEND) result.bytes = shared->bytes;
+        result.ok = true;
+    }
+
+    // Closed first, the transport would log the device going away as a lost link
+    transport->close();
+    shared->started = true;
+    shared->stop = true;
+
+    int status;
+    waitpid(device, &status, 0);
+    if(socketPath[0]) unlink(socketPath);
+
+    result.deviceCpu = shared->cpu;
+    return result;
+}
+
+static void i_printSweepLatency(const char* peer, const char* name, const HCPHistogram& histogram)
+{
+    printf("%-6s  %-12s  %10llu  %10.1f  %10.1f  %10.1f  %10.1f\n", peer, name, (unsigned long long) histogram.getCount(),
+        histogram.getPercentile(50.0) / 1000.0, histogram.getPercentile(99.0) / 1000.0,
+        histogram.getPercentile(99.9) / 1000.0, histogram.getMax() / 1000.0);
+}
+
+static int i_runSweeps(const std::vector<std::string>& peers, const std::vector<size_t>& chunks, uint32_t baudRate,
+    double seconds, double probeHz)
+{
+    void* memory = mmap(nullptr, sizeof(SweepShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    SweepShared* shared = new(memory) SweepShared();
+    int status = 0;
+
+    printf("%.1f s per run, threaded transport, calls are the panel's read and write syscalls, waits the times its I/O thread blocked\n\n", seconds);
+    printf("%-6s  %-9s  %8s  %10s  %10s  %10s  %9s  %9s\n", "peer", "direction", "chunk", "MB/s", "calls/MB", "waits/MB", "panel CPU", "device CPU");
+
+    for(const std::string& peer : peers)
+    {
+        for(SweepTest test : { SWEEP_RECEIVE, SWEEP_SEND })
+        {
+            for(size_t chunk : chunks)
+            {
+                SweepResult result = i_runSweep(peer.c_str(), test, chunk, baudRate, seconds, probeHz, shared);
+                if(!result.ok || !result.bytes)
+                {
+                    printf("%-6s  %-9s  %8zu  failed\n", peer.c_str(), test == SWEEP_RECEIVE ? "receive" : "send", chunk);
+                    status = 1;
+                    continue;
+                }
+
+                double megabytes = result.bytes / 1e6;
+                printf("%-6s  %-9s  %8zu  %10.2f  %10.0f  %10.0f  %8.1f%%  %8.1f%%\n",
+                    peer.c_str(), test == SWEEP_RECEIVE ? "receive" : "send", chunk,
+                    megabytes / result.elapsed, result.panel.ioCalls / megabytes, result.panel.waits / megabytes,
+                    100.0 * result.panel.cpu / result.elapsed, 100.0 * result.deviceCpu / result.elapsed);
+            }
+        }
+    }
+
+    printf("\n%.0f probes of %zu bytes a second, echoed by the device, latencies in us\n\n", probeHz, PROBE_SIZE);
+    printf("%-6s  %-12s  %10s  %10s  %10s  %10s  %10s\n", "peer", "path", "count", "p50", "p99", "p99.9", "max");
+
+    for(const std::string& peer : peers)
+    {
+        shared->toDevice.reset();
+        shared->toPanel.reset();
+        shared->roundTrip.reset();
+
+        if(!i_runSweep(peer.c_str(), SWEEP_LATENCY, PROBE_SIZE, baudRate, seconds, probeHz, shared).ok)
+        {
+            printf("%-6s  failed\n", peer.c_str());
+            status = 1;
+            continue;
+        }
+
+        i_printSweepLatency(peer.c_str(), "to device", shared->toDevice);
+        i_printSweepLatency(peer.c_str(), "to panel", shared->toPanel);
+        i_printSweepLatency(peer.c_str(), "round trip", shared->roundTrip);
+    }
+
+    shared->~SweepShared();
+    munmap(memory, sizeof(SweepShared));
+
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    if(i_hasArg(argc, argv, "--sweep"))
+    {
+        const char* peerList = i_getArg(argc, argv, "--peers");
+        const char* chunkList = i_getArg(argc, argv, "--chunks");
+        const char* baud = i_getArg(argc, argv, "--baud");
+        const char* seconds = i_getArg(argc, argv, "--seconds");
+        const char* probeHz = i_getArg(argc, argv, "--probe-hz");
+
+        std::vector<std::string> peers;
+        for(const char* peer = peerList ? peerList : "pty,unix"; peer && *peer; peer = strchr(peer, ','), peer = peer ? peer + 1 : nullptr)
+            peers.push_back(std::string(peer, strcspn(peer, ",")));
+
+        std::vector<size_t> chunks;
+        for(const char* chunk = chunkList ? chunkList : "1,16,256,4096,65536"; chunk && *chunk; chunk = strchr(chunk, ','), chunk = chunk ? chunk + 1 : nullptr)
+            chunks.push_back(std::max((size_t) 1, (size_t) strtoul(chunk, nullptr, 10)));
+
+        return i_runSweeps(peers, chunks, baud ? (uint32_t) strtoul(baud, nullptr, 10) : 3000000, seconds ? atof(seconds) : 2.0,
+            probeHz ? atof(probeHz) : 1000.0);
+    }
+
+    if(i_hasArg(argc, argv, "--estop"))
+    {
+        const char* baud = i_getArg(argc, argv, "--baud");
+        const char* backlog = i_getArg(argc, argv, "--backlog");
+        const char* runs = i_getArg(argc, argv, "--runs");
+
+        return i_runEStop(baud ? (uint32_t) strtoul(baud, nullptr, 10) : 115200, backlog ? strtoul(backlog, nullptr, 10) : 16384,
+            runs ? std::max(1, atoi(runs)) : 10);
+    }
+
+    if(const char* address = i_getArg(argc, argv, "--commands"))
+    {
+        const char* steps = i_getArg(argc, argv, "--steps");
+        const char* runs = i_getArg(argc, argv, "--runs");
+        const char* windowList = i_getArg(argc, argv, "--windows");
+
+        std::vector<int> windows;
+        for(const char* window = windowList ? windowList : "1,4,20"; window && *window; window = strchr(window, ','), window = window ? window + 1 : nullptr)
+            windows.push_back(std::max(1, atoi(window)));
+
+        return i_runCommands(address, steps ? atoi(steps) : 20, windows, runs ? std::max(1, atoi(runs)) : 10);
+    }
+
+    if(const char* prefix = i_getArg(argc, argv, "--reactor"))
+    {
+        const char* ports = i_getArg(argc, argv, "--ports");
+        const char* seconds = i_getArg(argc, argv, "--seconds");
+        const char* fps = i_getArg(argc, argv, "--fps");
+        const char* pingHz = i_getArg(argc, argv, "--ping-hz");
+
+        return i_runReactor(prefix, ports ? atoi(ports) : 64, seconds ? atof(seconds) : 5.0,
+            fps ? atof(fps) : 60.0, pingHz ? atof(pingHz) : 50.0);
+    }
+
+    BenchOptions options;
+
+    if(const char* baud = i_getArg(argc, argv, "--baud"))
+    {
+        options.baudRates.clear();
+        for(const char* rate = baud; rate && *rate; rate = strchr(rate, ','), rate = rate ? rate + 1 : nullptr)
+            options.baudRates.push_back((uint32_t) strtoul(rate, nullptr, 10));
+    }
+    if(const char* seconds = i_getArg(argc, argv, "--seconds")) options.seconds = atof(seconds);
+    if(const char* fps = i_getArg(argc, argv, "--fps")) options.fps = atof(fps);
+    if(const char* stall = i_getArg(argc, argv, "--stall-ms")) options.stallMs = atoi(stall);
+    if(const char* consume = i_getArg(argc, argv, "--consume")) options.consumeRate = atof(consume);
+    if(const char* flow = i_getArg(argc, argv, "--flow"))
+    {
+        options.flowControls.clear();
+        for(const char* mode = flow; mode && *mode; mode = strchr(mode, ','), mode = mode ? mode + 1 : nullptr)
+        {
+            options.flowControls.push_back(strncmp(mode, "xonxoff", 7) == 0 ? HCPSerial::FLOWCONTROL_SOFTWARE
+                : strncmp(mode, "rtscts", 6) == 0 ? HCPSerial::FLOWCONTROL_HARDWARE : HCPSerial::FLOWCONTROL_NONE);
+        }
+    }
+
+    printf("%d s per run, UI at %.1f fps, %d ms stall per second", (int) options.seconds, options.fps, options.stallMs);
+    if(options.consumeRate) printf(", reading at most %.0f bytes/s", options.consumeRate);
+    printf("\n\n%10s  %-8s  %-8s  %12s  %12s  %12s  %10s  %8s  %8s\n", "baud", "flow", "mode", "offered", "received", "overrun", "KiB/s", "line %", "paused");
+
+    const char* flowNames[] = { "none", "rtscts", "xonxoff" };
+
+    for(uint32_t baudRate : options.baudRates)
+    {
+        for(HCPSerial::FlowControl flowControl : options.flowControls)
+        {
+            for(int threaded = 0; threaded < 2; threaded++)
+            {
+                BenchResult result = i_run(options, baudRate, flowControl, threaded);
+
+                double rate = result.elapsed ? result.received / result.elapsed / 1024.0 : 0.0;
+                double line = result.elapsed ? 100.0 * result.received / (result.elapsed * baudRate / 10.0) : 0.0;
+
+                printf("%10u  %-8s  %-8s  %12llu  %12llu  %12llu  %10.1f  %7.1f%%  %7.2fs\n",
+                    baudRate, flowNames[flowControl], threaded ? "threaded" : "polled",
+                    (unsigned long long) result.offered,
+                    (unsigned long long) result.received,
+                    (unsigned long long) result.overrun,
+                    rate, line, result.paused);
+
+                if(result.gaps)
+                    printf("%10s  %llu gaps in the received pattern\n", "", (unsigned long long) result.gaps);
+            }
+        }
+    }
+
+    return 0;
+}
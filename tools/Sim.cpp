@@ -0,0 +1,757 @@
+// Rack controller emulator
+//
+// Opens a pty pair and plays the device side of the link protocol: answers
+// console commands and pings, acks commands, streams synthetic pH/EC/
+// temperature/water level/light/pump current samples and moves a simulated
+// gantry, swivel and claw with per axis speed and acceleration limits. Start the panel with
+// --port=<pty> (or the --link path) to talk to it. Flood mode keeps the link
+// saturated with full sensor frames. --ports emulates that many racks at once,
+// each on its own pty, for testing the multi-port reactor. --latency holds
+// every received frame that long before handling it and --loss drops that
+// percentage of them and of the acks sent, for testing the command queue.
+//
+// Usage: hcp-sim [--link=/tmp/ttyHCP] [--ports=1] [--rate=10] [--state-rate=50] [--flood]
+//                [--latency=0] [--loss=0]
+
+#include "hcp/Protocol.hpp"
+#include "hcp/RingBuffer.hpp"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+
+using SimClock = std::chrono::steady_clock;
+
+// Reports every channel of HCPMessage::Channel
+static const size_t CHANNEL_COUNT = 6;
+
+static volatile sig_atomic_t s_running = 1;
+
+static const char* i_getArg(int argc, char** argv, const char* name)
+{
+    size_t nameLen = strlen(name);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], name, nameLen) != 0) continue;
+
+        if(argv[i][nameLen] == '=') return argv[i] + nameLen + 1;
+        if(argv[i][nameLen] == '\0') return "";
+    }
+
+    return nullptr;
+}
+
+static void i_onSignal(int)
+{
+    s_running = 0;
+}
+
+static float i_clamp(float value, float min, float max)
+{
+    return value < min ? min : (max < value ? max : value);
+}
+
+// One motor with a trapezoidal velocity profile
+struct SimAxis
+{
+    float position;
+    float velocity;
+    float target;
+
+    float minPosition, maxPosition;
+    float maxSpeed, maxAccel;
+
+    void setTarget(float value)
+    {
+        target = i_clamp(value, minPosition, maxPosition);
+    }
+
+    void stop()
+    {
+        // Brake as hard as allowed instead of stopping dead
+        float brakeDistance = velocity * velocity / (2.0f * maxAccel);
+        setTarget(position + (velocity < 0.0f ? -brakeDistance : brakeDistance));
+    }
+
+    bool moving() const
+    {
+        return velocity != 0.0f || position != target;
+    }
+
+    void step(float dt)
+    {
+        float distance = target - position;
+
+        // Fastest speed that can still stop at the target
+        float desired = std::min(maxSpeed, std::sqrt(2.0f * maxAccel * std::fabs(distance)));
+        if(distance < 0.0f) desired = -desired;
+
+        float maxDelta = maxAccel * dt;
+        velocity += i_clamp(desired - velocity, -maxDelta, maxDelta);
+
+        float move = velocity * dt;
+        bool overshoot = 0.0f <= move * distance && std::fabs(distance) <= std::fabs(move);
+        if(overshoot || (std::fabs(distance) < 1e-4f && std::fabs(velocity) < maxDelta))
+        {
+            position = target;
+            velocity = 0.0f;
+            return;
+        }
+
+        position += move;
+    }
+};
+
+class Simulator
+{
+public:
+    Simulator(int master) :
+        m_master(master),
+        m_out(1 << 16),
+        m_sampleRate(10.0),
+        m_stateRate(50.0),
+        m_flood(false),
+        m_latency(0),
+        m_loss(0.0),
+        m_noise(0x2545F491),
+        m_lossNoise(0x9E3779B9),
+        m_seq(0),
+        m_txBytes(0),
+        m_txFrames(0),
+        m_rxFrames(0),
+        m_dropped(0),
+        m_lost(0),
+        m_duplicates(0),
+        m_acked(),
+        m_streamed(),
+        m_streamFrames(0)
+    {
+        //                pos   vel   target  min     max    speed  accel
+        m_axes[0] = { 0.0f, 0.0f, 0.0f,   0.0f,  65.0f, 25.0f, 60.0f }; // x
+        m_axes[1] = { 0.0f, 0.0f, 0.0f,   0.0f,  28.0f, 12.0f, 30.0f }; // y
+        m_axes[2] = { 0.0f, 0.0f, 0.0f,  -3.14f,  3.14f, 2.0f, 6.0f };  // swivel
+        m_axes[3] = { 0.0f, 0.0f, 0.0f,  -0.5f,   0.37f, 0.6f, 4.0f };  // claw
+    }
+
+    void setSampleRate(double rate) { m_sampleRate = rate; }
+    void setStateRate(double rate) { m_stateRate = rate; }
+    void setFlood(bool flood) { m_flood = flood; }
+    void setLatency(double ms) { m_latency = std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double, std::milli>(ms)); }
+    void setLoss(double percent) { m_loss = percent / 100.0; }
+
+    void start(SimClock::time_point now)
+    {
+        m_start = m_lastStep = m_nextSample = m_nextState = now;
+    }
+
+    // Runs everything that is due and returns when it next wants to run
+    SimClock::time_point tick(SimClock::time_point now)
+    {
+        while(!m_received.empty() && m_received.front().due <= now)
+        {
+            handleMessage(m_received.front().message);
+            m_received.pop_front();
+        }
+
+        float dt = std::chrono::duration<float>(now - m_lastStep).count();
+        for(SimAxis& axis : m_axes) axis.step(dt);
+        m_lastStep = now;
+
+        if(m_sampleRate > 0.0 && m_nextSample <= now)
+        {
+            sendSamples(now);
+            m_nextSample += std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(1.0 / m_sampleRate));
+            if(m_nextSample < now) m_nextSample = now;
+        }
+
+        if(m_stateRate > 0.0 && m_nextState <= now)
+        {
+            sendState();
+            m_nextState += std::chrono::duration_cast<SimClock::duration>(std::chrono::duration<double>(1.0 / m_stateRate));
+            if(m_nextState < now) m_nextState = now;
+        }
+
+        if(m_flood)
+        {
+            while(HCPProtocol::MAX_FRAME_SIZE <= m_out.space())
+                sendSamples(now, HCPMessage::MAX_SAMPLES);
+        }
+
+        flush();
+
+        SimClock::time_point wake = now + std::chrono::seconds(1);
+        if(m_sampleRate > 0.0) wake = std::min(wake, m_nextSample);
+        if(m_stateRate > 0.0) wake = std::min(wake, m_nextState);
+        if(moving()) wake = std::min(wake, now + std::chrono::milliseconds(5));
+        if(!m_received.empty()) wake = std::min(wake, m_received.front().due);
+
+        return wake;
+    }
+
+    // What to wait for on the pty before the next tick
+    pollfd getPollFd() const
+    {
+        return { m_master, (short) (POLLIN | (m_out.empty() ? 0 : POLLOUT)), 0 };
+    }
+
+    void receive()
+    {
+        uint8_t buffer[4096];
+        ssize_t bytesRead;
+        SimClock::time_point now = SimClock::now();
+
+        while(0 < (bytesRead = ::read(m_master, buffer, sizeof(buffer))))
+        {
+            HCPMessage message;
+            size_t offset = 0;
+
+            while(offset < (size_t) bytesRead)
+            {
+                offset += m_decoder.feed(buffer + offset, bytesRead - offset, &message);
+                if(message.type == HCPMessage::NONE) continue;
+
+                m_rxFrames++;
+                if(m_loss > 0.0 && lossRoll() < m_loss)
+                {
+                    m_lost++;
+                    continue;
+                }
+
+                if(m_latency == SimClock::duration::zero())
+                {
+                    handleMessage(message);
+                    continue;
+                }
+
+                // Console text points into the decoder, keep a copy
+                m_received.emplace_back();
+                ReceivedFrame& frame = m_received.back();
+                frame.due = now + m_latency;
+                frame.message = message;
+                if(message.type == HCPMessage::CONSOLE)
+                {
+                    memcpy(frame.text, message.console.text, message.console.len);
+                    frame.message.console.text = frame.text;
+                }
+            }
+        }
+    }
+
+    bool isFlooding() const { return m_flood; }
+    uint64_t getTxBytes() const { return m_txBytes; }
+    uint64_t getTxFrames() const { return m_txFrames; }
+    uint64_t getRxFrames() const { return m_rxFrames; }
+
+    void printSummary(const char* name) const
+    {
+        printf("%s: sent %llu frames (%llu bytes), received %llu frames (%llu streamed setpoints, %llu lost, %llu duplicates), %u CRC errors, %u framing errors, %llu frames dropped\n",
+            name, (unsigned long long) m_txFrames, (unsigned long long) m_txBytes, (unsigned long long) m_rxFrames, (unsigned long long) m_streamFrames,
+            (unsigned long long) m_lost, (unsigned long long) m_duplicates, m_decoder.getCRCErrors(), m_decoder.getFramingErrors(), (unsigned long long) m_dropped);
+    }
+private:
+    // A received frame waiting out the artificial latency
+    struct ReceivedFrame
+    {
+        SimClock::time_point due;
+        HCPMessage message;
+        char text[HCPMessage::MAX_PAYLOAD];
+    };
+
+    // Recently acked commands by seq, so a resent one is acked again without
+    // running twice
+    struct AckedCommand
+    {
+        bool valid;
+        uint16_t seq;
+        uint8_t status;
+        SimClock::time_point time;
+    };
+
+    static const size_t ACKED_HISTORY = 256;
+
+    int m_master;
+    HCPRingBuffer m_out;
+    HCPFrameDecoder m_decoder;
+    SimAxis m_axes[4]; // x, y, swivel, claw
+
+    double m_sampleRate;
+    double m_stateRate;
+    bool m_flood;
+    SimClock::duration m_latency;
+    double m_loss; // fraction of received frames to drop
+    uint32_t m_noise;
+    uint32_t m_lossNoise;
+    uint16_t m_seq;
+    SimClock::time_point m_start;
+    SimClock::time_point m_lastStep;
+    SimClock::time_point m_nextSample;
+    SimClock::time_point m_nextState;
+
+    uint64_t m_txBytes;
+    uint64_t m_txFrames;
+    uint64_t m_rxFrames;
+    uint64_t m_dropped;
+    uint64_t m_lost;
+    uint64_t m_duplicates;
+
+    std::deque<ReceivedFrame> m_received;
+    AckedCommand m_acked[ACKED_HISTORY]; // indexed by the low byte of seq
+
+    int32_t m_streamed[4]; // streamed setpoints in thousandths
+    uint64_t m_streamFrames;
+
+    bool moving() const
+    {
+        for(const SimAxis& axis : m_axes)
+        {
+            if(axis.moving()) return true;
+        }
+
+        return false;
+    }
+
+    // xorshift32 mapped to [-1, 1]
+    float noise()
+    {
+        m_noise ^= m_noise << 13;
+        m_noise ^= m_noise >> 17;
+        m_noise ^= m_noise << 5;
+        return (float) (m_noise / 2147483647.5 - 1.0);
+    }
+
+    // xorshift32 mapped to [0, 1), separate from the sensor noise so loss
+    // doesn't change the samples
+    double lossRoll()
+    {
+        m_lossNoise ^= m_lossNoise << 13;
+        m_lossNoise ^= m_lossNoise >> 17;
+        m_lossNoise ^= m_lossNoise << 5;
+        return m_lossNoise / 4294967296.0;
+    }
+
+    float sensorValue(uint8_t channel, double t)
+    {
+        const double twoPi = 6.283185307179586;
+
+        switch(channel)
+        {
+        case HCPMessage::CHANNEL_PH:                return (float) (6.0 + 0.15 * sin(twoPi * t / 90.0)) + 0.01f * noise();
+        case HCPMessage::CHANNEL_EC:                return (float) (1.8 + 0.05 * sin(twoPi * t / 300.0)) + 0.005f * noise();
+        case HCPMessage::CHANNEL_WATER_TEMPERATURE: return (float) (22.0 + 1.5 * sin(twoPi * t / 600.0)) + 0.02f * noise();
+        case HCPMessage::CHANNEL_WATER_LEVEL:       return (float) (100.0 - fmod(t * 0.05, 40.0)) + 0.1f * noise(); // drains, then refills
+        case HCPMessage::CHANNEL_LIGHT:             return (fmod(t, 1200.0) < 800.0 ? 18000.0f : 0.0f) + 50.0f * noise(); // a 20 minute day
+        case HCPMessage::CHANNEL_PUMP_CURRENT:      return (fmod(t, 60.0) < 15.0 ? 1.2f : 0.0f) + 0.02f * noise(); // runs 15 s a minute
+        default:                                    return 0.0f;
+        }
+    }
+
+    void send(const HCPMessage& message)
+    {
+        uint8_t frame[HCPProtocol::MAX_FRAME_SIZE];
+        size_t len = HCPProtocol::encode(message, frame, sizeof(frame));
+
+        // A real controller would drop telemetry when its UART is backed up
+        if(m_out.space() < len)
+        {
+            m_dropped++;
+            return;
+        }
+
+        m_out.write(frame, len);
+        m_txFrames++;
+    }
+
+    void sendSamples(SimClock::time_point now, size_t count = CHANNEL_COUNT)
+    {
+        double t = std::chrono::duration<double>(now - m_start).count();
+
+        HCPMessage message(HCPMessage::SENSOR_SAMPLES, m_seq++);
+        message.sensors.timestamp = (uint32_t) (t * 1000.0);
+        message.sensors.count = (uint8_t) count;
+
+        for(size_t i = 0; i < count; i++)
+        {
+            uint8_t channel = (uint8_t) (i % CHANNEL_COUNT);
+            message.sensors.samples[i] = { channel, sensorValue(channel, t) };
+        }
+
+        send(message);
+    }
+
+    void sendState()
+    {
+        HCPMessage message(HCPMessage::ROBOT_STATE, m_seq++);
+        message.robot.x = m_axes[0].position;
+        message.robot.y = m_axes[1].position;
+        message.robot.swivel = m_axes[2].position;
+        message.robot.claw = m_axes[3].position;
+        send(message);
+    }
+
+    void reply(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char line[HCPMessage::MAX_PAYLOAD + 1];
+
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+
+        if(len < 0) return;
+        send(HCPProtocol::consoleMessage(line, std::min((size_t) len, HCPMessage::MAX_PAYLOAD), m_seq++));
+    }
+
+    void flush()
+    {
+        const uint8_t* data;
+        size_t len;
+
+        while((len = m_out.readSpan(&data)))
+        {
+            ssize_t written = ::write(m_master, data, len);
+            if(written <= 0) break;
+
+            m_out.consume(written);
+            m_txBytes += written;
+        }
+    }
+
+    void handleMessage(const HCPMessage& message)
+    {
+        switch(message.type)
+        {
+        case HCPMessage::COMMAND:
+            if(message.command.opcode == HCPMessage::CMD_STREAM_TARGET || message.command.opcode == HCPMessage::CMD_STREAM_DELTA)
+                handleStream(message.command);
+            else if(!ackDuplicate(message.seq))
+                sendAck(message.seq, handleCommand(message.command));
+            break;
+        case HCPMessage::CONSOLE:
+        {
+            if(ackDuplicate(message.seq)) break;
+
+            char line[HCPMessage::MAX_PAYLOAD + 1];
+            memcpy(line, message.console.text, message.console.len);
+            line[message.console.len] = '\0';
+            sendAck(message.seq, 0);
+            handleConsole(line);
+            break;
+        }
+        case HCPMessage::PING:
+        {
+            HCPMessage pong(HCPMessage::PONG, message.seq);
+            pong.ping.timestamp = message.ping.timestamp;
+            send(pong);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void sendAck(uint16_t seq, uint8_t status)
+    {
+        HCPMessage ack(HCPMessage::ACK, m_seq++);
+        ack.ack.seq = seq;
+        ack.ack.status = status;
+        if(m_loss > 0.0 && lossRoll() < m_loss) m_lost++;
+        else send(ack);
+
+        AckedCommand& acked = m_acked[seq % ACKED_HISTORY];
+        acked.valid = true;
+        acked.seq = seq;
+        acked.status = status;
+        acked.time = SimClock::now();
+    }
+
+    // A resend of a command that was already run, only its ack went missing.
+    // Old entries are ignored so a restarted panel reusing seqs isn't mistaken
+    // for one.
+    bool ackDuplicate(uint16_t seq)
+    {
+        const AckedCommand& acked = m_acked[seq % ACKED_HISTORY];
+        if(!acked.valid || acked.seq != seq || std::chrono::seconds(5) < SimClock::now() - acked.time) return false;
+
+        m_duplicates++;
+        sendAck(seq, acked.status);
+        return true;
+    }
+
+    // Streamed setpoints aren't acked, a bad one is just ignored
+    void handleStream(const HCPMessage::Command& command)
+    {
+        if(command.opcode == HCPMessage::CMD_STREAM_TARGET)
+        {
+            if(command.len != 16) return;
+
+            for(int i = 0; i < 4; i++)
+                m_streamed[i] = (int32_t) lroundf(HCPProtocol::getF32(command.args + i * 4) * 1000.0f);
+        }
+        else
+        {
+            uint8_t mask = command.len ? command.args[0] : 0;
+            size_t expected = 1;
+            for(int i = 0; i < 4; i++) expected += mask & (1 << i) ? 2 : 0;
+            if(!command.len || command.len != expected) return;
+
+            const uint8_t* delta = command.args + 1;
+            for(int i = 0; i < 4; i++)
+            {
+                if(!(mask & (1 << i))) continue;
+
+                m_streamed[i] += (int16_t) (delta[0] | (delta[1] << 8));
+                delta += 2;
+            }
+        }
+
+        for(int i = 0; i < 4; i++) m_axes[i].setTarget(m_streamed[i] / 1000.0f);
+        m_streamFrames++;
+    }
+
+    uint8_t handleCommand(const HCPMessage::Command& command)
+    {
+        switch(command.opcode)
+        {
+        case HCPMessage::CMD_STOP:
+            for(SimAxis& axis : m_axes) axis.stop();
+            return 0;
+        case HCPMessage::CMD_SET_TARGET:
+        {
+            if(command.len != 16) return 2;
+
+            for(int i = 0; i < 4; i++) m_axes[i].setTarget(HCPProtocol::getF32(command.args + i * 4));
+            return 0;
+        }
+        default:
+            return 1;
+        }
+    }
+
+    void handleConsole(const char* line)
+    {
+        char command[32] = "";
+        float a = 0.0f, b = 0.0f;
+        int numArgs = sscanf(line, "%31s %f %f", command, &a, &b) - 1;
+
+        if(strcmp(command, "help") == 0)
+        {
+            reply("Commands: status, move <x> <y>, swivel <rad>, claw <pos>, home, stop, dose <pump> <ml>, rate <hz>, flood <0|1>");
+        }
+        else if(strcmp(command, "status") == 0)
+        {
+            reply("X %.2f Y %.2f swivel %.2f claw %.2f%s", m_axes[0].position, m_axes[1].position,
+                m_axes[2].position, m_axes[3].position, moving() ? " (moving)" : "");
+            reply("Sampling at %.1f Hz, flood %s", m_sampleRate, m_flood ? "on" : "off");
+        }
+        else if(strcmp(command, "move") == 0 && numArgs == 2)
+        {
+            m_axes[0].setTarget(a);
+            m_axes[1].setTarget(b);
+            reply("Moving to %.2f, %.2f", m_axes[0].target, m_axes[1].target);
+        }
+        else if(strcmp(command, "swivel") == 0 && numArgs == 1)
+        {
+            m_axes[2].setTarget(a);
+            reply("Swivel to %.2f", m_axes[2].target);
+        }
+        else if(strcmp(command, "claw") == 0 && numArgs == 1)
+        {
+            m_axes[3].setTarget(a);
+            reply("Claw to %.2f", m_axes[3].target);
+        }
+        else if(strcmp(command, "home") == 0)
+        {
+            for(SimAxis& axis : m_axes) axis.setTarget(0.0f);
+            reply("Homing");
+        }
+        else if(strcmp(command, "stop") == 0)
+        {
+            for(SimAxis& axis : m_axes) axis.stop();
+            reply("Stopped");
+        }
+        else if(strcmp(command, "dose") == 0 && numArgs == 2 && 0.0f <= b)
+        {
+            reply("Pump %d dosed %.1f ml", (int) a, b);
+        }
+        else if(strcmp(command, "rate") == 0 && numArgs == 1 && 0.0f <= a)
+        {
+            m_sampleRate = a;
+            reply("Sampling at %.1f Hz", m_sampleRate);
+        }
+        else if(strcmp(command, "flood") == 0 && numArgs == 1)
+        {
+            m_flood = a != 0.0f;
+            reply("Flood %s", m_flood ? "on" : "off");
+        }
+        else
+        {
+            reply("§4Unknown command: %s", line);
+        }
+    }
+};
+
+// Opens a pty and keeps its slave end open in raw mode. Returns the master.
+static int i_openPty(std::string& slaveName, int& slave)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+        fprintf(stderr, "Failed to open pty: %s\n", strerror(errno));
+        return -1;
+    }
+
+    slaveName = ptsname(master);
+
+    // Keep the slave open ourselves so the master doesn't see a hangup while
+    // the panel isn't connected. Raw mode stops the line discipline echoing
+    // our own frames back at us.
+    slave = open(slaveName.c_str(), O_RDWR | O_NOCTTY);
+    if(slave < 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", slaveName.c_str(), strerror(errno));
+        ::close(master);
+        return -1;
+    }
+
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    return master;
+}
+
+struct SimPort
+{
+    int master;
+    int slave;
+    std::string slaveName;
+    std::string link;
+    std::unique_ptr<Simulator> simulator;
+};
+
+int main(int argc, char** argv)
+{
+    int numPorts = 1;
+    if(const char* ports = i_getArg(argc, argv, "--ports")) numPorts = std::max(1, atoi(ports));
+
+    const char* link = i_getArg(argc, argv, "--link");
+    std::vector<SimPort> ports(numPorts);
+
+    for(int i = 0; i < numPorts; i++)
+    {
+        SimPort& port = ports[i];
+
+        port.master = i_openPty(port.slaveName, port.slave);
+        if(port.master < 0) return 1;
+
+        // With several ports the link is numbered, /tmp/ttyHCP0, /tmp/ttyHCP1...
+        if(link && *link)
+        {
+            port.link = numPorts == 1 ? link : std::string(link) + std::to_string(i);
+            unlink(port.link.c_str());
+            if(symlink(port.slaveName.c_str(), port.link.c_str()) < 0)
+                fprintf(stderr, "Failed to link %s: %s\n", port.link.c_str(), strerror(errno));
+        }
+
+        port.simulator.reset(new Simulator(port.master));
+        if(const char* rate = i_getArg(argc, argv, "--rate")) port.simulator->setSampleRate(atof(rate));
+        if(const char* rate = i_getArg(argc, argv, "--state-rate")) port.simulator->setStateRate(atof(rate));
+        port.simulator->setFlood(i_getArg(argc, argv, "--flood") != nullptr);
+        if(const char* latency = i_getArg(argc, argv, "--latency")) port.simulator->setLatency(atof(latency));
+        if(const char* loss = i_getArg(argc, argv, "--loss")) port.simulator->setLoss(atof(loss));
+    }
+
+    signal(SIGINT, i_onSignal);
+    signal(SIGTERM, i_onSignal);
+
+    for(SimPort& port : ports)
+    {
+        printf("Rack controller emulator on %s\n", port.slaveName.c_str());
+        printf("Start the panel with --port=%s\n", port.link.empty() ? port.slaveName.c_str() : port.link.c_str());
+    }
+    fflush(stdout);
+
+    SimClock::time_point now = SimClock::now();
+    for(SimPort& port : ports) port.simulator->start(now);
+
+    SimClock::time_point nextReport = now + std::chrono::seconds(1);
+    uint64_t reportBytes = 0;
+    std::vector<pollfd> fds(numPorts);
+
+    while(s_running)
+    {
+        now = SimClock::now();
+
+        // Sleep until the next tick, or until the host sends something or a
+        // pty can take more output
+        SimClock::time_point wake = nextReport;
+        for(int i = 0; i < numPorts; i++)
+        {
+            wake = std::min(wake, ports[i].simulator->tick(now));
+            fds[i] = ports[i].simulator->getPollFd();
+        }
+
+        if(nextReport <= now)
+        {
+            uint64_t txBytes = 0, txFrames = 0, rxFrames = 0;
+            for(SimPort& port : ports)
+            {
+                txBytes += port.simulator->getTxBytes();
+                txFrames += port.simulator->getTxFrames();
+                rxFrames += port.simulator->getRxFrames();
+            }
+
+            if(ports[0].simulator->isFlooding())
+            {
+                printf("tx %8.1f KiB/s  %llu frames  rx %llu frames\n", (txBytes - reportBytes) / 1024.0,
+                    (unsigned long long) txFrames, (unsigned long long) rxFrames);
+                fflush(stdout);
+            }
+
+            reportBytes = txBytes;
+            nextReport += std::chrono::seconds(1);
+            wake = std::min(wake, nextReport);
+        }
+
+        int timeoutMs = (int) std::chrono::duration_cast<std::chrono::milliseconds>(wake - SimClock::now()).count();
+
+        if(poll(fds.data(), fds.size(), timeoutMs < 0 ? 0 : timeoutMs) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+
+        for(int i = 0; i < numPorts; i++)
+        {
+            if(fds[i].revents & POLLIN) ports[i].simulator->receive();
+        }
+    }
+
+    printf("\n");
+    for(SimPort& port : ports)
+    {
+        port.simulator->printSummary(port.link.empty() ? port.slaveName.c_str() : port.link.c_str());
+
+        if(!port.link.empty()) unlink(port.link.c_str());
+        ::close(port.slave);
+        ::close(port.master);
+    }
+
+    return 0;
+}
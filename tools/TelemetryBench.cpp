@@ -0,0 +1,342 @@
+// Telemetry store benchmark
+//
+// Times appends to an HCPTelemetryStore, first alone and then while another
+// thread reads time ranges from it, and checks that no read returns a torn
+// sample. Each channel gets samples --rate times a second of device time,
+// written as fast as the store takes them. Reads pick a random channel and a
+// window of each of --windows seconds ending somewhere in what is held.
+// Then one channel gets --days of samples and is summarised into --columns
+// for spans from five seconds to all of it. With --archive, --archive-days of
+// six sensor-like channels are written to an archive in that directory, which
+// is then opened again and read back.
+//
+// Usage: hcp-telemetry-bench [--channels=50] [--rate=100] [--samples=65536]
+//                            [--seconds=2] [--windows=1,10,60] [--days=7]
+//                            [--columns=3840] [--archive=<dir>]
+//                            [--archive-days=1]
+
+#include "hcp/Telemetry.hpp"
+#include "hcp/TelemetryArchive.hpp"
+#include "hcp/Histogram.hpp"
+
+#include <stdlib.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+using ToolClock = std::chrono::steady_clock;
+
+static const char* i_getArg(int argc, char** argv, const char* name)
+{
+    size_t nameLen = strlen(name);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], name, nameLen) == 0 && (argv[i][nameLen] == '=' || argv[i][nameLen] == '\0'))
+            return argv[i][nameLen] ? argv[i] + nameLen + 1 : argv[i] + nameLen;
+    }
+
+    return nullptr;
+}
+
+static std::vector<double> i_parseList(const char* list)
+{
+    std::vector<double> values;
+
+    for(const char* item = list; *item;)
+    {
+        values.push_back(atof(item));
+        item = strchr(item, ',');
+        if(!item) break;
+        item++;
+    }
+
+    return values;
+}
+
+// A value that follows from the timestamp, so a torn read shows
+static float i_valueAt(uint8_t channel, int64_t timestamp)
+{
+    return (float) (timestamp / 1000 % 1000003 + channel);
+}
+
+// Wanders around a set point in steps an ADC could resolve, so it packs
+// like a real sensor rather than like noise
+static float i_sensorValue(std::mt19937_64& random, float* level, float center, float step)
+{
+    *level += (float) ((int) (random() % 3) - 1) * step;
+    *level += (center - *level) * 0.001f;
+    return std::round(*level / step) * step;
+}
+
+// Appends round robin over the channels, each sample period apart per
+// channel, until stop is set or count samples are in. Returns the count.
+static uint64_t i_append(HCPTelemetryStore& store, size_t channels, int64_t period, uint64_t* next, uint64_t count, const std::atomic<bool>& stop)
+{
+    uint64_t appended = 0;
+
+    while(appended < count && !stop.load(std::memory_order_relaxed))
+    {
+        // Check the flag once per round of 4096
+        for(int i = 0; i < 4096 && appended < count; i++, appended++, (*next)++)
+        {
+            uint8_t channel = (uint8_t) (*next % channels);
+            int64_t timestamp = (int64_t) (*next / channels) * period;
+            store.append(channel, timestamp, i_valueAt(channel, timestamp));
+        }
+    }
+
+    return appended;
+}
+
+// Fills every ring once, so timed appends reuse blocks like a long run does
+static void i_fill(HCPTelemetryStore& store, size_t channels, int64_t period, uint64_t* next)
+{
+    std::atomic<bool> stop(false);
+    i_append(store, channels, period, next, channels, stop);
+    i_append(store, channels, period, next, (uint64_t) channels * store.getChannel(0)->getCapacity(), stop);
+}
+
+int main(int argc, char** argv)
+{
+    const char* arg;
+    size_t channels = (arg = i_getArg(argc, argv, "--channels")) ? (size_t) atoi(arg) : 50;
+    double rate = (arg = i_getArg(argc, argv, "--rate")) ? atof(arg) : 100.0;
+    size_t samples = (arg = i_getArg(argc, argv, "--samples")) ? (size_t) strtoull(arg, nullptr, 10) : HCPTelemetryStore::DEFAULT_CAPACITY;
+    double seconds = (arg = i_getArg(argc, argv, "--seconds")) ? atof(arg) : 2.0;
+    std::vector<double> windows = i_parseList((arg = i_getArg(argc, argv, "--windows")) ? arg : "1,10,60");
+    double days = (arg = i_getArg(argc, argv, "--days")) ? atof(arg) : 7.0;
+    size_t columns = (arg = i_getArg(argc, argv, "--columns")) ? (size_t) atoi(arg) : 3840;
+
+    if(channels < 1 || HCPTelemetryStore::MAX_CHANNELS < channels || rate <= 0.0)
+    {
+        fprintf(stderr, "--channels must be 1 to %zu and --rate above 0\n", HCPTelemetryStore::MAX_CHANNELS);
+        return 2;
+    }
+
+    int64_t period = (int64_t) (1e6 / rate);
+
+    {
+        HCPTelemetryStore store(samples);
+        std::atomic<bool> stop(false);
+        uint64_t next = 0;
+
+        i_fill(store, channels, period, &next);
+
+        ToolClock::time_point start = ToolClock::now();
+        uint64_t appended = 0;
+        while(ToolClock::now() - start < std::chrono::duration<double>(seconds))
+            appended += i_append(store, channels, period, &next, 1 << 20, stop);
+        double elapsed = std::chrono::duration<double>(ToolClock::now() - start).count();
+
+        const HCPTelemetryChannel* channel = store.getChannel(0);
+        printf("%zu channels at %.0f Hz, %zu samples each (%.1f min)\n",
+            channels, rate, channel->getCapacity(), channel->getCapacity() / rate / 60.0);
+        printf("  memory         %.1f MiB, 7 days raw would take %.1f GiB\n",
+            store.getMemoryUsage() / 1048576.0, channels * rate * 7 * 86400 * (sizeof(int64_t) + sizeof(float)) / 1073741824.0);
+        printf("  append alone   %.1f M samples/s, %.1f ns each\n", appended / elapsed / 1e6, elapsed * 1e9 / appended);
+    }
+
+    HCPTelemetryStore store(samples);
+    std::atomic<bool> stop(false);
+    uint64_t next = 0;
+    i_fill(store, channels, period, &next);
+
+    uint64_t appended = 0;
+    ToolClock::time_point writerStart = ToolClock::now();
+    std::thread writer([&]()
+    {
+        appended = i_append(store, channels, period, &next, UINT64_MAX, stop);
+    });
+
+    std::mt19937_64 random(1);
+    std::vector<int64_t> timestamps;
+    std::vector<float> values;
+
+    for(double window : windows)
+    {
+        HCPHistogram latency;
+        uint64_t reads = 0, read = 0, lapped = 0, torn = 0;
+        int64_t span = (int64_t) (window * 1e6);
+
+        ToolClock::time_point start = ToolClock::now();
+        while(ToolClock::now() - start < std::chrono::duration<double>(seconds))
+        {
+            uint8_t index = (uint8_t) (random() % channels);
+            const HCPTelemetryChannel* channel = store.getChannel(index);
+
+            int64_t newest, oldest;
+            float value;
+            uint64_t first = channel->getStart();
+            if(!channel->getLatest(&newest, &value) || channel->read(&first, 1, &oldest, nullptr) != 1) continue;
+            if(newest - oldest < span) continue;
+
+            int64_t to = oldest + span + (int64_t) (random() % (uint64_t) (newest - oldest - span + 1));
+
+            ToolClock::time_point readStart = ToolClock::now();
+            // A search the writer laps can land anywhere, the read sorts it out
+            uint64_t from = channel->lowerBound(to - span);
+            uint64_t end = channel->lowerBound(to);
+            size_t count = end > from ? (size_t) (end - from) : 0;
+            timestamps.resize(count);
+            values.resize(count);
+
+            uint64_t requested = from;
+            count = channel->read(&from, count, timestamps.data(), values.data());
+            latency.record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ToolClock::now() - readStart).count());
+
+            reads++;
+            read += count;
+            if(from != requested) lapped++;
+
+            for(size_t i = 0; i < count; i++)
+            {
+                bool ordered = !i || timestamps[i - 1] <= timestamps[i];
+                if(!ordered || values[i] != i_valueAt(index, timestamps[i])) torn++;
+            }
+        }
+        double elapsed = std::chrono::duration<double>(ToolClock::now() - start).count();
+
+        char label[32];
+        snprintf(label, sizeof(label), "%gs", window);
+        printf("  read %-9s %.0f reads/s, %.1f M samples/s, %llu lapped, %llu torn\n", label,
+            reads / elapsed, read / elapsed / 1e6, (unsigned long long) lapped, (unsigned long long) torn);
+        latency.print(stdout, "    read time", 1000.0, "us");
+    }
+
+    stop = true;
+    writer.join();
+
+    double elapsed = std::chrono::duration<double>(ToolClock::now() - writerStart).count();
+    printf("  append while reading %.1f M samples/s\n", appended / elapsed / 1e6);
+
+    if(days > 0.0 && columns > 0)
+    {
+        HCPTelemetryStore history(samples);
+        uint64_t count = (uint64_t) (days * 86400 * rate);
+        next = 0;
+        stop = false;
+
+        ToolClock::time_point start = ToolClock::now();
+        i_append(history, 1, period, &next, count, stop);
+        elapsed = std::chrono::duration<double>(ToolClock::now() - start).count();
+
+        const HCPTelemetryChannel* channel = history.getChannel(0);
+        printf("1 channel with %g days, %.1f ns per append, %.1f MiB\n", days, elapsed * 1e9 / count, history.getMemoryUsage() / 1048576.0);
+
+        std::vector<HCPTelemetryChannel::Summary> summaries(columns);
+        int64_t newest = (int64_t) (count - 1) * period;
+
+        for(double span : {5.0, 60.0, 3600.0, 86400.0, days * 86400})
+        {
+            if(days * 86400 < span) continue;
+
+            HCPHistogram latency;
+            start = ToolClock::now();
+            while(ToolClock::now() - start < std::chrono::duration<double>(seconds / 5))
+            {
+                ToolClock::time_point queryStart = ToolClock::now();
+                channel->summarize(newest + 1 - (int64_t) (span * 1e6), newest + 1, summaries.data(), columns);
+                latency.record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ToolClock::now() - queryStart).count());
+            }
+
+            size_t empty = 0;
+            for(const HCPTelemetryChannel::Summary& summary : summaries) empty += !summary.count;
+
+            char label[64];
+            snprintf(label, sizeof(label), "  summarize %gs into %zu, %zu empty", span, columns, empty);
+            latency.print(stdout, label, 1000.0, "us");
+        }
+    }
+
+    const char* archivePath = i_getArg(argc, argv, "--archive");
+    double archiveDays = (arg = i_getArg(argc, argv, "--archive-days")) ? atof(arg) : 1.0;
+    if(archivePath && archiveDays > 0.0)
+    {
+        // pH, EC, water temperature, water level, light and pump current
+        static const float centers[] = { 6.0f, 1.8f, 22.0f, 80.0f, 18000.0f, 1.2f };
+        static const float steps[] = { 0.01f, 0.01f, 0.0625f, 0.5f, 1.0f, 0.001f };
+        const size_t sensors = sizeof(centers) / sizeof(centers[0]);
+        float levels[sensors];
+        std::copy(centers, centers + sensors, levels);
+
+        std::error_code error;
+        std::filesystem::remove_all(archivePath, error);
+
+        uint64_t count = (uint64_t) (archiveDays * 86400 * rate);
+        int64_t first = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - (int64_t) count * period;
+
+        HCPTelemetryArchive archive;
+        if(!archive.open(archivePath)) return 1;
+
+        ToolClock::time_point start = ToolClock::now();
+        for(uint64_t i = 0; i < count; i++)
+        {
+            // Whole milliseconds like the device clock, now and then one late
+            int64_t timestamp = first + (int64_t) i * period + (random() % 16 == 0 ? 1000 : 0);
+            for(size_t sensor = 0; sensor < sensors; sensor++)
+                archive.append((uint8_t) sensor, timestamp, i_sensorValue(random, &levels[sensor], centers[sensor], steps[sensor]));
+        }
+        archive.close();
+        elapsed = std::chrono::duration<double>(ToolClock::now() - start).count();
+
+        start = ToolClock::now();
+        archive.open(archivePath);
+        double opened = std::chrono::duration<double>(ToolClock::now() - start).count();
+
+        uint64_t stored = count * sensors;
+        printf("Archive of %zu channels at %.0f Hz for %g days\n", sensors, rate, archiveDays);
+        printf("  write          %.1f ns per sample\n", elapsed * 1e9 / stored);
+        printf("  disk           %.1f MiB in %zu chunks, %.2f bytes per sample, %.0f MiB per 30 days\n",
+            archive.getDiskUsage() / 1048576.0, archive.getChunkCount(), (double) archive.getDiskUsage() / stored,
+            archive.getDiskUsage() / archiveDays * 30 / 1048576.0);
+        printf("  open           %.2f ms\n", opened * 1e3);
+
+        int64_t oldest = archive.getStartTime(), newest = archive.getEndTime();
+        std::vector<int64_t> timestamps;
+        std::vector<float> values;
+
+        HCPHistogram latency;
+        start = ToolClock::now();
+        while(ToolClock::now() - start < std::chrono::duration<double>(seconds / 5))
+        {
+            int64_t from = oldest + (int64_t) (random() % (uint64_t) std::max((int64_t) 1, newest - oldest - 60000000));
+            timestamps.clear();
+            values.clear();
+
+            ToolClock::time_point readStart = ToolClock::now();
+            archive.read((uint8_t) (random() % sensors), from, from + 60000000, timestamps, values);
+            latency.record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ToolClock::now() - readStart).count());
+        }
+        latency.print(stdout, "  read 60s at random", 1000.0, "us");
+
+        std::vector<HCPTelemetryChannel::Summary> summaries(columns);
+        for(double span : {60.0, 3600.0, 86400.0, archiveDays * 86400})
+        {
+            if(archiveDays * 86400 < span) continue;
+
+            // The first one maps the chunks
+            HCPHistogram spanLatency;
+            start = ToolClock::now();
+            while(ToolClock::now() - start < std::chrono::duration<double>(seconds / 5))
+            {
+                ToolClock::time_point queryStart = ToolClock::now();
+                archive.summarize(0, newest + 1 - (int64_t) (span * 1e6), newest + 1, summaries.data(), columns);
+                spanLatency.record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ToolClock::now() - queryStart).count());
+            }
+
+            char label[64];
+            snprintf(label, sizeof(label), "  summarize %gs into %zu", span, columns);
+            spanLatency.print(stdout, label, 1000.0, "us");
+        }
+    }
+
+    return 0;
+}